@@ -0,0 +1,22 @@
+r31 = #0x0100000 //sp
+
+//ALU loop: xorshift32 (shift/xor/add only), 2M steps.
+//Checksum: r4.
+.DEF STEPS = 0x200000
+r1 = #1
+r2 = #STEPS
+r4 = #0
+r8 = #17	//shift count: ">>= #i" shifts left (eLsri quirk)
+step: r3 = r1
+r3 <<= #13
+r1 ^= r3
+r3 = r1
+r3 >>= r8
+r1 ^= r3
+r3 = r1
+r3 <<= #5
+r1 ^= r3
+r4 += r1
+r2 -= #1
+!zero? -> step
+halt
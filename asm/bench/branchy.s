@@ -0,0 +1,37 @@
+r31 = #0x0100000 //sp
+
+//Data-dependent branches: on low bits of a xorshift32 sequence, 1M steps.
+//Checksum: r5 + r6 + r7.
+.DEF STEPS = 0x100000
+r1 = #12345
+r2 = #STEPS
+r5 = #0
+r6 = #0
+r7 = #0
+r8 = #17	//shift count: ">>= #i" shifts left (eLsri quirk)
+step: r3 = r1
+r3 <<= #13
+r1 ^= r3
+r3 = r1
+r3 >>= r8
+r1 ^= r3
+r3 = r1
+r3 <<= #5
+r1 ^= r3
+r3 = r1
+r3 &= #1
+zero? -> even
+r5 += #1
+-> step_next
+even: r6 += #3
+step_next: r3 = r1
+r3 &= #6
+zero? -> skip
+r7 ^= r1
+skip: r3 = r1
+r3 &= #0x30
+!zero? -> tail
+r6 -= #1
+tail: r2 -= #1
+!zero? -> step
+halt
@@ -0,0 +1,24 @@
+r31 = #0x0100000 //sp
+
+//Call/return heavy: naive recursive fib(29).
+//Checksum: r2 (514229).
+r1 = #29
++> fib
+halt
+
+//r2 = fib(r1); uses r1..r3
+fib: r3 = r1
+r3 &= #-2
+zero? -> fib_base	//r1 < 2
+push r1
+r1 -= #1
++> fib
+pop r1
+push r2			//fib(n-1)
+r1 -= #2
++> fib
+pop r3
+r2 += r3
+ret
+fib_base: r2 = r1
+ret
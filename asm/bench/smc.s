@@ -0,0 +1,23 @@
+r31 = #0x0100000 //sp
+
+//Self-modifying code: each step rewrites the immediate of the
+//instruction at patch, then executes it.  512K steps.
+//Checksum: r4.
+//NOTE: "mem[rV + #i] = rA" stores rV at rA+i.
+.DEF STEPS = 0x80000
+r0 = #0
+r2 = #STEPS
+r4 = #0
+-> start
+patch: r4 += #0
+-> back
+start: r5 = mem[r0 + #patch]	//template: immediate 0
+step: r6 = r5
+r7 = r2
+r7 &= #0xff
+r6 |= r7
+mem[r6 + #patch] = r0	//immediate = step & 0xff
+-> patch
+back: r2 -= #1
+!zero? -> step
+halt
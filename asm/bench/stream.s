@@ -0,0 +1,34 @@
+r31 = #0x0100000 //sp
+
+//Memory streaming (eLoad/eStore): per pass, fill a[], copy a[]+k to b[],
+//sum b[], over N words each.  Checksum: r4.
+//NOTE: "mem[rV + #i] = rA" stores rV at rA+i.
+.DEF N = 0x8000
+.DEF A = 0x4000
+.DEF B = 0xC000
+r9 = #16	//passes
+r4 = #0
+pass: r1 = #0
+r2 = #N
+fill: mem[r1 + #A] = r1	//a[r1] = r1
+r1 += #1
+r2 -= #1
+!zero? -> fill
+r1 = #0
+r2 = #N
+copy: r3 = mem[r1 + #A]
+r3 += r9
+mem[r3 + #B] = r1	//b[r1] = r3
+r1 += #1
+r2 -= #1
+!zero? -> copy
+r1 = #0
+r2 = #N
+sum: r3 = mem[r1 + #B]
+r4 += r3
+r1 += #1
+r2 -= #1
+!zero? -> sum
+r9 -= #1
+!zero? -> pass
+halt
@@ -68,6 +68,7 @@ class OpCodes
     map_op.merge!({"load"=>"load","store"=>"store"})
     map_op.merge!({"loadr"=>"loadr"})
     map_op.merge!({"loadi"=>"loadi","loadil"=>"loadil"})
+    map_op.merge!({"<->"=>"swap"})
     @opcode_by_operator = Hash.new
     map_op.each do |k,v|
       @opcode_by_operator[k] = @op_by_name[v]
@@ -95,34 +96,29 @@ class OpCodes
       @k = k          #can be nil
       @immed = immed  #can be nil
     end
-    def gen(ofid)
+    #Return encoded word(s)
+    def words
       op = @opcode.code << OPCODE_N_LSL
       longi = nil
       case @opcode.enum
       when /^(eHalt|eNop|eRetn)$/
         ins = op
-      when /^(eAdd|eSub|eLsl|eLsr|eAsr|eAnd|eOr|eXor|eLoad|eStore|eLoadr|eCmp)$/
-        @j <<= IMMED_N_BITS_MEM + REG_N_BITS
-        @k <<= IMMED_N_BITS_MEM
-        ins = op + @j + @k
-        ins += mask_immed(IMMED_N_BITS_MEM) if @opcode.enum =~ /^(eLoad|eStore)$/
+      when /^(eAdd|eSub|eLsl|eLsr|eAsr|eAnd|eOr|eXor|eLoad|eStore|eLoadr|eCmp|eSwap)$/
+        ins = op + (@j << (IMMED_N_BITS_MEM + REG_N_BITS)) + (@k << IMMED_N_BITS_MEM)
+        ins += mask_immed(IMMED_N_BITS_MEM) if @opcode.enum =~ /^(eLoad|eStore|eSwap)$/
       when /^(eLoadi|eAddi|eSubi|eLsli|eLsri|eAsri|eAndi|eOri|eXori|eCmpi)$/
-        @j <<= IMMED_N_BIT
-        ins = op + @j + mask_immed(IMMED_N_BIT)
+        ins = op + (@j << IMMED_N_BIT) + mask_immed(IMMED_N_BIT)
       when /^(eNot|ePush|ePop)$/
-        @j <<= IMMED_N_BITS_MEM + REG_N_BITS
-        ins = op + @j
+        ins = op + (@j << (IMMED_N_BITS_MEM + REG_N_BITS))
       when /^(eBr|eCall)$/
-        @cond <<= IMMED_N_BITS_COND
-        ins = op + @cond + mask_immed(IMMED_N_BITS_COND)
+        ins = op + (@cond << IMMED_N_BITS_COND) + mask_immed(IMMED_N_BITS_COND)
       when /^eLoadil$/
-        ins = op
-        loadil = immed
+        ins = op + (@j << IMMED_N_BIT)
+        loadil = @immed & 0xFFFFFFFF
       else
         STDERR.puts "Error: #{@opcode.enum}: Unsupported instruction"
       end
-      ofid.puts ins
-      ofid.puts loadil if loadil
+      return loadil ? [ins, loadil] : [ins]
     end
     private
     def mask_immed(nbits)
@@ -137,6 +133,7 @@ class Asm
     @opcodes = OpCodes.new(opcode_hxx)
     @var_values = VarVals.new
     @instructions = []
+    @labels = Hash.new   #label => address
   end
   def asm(infile, outfile = nil)
     @ifname = infile
@@ -156,8 +153,38 @@ class Asm
     else
       ofid = STDOUT
     end
-    @instructions.each do |ins|
-      ins.gen(ofid)
+    @instructions.each do |org,ins|
+      ins.words.each {|w| ofid.puts w}
+    end
+  end
+  #Write binary image (see iss/cxx/miscpu/image.hxx): words placed at
+  #their .ORG address, from lowest to highest; gaps hold 0 (as the
+  #iss leaves unloaded memory).  Entry is the first instruction.
+  IMG_VERSION = 1
+  IMG_HEADER_BYTES = 32
+  IMG_ALIGN = 4096
+  IMG_FILL = 0   #eNop: same as unloaded (demand zero) memory
+  def write_image(outfile)
+    mem = Hash.new
+    @instructions.each do |org,ins|
+      ins.words.each_with_index {|w,i| mem[org+i] = w}
+    end
+    load_addr = mem.empty? ? 0 : mem.keys.min
+    word_cnt = mem.empty? ? 0 : (mem.keys.max - load_addr + 1)
+    entry = @instructions.empty? ? 0 : @instructions[0][0]
+    syms = @labels.sort_by {|lbl,addr| [addr,lbl]}.map do |lbl,addr|
+      [addr, lbl.length].pack('VV') + lbl
+    end.join
+    syms_offset = IMG_HEADER_BYTES
+    min_words = syms_offset + syms.length
+    words_offset = min_words - (min_words % IMG_ALIGN) + ((4 * load_addr) % IMG_ALIGN)
+    words_offset += IMG_ALIGN if words_offset < min_words
+    hdr = 'MISC' + [IMG_VERSION, load_addr, word_cnt, entry, @labels.size,
+                    syms_offset, words_offset].pack('V*')
+    words = (0...word_cnt).map {|i| mem[load_addr+i] || IMG_FILL}
+    File.open(outfile,'wb') do |ofid|
+      ofid.write(hdr + syms + ("\0" * (words_offset - min_words)))
+      ofid.write(words.pack('V*'))
     end
   end
   #
@@ -187,6 +214,9 @@ class Asm
   #   9)    halt|nop
   PROD8_REX = Regexp.new("^#{LABEL}?\\s*(?<op>ret|halt|nop)$")
   LDI_REX = Regexp.new("^#{LABEL}?\\s*#{LHS}\\s*=\\s*#{IMMED}$")
+  #  12)    rj <-> mem[rk (+ immed)?]
+  PROD12 = "#{LABEL}?\\s*#{LHS}\\s*<\\->\\s*#{MEM_ALT1.gsub('lhs','rhs')}"
+  PROD12_REX = Regexp.new("^#{PROD12}$")
   def do_line
     case @line
     when /\.ORG\s+(\S+)/
@@ -213,6 +243,8 @@ class Asm
         prod_cmp(match)
       when match = LDI_REX.match(@line)
         prod_ldi(match)
+      when match = PROD12_REX.match(@line)
+        prod12(match)
       else
         error("syntax error: #{@line}")
       end
@@ -232,7 +264,7 @@ class Asm
   def add_instruction(op, cond, j, k, immed)
     return if @pass==1
     ins = @opcodes.get_instruction(op, cond, j, k, immed)
-    @instructions << ins
+    @instructions << [@org, ins]
   end
   def prod_ldi(match)
     set_label(match[:label])
@@ -240,11 +272,9 @@ class Asm
     check_valid_reg_ix(lhs_ix)
     immed = get_immed(match)
     op = 'loadi'
-    if (abs(immed) > OpCodes::Instruction::MAX_IMMED)
-      op = 'loadil'
-      @org += 1  #account for next word used by immed
-    end
+    op = 'loadil' if (abs(immed) > OpCodes::Instruction::MAX_IMMED)
     add_instruction(op, nil, lhs_ix, 0, immed)
+    @org += 1 if op == 'loadil'  #account for next word used by immed
   end
   # 2)    lhs op= rhs
   def prod2(match)
@@ -304,6 +334,15 @@ class Asm
     check_valid_reg_ix(lhs_ix)
     add_instruction(match[:op], nil, lhs_ix, nil, nil)
   end
+  #  12)    rj <-> mem[rk (+ immed)?]
+  def prod12(match)
+    set_label(match[:label])
+    lhs_ix = match[:lhs_ix].to_i
+    rhs_ix = match[:rhs_ix].to_i
+    check_valid_reg_ix(lhs_ix)
+    check_valid_reg_ix(rhs_ix)
+    add_instruction('<->', nil, lhs_ix, rhs_ix, get_immed(match))
+  end
   #   6,7)    cond? [-+]> label  #a branch or call
   #   6.1)    where cond is one of: cy zero !cy !zero
   #   6.2)    where label is ident (line starts with "ident:"
@@ -323,7 +362,19 @@ class Asm
     add_instruction(match[:op], nil, nil, nil, nil)
   end
   def set_label(lbl)
-    @var_values.set(lbl, @org.to_s) if (lbl && @pass==1)
+    if (lbl && @pass==1)
+      @var_values.set(lbl, @org.to_s)
+      @labels[lbl] = @org
+    end
+  end
+  #Write "address label" lines (decimal address), in address order:
+  #the symbol map read by the iss (see iss/cxx/miscpu/symbols.hxx).
+  def write_symbols(outfile)
+    File.open(outfile,'w') do |ofid|
+      @labels.sort_by {|lbl,addr| [addr,lbl]}.each do |lbl,addr|
+        ofid.puts "#{addr} #{lbl}"
+      end
+    end
   end
   def check_valid_reg_ix(ix)
     if (ix < 0) || (ix > REG_IX_HI)
@@ -368,8 +419,24 @@ class Asm
   end
 end
 
-asm = Asm.new(ARGV[0])
-asm.asm(ARGV[1])
+#Usage: main.rb opcode.hxx [-sym out.sym] [-img out.img] in.s
+opcode_hxx = ARGV.shift
+sym_file = nil
+img_file = nil
+args = []
+while arg = ARGV.shift
+  if arg == '-sym'
+    sym_file = ARGV.shift
+  elsif arg == '-img'
+    img_file = ARGV.shift
+  else
+    args << arg
+  end
+end
+asm = Asm.new(opcode_hxx)
+asm.asm(args[0])
+asm.write_symbols(sym_file) if sym_file
+asm.write_image(img_file) if img_file
 
 
 #Format of .s files
@@ -397,6 +464,8 @@ asm.asm(ARGV[1])
 #
 #   10)  any instruction line can start with a label "ident:"
 #
+#   12)   rj <-> mem[rk (+ immed)?]   #atomic swap (eSwap): rk is the base
+#
 #  
 #   11) The following set variables which can be reference later
 #         .DEF ident = expr
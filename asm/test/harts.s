@@ -0,0 +1,41 @@
+//Multi-hart test (iss: miscpu -harts n harts.s): each hart adds 1 to a
+//shared counter K times, under a spinlock built on eSwap ("<->").
+//Hart 0 waits for all harts, then halts with r2 = n * K.
+//At entry r0 = hart, r1 = n and sp is set per hart (no "r31 =").
+.DEF LOCK = 0x8000
+.DEF COUNT = 0x8001
+.DEF DONE = 0x8002
+.DEF K = 100000
+r8 = #0
+r3 = #K
+loop: nop
++> lock
+r2 = mem[r8 + #COUNT]
+r2 += #1
+mem[r2 + #COUNT] = r8	//stores r2 at r8+COUNT
++> unlock
+r3 -= #1
+!zero? -> loop
++> lock
+r2 = mem[r8 + #DONE]
+r2 += #1
+mem[r2 + #DONE] = r8
++> unlock
+r0 ==? #0
+!zero? -> out
+wait: r2 = mem[r8 + #DONE]
+r2 ==? r1
+!zero? -> wait
+r2 = mem[r8 + #COUNT]
+out: halt
+
+//Spin until LOCK was 0; uses r4.
+lock: r4 = #1
+r4 <-> mem[r8 + #LOCK]
+r4 ==? #0
+!zero? -> lock
+ret
+
+unlock: r4 = #0
+r4 <-> mem[r8 + #LOCK]
+ret
@@ -0,0 +1,41 @@
+r31 = #0x0100000 //sp
+
+//Devices (iss -io -blockdev file: see iss/cxx/miscpu/iobus.hxx).
+//NOTE: "mem[rV + #i] = rA" stores rV at rA+i.
+.DEF CONSOLE = 0xFFFF0000
+.DEF TIMER = 0xFFFF0010
+.DEF BLOCK = 0xFFFF1000
+.DEF DATA = 128	//words of selected block
+.DEF EOF = -1
+
+r1 = #CONSOLE
+r10 = #TIMER
+mem[r0 + #0] = r10	//reset timer (any value)
+
+//"0123456789\n"
+r2 = #48
+digits: mem[r2 + #0] = r1
+r2 += #1
+r2 ==? #58
+!zero? -> digits
+r2 = #10
+mem[r2 + #0] = r1
+
+//Echo input, to end of input
+echo: r3 = mem[r1 + #0]
+r3 ==? #EOF
+zero? -> echo_end
+mem[r3 + #0] = r1
+-> echo
+
+//Count runs in word 0 of block 1
+echo_end: r5 = #BLOCK
+r6 = #1
+mem[r6 + #0] = r5	//select block 1
+r7 = mem[r5 + #DATA]
+r7 += #1
+mem[r7 + #DATA] = r5
+mem[r6 + #2] = r5	//write back
+
+r4 = mem[r10 + #0]	//elapsed microseconds
+halt
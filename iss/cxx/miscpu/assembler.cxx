@@ -0,0 +1,544 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include "xyzzy/assert.hxx"
+#include "assembler.hxx"
+
+namespace miscpu
+{
+    //Largest |immed| of "rj = #immed" encoded as eLoadi (22-bit field).
+    static const long long cMaxLoadi = (1 << 21) - 1;
+
+    static bool isIdentChar(char c) {
+        return isalnum((unsigned char)c) || ('_' == c);
+    }
+
+    //As ruby: round to -infinity.
+    static long long floorDiv(long long a, long long b) {
+        const long long q = a / b;
+        return ((0 != (a % b)) && ((a < 0) != (b < 0))) ? (q - 1) : q;
+    }
+
+    //Cursor over one line (comment already removed).
+    class TAssembler::TLine {
+    public:
+        TLine(const char *p, const char *end)
+            :   m_p(p), m_end(end) {
+        }
+
+        const char* mark() const {
+            return m_p;
+        }
+
+        void reset(const char *p) {
+            m_p = p;
+        }
+
+        bool atEnd() {
+            skipWs();
+            return (m_end == m_p);
+        }
+
+        char peek() {
+            skipWs();
+            return (m_end == m_p) ? '\0' : *m_p;
+        }
+
+        //Accept tok (after white space).
+        bool accept(const char *tok) {
+            skipWs();
+            const char *q = m_p;
+            for (; '\0' != *tok; tok++, q++) {
+                if ((m_end == q) || (*q != *tok)) {
+                    return false;
+                }
+            }
+            m_p = q;
+            return true;
+        }
+
+        //... only if not followed by an identifier character.
+        bool acceptWord(const char *word) {
+            const char *p = m_p;
+            if (accept(word) && ((m_end == m_p) || !isIdentChar(*m_p))) {
+                return true;
+            }
+            m_p = p;
+            return false;
+        }
+
+        bool ident(string &s) {
+            skipWs();
+            if ((m_end == m_p) || !(isalpha((unsigned char)*m_p) || ('_' == *m_p))) {
+                return false;
+            }
+            const char *p = m_p;
+            while ((m_end != m_p) && isIdentChar(*m_p)) {
+                m_p++;
+            }
+            s.assign(p, m_p);
+            return true;
+        }
+
+        //Number as ruby reads it (0x hex, 0 octal, '_' ignored).
+        bool number(long long &val) {
+            skipWs();
+            if ((m_end == m_p) || !isdigit((unsigned char)*m_p)) {
+                return false;
+            }
+            char buf[64];
+            unsigned n = 0;
+            for (; (m_end != m_p) && isIdentChar(*m_p); m_p++) {
+                if (('_' != *m_p) && (n + 1 < sizeof(buf))) {
+                    buf[n++] = *m_p;
+                }
+            }
+            buf[n] = '\0';
+            char *end = 0;
+            val = (long long)strtoull(buf, &end, 0);
+            return ('\0' == *end);
+        }
+
+        string text() const {
+            return string(m_p, m_end);
+        }
+
+    private:
+        void skipWs() {
+            while ((m_end != m_p) && isspace((unsigned char)*m_p)) {
+                m_p++;
+            }
+        }
+
+        const char  *m_p, *m_end;
+    };
+
+    TAssembler::TAssembler(MiscCpu &cpu)
+        :   m_cpu(cpu), cRegIxHi(cpu.getNumRegs() - 1),
+            m_org(0), m_lnum(0), m_errs(0) {
+    }
+
+    bool TAssembler::assembleFile(const string &fname, std::ostream &errs) {
+        std::ifstream ifs(fname.c_str());
+        ASSERT_TRUE(false == ifs.fail());
+        std::ostringstream src;
+        src << ifs.rdbuf();
+        return assemble(src.str(), fname, errs);
+    }
+
+    bool TAssembler::assemble(const string &src, const string &name,
+            std::ostream &errs) {
+        m_values.clear();
+        m_syms = TSymbolMap();
+        m_words.clear();
+        m_fixups.clear();
+        m_org = 0;
+        m_name = name;
+        m_errs = &errs;
+        const char *p = src.data(), *const end = p + src.size();
+        for (m_lnum = 1; p < end; m_lnum++) {
+            const char *eol = p;
+            while ((end != eol) && ('\n' != *eol)) {
+                eol++;
+            }
+            const char *eos = p;
+            while ((eol != eos) && !(('/' == eos[0]) && (eol != eos + 1) && ('/' == eos[1]))) {
+                eos++;
+            }
+            TLine line(p, eos);
+            if (!line.atEnd() && !doLine(line)) {
+                return false;
+            }
+            p = (end == eol) ? end : (eol + 1);
+        }
+        for (unsigned i = 0; i < m_fixups.size(); i++) {
+            const TFixup &fix = m_fixups[i];
+            t_values::const_iterator it = m_values.find(fix.name);
+            if (m_values.end() == it) {
+                m_lnum = fix.lnum;
+                return error("'" + fix.name + "': target of goto undefined");
+            }
+            TWord &word = m_words[fix.ix];
+            word.val = m_cpu.instructionb(fix.op, fix.cond,
+                                          (int)(it->second - word.addr - 1));
+        }
+        return true;
+    }
+
+    bool TAssembler::doLine(TLine &line) {
+        long long val;
+        string name;
+        if (line.accept(".ORG")) {
+            if (!expr(line, val)) {
+                return false;
+            }
+            m_org = (TUint32)val;
+        } else if (line.accept(".DEF")) {
+            if (!line.ident(name) || !line.accept("=")) {
+                return error("syntax error: .DEF" + line.text());
+            }
+            if (!expr(line, val)) {
+                return false;
+            }
+            m_values[name] = val;
+        } else {
+            return doInstruction(line);
+        }
+        return line.atEnd() ? true : error("syntax error: " + line.text());
+    }
+
+    bool TAssembler::doInstruction(TLine &line) {
+        const char *start = line.mark();
+        string name;
+        if (line.ident(name) && line.accept(":")) {
+            setLabel(name);
+        } else {
+            line.reset(start);
+        }
+        start = line.mark();
+        MiscCpu::ECond cond = MiscCpu::eUncond;
+        if (line.accept("!zero?")) {
+            cond = MiscCpu::eNotZero;
+        } else if (line.accept("!cy?")) {
+            cond = MiscCpu::eNotCy;
+        } else if (line.accept("zero?")) {
+            cond = MiscCpu::eZero;
+        } else if (line.accept("cy?")) {
+            cond = MiscCpu::eCy;
+        }
+        OpCode::EOp op = OpCode::eNotUsed;
+        unsigned j, k;
+        long long val;
+        bool ok = true;
+        if (line.accept("->")) {
+            op = OpCode::eBr;
+        } else if (line.accept("+>")) {
+            op = OpCode::eCall;
+        }
+        if (OpCode::eNotUsed != op) {
+            //target patched in assemble()
+            TFixup fix;
+            fix.ix = m_words.size();
+            fix.lnum = m_lnum;
+            fix.op = op;
+            fix.cond = cond;
+            ok = line.ident(fix.name);
+            m_fixups.push_back(fix);
+            add(0);
+        } else if (MiscCpu::eUncond != cond) {
+            ok = false;
+        } else if (line.acceptWord("ret")) {
+            add(m_cpu.instruction(OpCode::eRetn));
+        } else if (line.acceptWord("halt")) {
+            add(m_cpu.instruction(OpCode::eHalt));
+        } else if (line.acceptWord("nop")) {
+            add(m_cpu.instruction(OpCode::eNop));
+        } else if (line.accept("push")) {
+            if (!regIx(line, j)) {
+                return false;
+            }
+            add(m_cpu.instruction(OpCode::ePush, j));
+        } else if (line.accept("pop")) {
+            if (!regIx(line, j)) {
+                return false;
+            }
+            add(m_cpu.instruction(OpCode::ePop, j));
+        } else if ('m' == line.peek()) {
+            //mem[rj +/- #immed] = rk: as main.rb, eStore j, k
+            if (!memRef(line, j, val)) {
+                return false;
+            }
+            if (!line.accept("=")) {
+                ok = false;
+            } else if ('m' == line.peek()) {
+                return error("mem[...]=mem[...] style not supported");
+            } else if (!regIx(line, k)) {
+                return false;
+            } else {
+                add(m_cpu.instruction(OpCode::eStore, j, k, (int)val));
+            }
+        } else if ('r' == line.peek()) {
+            if (!regIx(line, j)) {
+                return false;
+            }
+            if (line.accept("<->")) {
+                //rj <-> mem[rk +/- #immed]: eSwap j, k (no quirk)
+                if (!memRef(line, k, val)) {
+                    return false;
+                }
+                add(m_cpu.instruction(OpCode::eSwap, j, k, (int)val));
+                return line.atEnd() ? true : error("syntax error: " + line.text());
+            }
+            const char *op2 = line.mark();
+            if (line.accept("==") || !line.accept("=")) {
+                line.reset(op2);
+                return aluOp(line, j);
+            }
+            const char c = line.peek();
+            if (line.accept("~")) {
+                //as main.rb: k is not encoded (eNot is r[j] = ~r[j])
+                if (!regIx(line, k)) {
+                    return false;
+                }
+                add(m_cpu.instruction(OpCode::eNot, j));
+            } else if ('#' == c) {
+                if (!immed(line, val)) {
+                    return false;
+                }
+                if ((val > cMaxLoadi) || (val < -cMaxLoadi)) {
+                    add(m_cpu.instruction(OpCode::eLoadil, j));
+                    add((TInt32)(TUint32)val);
+                } else {
+                    add(m_cpu.instructioni(OpCode::eLoadi, j, (int)val));
+                }
+            } else if ('m' == c) {
+                if (!memRef(line, k, val)) {
+                    return false;
+                }
+                add(m_cpu.instruction(OpCode::eLoad, j, k, (int)val));
+            } else {
+                if (!regIx(line, k)) {
+                    return false;
+                }
+                add(m_cpu.instruction(OpCode::eLoadr, j, k));
+            }
+        } else {
+            ok = false;
+        }
+        if (!ok || !line.atEnd()) {
+            line.reset(start);
+            return error("syntax error: " + line.text());
+        }
+        return true;
+    }
+
+    //rj op= (rk | #immed), rj ==? (rk | #immed)
+    bool TAssembler::aluOp(TLine &line, unsigned j) {
+        static const struct {
+            const char  *tok;
+            OpCode::EOp op, opi;
+        } cOps[] = {
+            {"==?", OpCode::eCmp, OpCode::eCmpi},
+            {">a>=", OpCode::eAsr, OpCode::eAsri},
+            {"<<=", OpCode::eLsl, OpCode::eLsli},
+            {">>=", OpCode::eLsr, OpCode::eLsri},
+            {"+=", OpCode::eAdd, OpCode::eAddi},
+            {"-=", OpCode::eSub, OpCode::eSubi},
+            {"&=", OpCode::eAnd, OpCode::eAndi},
+            {"|=", OpCode::eOr, OpCode::eOri},
+            {"^=", OpCode::eXor, OpCode::eXori}
+        };
+        for (unsigned i = 0; i < sizeof(cOps)/sizeof(cOps[0]); i++) {
+            if (!line.accept(cOps[i].tok)) {
+                continue;
+            }
+            unsigned k;
+            long long val;
+            if ('#' == line.peek()) {
+                if (!immed(line, val)) {
+                    return false;
+                }
+                add(m_cpu.instructioni(cOps[i].opi, j, (int)val));
+            } else {
+                if (!regIx(line, k)) {
+                    return false;
+                }
+                add(m_cpu.instruction(cOps[i].op, j, k));
+            }
+            return line.atEnd() ? true : error("syntax error: " + line.text());
+        }
+        return error("syntax error: " + line.text());
+    }
+
+    //#immed: number or name (see primary())
+    bool TAssembler::immed(TLine &line, long long &val) {
+        if (!line.accept("#")) {
+            return error("syntax error: " + line.text());
+        }
+        return primary(line, val);
+    }
+
+    //.DEF expression: ruby precedence (<< >>, then + -, then * / %).
+    bool TAssembler::expr(TLine &line, long long &val, unsigned prec) {
+        static const char* const cOps[3][3] = {
+            {"<<", ">>", 0}, {"+", "-", 0}, {"*", "/", "%"}
+        };
+        if (3 == prec) {
+            return primary(line, val);
+        }
+        if (!expr(line, val, prec + 1)) {
+            return false;
+        }
+        while (true) {
+            unsigned i = 0;
+            while ((3 > i) && (0 != cOps[prec][i]) && !line.accept(cOps[prec][i])) {
+                i++;
+            }
+            if ((3 == i) || (0 == cOps[prec][i])) {
+                return true;
+            }
+            long long rhs;
+            if (!expr(line, rhs, prec + 1)) {
+                return false;
+            }
+            const char op = cOps[prec][i][0];
+            if ((('/' == op) || ('%' == op)) && (0 == rhs)) {
+                return error("divided by 0");
+            }
+            switch (op) {
+                case '<': val = (long long)((unsigned long long)val << rhs); break;
+                case '>': val >>= rhs; break;
+                case '+': val += rhs; break;
+                case '-': val -= rhs; break;
+                case '*': val *= rhs; break;
+                case '/': val = floorDiv(val, rhs); break;
+                case '%': val -= floorDiv(val, rhs) * rhs; break;
+                default: ASSERT_NEVER;
+            }
+        }
+    }
+
+    //number | name | -primary | +primary | (expr)
+    bool TAssembler::primary(TLine &line, long long &val) {
+        string name;
+        if (line.accept("(")) {
+            if (!expr(line, val)) {
+                return false;
+            }
+            return line.accept(")") ? true : error("syntax error: missing ')'");
+        } else if (line.accept("-")) {
+            if (!primary(line, val)) {
+                return false;
+            }
+            val = -val;
+            return true;
+        } else if (line.accept("+")) {
+            return primary(line, val);
+        } else if (isdigit((unsigned char)line.peek())) {
+            return line.number(val) ? true : error("bad number: " + line.text());
+        } else if (line.ident(name)) {
+            return value(name, val);
+        }
+        return error("syntax error: " + line.text());
+    }
+
+    bool TAssembler::value(const string &name, long long &val) {
+        t_values::const_iterator it = m_values.find(name);
+        if (m_values.end() == it) {
+            return error("'" + name + "': undefined");
+        }
+        val = it->second;
+        return true;
+    }
+
+    bool TAssembler::regIx(TLine &line, unsigned &ix) {
+        long long val;
+        if (!line.accept("r") || !line.number(val)) {
+            return error("syntax error: " + line.text());
+        }
+        if ((0 > val) || (cRegIxHi < val)) {
+            std::ostringstream oss;
+            oss << "r'" << val << "': index out of range [0.." << cRegIxHi << "]";
+            return error(oss.str());
+        }
+        ix = (unsigned)val;
+        return true;
+    }
+
+    //m[rk] | mem[rk +/- #immed]
+    bool TAssembler::memRef(TLine &line, unsigned &ix, long long &offset) {
+        if (!(line.accept("mem[") || line.accept("m[")) || !regIx(line, ix)) {
+            return error("syntax error: " + line.text());
+        }
+        offset = 0;
+        if (line.accept("+")) {
+            if (!immed(line, offset)) {
+                return false;
+            }
+        } else if (line.accept("-")) {
+            if (!immed(line, offset)) {
+                return false;
+            }
+            offset = -offset;
+        }
+        return line.accept("]") ? true : error("syntax error: missing ']'");
+    }
+
+    void TAssembler::setLabel(const string &name) {
+        m_values[name] = m_org;
+        m_syms.add(m_org, name);
+    }
+
+    void TAssembler::add(TInt32 val) {
+        TWord word;
+        word.addr = m_org++;
+        word.val = val;
+        m_words.push_back(word);
+    }
+
+    bool TAssembler::error(const string &msg) {
+        *m_errs << "Error: " << m_name << ":" << m_lnum << ": " << msg << std::endl;
+        return false;
+    }
+
+    TUint32 TAssembler::getExtent(TUint32 &lo) const {
+        lo = 0;
+        if (m_words.empty()) {
+            return 0;
+        }
+        TUint32 hi = lo = m_words[0].addr;
+        for (unsigned i = 1; i < m_words.size(); i++) {
+            const TUint32 addr = m_words[i].addr;
+            if (addr < lo) {
+                lo = addr;
+            } else if (addr > hi) {
+                hi = addr;
+            }
+        }
+        return hi - lo + 1;
+    }
+
+    unsigned TAssembler::load(MiscCpu &cpu) const {
+        for (unsigned i = 0; i < m_words.size(); i++) {
+            cpu.setMem(m_words[i].addr, m_words[i].val);
+        }
+        cpu.setPc(getEntry());
+        return m_words.size();
+    }
+
+    void TAssembler::writeText(std::ostream &os) const {
+        for (unsigned i = 0; i < m_words.size(); i++) {
+            os << (TUint32)m_words[i].val << '\n';
+        }
+    }
+
+    bool isAsmSource(const string &fname) {
+        return (2 < fname.length()) && (".s" == fname.substr(fname.length() - 2));
+    }
+};
@@ -0,0 +1,147 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+
+#if !defined(_miscpu_assembler_hxx_)
+#    define  _miscpu_assembler_hxx_
+
+#include <map>
+#include <vector>
+#include <string>
+#include <ostream>
+#include "xyzzy/portable.hxx"
+#include "miscpu.hxx"
+#include "symbols.hxx"
+
+using std::string;
+using xyzzy::TUint32;
+using xyzzy::TInt32;
+
+namespace miscpu
+{
+    /**
+     * Assembler for the syntax of asm/lib/main.rb (see the end of that
+     * file): "r1 += #1", "zero? -> label", "+> MULT16u", ".DEF", ".ORG".
+     * Words are encoded by MiscCpu::instruction/instructionb/instructioni,
+     * and go straight to memory by load(): no Ruby, no text file.
+     *
+     * Same encodings as main.rb, including its quirks: "mem[rk + #i] = rj"
+     * is encoded as eStore with j=k (it stores rk at rj+i), and an
+     * immediate which does not fit 22 bits makes "rj = #i" an eLoadil.
+     * "rj <-> mem[rk + #i]" is eSwap (rk is the base, as for loads).
+     *
+     * Differences: a single pass (branch/call targets are patched once
+     * all labels are known; as in main.rb, other operands can only use
+     * names defined above them); "mem[rk - #i]" subtracts i; labels may
+     * be on branch/call lines.
+     */
+    class TAssembler {
+    public:
+        struct TWord {
+            TUint32 addr;
+            TInt32  val;
+        };
+
+        //Encode for (registers of) cpu.
+        explicit TAssembler(MiscCpu &cpu);
+
+        //Assemble source text src (name is used in messages).
+        //Returns false (after writing "Error: name:line: ..." to errs)
+        //at the first error.
+        bool assemble(const string &src, const string &name, std::ostream &errs);
+
+        bool assembleFile(const string &fname, std::ostream &errs);
+
+        //Words in source order.
+        const std::vector<TWord>& getWords() const {
+            return m_words;
+        }
+
+        //Address of first instruction (0 if none).
+        TUint32 getEntry() const {
+            return m_words.empty() ? 0 : m_words[0].addr;
+        }
+
+        const TSymbolMap& getSymbols() const {
+            return m_syms;
+        }
+
+        //Lowest address and number of words up to the highest (0 if none).
+        TUint32 getExtent(TUint32 &lo) const;
+
+        //Write words to cpu memory (as stores do), set pc to getEntry().
+        //Return number of words written.
+        unsigned load(MiscCpu &cpu) const;
+
+        //Text format of main.rb (read by MiscCpu::loadMemory()):
+        //one decimal word per line, in source order.
+        void writeText(std::ostream &os) const;
+
+    private:
+        //not copyable
+        TAssembler(const TAssembler&);
+        TAssembler& operator=(const TAssembler&);
+
+        class TLine;
+
+        //branch/call at m_words[ix] to name (on line lnum)
+        struct TFixup {
+            unsigned        ix, lnum;
+            OpCode::EOp     op;
+            MiscCpu::ECond  cond;
+            string          name;
+        };
+
+        typedef std::map<string, long long> t_values;
+
+        bool doLine(TLine &line);
+        bool doInstruction(TLine &line);
+        bool immed(TLine &line, long long &val);
+        bool expr(TLine &line, long long &val, unsigned prec = 0);
+        bool primary(TLine &line, long long &val);
+        bool value(const string &name, long long &val);
+        bool regIx(TLine &line, unsigned &ix);
+        bool memRef(TLine &line, unsigned &ix, long long &offset);
+        bool aluOp(TLine &line, unsigned j);
+        void setLabel(const string &name);
+        void add(TInt32 val);
+        bool error(const string &msg);
+
+        MiscCpu             &m_cpu;
+        const unsigned      cRegIxHi;
+        t_values            m_values;   //.DEF and labels
+        TSymbolMap          m_syms;
+        std::vector<TWord>  m_words;
+        std::vector<TFixup> m_fixups;
+        TUint32             m_org;
+        string              m_name;
+        unsigned            m_lnum;
+        std::ostream        *m_errs;
+    };
+
+    //True if fname ends in ".s" (assembler source).
+    bool isAsmSource(const string &fname);
+};
+
+#endif  //_miscpu_assembler_hxx_
@@ -0,0 +1,356 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstdlib>
+#include <unistd.h>
+#include "xyzzy/assert.hxx"
+#include "batch.hxx"
+#include "simd.hxx"
+#include "hosttime.hxx"
+
+namespace miscpu
+{
+    //Parse "val" of a field; false if not all digits.
+    static bool parseVal(const string &s, unsigned long &val) {
+        char *end = 0;
+        val = strtoul(s.c_str(), &end, 0);
+        return (0 < s.length()) && ('\0' == *end);
+    }
+
+    //Parse one "name=val" field into job; false if malformed.
+    static bool parseField(const string &field, TBatchJob &job) {
+        string::size_type eq = field.find('=');
+        unsigned long ix, val;
+        if ((string::npos == eq) || !parseVal(field.substr(eq + 1), val)) {
+            return false;
+        }
+        const string name = field.substr(0, eq);
+        if ("pc" == name) {
+            job.setPc = true;
+            job.pc = val;
+        } else if ((1 < name.length()) && ('r' == name[0]) &&
+                   parseVal(name.substr(1), ix)) {
+            job.regs.push_back(std::make_pair((unsigned)ix, (TInt32)val));
+        } else if ((1 < name.length()) && ('m' == name[0]) &&
+                   parseVal(name.substr(1), ix)) {
+            job.mem.push_back(std::make_pair((TUint32)ix, (TInt32)val));
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    unsigned readBatchJobs(const string &fname, std::vector<TBatchJob> &jobs) {
+        std::ifstream ifs(fname.c_str());
+        ASSERT_TRUE(false == ifs.fail());
+        unsigned n = 0, lineNum = 0;
+        string line;
+        while (std::getline(ifs, line)) {
+            lineNum++;
+            string::size_type hash = line.find('#');
+            if (string::npos != hash) {
+                line.erase(hash);
+            }
+            std::istringstream iss(line);
+            string field;
+            TBatchJob job;
+            bool any = false;
+            while (iss >> field) {
+                if (!parseField(field, job)) {
+                    std::cerr << "Error: " << fname << ":" << lineNum
+                              << ": bad field \"" << field << "\"" << std::endl;
+                    ASSERT_NEVER;
+                }
+                any = true;
+            }
+            if (any) {
+                jobs.push_back(job);
+                n++;
+            }
+        }
+        ifs.close();
+        return n;
+    }
+
+    TBatchRunner::TBatchRunner(const string &imageFname,
+            const std::vector<TBatchJob> &jobs,
+            MiscCpu::EEngine engine,
+            TUint64 maxInstrs,
+            unsigned lanes,
+            bool check)
+        :   m_image(imageFname),
+            m_jobs(jobs),
+            m_engine(engine),
+            m_maxInstrs(maxInstrs),
+            m_lanes(lanes),
+            m_check(check),
+            m_results(jobs.size()),
+            m_ranges(0),
+            m_nthreads(0) {
+        ASSERT_TRUE((0 == lanes) || (TSimdGroup8::cLanes == lanes) ||
+                    (TSimdGroup16::cLanes == lanes));
+        pthread_mutex_init(&m_statsLock, 0);
+    }
+
+    TBatchRunner::~TBatchRunner() {
+        delete [] m_ranges;
+        pthread_mutex_destroy(&m_statsLock);
+    }
+
+    unsigned TBatchRunner::getHostThreads() {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        return (0 < n) ? (unsigned)n : 1;
+    }
+
+    double TBatchRunner::run(unsigned nthreads) {
+        ASSERT_TRUE(0 < nthreads);
+        //units of work: jobs, or groups of m_lanes jobs
+        const unsigned nunits = (0 == m_lanes) ? m_jobs.size()
+                                               : ((m_jobs.size() + m_lanes - 1) / m_lanes);
+        delete [] m_ranges;
+        m_ranges = new TRange[nthreads];
+        m_nthreads = nthreads;
+        m_simdStats = TSimdStats();
+        for (unsigned i = 0; i < nthreads; i++) {
+            pthread_mutex_init(&m_ranges[i].lock, 0);
+            m_ranges[i].lo = (TUint64)nunits * i / nthreads;
+            m_ranges[i].hi = (TUint64)nunits * (i + 1) / nthreads;
+        }
+        std::vector<TWorker> workers(nthreads);
+        std::vector<pthread_t> tids(nthreads);
+        const double t0 = nowSecs();
+        for (unsigned i = 0; i < nthreads; i++) {
+            workers[i].runner = this;
+            workers[i].ix = i;
+            //worker 0 is this thread
+            if (0 < i) {
+                ASSERT_TRUE(0 == pthread_create(&tids[i], 0, worker, &workers[i]));
+            }
+        }
+        worker(&workers[0]);
+        for (unsigned i = 1; i < nthreads; i++) {
+            pthread_join(tids[i], 0);
+        }
+        const double secs = nowSecs() - t0;
+        for (unsigned i = 0; i < nthreads; i++) {
+            pthread_mutex_destroy(&m_ranges[i].lock);
+        }
+        return secs;
+    }
+
+    void* TBatchRunner::worker(void *arg) {
+        TWorker *w = (TWorker*)arg;
+        unsigned unit;
+        while (w->runner->take(w->ix, unit)) {
+            if (0 == w->runner->m_lanes) {
+                w->runner->runJob(unit);
+            } else {
+                w->runner->runGroup(unit);
+            }
+        }
+        return 0;
+    }
+
+    bool TBatchRunner::take(unsigned self, unsigned &unit) {
+        TRange &own = m_ranges[self];
+        while (true) {
+            pthread_mutex_lock(&own.lock);
+            const bool found = (own.lo < own.hi);
+            if (found) {
+                unit = own.lo++;
+            }
+            pthread_mutex_unlock(&own.lock);
+            if (found) {
+                return true;
+            }
+            if (!steal(self)) {
+                return false;   //no jobs are added: all taken
+            }
+        }
+    }
+
+    bool TBatchRunner::steal(unsigned self) {
+        //victim: largest remaining range (sizes may be stale: retry)
+        while (true) {
+            unsigned victim = self, most = 0;
+            for (unsigned i = 0; i < m_nthreads; i++) {
+                pthread_mutex_lock(&m_ranges[i].lock);
+                const unsigned n = m_ranges[i].hi - m_ranges[i].lo;
+                pthread_mutex_unlock(&m_ranges[i].lock);
+                if ((i != self) && (n > most)) {
+                    victim = i;
+                    most = n;
+                }
+            }
+            if (0 == most) {
+                return false;
+            }
+            TRange &from = m_ranges[victim];
+            unsigned lo = 0, hi = 0;
+            pthread_mutex_lock(&from.lock);
+            if (from.lo < from.hi) {
+                //top half, rounded up: a lone remaining job moves to the thief
+                hi = from.hi;
+                lo = from.hi - ((from.hi - from.lo + 1) / 2);
+                from.hi = lo;
+            }
+            pthread_mutex_unlock(&from.lock);
+            if (lo < hi) {
+                TRange &own = m_ranges[self];
+                pthread_mutex_lock(&own.lock);
+                own.lo = lo;
+                own.hi = hi;
+                pthread_mutex_unlock(&own.lock);
+                return true;
+            }
+        }
+    }
+
+    void TBatchRunner::startJob(unsigned job, MiscCpu &cpu) const {
+        const TBatchJob &in = m_jobs[job];
+        cpu.loadImage(m_image);
+        for (unsigned i = 0; i < in.regs.size(); i++) {
+            ASSERT_TRUE(in.regs[i].first < cpu.getNumRegs());
+            cpu.setReg(in.regs[i].first, in.regs[i].second);
+        }
+        for (unsigned i = 0; i < in.mem.size(); i++) {
+            cpu.setMem(in.mem[i].first, in.mem[i].second);
+        }
+        if (in.setPc) {
+            cpu.setPc(in.pc);
+        }
+    }
+
+    void TBatchRunner::endJob(unsigned job, const MiscCpu &cpu) {
+        TBatchResult &out = m_results[job];
+        out.instrs = cpu.getPerfMon()->getInstructionCnt();
+        //no budget: ran to eHalt (translated code does not update opcode)
+        out.halted = (0 == m_maxInstrs) || (OpCode::eHalt == cpu.getOpcode());
+        out.pc = cpu.getPc();
+        out.regs.resize(cpu.getNumRegs());
+        for (unsigned i = 0; i < out.regs.size(); i++) {
+            out.regs[i] = cpu.getReg(i);
+        }
+    }
+
+    void TBatchRunner::runJob(unsigned job) {
+        MiscCpu cpu(0, 5, 20, true, m_engine);
+        startJob(job, cpu);
+        cpu.run(m_maxInstrs);
+        endJob(job, cpu);
+    }
+
+    void TBatchRunner::runGroup(unsigned group) {
+        const unsigned lo = group * m_lanes;
+        const unsigned hi = (lo + m_lanes < m_jobs.size()) ? (lo + m_lanes) : m_jobs.size();
+        std::vector<MiscCpu*> cpus;
+        for (unsigned job = lo; job < hi; job++) {
+            cpus.push_back(new MiscCpu(0, 5, 20, true, m_engine));
+            startJob(job, *cpus.back());
+        }
+        if (TSimdGroup8::cLanes == m_lanes) {
+            runGroupT<TSimdGroup8::cLanes>(cpus);
+        } else {
+            runGroupT<TSimdGroup16::cLanes>(cpus);
+        }
+        unsigned mismatches = 0;
+        std::ostringstream diffs;
+        for (unsigned job = lo; job < hi; job++) {
+            const MiscCpu &cpu = *cpus[job - lo];
+            endJob(job, cpu);
+            if (m_check) {
+                MiscCpu ref(0, 5, 20, true, m_engine);
+                startJob(job, ref);
+                ref.run(m_maxInstrs);
+                std::ostringstream os;
+                unsigned ndiffs = cpu.compareState(ref, os);
+                if (ref.getPerfMon()->getInstructionCnt() != m_results[job].instrs) {
+                    os << "instruction count: " << m_results[job].instrs << " (expected "
+                       << ref.getPerfMon()->getInstructionCnt() << ")" << std::endl;
+                    ndiffs++;
+                }
+                if (0 != ndiffs) {
+                    diffs << "Error: job " << job << ": lane differs from scalar ("
+                          << ndiffs << " difference(s))" << std::endl << os.str();
+                    mismatches++;
+                }
+            }
+            delete cpus[job - lo];
+        }
+        pthread_mutex_lock(&m_statsLock);
+        m_simdStats.mismatches += mismatches;
+        std::cout << diffs.str();
+        pthread_mutex_unlock(&m_statsLock);
+    }
+
+    template<unsigned Lanes>
+    void TBatchRunner::runGroupT(const std::vector<MiscCpu*> &cpus) {
+        PTSimdGroup<Lanes> group(cpus);
+        group.run(m_maxInstrs);
+        pthread_mutex_lock(&m_statsLock);
+        TSimdStats &st = m_simdStats;
+        st.groups++;
+        st.fallbacks += (0 != group.getFallback()) ? 1 : 0;
+        st.steps += group.getSteps();
+        st.laneSlots += group.getSteps() * group.getLanes();
+        st.laneInstrs += group.getLaneInstrs();
+        st.scalarInstrs += group.getScalarInstrs();
+        st.splits += group.getSplits();
+        pthread_mutex_unlock(&m_statsLock);
+    }
+
+    void TBatchRunner::writeSimdStats(std::ostream &os) const {
+        const TSimdStats &st = m_simdStats;
+        const double util = (0 == st.laneSlots) ? 1.0 : ((double)st.laneInstrs / st.laneSlots);
+        os << "Info: simd: " << st.groups << " group(s) of " << m_lanes << " lanes: "
+           << st.steps << " step(s), " << st.laneInstrs << " lane instruction(s), "
+           << (100.0 * util) << "% lane utilization, " << st.splits << " split(s)" << std::endl
+           << "Info: simd: " << st.fallbacks << " group(s) fell back to scalar ("
+           << st.scalarInstrs << " instruction(s))" << std::endl;
+        if (m_check) {
+            os << "Info: simd: " << (m_jobs.size() - st.mismatches) << " of " << m_jobs.size()
+               << " job(s) match scalar" << std::endl;
+        }
+    }
+
+    void TBatchRunner::writeCsv(std::ostream &os) const {
+        const unsigned nregs = m_results.empty() ? 0 : m_results[0].regs.size();
+        os << "job,halted,pc,instructions";
+        for (unsigned i = 0; i < nregs; i++) {
+            os << ",r" << i;
+        }
+        os << std::endl;
+        for (unsigned j = 0; j < m_results.size(); j++) {
+            const TBatchResult &r = m_results[j];
+            os << j << "," << (r.halted ? 1 : 0) << "," << r.pc << "," << r.instrs;
+            for (unsigned i = 0; i < r.regs.size(); i++) {
+                os << "," << r.regs[i];
+            }
+            os << std::endl;
+        }
+    }
+};
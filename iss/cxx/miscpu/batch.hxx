@@ -0,0 +1,177 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+#if !defined(_miscpu_batch_hxx_)
+#    define  _miscpu_batch_hxx_
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <ostream>
+#include <pthread.h>
+#include "xyzzy/portable.hxx"
+#include "miscpu.hxx"
+#include "image.hxx"
+
+using std::string;
+using xyzzy::TUint32;
+using xyzzy::TUint64;
+using xyzzy::TInt32;
+
+namespace miscpu
+{
+    //Initial state of one job: applied after the image is loaded.
+    struct TBatchJob {
+        explicit TBatchJob()
+            :   setPc(false), pc(0) {
+        }
+
+        bool                                        setPc;
+        TUint32                                     pc;
+        std::vector<std::pair<unsigned, TInt32> >   regs;   //r[ix] = val
+        std::vector<std::pair<TUint32, TInt32> >    mem;    //m[addr] = val
+    };
+
+    //Final state of one job.
+    struct TBatchResult {
+        bool                halted;     //else stopped at max instructions
+        TUint32             pc;
+        TUint64             instrs;     //PerfMon instruction count
+        std::vector<TInt32> regs;
+    };
+
+    //Totals over the groups of a SIMD batch (see simd.hxx).
+    struct TSimdStats {
+        explicit TSimdStats()
+            :   groups(0), fallbacks(0), mismatches(0), steps(0), laneSlots(0),
+                laneInstrs(0), scalarInstrs(0), splits(0) {
+        }
+
+        unsigned    groups, fallbacks, mismatches;
+        TUint64     steps, laneSlots;   //laneSlots: steps * lanes
+        TUint64     laneInstrs, scalarInstrs, splits;
+    };
+
+    /**
+     * Read jobs file: one job per line, of whitespace separated
+     *
+     *      rN=val      register N
+     *      mA=val      memory word A
+     *      pc=val      start address (default: image entry)
+     *
+     * (numbers as strtoul(,,0)); '#' starts a comment; blank lines
+     * are skipped.  Return number of jobs appended.
+     */
+    unsigned readBatchJobs(const string &fname, std::vector<TBatchJob> &jobs);
+
+    /**
+     * Run many independent jobs against one image.
+     *
+     * The image is opened once (see TImage); each job gets a fresh
+     * MiscCpu which maps it copy-on-write, so unwritten image pages are
+     * shared by all jobs in the host page cache.
+     *
+     * Jobs are split into one contiguous range per worker thread.  A
+     * worker takes jobs from the bottom of its own range; when empty it
+     * steals the top half of the largest remaining range.
+     *
+     * If lanes (8 or 16), each unit of work is a group of that many
+     * consecutive jobs run in lockstep (see PTSimdGroup); if check, each
+     * job is then run again on its own MiscCpu and compared.
+     */
+    class TBatchRunner {
+    public:
+        explicit TBatchRunner(const string &imageFname,
+                const std::vector<TBatchJob> &jobs,
+                MiscCpu::EEngine engine = MiscCpu::eThreadedEngine,
+                TUint64 maxInstrs = 0,
+                unsigned lanes = 0,
+                bool check = false);
+
+        ~TBatchRunner();
+
+        //Run all jobs on nthreads workers; return elapsed seconds.
+        double run(unsigned nthreads);
+
+        const std::vector<TBatchResult>& getResults() const {
+            return m_results;
+        }
+
+        //Of last run(), if lanes.
+        const TSimdStats& getSimdStats() const {
+            return m_simdStats;
+        }
+
+        void writeSimdStats(std::ostream &os) const;
+
+        //Rows of: job,halted,pc,instructions,r0,...
+        void writeCsv(std::ostream &os) const;
+
+        //Online host cpus.
+        static unsigned getHostThreads();
+
+    private:
+        struct TRange {
+            pthread_mutex_t lock;
+            unsigned        lo, hi;     //jobs [lo, hi) not yet taken
+        };
+
+        struct TWorker {
+            TBatchRunner    *runner;
+            unsigned        ix;
+        };
+
+        //not copyable (owns m_ranges)
+        TBatchRunner(const TBatchRunner&);
+        TBatchRunner& operator=(const TBatchRunner&);
+
+        static void* worker(void *arg);
+
+        bool take(unsigned self, unsigned &unit);
+        bool steal(unsigned self);
+        void runJob(unsigned job);
+        void runGroup(unsigned group);
+
+        //Initial state of job into cpu; final state of cpu into result.
+        void startJob(unsigned job, MiscCpu &cpu) const;
+        void endJob(unsigned job, const MiscCpu &cpu);
+
+        template<unsigned Lanes>
+        void runGroupT(const std::vector<MiscCpu*> &cpus);
+
+        const TImage                    m_image;
+        const std::vector<TBatchJob>    &m_jobs;
+        const MiscCpu::EEngine          m_engine;
+        const TUint64                   m_maxInstrs;
+        const unsigned                  m_lanes;
+        const bool                      m_check;
+        TSimdStats                      m_simdStats;
+        pthread_mutex_t                 m_statsLock;
+        std::vector<TBatchResult>       m_results;
+        TRange                          *m_ranges;
+        unsigned                        m_nthreads;
+    };
+};
+
+#endif  //_miscpu_batch_hxx_
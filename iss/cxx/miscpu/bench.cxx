@@ -0,0 +1,188 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <unistd.h>
+#include "xyzzy/assert.hxx"
+#include "bench.hxx"
+#include "image.hxx"
+#include "assembler.hxx"
+#include "hosttime.hxx"
+
+namespace miscpu
+{
+    static const unsigned cRegBits = 5;
+
+    TBenchSummary::TBenchSummary(std::vector<double> samples) {
+        ASSERT_TRUE(!samples.empty());
+        std::sort(samples.begin(), samples.end());
+        const size_t n = samples.size();
+        min = samples[0];
+        median = (0 != (n % 2)) ? samples[n / 2]
+                                : ((samples[n / 2 - 1] + samples[n / 2]) / 2);
+        double sum = 0;
+        for (size_t i = 0; i < n; i++) {
+            sum += samples[i];
+        }
+        mean = sum / n;
+        double sq = 0;
+        for (size_t i = 0; i < n; i++) {
+            sq += (samples[i] - mean) * (samples[i] - mean);
+        }
+        stddev = (1 < n) ? sqrt(sq / (n - 1)) : 0;
+    }
+
+    void TBenchSummary::writeJson(std::ostream &os) const {
+        os << "{\"min\": " << min << ", \"median\": " << median
+           << ", \"mean\": " << mean << ", \"stddev\": " << stddev << "}";
+    }
+
+    TBenchRunner::TBenchRunner(unsigned memBits, unsigned warmup, unsigned reps)
+        :   m_memBits(memBits), m_warmup(warmup), m_reps(reps) {
+        ASSERT_TRUE(0 < reps);
+    }
+
+    const char* TBenchRunner::engineName(MiscCpu::EEngine engine) {
+        static const char* const cNames[] = {"switch", "threaded", "jit"};
+        return cNames[engine];
+    }
+
+    void TBenchRunner::load(MiscCpu &cpu, const string &fname) {
+        if (isImage(fname)) {
+            cpu.loadImage(fname);
+        } else if (isAsmSource(fname)) {
+            TAssembler as(cpu);
+            const bool ok = as.assembleFile(fname, std::cout);
+            ASSERT_TRUE(ok);
+            as.load(cpu);
+        } else {
+            cpu.loadMemory(fname);
+        }
+    }
+
+    TUint32 TBenchRunner::checksum(const MiscCpu &cpu) {
+        //FNV-1a over pc and registers
+        TUint32 h = 2166136261u;
+        h = (h ^ cpu.getPc()) * 16777619u;
+        for (unsigned i = 0; i < cpu.getNumRegs(); i++) {
+            h = (h ^ (TUint32)cpu.getReg(i)) * 16777619u;
+        }
+        return h;
+    }
+
+    TUint64 TBenchRunner::getRssKiB() {
+        //Linux: resident pages are the 2nd field
+        FILE *fp = fopen("/proc/self/statm", "r");
+        unsigned long size = 0, resident = 0;
+        if (0 != fp) {
+            if (2 != fscanf(fp, "%lu %lu", &size, &resident)) {
+                resident = 0;
+            }
+            fclose(fp);
+        }
+        return (TUint64)resident * (sysconf(_SC_PAGESIZE) / 1024);
+    }
+
+    bool TBenchRunner::run(const string &fname, MiscCpu::EEngine engine,
+            std::ostream &os) {
+        const string::size_type slash = fname.rfind('/');
+        TBenchResult res;
+        res.kernel = (string::npos == slash) ? fname : fname.substr(slash + 1);
+        res.engine = engine;
+        res.regBits = cRegBits;
+        res.memBits = m_memBits;
+        res.rssKiB = 0;
+        std::vector<double> loadMs, nsPerInstr, mips;
+        for (unsigned i = 0; i < m_warmup + m_reps; i++) {
+            MiscCpu cpu(0, cRegBits, m_memBits, true, engine);
+            const double t0 = nowSecs();
+            load(cpu, fname);
+            const double t1 = nowSecs();
+            cpu.run();
+            const double secs = nowSecs() - t1;
+            const TUint64 instrs = cpu.getPerfMon()->getInstructionCnt();
+            const TUint32 sum = checksum(cpu);
+            if (0 == i) {
+                res.instrs = instrs;
+                res.checksum = sum;
+            } else if ((instrs != res.instrs) || (sum != res.checksum)) {
+                os << "Error: bench: " << res.kernel << " " << engineName(engine)
+                   << ": run " << i << " differs from run 0" << std::endl;
+                return false;
+            }
+            if (i < m_warmup) {
+                continue;
+            }
+            res.rssKiB = std::max(res.rssKiB, getRssKiB());
+            loadMs.push_back(1e3 * (t1 - t0));
+            nsPerInstr.push_back(1e9 * secs / ((0 != instrs) ? instrs : 1));
+            mips.push_back(instrs / secs / 1e6);
+        }
+        res.loadMs = TBenchSummary(loadMs);
+        res.nsPerInstr = TBenchSummary(nsPerInstr);
+        res.mips = TBenchSummary(mips);
+        os << "Info: bench: " << res.kernel << " " << engineName(engine) << ": "
+           << res.instrs << " instruction(s), " << res.mips.median << " MIPS ("
+           << res.nsPerInstr.median << " ns/instruction, sd "
+           << res.nsPerInstr.stddev << ", median of " << m_reps << "), load "
+           << res.loadMs.median << " ms, RSS " << res.rssKiB << " KiB" << std::endl;
+        for (unsigned i = 0; i < m_results.size(); i++) {
+            const TBenchResult &prev = m_results[i];
+            if ((prev.kernel == res.kernel) && (prev.memBits == res.memBits) &&
+                ((prev.instrs != res.instrs) || (prev.checksum != res.checksum))) {
+                os << "Error: bench: " << res.kernel << ": " << engineName(engine)
+                   << " engine differs from " << engineName(prev.engine) << std::endl;
+                m_results.push_back(res);
+                return false;
+            }
+        }
+        m_results.push_back(res);
+        return true;
+    }
+
+    void TBenchRunner::writeJson(std::ostream &os) const {
+        os << "{\"warmup\": " << m_warmup << ", \"reps\": " << m_reps
+           << ", \"results\": [";
+        for (unsigned i = 0; i < m_results.size(); i++) {
+            const TBenchResult &res = m_results[i];
+            os << ((0 == i) ? "" : ",") << std::endl
+               << "  {\"kernel\": \"" << res.kernel << "\", \"engine\": \""
+               << engineName(res.engine) << "\", \"regBits\": " << res.regBits
+               << ", \"memBits\": " << res.memBits << ", \"instructions\": "
+               << res.instrs << ", \"checksum\": " << res.checksum
+               << ", \"rssKiB\": " << res.rssKiB << "," << std::endl
+               << "   \"loadMs\": ";
+            res.loadMs.writeJson(os);
+            os << ", \"nsPerInstr\": ";
+            res.nsPerInstr.writeJson(os);
+            os << ", \"mips\": ";
+            res.mips.writeJson(os);
+            os << "}";
+        }
+        os << "]}" << std::endl;
+    }
+};
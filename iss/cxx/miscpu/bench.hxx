@@ -0,0 +1,113 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+
+#if !defined(_miscpu_bench_hxx_)
+#    define  _miscpu_bench_hxx_
+
+/*
+ * Benchmark harness (-bench, make bench): guest kernels (any mem
+ * file; the suite is the .s files of asm/bench) on each engine.  Per
+ * kernel and engine: warmup runs, then reps timed runs, each on a fresh
+ * MiscCpu; the load (file to memory) and the run are timed apart.  Reported: instruction
+ * count, a checksum of final pc and registers (must agree across
+ * engines), load ms, ns/instruction and MIPS (min, median, mean and
+ * standard deviation over reps), and process RSS after the run.
+ *
+ * writeJson() is the machine-readable form, for regression tracking:
+ *
+ *      {"warmup": w, "reps": n, "results": [
+ *        {"kernel": "alu.s", "engine": "threaded", "regBits": 5,
+ *         "memBits": 20, "instructions": i, "checksum": c, "rssKiB": k,
+ *         "loadMs": S, "nsPerInstr": S, "mips": S}, ...]}
+ *
+ * where S is {"min": .., "median": .., "mean": .., "stddev": ..}.
+ */
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include "xyzzy/portable.hxx"
+#include "miscpu.hxx"
+
+using std::string;
+using xyzzy::TUint32;
+using xyzzy::TUint64;
+
+namespace miscpu
+{
+    struct TBenchSummary {
+        explicit TBenchSummary()
+            :   min(0), median(0), mean(0), stddev(0) {
+        }
+
+        //Of samples (at least one).
+        explicit TBenchSummary(std::vector<double> samples);
+
+        void writeJson(std::ostream &os) const;
+
+        double  min, median, mean, stddev;
+    };
+
+    struct TBenchResult {
+        string              kernel;     //file name, no directory
+        MiscCpu::EEngine    engine;
+        unsigned            regBits, memBits;
+        TUint64             instrs;
+        TUint32             checksum;
+        TUint64             rssKiB;     //most of the timed runs
+        TBenchSummary       loadMs, nsPerInstr, mips;
+    };
+
+    class TBenchRunner {
+    public:
+        explicit TBenchRunner(unsigned memBits = 20, unsigned warmup = 1,
+                unsigned reps = 5);
+
+        //Benchmark kernel on engine, write a summary line to os.  Return
+        //false (after "Error: ..." to os) if runs of kernel disagree, on
+        //this or an earlier engine, in instruction count or checksum.
+        bool run(const string &fname, MiscCpu::EEngine engine, std::ostream &os);
+
+        const std::vector<TBenchResult>& getResults() const {
+            return m_results;
+        }
+
+        void writeJson(std::ostream &os) const;
+
+        static const char* engineName(MiscCpu::EEngine engine);
+
+    private:
+        //Load fname into cpu as MiscCpu::loadMemory() would (quietly).
+        static void load(MiscCpu &cpu, const string &fname);
+        static TUint32 checksum(const MiscCpu &cpu);
+        static TUint64 getRssKiB();
+
+        const unsigned              m_memBits;
+        const unsigned              m_warmup, m_reps;
+        std::vector<TBenchResult>   m_results;
+    };
+};
+
+#endif  //_miscpu_bench_hxx_
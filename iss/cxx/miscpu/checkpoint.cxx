@@ -0,0 +1,224 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include "xyzzy/assert.hxx"
+#include "checkpoint.hxx"
+#include "miscpu.hxx"
+#include "image.hxx"
+#include "jit.hxx"
+
+namespace miscpu
+{
+    static const char cMagic[4] = {'M', 'C', 'K', 'P'};
+
+    static const TUint32 cFlagCy = 1;
+    static const TUint32 cFlagZero = 2;
+
+    //log2 of power of 2 n.
+    static TUint32 log2(TUint64 n) {
+        TUint32 bits = 0;
+        while ((TUint64)1 << bits < n) {
+            bits++;
+        }
+        return bits;
+    }
+
+    static TUint64 getLe64(const unsigned char *b) {
+        return getLe32(b) | ((TUint64)getLe32(b + 4) << 32);
+    }
+
+    static void putLe64(std::ostream &os, TUint64 v) {
+        putLe32(os, (TUint32)v);
+        putLe32(os, (TUint32)(v >> 32));
+    }
+
+    //Header bytes of version (1, 2 or cVersion).
+    static unsigned headerBytes(TUint32 version) {
+        return (1 == version) ? TCheckpointHeader::cBytesV1
+             : (2 == version) ? TCheckpointHeader::cBytesV2 : TCheckpointHeader::cBytes;
+    }
+
+    static bool parseHeader(const unsigned char *b, TCheckpointHeader &hdr) {
+        if (0 != memcmp(b, cMagic, 4)) {
+            return false;
+        }
+        hdr.version = getLe32(b + 4);
+        hdr.regBits = getLe32(b + 8);
+        hdr.memBits = getLe32(b + 12);
+        hdr.pc = getLe32(b + 16);
+        hdr.flags = getLe32(b + 20);
+        hdr.aluz = getLe32(b + 24);
+        hdr.instrCnt = getLe64(b + 28);
+        hdr.pageCnt = getLe32(b + 36);
+        hdr.imageLen = getLe32(b + 40);
+        const unsigned n = headerBytes(hdr.version);
+        hdr.fusedCnt = (TCheckpointHeader::cBytesV2 <= n) ? getLe64(b + 44) : 0;
+        hdr.callDepth = (TCheckpointHeader::cBytes <= n) ? (long long)getLe64(b + 52) : 0;
+        hdr.storeCnt = (TCheckpointHeader::cBytes <= n) ? getLe64(b + 60) : 0;
+        return true;
+    }
+
+    bool readCheckpointHeader(const string &fname, TCheckpointHeader &hdr) {
+        std::ifstream ifs(fname.c_str(), std::ios::in | std::ios::binary);
+        unsigned char b[TCheckpointHeader::cBytes];
+        ifs.read((char*)b, sizeof(b));
+        return !ifs.fail() && parseHeader(b, hdr);
+    }
+
+    void MiscCpu::saveCheckpoint(string fname) const {
+        const TUint64 cPageWords = TMappedRegion::getPageBytes() / sizeof(TInt32);
+        const TUint64 memWords = m_mem.length();
+        TImage *img = m_imageFname.empty() ? 0 : new TImage(m_imageFname);
+        //dirty: resident (mincore) and not what the image loads there
+        std::vector<TUint64> pages, dirty;
+        std::vector<TInt32> base(cPageWords, 0);
+        m_mem.getResidentPages(pages);
+        for (unsigned i = 0; i < pages.size(); i++) {
+            const TUint64 addr = pages[i] * cPageWords;
+            if (addr >= memWords) {
+                break;
+            }
+            const TUint32 n = ((memWords - addr) < cPageWords) ? (memWords - addr)
+                                                               : cPageWords;
+            if (0 != img) {
+                img->readWords(addr, n, &base[0]);
+            }
+            if (0 != memcmp(&base[0], &m_memBase[addr], sizeof(TInt32) * n)) {
+                dirty.push_back(addr);
+            }
+        }
+        delete img;
+        std::ofstream ofs(fname.c_str(), std::ios::out | std::ios::binary);
+        ASSERT_TRUE(false == ofs.fail());
+        const TUint64 instrCnt = m_perfMon.isNull() ? 0 : m_perfMon->getInstructionCnt();
+        ofs.write(cMagic, 4);
+        putLe32(ofs, TCheckpointHeader::cVersion);
+        putLe32(ofs, cRegsN);
+        putLe32(ofs, log2(memWords));
+        putLe32(ofs, m_pc);
+        evalFlags();
+        putLe32(ofs, (m_cy ? cFlagCy : 0) | (m_zero ? cFlagZero : 0));
+        putLe32(ofs, m_aluz);
+        putLe64(ofs, instrCnt);
+        putLe32(ofs, dirty.size());
+        putLe32(ofs, m_imageFname.length());
+        putLe64(ofs, m_fusedCnt);
+        putLe64(ofs, (TUint64)m_callDepth);
+        putLe64(ofs, m_storeCnt);
+        ofs.write(m_imageFname.data(), m_imageFname.length());
+        for (unsigned i = 0; i < m_regs.length(); i++) {
+            putLe32(ofs, m_regs[i]);
+        }
+        for (unsigned i = 0; i < dirty.size(); i++) {
+            const TUint64 addr = dirty[i];
+            const TUint32 n = ((memWords - addr) < cPageWords) ? (memWords - addr)
+                                                               : cPageWords;
+            putLe32(ofs, addr);
+            putLe32(ofs, n);
+            for (TUint32 j = 0; j < n; j++) {
+                putLe32(ofs, m_memBase[addr + j]);
+            }
+        }
+        ASSERT_TRUE(false == ofs.fail());
+        ofs.close();
+    }
+
+    unsigned MiscCpu::restoreCheckpoint(string fname) {
+        std::ifstream ifs(fname.c_str(), std::ios::in | std::ios::binary);
+        ASSERT_TRUE(false == ifs.fail());
+        std::ostringstream oss;
+        oss << ifs.rdbuf();
+        const string buf = oss.str();
+        const unsigned char *p = (const unsigned char*)buf.data();
+        const unsigned char *const end = p + buf.length();
+        TCheckpointHeader hdr;
+        ASSERT_TRUE((TCheckpointHeader::cBytes <= buf.length()) && parseHeader(p, hdr));
+        ASSERT_TRUE((0 < hdr.version) && (TCheckpointHeader::cVersion >= hdr.version));
+        ASSERT_TRUE((cRegsN == hdr.regBits) && (m_mem.length() == ((TUint64)1 << hdr.memBits)));
+        p += headerBytes(hdr.version);
+        ASSERT_TRUE(hdr.imageLen <= (TUint64)(end - p));
+        const string imageFname((const char*)p, hdr.imageLen);
+        p += hdr.imageLen;
+        //start over: demand zero memory, nothing decoded or translated
+        delete m_jit;
+        m_jit = 0;
+        m_mem.discard();
+        m_decoded.discard();
+        m_imageFname.clear();
+        if (!imageFname.empty()) {
+            const TImage img(imageFname);
+            loadImage(img);
+        }
+        ASSERT_TRUE(sizeof(TInt32) * m_regs.length() <= (TUint64)(end - p));
+        for (unsigned i = 0; i < m_regs.length(); i++, p += sizeof(TInt32)) {
+            m_regs[i] = getLe32(p);
+        }
+        for (TUint32 i = 0; i < hdr.pageCnt; i++) {
+            ASSERT_TRUE(8 <= (end - p));
+            const TUint32 addr = getLe32(p), n = getLe32(p + 4);
+            p += 8;
+            ASSERT_TRUE((addr < m_mem.length()) && (n <= (m_mem.length() - addr)) &&
+                        (sizeof(TInt32) * (TUint64)n <= (TUint64)(end - p)));
+            //m_decoded was discarded: plain copy
+            for (TUint32 j = 0; j < n; j++, p += sizeof(TInt32)) {
+                m_memBase[addr + j] = getLe32(p);
+            }
+        }
+        m_pc = hdr.pc;
+        setZeroCy(0 != (hdr.flags & cFlagZero), 0 != (hdr.flags & cFlagCy));
+        m_aluz = hdr.aluz;
+        m_fusedCnt = hdr.fusedCnt;
+        m_callDepth = hdr.callDepth;
+        m_storeCnt = hdr.storeCnt;
+        m_opCode = OpCode();
+        if (false == m_perfMon.isNull()) {
+            m_perfMon->setInstructionCnt(hdr.instrCnt);
+        }
+        return hdr.pageCnt;
+    }
+
+    unsigned runCheckpointed(MiscCpu &cpu, TUint64 every, const string &prefix) {
+        ASSERT_TRUE(0 < every);
+        unsigned n = 0;
+        TUint64 ran = 0;
+        while (true) {
+            cpu.run(every);
+            if (OpCode::eHalt == cpu.getOpcode()) {
+                return n;
+            }
+            ran += every;
+            std::ostringstream fname;
+            fname << prefix << "."
+                  << (cpu.getPerfMon().isNull() ? ran : cpu.getPerfMon()->getInstructionCnt())
+                  << ".ckp";
+            cpu.saveCheckpoint(fname.str());
+            n++;
+        }
+    }
+};
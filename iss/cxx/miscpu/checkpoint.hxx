@@ -0,0 +1,88 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+
+#if !defined(_miscpu_checkpoint_hxx_)
+#    define  _miscpu_checkpoint_hxx_
+
+#include <string>
+#include "xyzzy/portable.hxx"
+#include "miscpu.hxx"
+
+using std::string;
+using xyzzy::TUint32;
+using xyzzy::TUint64;
+
+namespace miscpu
+{
+    /**
+     * Checkpoint file (see MiscCpu::saveCheckpoint()), all fields
+     * little-endian 32-bit:
+     *
+     *   header      magic "MCKP", version, regBits, memBits, pc,
+     *               flags (1: cy, 2: zero), aluz, instrCnt (lo, hi),
+     *               pageCnt, imageLen, fusedCnt (lo, hi),
+     *               callDepth (lo, hi), storeCnt (lo, hi)
+     *   image       imageLen bytes: file name of the image the state is
+     *               relative to (none if 0)
+     *   registers   2^regBits words
+     *   pages       pageCnt x {addr, n, words[n]}
+     *
+     * Only pages which differ from the image (0 outside of it) are
+     * saved; restore maps the image again and copies them over.
+     * Version 1 headers end at imageLen, version 2 at fusedCnt (the
+     * counts left out are 0).
+     */
+    struct TCheckpointHeader {
+        static const TUint32 cVersion = 3;
+        static const unsigned cBytes = 68;
+        static const unsigned cBytesV1 = 44;
+        static const unsigned cBytesV2 = 52;
+
+        TUint32     version;
+        TUint32     regBits, memBits;
+        TUint32     pc;
+        TUint32     flags;
+        TUint32     aluz;
+        TUint64     instrCnt;
+        TUint32     pageCnt;
+        TUint32     imageLen;
+        TUint64     fusedCnt;   //MiscCpu::getFusedCnt()
+        long long   callDepth;  //MiscCpu::getCallDepth()
+        TUint64     storeCnt;   //MiscCpu::getStoreCnt()
+    };
+
+    //Read header of checkpoint fname; false if not a checkpoint.
+    bool readCheckpointHeader(const string &fname, TCheckpointHeader &hdr);
+
+    /**
+     * Run cpu until eHalt, saving a checkpoint every instructions
+     * (as prefix.N.ckp, N the PerfMon instruction count, else the
+     * count of this run).  Interpreted (see MiscCpu::run(cnt)).
+     * Return number of checkpoints saved.
+     */
+    unsigned runCheckpointed(MiscCpu &cpu, TUint64 every, const string &prefix);
+};
+
+#endif  //_miscpu_checkpoint_hxx_
@@ -0,0 +1,189 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "xyzzy/assert.hxx"
+#include "cosim.hxx"
+#include "opcode.hxx"
+
+namespace miscpu
+{
+    //Decimal field; false if RTL wrote x/z (or garbage).
+    static bool getField(std::istream &is, TUint32 &val) {
+        string tok;
+        if (!(is >> tok)) {
+            return false;
+        }
+        char *end;
+        unsigned long v = strtoul(tok.c_str(), &end, 10);
+        if ((end == tok.c_str()) || ('\0' != *end)) {
+            return false;
+        }
+        val = (TUint32) v;
+        return true;
+    }
+
+    static void makeFifo(const string &fname) {
+        int rval = mkfifo(fname.c_str(), 0600);
+        ASSERT_TRUE((0 == rval) || (EEXIST == errno));
+    }
+
+    TCosim::TCosim(MiscCpu &ref, MiscCpu &bus)
+    :   m_ref(ref), m_bus(bus), m_retired(0) {
+        ASSERT_TRUE(ref.getNumRegs() == bus.getNumRegs());
+        ASSERT_TRUE(ref.getMemDepth() == bus.getMemDepth());
+    }
+
+    bool TCosim::retire(const std::vector<TUint32> &state, std::ostream &os) {
+        const TUint32 pc = m_ref.getPc();
+        std::ostringstream diffs;
+        unsigned ndiffs = 0;
+        if (OpCode::eHalt == m_ref.getOpcode() && (0 < m_retired)) {
+            diffs << "RTL retired past halt" << std::endl;
+            ndiffs++;
+        } else {
+            m_ref.run(1);
+            m_retired++;
+            if (state[0] != m_ref.getPc()) {
+                diffs << "pc=" << state[0] << " (expected " << m_ref.getPc() << ")" << std::endl;
+                ndiffs++;
+            }
+            if (state[1] != (TUint32) m_ref.getZero()) {
+                diffs << "zero=" << state[1] << " (expected " << m_ref.getZero() << ")" << std::endl;
+                ndiffs++;
+            }
+            if (state[2] != (TUint32) m_ref.getCy()) {
+                diffs << "cy=" << state[2] << " (expected " << m_ref.getCy() << ")" << std::endl;
+                ndiffs++;
+            }
+            for (unsigned i = 0; i < m_ref.getNumRegs(); i++) {
+                if ((TInt32) state[3 + i] != m_ref.getReg(i)) {
+                    diffs << "r[" << i << "]=" << (TInt32) state[3 + i]
+                          << " (expected " << m_ref.getReg(i) << ")" << std::endl;
+                    ndiffs++;
+                }
+            }
+            const OpCode::EOp op = m_ref.getOpcode();
+            const unsigned nwrites = (OpCode::eStore == op || OpCode::ePush == op ||
+                                      OpCode::eSwap == op ||
+                                     (OpCode::eCall == op && m_ref.checkCond())) ? 1 : 0;
+            if (nwrites != m_writes.size()) {
+                diffs << "writes=" << m_writes.size() << " (expected " << nwrites << ")" << std::endl;
+                ndiffs++;
+            }
+            for (unsigned i = 0; i < m_writes.size(); i++) {
+                const TUint32 addr = m_writes[i].first;
+                if (m_writes[i].second != m_ref.getMem(addr)) {
+                    diffs << "mem[" << addr << "]=" << m_writes[i].second
+                          << " (expected " << m_ref.getMem(addr) << ")" << std::endl;
+                    ndiffs++;
+                }
+            }
+        }
+        m_writes.clear();
+        if (0 < ndiffs) {
+            os << "Error: cosim: instruction " << m_retired << " at pc " << pc
+               << " (" << OpCode::name(m_ref.getOpcode()) << "): "
+               << ndiffs << " difference(s)" << std::endl
+               << diffs.str();
+        }
+        return (0 == ndiffs);
+    }
+
+    bool TCosim::run(const string &reqFname, const string &rspFname, std::ostream &os) {
+        makeFifo(reqFname);
+        makeFifo(rspFname);
+        //Same open order as RTL side, else both block.
+        std::ifstream req(reqFname.c_str());
+        ASSERT_TRUE(false == req.fail());
+        std::ofstream rsp(rspFname.c_str());
+        ASSERT_TRUE(false == rsp.fail());
+        const unsigned nstate = 3 + m_ref.getNumRegs();
+        std::vector<TUint32> state(nstate);
+        bool ok = true, halted = false;
+        string line;
+        while (ok && !halted && std::getline(req, line)) {
+            std::istringstream is(line);
+            char kind = '\0';
+            is >> kind;
+            TUint32 addr, data;
+            switch (kind) {
+                case 'R':
+                    if (!getField(is, addr) || (addr >= m_bus.getMemDepth())) {
+                        os << "Error: cosim: bad read: " << line << std::endl;
+                        ok = false;
+                    } else {
+                        rsp << "D " << (TUint32) m_bus.getMem(addr) << std::endl;
+                    }
+                    break;
+                case 'W':
+                    if (!getField(is, addr) || !getField(is, data) ||
+                        (addr >= m_bus.getMemDepth())) {
+                        os << "Error: cosim: bad write: " << line << std::endl;
+                        ok = false;
+                    } else {
+                        m_bus.setMem(addr, (TInt32) data);
+                        m_writes.push_back(std::make_pair(addr, (TInt32) data));
+                    }
+                    break;
+                case 'S':
+                    for (unsigned i = 0; ok && (i < nstate); i++) {
+                        ok = getField(is, state[i]);
+                    }
+                    if (!ok) {
+                        os << "Error: cosim: instruction " << (m_retired + 1)
+                           << ": bad (x/z?) state: " << line << std::endl;
+                    } else {
+                        ok = retire(state, os);
+                    }
+                    break;
+                case 'H':
+                    halted = true;
+                    if (OpCode::eHalt != m_ref.getOpcode()) {
+                        os << "Error: cosim: RTL halted at instruction " << m_retired
+                           << ", reference at pc " << m_ref.getPc() << std::endl;
+                        ok = false;
+                    }
+                    break;
+                default:
+                    os << "Error: cosim: bad request: " << line << std::endl;
+                    ok = false;
+            }
+        }
+        if (ok && !halted) {
+            os << "Error: cosim: RTL closed before halt" << std::endl;
+            ok = false;
+        }
+        if (!ok) {
+            rsp << "X" << std::endl;
+        }
+        return ok;
+    }
+};
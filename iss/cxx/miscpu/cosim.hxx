@@ -0,0 +1,95 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+
+#if !defined(_miscpu_cosim_hxx_)
+#    define  _miscpu_cosim_hxx_
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <ostream>
+#include "xyzzy/portable.hxx"
+#include "miscpu.hxx"
+
+using std::string;
+using xyzzy::TUint32;
+using xyzzy::TUint64;
+using xyzzy::TInt32;
+
+namespace miscpu
+{
+    /**
+     * Lockstep co-simulation of an RTL model (see vlog/cosim.v) against
+     * a reference MiscCpu.
+     *
+     * The RTL side writes one transaction per line (decimal fields) to
+     * the request pipe:
+     *
+     *      R addr                  memory read: answered by "D data"
+     *      W addr data             memory write
+     *      S pc zero cy r0 ... rN  state after an instruction retired
+     *      H                       halted (ends the run)
+     *
+     * Only R is answered (on the response pipe), so the RTL runs ahead
+     * of the comparisons: the request stream is read buffered and the
+     * response pipe flushed only for a read.  On S, the reference
+     * executes one instruction and its state (and the W of that
+     * instruction) is compared; at the first difference the next answer
+     * is "X" and run() returns.
+     *
+     * Memory served to the RTL is that of bus (not of ref), so reads
+     * see RTL writes even if they are wrong.
+     */
+    class TCosim {
+    public:
+        explicit TCosim(MiscCpu &ref, MiscCpu &bus);
+
+        //Create (mkfifo) the pipes if need be, serve the RTL until H,
+        //end of requests or a difference (written to os).
+        //Return true if the RTL halted with the reference, no difference.
+        bool run(const string &reqFname, const string &rspFname, std::ostream &os);
+
+        //Instructions compared.
+        TUint64 getRetired() const {
+            return m_retired;
+        }
+
+    private:
+        //not copyable
+        TCosim(const TCosim&);
+        TCosim& operator=(const TCosim&);
+
+        //Step ref, compare against RTL state (pc, zero, cy, regs...).
+        bool retire(const std::vector<TUint32> &state, std::ostream &os);
+
+        MiscCpu     &m_ref;
+        MiscCpu     &m_bus;
+        //RTL writes since last S
+        std::vector<std::pair<TUint32, TInt32> >    m_writes;
+        TUint64     m_retired;
+    };
+};
+
+#endif  //_miscpu_cosim_hxx_
@@ -0,0 +1,403 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+
+#include <algorithm>
+#include <set>
+#include "xyzzy/assert.hxx"
+#include "faultinj.hxx"
+#include "miscpucore.hxx"
+#include "hosttime.hxx"
+
+namespace miscpu
+{
+    //Most injections handed to a worker at once (see take()).
+    static const unsigned cMaxChunk = 256;
+
+    //splitmix64: injection choices, and the memory hash.
+    static TUint64 mix64(TUint64 x) {
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    static TUint64 wordHash(TUint32 addr, TInt32 val) {
+        return mix64(((TUint64)addr << 32) | (TUint32)val);
+    }
+
+    static bool isEarlierAddr(const TUndoLog::TEntry &a, const TUndoLog::TEntry &b) {
+        return a.addr < b.addr;
+    }
+
+    static bool isEarlierTime(const TInjection &a, const TInjection &b) {
+        return a.time < b.time;
+    }
+
+    TFaultCampaign::TFaultCampaign(const string &imageFname, TUint32 interval)
+        :   m_image(imageFname),
+            m_interval(interval),
+            m_goldenLen(0),
+            m_next(0),
+            m_chunk(1) {
+        ASSERT_TRUE(0 < interval);
+        pthread_mutex_init(&m_lock, 0);
+    }
+
+    TFaultCampaign::~TFaultCampaign() {
+        pthread_mutex_destroy(&m_lock);
+    }
+
+    const char* TFaultCampaign::targetName(TInjection::ETarget target) {
+        static const char* const cNames[] = {"reg", "mem", "ir", "flag"};
+        return cNames[target];
+    }
+
+    const char* TFaultCampaign::outcomeName(TFaultResult::EOutcome outcome) {
+        static const char* const cNames[] = {"masked", "sdc", "hang", "crash"};
+        return cNames[outcome];
+    }
+
+    void TFaultCampaign::initCpu(MiscCpu &cpu, TUndoLog &log) const {
+        cpu.loadImage(m_image);
+        cpu.setFaultStops(true);
+        cpu.setUndoLog(&log);
+    }
+
+    TUint64 TFaultCampaign::runFor(MiscCpu &cpu, TUint64 n) {
+        ASSERT_TRUE(0 < n);     //0 would run to eHalt
+        TCountMon counter;
+        cpu.run(counter, n);
+        return counter.getCnt();
+    }
+
+    void TFaultCampaign::save(const MiscCpu &cpu, TState &state) {
+        state.pc = cpu.getPc();
+        state.zero = cpu.getZero();
+        state.cy = cpu.getCy();
+        state.regs.resize(cpu.getNumRegs());
+        for (unsigned i = 0; i < state.regs.size(); i++) {
+            state.regs[i] = cpu.getReg(i);
+        }
+    }
+
+    void TFaultCampaign::restore(MiscCpu &cpu, const TState &state) {
+        cpu.setPc(state.pc);
+        cpu.setZeroCy(state.zero, state.cy);
+        for (unsigned i = 0; i < state.regs.size(); i++) {
+            cpu.setReg(i, state.regs[i]);
+        }
+        cpu.m_opCode = OpCode();    //not eHalt of the faulty run
+        TUint32 addr;
+        cpu.takeStop(addr);
+    }
+
+    bool TFaultCampaign::isSame(const MiscCpu &cpu, const TState &state) {
+        if ((cpu.getPc() != state.pc) || (cpu.getZero() != state.zero) ||
+            (cpu.getCy() != state.cy)) {
+            return false;
+        }
+        for (unsigned i = 0; i < state.regs.size(); i++) {
+            if (cpu.getReg(i) != state.regs[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    TUint64 TFaultCampaign::hashDelta(const MiscCpu &cpu, const TUndoLog &log,
+            TUint64 from, std::vector<TUndoLog::TEntry> &scratch) {
+        //first entry of a word holds its value at from
+        scratch.clear();
+        for (TUint64 pos = from; pos < log.getEnd(); pos++) {
+            scratch.push_back(log.getEntry(pos));
+        }
+        std::stable_sort(scratch.begin(), scratch.end(), isEarlierAddr);
+        TUint64 delta = 0;
+        for (unsigned i = 0; i < scratch.size(); i++) {
+            const TUint32 addr = scratch[i].addr;
+            if ((0 == i) || (scratch[i - 1].addr != addr)) {
+                delta += wordHash(addr, cpu.getMem(addr)) - wordHash(addr, scratch[i].old);
+            }
+        }
+        return delta;
+    }
+
+    bool TFaultCampaign::runGolden(TUint64 maxInstrs, std::ostream &os) {
+        MiscCpu cpu(0, 5, 20, false, MiscCpu::eSwitchEngine);
+        TUndoLog log;
+        initCpu(cpu, log);
+        std::vector<TUndoLog::TEntry> scratch;
+        std::set<TUint32> written;
+        TState state;
+        TUint64 t = 0, hash = 0;
+        m_points.clear();
+        m_goldenLen = 0;
+        save(cpu, state);
+        state.memHash = 0;
+        m_points.push_back(state);
+        while (true) {
+            const TUint64 n = ((0 != maxInstrs) && (maxInstrs - t < m_interval))
+                              ? (maxInstrs - t) : m_interval;
+            if (0 == n) {
+                os << "Error: fi: golden run did not halt in " << maxInstrs
+                   << " instruction(s)" << std::endl;
+                return false;
+            }
+            const TUint64 pos = log.getEnd();
+            t += runFor(cpu, n);
+            for (TUint64 i = pos; i < log.getEnd(); i++) {
+                written.insert(log.getEntry(i).addr);
+            }
+            hash += hashDelta(cpu, log, pos, scratch);
+            log.discard(log.getEnd());
+            TUint32 addr;
+            if (MiscCpu::eNoStop != cpu.takeStop(addr)) {
+                os << "Error: fi: golden run: guest error at " << addr
+                   << " after " << t << " instruction(s)" << std::endl;
+                return false;
+            }
+            save(cpu, state);
+            state.memHash = hash;
+            if (OpCode::eHalt == cpu.getOpcode()) {
+                break;
+            }
+            m_points.push_back(state);
+        }
+        m_final = state;
+        m_goldenLen = t;
+        //memory targets: the image, and what the program writes
+        const TImageHeader &hdr = m_image.getHeader();
+        m_memTargets.clear();
+        for (TUint32 i = 0; i < hdr.wordCnt; i++) {
+            m_memTargets.push_back(hdr.loadAddr + i);
+        }
+        for (std::set<TUint32>::const_iterator it = written.begin(); it != written.end(); ++it) {
+            if ((*it < hdr.loadAddr) || (*it - hdr.loadAddr >= hdr.wordCnt)) {
+                m_memTargets.push_back(*it);
+            }
+        }
+        return true;
+    }
+
+    void TFaultCampaign::generate(unsigned n, TUint32 seed) {
+        ASSERT_TRUE((0 != m_goldenLen) && !m_memTargets.empty());
+        TUint64 rnd = seed;
+        m_injections.resize(n);
+        for (unsigned i = 0; i < n; i++) {
+            TInjection &inj = m_injections[i];
+            inj.time = mix64(rnd++) % m_goldenLen;
+            inj.target = (TInjection::ETarget)(mix64(rnd++) % TInjection::eTargets);
+            const TUint64 r = mix64(rnd++);
+            switch (inj.target) {
+                case TInjection::eReg:
+                    inj.where = r % m_final.regs.size();
+                    break;
+                case TInjection::eMem:
+                    inj.where = m_memTargets[r % m_memTargets.size()];
+                    break;
+                case TInjection::eFlag:
+                    inj.where = r % 2;
+                    break;
+                default:
+                    inj.where = 0;
+            }
+            inj.bit = mix64(rnd++) % 32;
+        }
+        std::stable_sort(m_injections.begin(), m_injections.end(), isEarlierTime);
+        m_results.assign(n, TFaultResult());
+    }
+
+    double TFaultCampaign::run(unsigned nthreads) {
+        ASSERT_TRUE(0 < nthreads);
+        m_next = 0;
+        m_chunk = m_injections.size() / (16 * nthreads);
+        m_chunk = (0 == m_chunk) ? 1 : std::min(m_chunk, cMaxChunk);
+        std::vector<TWorker> workers(nthreads);
+        std::vector<pthread_t> tids(nthreads);
+        const double t0 = nowSecs();
+        for (unsigned i = 0; i < nthreads; i++) {
+            workers[i].campaign = this;
+            //worker 0 is this thread
+            if (0 < i) {
+                ASSERT_TRUE(0 == pthread_create(&tids[i], 0, worker, &workers[i]));
+            }
+        }
+        worker(&workers[0]);
+        for (unsigned i = 1; i < nthreads; i++) {
+            pthread_join(tids[i], 0);
+        }
+        return nowSecs() - t0;
+    }
+
+    void* TFaultCampaign::worker(void *arg) {
+        ((TWorker*)arg)->campaign->runWorker();
+        return 0;
+    }
+
+    bool TFaultCampaign::take(unsigned &lo, unsigned &hi) {
+        //in order: each worker's injections only move forward in time
+        pthread_mutex_lock(&m_lock);
+        lo = m_next;
+        hi = std::min<unsigned>(lo + m_chunk, m_injections.size());
+        m_next = hi;
+        pthread_mutex_unlock(&m_lock);
+        return lo < hi;
+    }
+
+    void TFaultCampaign::runWorker() {
+        MiscCpu cpu(0, 5, 20, false, MiscCpu::eSwitchEngine);
+        TUndoLog log;
+        initCpu(cpu, log);
+        std::vector<TUndoLog::TEntry> scratch;
+        TUint64 now = 0, hash = 0;
+        unsigned lo, hi;
+        while (take(lo, hi)) {
+            for (unsigned job = lo; job < hi; job++) {
+                const TUint64 time = m_injections[job].time;
+                if (now < time) {
+                    //golden: no stop before m_goldenLen
+                    const TUint64 pos = log.getEnd();
+                    now += runFor(cpu, time - now);
+                    hash += hashDelta(cpu, log, pos, scratch);
+                    log.discard(log.getEnd());
+                }
+                ASSERT_TRUE(now == time);
+                inject(cpu, log, job, hash, scratch);
+            }
+        }
+    }
+
+    void TFaultCampaign::inject(MiscCpu &cpu, TUndoLog &log, unsigned job,
+            TUint64 memHash, std::vector<TUndoLog::TEntry> &scratch) {
+        const TInjection &inj = m_injections[job];
+        TFaultResult &res = m_results[job];
+        TState golden;
+        save(cpu, golden);
+        const TUint64 pos = log.getEnd(), hangAt = 2 * m_goldenLen;
+        const TUint32 mask = 1u << inj.bit;
+        TUint64 t = inj.time, from = pos, hash = memHash;
+        switch (inj.target) {
+            case TInjection::eReg:
+                cpu.setReg(inj.where, cpu.getReg(inj.where) ^ mask);
+                break;
+            case TInjection::eMem:
+                cpu.setMem(inj.where, cpu.getMem(inj.where) ^ mask);
+                break;
+            case TInjection::eIr: {
+                //one fetch of the flipped word; memory keeps it unless
+                //the instruction itself overwrote it
+                const TUint32 pc = golden.pc;
+                const TInt32 word = cpu.getMem(pc);
+                cpu.setMem(pc, word ^ mask);
+                t += runFor(cpu, 1);
+                if ((word ^ mask) == (TUint32)cpu.getMem(pc)) {
+                    cpu.setMem(pc, word);
+                }
+                break;
+            }
+            default:
+                cpu.setZeroCy(cpu.getZero() != (0 == inj.where),
+                              cpu.getCy() != (1 == inj.where));
+        }
+        res.converged = false;
+        while (true) {
+            TUint32 addr;
+            if (MiscCpu::eNoStop != cpu.takeStop(addr)) {
+                res.outcome = TFaultResult::eCrash;
+                break;
+            }
+            hash += hashDelta(cpu, log, from, scratch);
+            from = log.getEnd();
+            if (OpCode::eHalt == cpu.getOpcode()) {
+                res.outcome = (isSame(cpu, m_final) && (hash == m_final.memHash))
+                              ? TFaultResult::eMasked : TFaultResult::eSdc;
+                break;
+            }
+            const TUint64 k = t / m_interval;
+            if ((0 == t % m_interval) && (k < m_points.size()) &&
+                isSame(cpu, m_points[k]) && (hash == m_points[k].memHash)) {
+                res.outcome = TFaultResult::eMasked;
+                res.converged = true;
+                break;
+            }
+            if (t >= hangAt) {
+                res.outcome = TFaultResult::eHang;
+                break;
+            }
+            t += runFor(cpu, std::min((k + 1) * m_interval, hangAt) - t);
+        }
+        res.instrs = t - inj.time;
+        //back to golden: the log must not record its own undo
+        cpu.setUndoLog(0);
+        log.undo(cpu, pos);
+        cpu.setUndoLog(&log);
+        restore(cpu, golden);
+    }
+
+    void TFaultCampaign::writeReport(std::ostream &os, double secs, unsigned nthreads) const {
+        const unsigned n = m_results.size();
+        os << "Info: fi: golden run " << m_goldenLen << " instruction(s), "
+           << m_points.size() << " point(s) every " << m_interval << ", "
+           << m_memTargets.size() << " memory word(s) to inject" << std::endl;
+        os << "Info: fi: " << n << " injection(s) on " << nthreads << " thread(s) in "
+           << secs << " s (" << ((0 < secs) ? (n / secs) : 0.0)
+           << " injections/sec)" << std::endl;
+        unsigned cnt[TFaultResult::eOutcomes][TInjection::eTargets + 1] = {{0}};
+        unsigned converged = 0;
+        TUint64 instrs = 0;
+        for (unsigned i = 0; i < n; i++) {
+            const TFaultResult &res = m_results[i];
+            cnt[res.outcome][m_injections[i].target]++;
+            cnt[res.outcome][TInjection::eTargets]++;
+            converged += res.converged ? 1 : 0;
+            instrs += res.instrs;
+        }
+        os << "Info: fi: outcome";
+        for (unsigned t = 0; t < TInjection::eTargets; t++) {
+            os << " " << targetName((TInjection::ETarget)t);
+        }
+        os << " total" << std::endl;
+        for (unsigned o = 0; o < TFaultResult::eOutcomes; o++) {
+            os << "Info: fi: " << outcomeName((TFaultResult::EOutcome)o);
+            for (unsigned t = 0; t <= TInjection::eTargets; t++) {
+                os << " " << cnt[o][t];
+            }
+            os << " (" << ((0 != n) ? (100.0 * cnt[o][TInjection::eTargets] / n) : 0.0)
+               << "%)" << std::endl;
+        }
+        os << "Info: fi: " << converged << " masked before halt; faulty runs "
+           << ((0 != n) ? ((double)instrs / n) : 0.0) << " instruction(s) on average"
+           << std::endl;
+    }
+
+    void TFaultCampaign::writeCsv(std::ostream &os) const {
+        for (unsigned i = 0; i < m_results.size(); i++) {
+            const TInjection &inj = m_injections[i];
+            const TFaultResult &res = m_results[i];
+            os << inj.time << "," << targetName(inj.target) << "," << inj.where
+               << "," << inj.bit << "," << outcomeName(res.outcome) << ","
+               << (res.converged ? 1 : 0) << "," << res.instrs << std::endl;
+        }
+    }
+};
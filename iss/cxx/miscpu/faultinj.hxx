@@ -0,0 +1,169 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+
+#if !defined(_miscpu_faultinj_hxx_)
+#    define  _miscpu_faultinj_hxx_
+
+/*
+ * Fault-injection campaigns: single bit flips in a register, a memory
+ * word, the instruction being fetched (as if in an instruction
+ * register: memory keeps the word) or a flag, each at some instruction
+ * count of a golden (fault-free) run of an image, classified as
+ *
+ *      masked      converged back to the golden state, or halted in it
+ *      sdc         halted in another state (silent data corruption)
+ *      hang        still running at twice the golden run's length
+ *      crash       guest error (see MiscCpu::setFaultStops())
+ *
+ * The golden run records state every interval instructions: pc, flags,
+ * registers and a hash of memory (sum over words of a hash of address
+ * and value, kept as a difference from the image, so it is updated from
+ * the undo log: see reverse.hxx).  A faulty run is compared with it at
+ * each of those points and ends as masked at the first match.
+ *
+ * Injections are run in order of time.  Each worker thread keeps one
+ * MiscCpu on the golden run: it executes forward to the next injection
+ * time, saves registers, injects and runs, then undoes the faulty run's
+ * memory writes and restores the registers.  So an injection costs its
+ * faulty run plus, per worker, one pass over the golden run.
+ */
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <pthread.h>
+#include "xyzzy/portable.hxx"
+#include "miscpu.hxx"
+#include "image.hxx"
+#include "reverse.hxx"
+
+using std::string;
+using xyzzy::TUint32;
+using xyzzy::TUint64;
+using xyzzy::TInt32;
+
+namespace miscpu
+{
+    struct TInjection {
+        enum ETarget {
+            eReg, eMem, eIr, eFlag, eTargets
+        };
+
+        TUint64     time;       //after this many golden instructions
+        ETarget     target;
+        TUint32     where;      //register, memory word, flag (0 zero, 1 cy)
+        unsigned    bit;
+    };
+
+    struct TFaultResult {
+        enum EOutcome {
+            eMasked, eSdc, eHang, eCrash, eOutcomes
+        };
+
+        EOutcome    outcome;
+        bool        converged;  //masked before halt
+        TUint64     instrs;     //of the faulty run
+    };
+
+    class TFaultCampaign {
+    public:
+        explicit TFaultCampaign(const string &imageFname, TUint32 interval = 4096);
+
+        ~TFaultCampaign();
+
+        //Golden run, at most maxInstrs (0: to eHalt); false if it did not
+        //halt (or hit a guest error): no injections are possible then.
+        bool runGolden(TUint64 maxInstrs, std::ostream &os);
+
+        //n injections, uniform in time and kind of target, then uniform
+        //in register, memory word (of the image or written by the golden
+        //run), flag and bit.
+        void generate(unsigned n, TUint32 seed);
+
+        //Run all injections on nthreads workers; return elapsed seconds.
+        double run(unsigned nthreads);
+
+        //Golden run, injections/sec and outcome per kind of target.
+        void writeReport(std::ostream &os, double secs, unsigned nthreads) const;
+
+        //Rows of: time,target,where,bit,outcome,converged,instructions
+        void writeCsv(std::ostream &os) const;
+
+        static const char* targetName(TInjection::ETarget target);
+        static const char* outcomeName(TFaultResult::EOutcome outcome);
+
+    private:
+        //State at one point of the golden run (memHash: see above).
+        struct TState {
+            TUint32             pc;
+            bool                zero, cy;
+            std::vector<TInt32> regs;
+            TUint64             memHash;
+        };
+
+        struct TWorker {
+            TFaultCampaign  *campaign;
+        };
+
+        //not copyable (owns m_lock)
+        TFaultCampaign(const TFaultCampaign&);
+        TFaultCampaign& operator=(const TFaultCampaign&);
+
+        static void* worker(void *arg);
+
+        //Next injections [lo, hi) to run, in time order.
+        bool take(unsigned &lo, unsigned &hi);
+        void runWorker();
+        //Run injection job from the golden state of cpu (memHash its
+        //memory hash); leave cpu in that state again.
+        void inject(MiscCpu &cpu, TUndoLog &log, unsigned job, TUint64 memHash,
+                std::vector<TUndoLog::TEntry> &scratch);
+
+        //cpu of the campaign (image loaded, log attached).
+        void initCpu(MiscCpu &cpu, TUndoLog &log) const;
+        //Run cpu at most n instructions; return how many ran.
+        static TUint64 runFor(MiscCpu &cpu, TUint64 n);
+        static void save(const MiscCpu &cpu, TState &state);
+        static void restore(MiscCpu &cpu, const TState &state);
+        //Registers, pc and flags as state's.
+        static bool isSame(const MiscCpu &cpu, const TState &state);
+        //Change of memory hash by log [from, getEnd()).
+        static TUint64 hashDelta(const MiscCpu &cpu, const TUndoLog &log, TUint64 from,
+                std::vector<TUndoLog::TEntry> &scratch);
+
+        const TImage                m_image;
+        const TUint32               m_interval;
+        std::vector<TState>         m_points;   //at k * m_interval
+        TState                      m_final;
+        TUint64                     m_goldenLen;
+        std::vector<TUint32>        m_memTargets;
+        std::vector<TInjection>     m_injections;   //by time
+        std::vector<TFaultResult>   m_results;
+        pthread_mutex_t             m_lock;
+        unsigned                    m_next, m_chunk;    //see take()
+    };
+};
+
+#endif  //_miscpu_faultinj_hxx_
@@ -0,0 +1,653 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <sstream>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "xyzzy/assert.hxx"
+#include "gdbstub.hxx"
+#include "miscpucore.hxx"
+#include "monitors.hxx"
+
+namespace miscpu
+{
+    static const unsigned cWordBytes = 4;
+    //Instructions between polls for ^C while continuing.
+    static const TUint64 cChunk = 1 << 20;
+    //Our PacketSize (hex in qSupported); bounds m replies.
+    static const unsigned cPacketSize = 0x1000;
+
+    static const char cHexDigits[] = "0123456789abcdef";
+
+    static int hexVal(char c) {
+        if (('0' <= c) && ('9' >= c)) return c - '0';
+        if (('a' <= c) && ('f' >= c)) return c - 'a' + 10;
+        if (('A' <= c) && ('F' >= c)) return c - 'A' + 10;
+        return -1;
+    }
+
+    static void appendByte(string &s, unsigned b) {
+        s += cHexDigits[(b >> 4) & 0xf];
+        s += cHexDigits[b & 0xf];
+    }
+
+    //As target bytes: little-endian.
+    static void appendWord(string &s, TUint32 w) {
+        for (unsigned i = 0; i < cWordBytes; i++, w >>= 8) {
+            appendByte(s, w);
+        }
+    }
+
+    static string hexNum(TUint32 n) {
+        char buf[16];
+        sprintf(buf, "%x", n);
+        return buf;
+    }
+
+    //Parse hex at s[pos], advance pos past it; false if none.
+    static bool parseHex(const string &s, string::size_type &pos, TUint32 &val) {
+        const string::size_type begin = pos;
+        val = 0;
+        for (int d; (pos < s.length()) && (0 <= (d = hexVal(s[pos]))); pos++) {
+            val = (val << 4) | d;
+        }
+        return pos != begin;
+    }
+
+    //Little-endian word from 8 hex digits at s[pos]; false if short.
+    static bool parseWord(const string &s, string::size_type pos, TUint32 &val) {
+        val = 0;
+        if (s.length() < pos + 2 * cWordBytes) {
+            return false;
+        }
+        for (unsigned i = 0; i < cWordBytes; i++) {
+            const int hi = hexVal(s[pos + 2*i]), lo = hexVal(s[pos + 2*i + 1]);
+            if ((0 > hi) || (0 > lo)) {
+                return false;
+            }
+            val |= (TUint32)((hi << 4) | lo) << (8 * i);
+        }
+        return true;
+    }
+
+    TGdbStub::TGdbStub(MiscCpu &cpu)
+        :   m_cpu(cpu),
+            m_engine(cpu.getEngine()),
+            m_listenFd(-1),
+            m_fd(-1),
+            m_bufPos(0),
+            m_bufEnd(0),
+            m_noAck(false),
+            m_state(eRunning),
+            m_lastStop("S05") {
+    }
+
+    TGdbStub::~TGdbStub() {
+        clearPoints();
+        close();
+    }
+
+    void TGdbStub::close() {
+        if (0 <= m_fd) {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+        if (0 <= m_listenFd) {
+            ::close(m_listenFd);
+            m_listenFd = -1;
+        }
+        if (!m_unixPath.empty()) {
+            unlink(m_unixPath.c_str());
+            m_unixPath.clear();
+        }
+    }
+
+    bool TGdbStub::listen(const string &addr, std::ostream &os) {
+        const bool isPort = !addr.empty() &&
+                            (addr.find_first_not_of("0123456789") == string::npos);
+        int rval;
+        if (isPort) {
+            sockaddr_in sa;
+            memset(&sa, 0, sizeof(sa));
+            sa.sin_family = AF_INET;
+            sa.sin_port = htons(atoi(addr.c_str()));
+            sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            m_listenFd = socket(AF_INET, SOCK_STREAM, 0);
+            if (0 <= m_listenFd) {
+                const int on = 1;
+                setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+            }
+            rval = (0 > m_listenFd) ? -1 : bind(m_listenFd, (sockaddr*)&sa, sizeof(sa));
+        } else {
+            sockaddr_un sa;
+            memset(&sa, 0, sizeof(sa));
+            sa.sun_family = AF_UNIX;
+            if (addr.length() >= sizeof(sa.sun_path)) {
+                os << "Error: gdb: socket path too long: " << addr << std::endl;
+                return false;
+            }
+            strcpy(sa.sun_path, addr.c_str());
+            unlink(addr.c_str());
+            m_listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+            rval = (0 > m_listenFd) ? -1 : bind(m_listenFd, (sockaddr*)&sa, sizeof(sa));
+            if (0 == rval) {
+                m_unixPath = addr;
+            }
+        }
+        if ((0 != rval) || (0 != ::listen(m_listenFd, 1))) {
+            os << "Error: gdb: cannot listen on " << addr << ": "
+               << strerror(errno) << std::endl;
+            close();
+            return false;
+        }
+        os << "Info: gdb: listening on " << (isPort ? "localhost:" : "") << addr
+           << std::endl;
+        m_fd = accept(m_listenFd, 0, 0);
+        if (0 > m_fd) {
+            os << "Error: gdb: accept: " << strerror(errno) << std::endl;
+            close();
+            return false;
+        }
+        if (isPort) {
+            const int on = 1;
+            setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        }
+        os << "Info: gdb: connected" << std::endl;
+        return true;
+    }
+
+    int TGdbStub::getChar() {
+        if (m_bufPos == m_bufEnd) {
+            if (0 > m_fd) {
+                return -1;
+            }
+            ssize_t n;
+            do {
+                n = recv(m_fd, m_buf, sizeof(m_buf), 0);
+            } while ((0 > n) && (EINTR == errno));
+            if (0 >= n) {
+                return -1;
+            }
+            m_bufPos = 0;
+            m_bufEnd = n;
+        }
+        return (unsigned char)m_buf[m_bufPos++];
+    }
+
+    bool TGdbStub::isInterrupt() {
+        if (m_bufPos == m_bufEnd) {
+            pollfd pfd;
+            pfd.fd = m_fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            if ((0 > m_fd) || (0 >= poll(&pfd, 1, 0))) {
+                return false;
+            }
+        }
+        const int c = getChar();
+        if (0x03 == c) {
+            return true;
+        }
+        if (0 <= c) {
+            m_bufPos--;     //a packet: read once stopped
+        }
+        return false;
+    }
+
+    bool TGdbStub::readPacket(string &pkt) {
+        while (true) {
+            int c;
+            //skip acks and ^C to the start of a packet
+            while ('$' != (c = getChar())) {
+                if (0 > c) {
+                    return false;
+                }
+            }
+            pkt.clear();
+            unsigned sum = 0;
+            while ('#' != (c = getChar())) {
+                if (0 > c) {
+                    return false;
+                }
+                pkt += (char)c;
+                sum += c;
+            }
+            const int hi = getChar(), lo = getChar();
+            if (0 > lo) {
+                return false;
+            }
+            if (m_noAck) {
+                return true;
+            }
+            const bool ok = ((0 <= hexVal(hi)) && (0 <= hexVal(lo)) &&
+                             ((sum & 0xff) == (unsigned)((hexVal(hi) << 4) | hexVal(lo))));
+            const char ack = ok ? '+' : '-';
+            send(m_fd, &ack, 1, MSG_NOSIGNAL);
+            if (ok) {
+                return true;
+            }
+        }
+    }
+
+    void TGdbStub::writePacket(const string &data) {
+        unsigned sum = 0;
+        for (string::size_type i = 0; i < data.length(); i++) {
+            sum += (unsigned char)data[i];
+        }
+        string pkt = "$" + data + "#";
+        appendByte(pkt, sum);
+        while (0 <= m_fd) {
+            for (string::size_type sent = 0; sent < pkt.length(); ) {
+                const ssize_t n = send(m_fd, pkt.data() + sent, pkt.length() - sent,
+                                       MSG_NOSIGNAL);
+                if (0 > n) {
+                    if (EINTR == errno) {
+                        continue;
+                    }
+                    return;
+                }
+                sent += n;
+            }
+            if (m_noAck) {
+                return;
+            }
+            int c;
+            while (('+' != (c = getChar())) && ('-' != c)) {
+                if (0 > c) {
+                    return;
+                }
+            }
+            if ('+' == c) {
+                return;
+            }
+        }
+    }
+
+    bool TGdbStub::serve(const string &addr, std::ostream &os) {
+        if (!listen(addr, os)) {
+            return false;
+        }
+        string pkt;
+        while ((eRunning == m_state) && readPacket(pkt)) {
+            const string reply = handle(pkt);
+            if (eKilled != m_state) {
+                writePacket(reply);
+            }
+            if ("QStartNoAckMode" == pkt) {
+                m_noAck = true;
+            }
+        }
+        clearPoints();
+        close();
+        os << "Info: gdb: " << ((eDetached == m_state) ? "detached"
+                                : (eKilled == m_state) ? "killed" : "closed")
+           << std::endl;
+        return eDetached == m_state;
+    }
+
+    string TGdbStub::handle(const string &pkt) {
+        if (pkt.empty()) {
+            return "";
+        }
+        const string args = pkt.substr(1);
+        switch (pkt[0]) {
+            case '?':
+                return m_lastStop;
+            case 'g':
+                return readRegs();
+            case 'G':
+                return writeRegs(args);
+            case 'p': {
+                string::size_type pos = 0;
+                TUint32 ix;
+                if (!parseHex(args, pos, ix) || (ix > m_cpu.getNumRegs() + 1)) {
+                    return "E01";
+                }
+                string reply;
+                appendWord(reply, getReg(ix));
+                return reply;
+            }
+            case 'P': {
+                string::size_type pos = 0;
+                TUint32 ix, val;
+                if (!parseHex(args, pos, ix) || (ix > m_cpu.getNumRegs() + 1) ||
+                    (pos >= args.length()) || ('=' != args[pos]) ||
+                    !parseWord(args, pos + 1, val)) {
+                    return "E01";
+                }
+                setReg(ix, val);
+                return "OK";
+            }
+            case 'm':
+                return readMem(args);
+            case 'M':
+                return writeMem(args);
+            case 'c':
+            case 's':
+                if (!args.empty()) {
+                    string::size_type pos = 0;
+                    TUint32 addr;
+                    if (!parseHex(args, pos, addr)) {
+                        return "E01";
+                    }
+                    m_cpu.setPc(addr / cWordBytes);
+                }
+                return resume('s' == pkt[0]);
+            case 'v':
+                if ("vCont?" == pkt) {
+                    return "vCont;c;C;s;S";
+                }
+                if (0 == pkt.compare(0, 6, "vCont;")) {
+                    //one thread: the first action is the one
+                    const char action = (pkt.length() > 6) ? pkt[6] : 'c';
+                    return resume(('s' == action) || ('S' == action));
+                }
+                return "";
+            case 'Z':
+            case 'z':
+                return setPoint(args, 'Z' == pkt[0]);
+            case 'q':
+                if (0 == pkt.compare(0, 10, "qSupported")) {
+                    return "PacketSize=" + hexNum(cPacketSize) +
+                           ";qXfer:features:read+;QStartNoAckMode+";
+                }
+                if (0 == pkt.compare(0, 31, "qXfer:features:read:target.xml:")) {
+                    return readFeatures(pkt.substr(31));
+                }
+                if ("qAttached" == pkt) {
+                    return "1";
+                }
+                if ("qC" == pkt) {
+                    return "QC1";
+                }
+                if ("qfThreadInfo" == pkt) {
+                    return "m1";
+                }
+                if ("qsThreadInfo" == pkt) {
+                    return "l";
+                }
+                return "";
+            case 'Q':
+                return ("QStartNoAckMode" == pkt) ? "OK" : "";
+            case 'H':
+            case 'T':
+                return "OK";
+            case 'D':
+                m_state = eDetached;
+                return "OK";
+            case 'k':
+                m_state = eKilled;
+                return "";
+            default:
+                return "";
+        }
+    }
+
+    string TGdbStub::resume(bool step) {
+        if ('W' == m_lastStop[0]) {
+            return m_lastStop;      //halted: nothing to run
+        }
+        TUint32 addr;
+        m_cpu.takeStop(addr);       //stale: from M or P
+        m_cpu.setEngine(m_watches.empty() ? m_engine : MiscCpu::eSwitchEngine);
+        //Step off a breakpoint at pc: run its instruction, not the trap.
+        const TUint32 pc = m_cpu.getPc() & (m_cpu.getMemDepth() - 1);
+        const bool over = (0 != m_breaks.count(pc));
+        if (over) {
+            m_cpu.clearTrap(pc);
+        }
+        TNullMon none;
+        MiscCpu::EStop stop;
+        m_cpu.run(none, 1);
+        if (over) {
+            m_cpu.setTrap(pc);
+        }
+        stop = m_cpu.takeStop(addr);
+        bool interrupted = false;
+        if (!step) {
+            while ((MiscCpu::eNoStop == stop) &&
+                   (OpCode::eHalt != m_cpu.getOpcode()) &&
+                   !(interrupted = isInterrupt())) {
+                m_cpu.run(none, cChunk);
+                stop = m_cpu.takeStop(addr);
+            }
+        }
+        m_lastStop = stopReply(stop, addr, interrupted);
+        return m_lastStop;
+    }
+
+    string TGdbStub::stopReply(MiscCpu::EStop stop, TUint32 addr, bool interrupted) {
+        switch (stop) {
+            case MiscCpu::eTrapStop: {
+                //the trap was counted as an instruction
+                TRcPerfMon pmon = m_cpu.getPerfMon();
+                if (!pmon.isNull()) {
+                    pmon->setInstructionCnt(pmon->getInstructionCnt() - 1);
+                }
+                return "S05";
+            }
+            case MiscCpu::eWatchStop:
+                return "T05watch:" + hexNum(addr * cWordBytes) + ";";
+            default:
+                break;
+        }
+        if (OpCode::eHalt == m_cpu.getOpcode()) {
+            return "W00";
+        }
+        return interrupted ? "S02" : "S05";
+    }
+
+    TInt32 TGdbStub::getReg(unsigned ix) const {
+        const unsigned n = m_cpu.getNumRegs();
+        if (ix < n) {
+            return m_cpu.getReg(ix);
+        }
+        if (ix == n) {
+            return (m_cpu.getPc() & (m_cpu.getMemDepth() - 1)) * cWordBytes;
+        }
+        return (m_cpu.getZero() ? 1 : 0) | (m_cpu.getCy() ? 2 : 0);
+    }
+
+    void TGdbStub::setReg(unsigned ix, TInt32 val) {
+        const unsigned n = m_cpu.getNumRegs();
+        if (ix < n) {
+            m_cpu.setReg(ix, val);
+        } else if (ix == n) {
+            m_cpu.setPc((TUint32)val / cWordBytes);
+        } else {
+            m_cpu.setZeroCy(0 != (val & 1), 0 != (val & 2));
+        }
+    }
+
+    string TGdbStub::readRegs() const {
+        string reply;
+        for (unsigned ix = 0; ix < m_cpu.getNumRegs() + 2; ix++) {
+            appendWord(reply, getReg(ix));
+        }
+        return reply;
+    }
+
+    string TGdbStub::writeRegs(const string &hex) {
+        const unsigned n = m_cpu.getNumRegs() + 2;
+        TUint32 val;
+        for (unsigned ix = 0; ix < n; ix++) {
+            if (!parseWord(hex, 2 * cWordBytes * ix, val)) {
+                return "E01";
+            }
+        }
+        for (unsigned ix = 0; ix < n; ix++) {
+            parseWord(hex, 2 * cWordBytes * ix, val);
+            setReg(ix, val);
+        }
+        return "OK";
+    }
+
+    string TGdbStub::readMem(const string &args) const {
+        string::size_type pos = 0;
+        TUint32 addr, len;
+        if (!parseHex(args, pos, addr) || (pos >= args.length()) ||
+            (',' != args[pos]) || !parseHex(args, ++pos, len)) {
+            return "E01";
+        }
+        if (len > cPacketSize / 2) {
+            len = cPacketSize / 2;
+        }
+        string reply;
+        const TUint64 depth = m_cpu.getMemDepth();
+        for (TUint32 i = 0; i < len; i++) {
+            const TUint32 b = addr + i;
+            if (b / cWordBytes >= depth) {
+                break;
+            }
+            appendByte(reply, (TUint32)m_cpu.getMem(b / cWordBytes) >> (8 * (b % cWordBytes)));
+        }
+        return ((0 != len) && reply.empty()) ? "E14" : reply;
+    }
+
+    string TGdbStub::writeMem(const string &args) {
+        string::size_type pos = 0;
+        TUint32 addr, len;
+        if (!parseHex(args, pos, addr) || (pos >= args.length()) ||
+            (',' != args[pos]) || !parseHex(args, ++pos, len) ||
+            (pos >= args.length()) || (':' != args[pos]) ||
+            (args.length() - pos - 1 != 2 * (string::size_type)len)) {
+            return "E01";
+        }
+        const TUint64 depth = m_cpu.getMemDepth();
+        if ((0 != len) && ((TUint64)addr + len - 1) / cWordBytes >= depth) {
+            return "E14";
+        }
+        for (TUint32 i = 0; i < len; i++) {
+            const int hi = hexVal(args[pos + 1 + 2*i]), lo = hexVal(args[pos + 2 + 2*i]);
+            if ((0 > hi) || (0 > lo)) {
+                return "E01";
+            }
+            const TUint32 b = addr + i, w = b / cWordBytes, shift = 8 * (b % cWordBytes);
+            const TUint32 old = m_cpu.getMem(w);
+            m_cpu.setMem(w, (old & ~(0xffu << shift)) | ((TUint32)((hi << 4) | lo) << shift));
+        }
+        return "OK";
+    }
+
+    string TGdbStub::setPoint(const string &args, bool set) {
+        string::size_type pos = 0;
+        TUint32 type, addr, kind;
+        if (!parseHex(args, pos, type) || (pos >= args.length()) ||
+            (',' != args[pos]) || !parseHex(args, ++pos, addr) ||
+            (pos >= args.length()) || (',' != args[pos]) || !parseHex(args, ++pos, kind)) {
+            return "E01";
+        }
+        const TUint64 depth = m_cpu.getMemDepth();
+        switch (type) {
+            case 0:     //software and hardware breakpoints: both traps
+            case 1: {
+                const TUint32 w = addr / cWordBytes;
+                if ((0 != addr % cWordBytes) || (w >= depth)) {
+                    return "E01";
+                }
+                if (set) {
+                    m_breaks.insert(w);
+                    m_cpu.setTrap(w);
+                } else if (0 != m_breaks.erase(w)) {
+                    m_cpu.clearTrap(w);
+                }
+                return "OK";
+            }
+            case 2: {   //write watchpoint: every word it overlaps
+                if ((0 == kind) || ((TUint64)addr + kind - 1) / cWordBytes >= depth) {
+                    return "E01";
+                }
+                const TUint32 last = (addr + kind - 1) / cWordBytes;
+                for (TUint32 w = addr / cWordBytes; w <= last; w++) {
+                    if (set) {
+                        if (1 == ++m_watches[w]) {
+                            m_cpu.setWatch(w);
+                        }
+                    } else {
+                        std::map<TUint32, unsigned>::iterator it = m_watches.find(w);
+                        if ((m_watches.end() != it) && (0 == --it->second)) {
+                            m_watches.erase(it);
+                            m_cpu.clearWatch(w);
+                        }
+                    }
+                }
+                return "OK";
+            }
+            default:    //read and access watchpoints: loads are not hooked
+                return "";
+        }
+    }
+
+    string TGdbStub::readFeatures(const string &args) const {
+        string::size_type pos = 0;
+        TUint32 offset, len;
+        if (!parseHex(args, pos, offset) || (pos >= args.length()) ||
+            (',' != args[pos]) || !parseHex(args, ++pos, len)) {
+            return "E01";
+        }
+        std::ostringstream xml;
+        xml << "<?xml version=\"1.0\"?>"
+            << "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+            << "<target version=\"1.0\"><feature name=\"org.miscpu.core\">";
+        for (unsigned ix = 0; ix < m_cpu.getNumRegs(); ix++) {
+            xml << "<reg name=\"r" << ix << "\" bitsize=\"32\" type=\"int32\"/>";
+        }
+        xml << "<reg name=\"pc\" bitsize=\"32\" type=\"code_ptr\"/>"
+            << "<reg name=\"flags\" bitsize=\"32\" type=\"uint32\"/>"
+            << "</feature></target>";
+        const string doc = xml.str();
+        if (offset >= doc.length()) {
+            return "l";
+        }
+        const string part = doc.substr(offset, len);
+        return ((offset + part.length() < doc.length()) ? "m" : "l") + part;
+    }
+
+    void TGdbStub::clearPoints() {
+        for (std::set<TUint32>::const_iterator it = m_breaks.begin();
+             it != m_breaks.end(); ++it) {
+            m_cpu.clearTrap(*it);
+        }
+        m_breaks.clear();
+        for (std::map<TUint32, unsigned>::const_iterator it = m_watches.begin();
+             it != m_watches.end(); ++it) {
+            m_cpu.clearWatch(it->first);
+        }
+        m_watches.clear();
+        m_cpu.setEngine(m_engine);
+        TUint32 addr;
+        m_cpu.takeStop(addr);
+    }
+};
@@ -0,0 +1,121 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+
+#if !defined(_miscpu_gdbstub_hxx_)
+#    define  _miscpu_gdbstub_hxx_
+
+/*
+ * GDB remote serial protocol stub.
+ *
+ * Serves one connection, on localhost TCP or a Unix-domain socket:
+ * register (g/G/p/P) and memory (m/M) access, continue and step
+ * (c/s/vCont), breakpoints (Z0/Z1) and store watchpoints (Z2), ^C,
+ * detach and kill.  Registers are r0..rN, pc and flags (bit 0 zero,
+ * bit 1 cy), as described by qXfer target.xml.  Addresses are in bytes,
+ * words little-endian: byte address 4*a is word m_mem[a].
+ *
+ * Nothing is checked per instruction for the debugger: breakpoints are
+ * predecoded trap markers (see MiscCpu::setTrap()) and watchpoints the
+ * store hook (see MiscCpu::setWatch()), so with none set the program
+ * runs as it would without the stub.  While a watchpoint is set the
+ * switch engine is used, which stops right after the store.
+ */
+
+#include <string>
+#include <map>
+#include <set>
+#include <ostream>
+#include "xyzzy/portable.hxx"
+#include "miscpu.hxx"
+
+using std::string;
+using xyzzy::TUint32;
+using xyzzy::TUint64;
+using xyzzy::TInt32;
+
+namespace miscpu
+{
+    class TGdbStub {
+    public:
+        explicit TGdbStub(MiscCpu &cpu);
+
+        ~TGdbStub();
+
+        //Listen on addr (a port number: localhost TCP; else a socket
+        //path), serve one connection until it closes, kills or detaches.
+        //Return true if detached: breakpoints are gone, cpu may run on.
+        bool serve(const string &addr, std::ostream &os);
+
+    private:
+        //not copyable
+        TGdbStub(const TGdbStub&);
+        TGdbStub& operator=(const TGdbStub&);
+
+        bool listen(const string &addr, std::ostream &os);
+        void close();
+
+        //Next byte from gdb; -1 once closed.
+        int getChar();
+        //True if gdb sent ^C (consumed); does not block.
+        bool isInterrupt();
+        bool readPacket(string &pkt);
+        void writePacket(const string &data);
+
+        //Reply to pkt; empty reply: not supported.
+        string handle(const string &pkt);
+        string resume(bool step);
+        string stopReply(MiscCpu::EStop stop, TUint32 addr, bool interrupted);
+        string readRegs() const;
+        string writeRegs(const string &hex);
+        string readMem(const string &args) const;
+        string writeMem(const string &args);
+        string setPoint(const string &args, bool set);
+        string readFeatures(const string &args) const;
+        TInt32 getReg(unsigned ix) const;
+        void setReg(unsigned ix, TInt32 val);
+
+        //Clear all breakpoints and watchpoints.
+        void clearPoints();
+
+        enum EState {
+            eRunning, eDetached, eKilled
+        };
+
+        MiscCpu     &m_cpu;
+        const MiscCpu::EEngine  m_engine;   //while no watchpoint is set
+        int         m_listenFd, m_fd;
+        string      m_unixPath;     //to unlink
+        char        m_buf[4096];
+        unsigned    m_bufPos, m_bufEnd;
+        bool        m_noAck;
+        EState      m_state;
+        string      m_lastStop;     //reply to '?'
+        std::set<TUint32>   m_breaks;
+        //watched word -> watchpoints on it
+        std::map<TUint32, unsigned> m_watches;
+    };
+};
+
+#endif  //_miscpu_gdbstub_hxx_
@@ -0,0 +1,137 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+
+#include "xyzzy/assert.hxx"
+#include "hle.hxx"
+
+namespace miscpu
+{
+    THleHook::THleHook(const char *name, TUint32 instrs, TUint32 cycles,
+            TUint32 clobbers)
+        :   m_name(name), m_instrs(instrs), m_cycles(cycles),
+            m_clobbers(clobbers), m_calls(0), m_verified(0),
+            m_guestInstrs(0), m_mismatches(0) {
+    }
+
+    THleHook::~THleHook() {
+    }
+
+    TInt32 THleHook::pop(MiscCpu &cpu) {
+        const TUint32 sp = cpu.getReg(cpu.cSpRegIx);
+        cpu.setReg(cpu.cSpRegIx, sp + 1);
+        return cpu.getMem(sp);
+    }
+
+    void THleHook::push(MiscCpu &cpu, TInt32 val) {
+        const TUint32 sp = cpu.getReg(cpu.cSpRegIx) - 1;
+        cpu.setMem(sp, val);
+        cpu.setReg(cpu.cSpRegIx, sp);
+    }
+
+    void THleHook::ret(MiscCpu &cpu) {
+        cpu.setPc(pop(cpu));
+    }
+
+    namespace {
+        /*
+         * asm/test/mult.s: push op2, push op1, +> MULT16u, pop product.
+         * Shift-and-add over the low 16 bits of op2, so the product is
+         * op1 * (op2 & 0xFFFF) mod 2^32.  Uses r0..r5.
+         *
+         * Cost: 120 instructions plus one add per set bit (8 on
+         * average); cycles add the default branch penalty (2) for the
+         * ~24 taken branches (loop, skipped adds, ret).
+         */
+        class TMult16uHook : public THleHook {
+        public:
+            explicit TMult16uHook()
+                :   THleHook("MULT16u", 128, 176, 0x3f) {
+            }
+
+            void call(MiscCpu &cpu) {
+                const TInt32 retPc = pop(cpu);
+                const TUint32 op1 = pop(cpu);
+                const TUint32 op2 = pop(cpu);
+                push(cpu, op1 * (op2 & 0xFFFF));
+                push(cpu, retPc);
+                ret(cpu);
+            }
+        };
+    };
+
+    THleLibrary::THleLibrary() {
+        m_hooks.push_back(new TMult16uHook());
+        m_entries.resize(m_hooks.size(), ~0u);
+    }
+
+    THleLibrary::~THleLibrary() {
+        for (unsigned i = 0; i < m_hooks.size(); i++) {
+            delete m_hooks[i];
+        }
+    }
+
+    unsigned THleLibrary::install(MiscCpu &cpu, const TSymbolMap &syms) {
+        unsigned n = 0;
+        for (unsigned i = 0; i < m_hooks.size(); i++) {
+            TUint32 entry;
+            if (syms.findAddr(m_hooks[i]->getName(), entry)) {
+                cpu.setHook(entry, m_hooks[i]);
+                m_entries[i] = entry;
+                n++;
+            }
+        }
+        return n;
+    }
+
+    void THleLibrary::uninstall(MiscCpu &cpu) {
+        for (unsigned i = 0; i < m_hooks.size(); i++) {
+            if (~0u != m_entries[i]) {
+                cpu.setHook(m_entries[i], 0);
+                m_entries[i] = ~0u;
+            }
+        }
+    }
+
+    void THleLibrary::writeReport(std::ostream &os) const {
+        for (unsigned i = 0; i < m_hooks.size(); i++) {
+            if (~0u == m_entries[i]) {
+                continue;
+            }
+            const THleHook &hook = *m_hooks[i];
+            os << "Info: hle: " << hook.getName() << " at 0x" << std::hex
+               << m_entries[i] << std::dec << ": " << hook.getCalls()
+               << " call(s), each as " << hook.getInstrs()
+               << " instruction(s), " << hook.getCycles() << " cycle(s)"
+               << std::endl;
+            if (0 != hook.getVerified()) {
+                os << "Info: hle: " << hook.getName() << ": verified "
+                   << hook.getVerified() << " call(s), guest ran "
+                   << ((double)hook.getGuestInstrs() / hook.getVerified())
+                   << " instruction(s) per call, " << hook.getMismatches()
+                   << " mismatch(es)" << std::endl;
+            }
+        }
+    }
+};
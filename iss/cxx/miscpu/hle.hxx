@@ -0,0 +1,149 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+
+#if !defined(_miscpu_hle_hxx_)
+#    define  _miscpu_hle_hxx_
+
+/*
+ * High-level emulation: native C++ run in place of a hot guest library
+ * routine, entered by a taken eCall to its entry (MiscCpu::setHook()).
+ *
+ * A hook follows the routine's stack convention as the guest code does:
+ * on entry pc is the routine's entry and the return address is on top
+ * of the stack; it pops the return address and operands, pushes its
+ * results and returns (see pop(), push(), ret()).  It need not leave
+ * the routine's scratch registers (getClobbers()) or flags as the guest
+ * code would: callers of a hooked routine must not depend on them.
+ *
+ * Each hook declares what one call stands for (getInstrs(),
+ * getCycles()), for instruction counts and the timing model.  With
+ * MiscCpu::setHookVerify() the guest routine is run too, so a hook can
+ * be checked against the code it replaces.
+ */
+
+#include <vector>
+#include <ostream>
+#include "xyzzy/portable.hxx"
+#include "miscpu.hxx"
+#include "symbols.hxx"
+
+using xyzzy::TUint32;
+using xyzzy::TUint64;
+using xyzzy::TInt32;
+
+namespace miscpu
+{
+    class THleHook {
+    public:
+        virtual ~THleHook();
+
+        //Guest routine's label: hooks are installed by it.
+        const char* getName() const {
+            return m_name;
+        }
+
+        //Guest instructions (after the eCall) one call stands for.
+        TUint32 getInstrs() const {
+            return m_instrs;
+        }
+
+        //Cycles one call stands for (see timing.hxx).
+        TUint32 getCycles() const {
+            return m_cycles;
+        }
+
+        //Bit i set: the routine leaves r[i] undefined (never sp).
+        TUint32 getClobbers() const {
+            return m_clobbers;
+        }
+
+        //Do what the routine does, through its return (see above).
+        virtual void call(MiscCpu &cpu) = 0;
+
+        TUint64 getCalls() const {
+            return m_calls;
+        }
+
+        //Calls verified (see MiscCpu::setHookVerify()), guest
+        //instructions they ran and calls which differed.
+        TUint64 getVerified() const {
+            return m_verified;
+        }
+
+        TUint64 getGuestInstrs() const {
+            return m_guestInstrs;
+        }
+
+        TUint64 getMismatches() const {
+            return m_mismatches;
+        }
+
+    protected:
+        explicit THleHook(const char *name, TUint32 instrs, TUint32 cycles,
+                TUint32 clobbers);
+
+        //As ePop, ePush, eRetn.
+        static TInt32 pop(MiscCpu &cpu);
+        static void push(MiscCpu &cpu, TInt32 val);
+        static void ret(MiscCpu &cpu);
+
+    private:
+        friend class MiscCpu;   //counts
+
+        const char  *m_name;
+        TUint32     m_instrs, m_cycles, m_clobbers;
+        TUint64     m_calls, m_verified, m_guestInstrs, m_mismatches;
+    };
+
+    /**
+     * The built in hooks.  install() puts each one whose routine syms
+     * has a label for on cpu.
+     */
+    class THleLibrary {
+    public:
+        explicit THleLibrary();
+
+        ~THleLibrary();
+
+        //Return number of hooks installed.
+        unsigned install(MiscCpu &cpu, const TSymbolMap &syms);
+
+        //Remove those install() put on cpu.
+        void uninstall(MiscCpu &cpu);
+
+        //Calls (and verification) per installed hook.
+        void writeReport(std::ostream &os) const;
+
+    private:
+        //not copyable (owns m_hooks)
+        THleLibrary(const THleLibrary&);
+        THleLibrary& operator=(const THleLibrary&);
+
+        std::vector<THleHook*>  m_hooks;
+        std::vector<TUint32>    m_entries;  //of installed; else ~0
+    };
+};
+
+#endif  //_miscpu_hle_hxx_
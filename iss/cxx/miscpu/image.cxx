@@ -0,0 +1,249 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "xyzzy/assert.hxx"
+#include "image.hxx"
+#include "miscpu.hxx"
+
+namespace miscpu
+{
+    static const char cMagic[4] = {'M', 'I', 'S', 'C'};
+
+    static bool isLittleEndian() {
+        const TUint32 one = 1;
+        return (1 == *(const unsigned char*)&one);
+    }
+
+    //Read exactly n bytes at offset.
+    static bool readAt(int fd, unsigned long offset, void *buf, unsigned long n) {
+        char *p = (char*)buf;
+        while (0 < n) {
+            ssize_t r = pread(fd, p, n, offset);
+            if (0 >= r) {
+                return false;
+            }
+            p += r; offset += r; n -= r;
+        }
+        return true;
+    }
+
+    static bool readHeader(int fd, TImageHeader &hdr) {
+        unsigned char b[TImageHeader::cBytes];
+        if (!readAt(fd, 0, b, sizeof(b)) || (0 != memcmp(b, cMagic, 4))) {
+            return false;
+        }
+        hdr.version = getLe32(b + 4);
+        hdr.loadAddr = getLe32(b + 8);
+        hdr.wordCnt = getLe32(b + 12);
+        hdr.entryPc = getLe32(b + 16);
+        hdr.symCnt = getLe32(b + 20);
+        hdr.symsOffset = getLe32(b + 24);
+        hdr.wordsOffset = getLe32(b + 28);
+        return true;
+    }
+
+    bool readImageHeader(const string &fname, TImageHeader &hdr) {
+        int fd = open(fname.c_str(), O_RDONLY);
+        if (0 > fd) {
+            return false;
+        }
+        bool rval = readHeader(fd, hdr);
+        close(fd);
+        return rval;
+    }
+
+    bool isImage(const string &fname) {
+        TImageHeader hdr;
+        return readImageHeader(fname, hdr);
+    }
+
+    static unsigned readSymbols(int fd, const TImageHeader &hdr, TSymbolMap &syms) {
+        ASSERT_TRUE(hdr.symsOffset <= hdr.wordsOffset);
+        std::vector<unsigned char> buf(hdr.wordsOffset - hdr.symsOffset + 1);
+        ASSERT_TRUE(readAt(fd, hdr.symsOffset, &buf[0], buf.size() - 1));
+        unsigned pos = 0;
+        for (unsigned i = 0; i < hdr.symCnt; i++) {
+            ASSERT_TRUE(pos + 8 <= buf.size() - 1);
+            TUint32 addr = getLe32(&buf[pos]), len = getLe32(&buf[pos + 4]);
+            pos += 8;
+            ASSERT_TRUE(len <= buf.size() - 1 - pos);
+            syms.add(addr, string((const char*)&buf[pos], len));
+            pos += len;
+        }
+        return hdr.symCnt;
+    }
+
+    TImage::TImage(const string &fname)
+        :   m_fname(fname) {
+        m_fd = open(fname.c_str(), O_RDONLY);
+        ASSERT_TRUE(0 <= m_fd);
+        ASSERT_TRUE(readHeader(m_fd, m_hdr));
+        ASSERT_TRUE(TImageHeader::cVersion == m_hdr.version);
+        struct stat st;
+        ASSERT_TRUE(0 == fstat(m_fd, &st));
+        ASSERT_TRUE((unsigned long)st.st_size >=
+                    m_hdr.wordsOffset + (sizeof(TInt32) * (unsigned long)m_hdr.wordCnt));
+    }
+
+    TImage::~TImage() {
+        close(m_fd);
+    }
+
+    unsigned TImage::readSymbols(TSymbolMap &syms) const {
+        return miscpu::readSymbols(m_fd, m_hdr, syms);
+    }
+
+    void TImage::readWords(TUint64 addr, TUint32 n, TInt32 *words) const {
+        const TUint64 lo = (addr > m_hdr.loadAddr) ? addr : m_hdr.loadAddr;
+        TUint64 hi = (TUint64)m_hdr.loadAddr + m_hdr.wordCnt;
+        if (hi > addr + n) {
+            hi = addr + n;
+        }
+        for (TUint32 i = 0; i < n; i++) {
+            words[i] = 0;
+        }
+        if (lo >= hi) {
+            return;
+        }
+        std::vector<unsigned char> buf(sizeof(TInt32) * (hi - lo));
+        ASSERT_TRUE(readAt(m_fd, m_hdr.wordsOffset +
+                           (sizeof(TInt32) * (unsigned long)(lo - m_hdr.loadAddr)),
+                           &buf[0], buf.size()));
+        for (TUint64 i = lo; i < hi; i++) {
+            words[i - addr] = getLe32(&buf[sizeof(TInt32) * (i - lo)]);
+        }
+    }
+
+    unsigned readImageSymbols(const string &fname, TSymbolMap &syms) {
+        return TImage(fname).readSymbols(syms);
+    }
+
+    unsigned MiscCpu::loadImage(string fname, TSymbolMap *syms) {
+        TImage img(fname);
+        if (0 != syms) {
+            img.readSymbols(*syms);
+        }
+        return loadImage(img);
+    }
+
+    unsigned MiscCpu::loadImage(const TImage &img) {
+        const int fd = img.m_fd;
+        const TImageHeader &hdr = img.m_hdr;
+        ASSERT_TRUE((hdr.loadAddr <= m_mem.length()) &&
+                    (hdr.wordCnt <= (m_mem.length() - hdr.loadAddr)));
+        const TUint64 cWordBytes = sizeof(TInt32);
+        const TUint64 end = (TUint64)hdr.loadAddr + hdr.wordCnt;
+        //whole pages: copy-on-write map of the file
+        TUint64 lo = end, hi = end;
+        if (isLittleEndian() &&
+            m_mem.mapFile(fd, hdr.wordsOffset, cWordBytes * hdr.loadAddr,
+                          cWordBytes * hdr.wordCnt, &lo, &hi)) {
+            lo /= cWordBytes;
+            hi /= cWordBytes;
+            for (TUint64 i = lo; i < hi; i++) {
+                //read first: do not commit untouched (zero) pages
+                if (cNotDecoded != m_decodedBase[i].op1) {
+                    m_decodedBase[i].op1 = cNotDecoded;
+                }
+                if ((0 != m_jitCodeMap) && (0 != m_jitCodeMap[i])) {
+                    invalidateJit(i);
+                }
+            }
+        } else {
+            lo = hi = end;
+        }
+        //rest: copy
+        const TUint64 ranges[2][2] = {{hdr.loadAddr, lo}, {hi, end}};
+        std::vector<unsigned char> buf;
+        for (unsigned r = 0; r < 2; r++) {
+            const TUint64 from = ranges[r][0], n = ranges[r][1] - from;
+            if (0 == n) {
+                continue;
+            }
+            buf.resize(sizeof(TInt32) * n);
+            ASSERT_TRUE(readAt(fd, hdr.wordsOffset +
+                               (sizeof(TInt32) * (unsigned long)(from - hdr.loadAddr)),
+                               &buf[0], buf.size()));
+            for (TUint64 i = 0; i < n; i++) {
+                writeMem(from + i, getLe32(&buf[sizeof(TInt32) * i]));
+            }
+        }
+        m_pc = hdr.entryPc;
+        m_imageFname = img.getFname();
+        return hdr.wordCnt;
+    }
+
+    void MiscCpu::saveImage(string fname, TUint32 addr, TUint32 n,
+            TUint32 entryPc, const TSymbolMap *syms) const {
+        ASSERT_TRUE((addr <= m_mem.length()) && (n <= (m_mem.length() - addr)));
+        std::ofstream ofs(fname.c_str(), std::ios::out | std::ios::binary);
+        ASSERT_TRUE(false == ofs.fail());
+        TUint32 symCnt = 0, symBytes = 0;
+        if (0 != syms) {
+            for (TSymbolMap::const_iterator it = syms->begin(); it != syms->end(); ++it) {
+                symCnt++;
+                symBytes += 8 + it->second.length();
+            }
+        }
+        const TUint32 cAlign = TImageHeader::cAlignBytes;
+        const TUint32 symsOffset = TImageHeader::cBytes;
+        const TUint32 minWords = symsOffset + symBytes;
+        const TUint32 phase = (sizeof(TInt32) * addr) % cAlign;
+        TUint32 wordsOffset = (minWords - (minWords % cAlign)) + phase;
+        if (wordsOffset < minWords) {
+            wordsOffset += cAlign;
+        }
+        ofs.write(cMagic, 4);
+        putLe32(ofs, TImageHeader::cVersion);
+        putLe32(ofs, addr);
+        putLe32(ofs, n);
+        putLe32(ofs, entryPc);
+        putLe32(ofs, symCnt);
+        putLe32(ofs, symsOffset);
+        putLe32(ofs, wordsOffset);
+        if (0 != syms) {
+            for (TSymbolMap::const_iterator it = syms->begin(); it != syms->end(); ++it) {
+                putLe32(ofs, it->first);
+                putLe32(ofs, it->second.length());
+                ofs.write(it->second.data(), it->second.length());
+            }
+        }
+        for (TUint32 i = minWords; i < wordsOffset; i++) {
+            ofs.put(0);
+        }
+        for (TUint32 i = 0; i < n; i++) {
+            putLe32(ofs, m_mem[addr + i]);
+        }
+        ASSERT_TRUE(false == ofs.fail());
+        ofs.close();
+    }
+};
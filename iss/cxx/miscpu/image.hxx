@@ -0,0 +1,125 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+#if !defined(_miscpu_image_hxx_)
+#    define  _miscpu_image_hxx_
+
+#include <string>
+#include <ostream>
+#include "xyzzy/portable.hxx"
+#include "symbols.hxx"
+
+using std::string;
+using xyzzy::TUint32;
+using xyzzy::TUint64;
+using xyzzy::TInt32;
+
+namespace miscpu
+{
+    /**
+     * Binary program image, all fields little-endian 32-bit:
+     *
+     *   header      magic "MISC", version, loadAddr, wordCnt, entryPc,
+     *               symCnt, symsOffset, wordsOffset (byte offsets)
+     *   symbols     symCnt x {addr, len, name[len]}  (no terminator)
+     *   (zero pad)
+     *   words       wordCnt raw words, loaded at m_mem[loadAddr...]
+     *
+     * wordsOffset is congruent to 4*loadAddr modulo 4096, so whole
+     * pages of words can be mmap'd in place (see MiscCpu::loadImage()).
+     */
+    struct TImageHeader {
+        static const TUint32 cVersion = 1;
+        static const unsigned cBytes = 32;
+        static const unsigned cAlignBytes = 4096;
+
+        TUint32     version;
+        TUint32     loadAddr;
+        TUint32     wordCnt;
+        TUint32     entryPc;
+        TUint32     symCnt;
+        TUint32     symsOffset;
+        TUint32     wordsOffset;
+    };
+
+    //Little-endian 32-bit field (image and checkpoint files).
+    inline TUint32 getLe32(const unsigned char *p) {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | ((TUint32)p[3] << 24);
+    }
+
+    inline void putLe32(std::ostream &os, TUint32 v) {
+        char b[4] = {(char)v, (char)(v >> 8), (char)(v >> 16), (char)(v >> 24)};
+        os.write(b, 4);
+    }
+
+    class MiscCpu;  //see miscpu.hxx
+
+    /**
+     * Open image: header read (and checked) once, file kept open.
+     * Any number of MiscCpu may then loadImage() it, concurrently:
+     * each maps the same file pages copy-on-write.
+     */
+    class TImage {
+    public:
+        explicit TImage(const string &fname);
+
+        ~TImage();
+
+        const string& getFname() const {
+            return m_fname;
+        }
+
+        const TImageHeader& getHeader() const {
+            return m_hdr;
+        }
+
+        //Add symbols to syms; return number added.
+        unsigned readSymbols(TSymbolMap &syms) const;
+
+        //Words loaded at m_mem[addr, addr+n) (0 outside the image).
+        void readWords(TUint64 addr, TUint32 n, TInt32 *words) const;
+
+    private:
+        friend class MiscCpu;
+
+        //not copyable (owns m_fd)
+        TImage(const TImage&);
+        TImage& operator=(const TImage&);
+
+        const string    m_fname;
+        int             m_fd;
+        TImageHeader    m_hdr;
+    };
+
+    //True if fname starts with the image magic.
+    bool isImage(const string &fname);
+
+    //Read header of image fname; false if not an image.
+    bool readImageHeader(const string &fname, TImageHeader &hdr);
+
+    //Add symbols of image fname to syms; return number added.
+    unsigned readImageSymbols(const string &fname, TSymbolMap &syms);
+};
+
+#endif  //_miscpu_image_hxx_
@@ -0,0 +1,215 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+
+#include <cstdio>
+#include "xyzzy/assert.hxx"
+#include "iobus.hxx"
+#include "hosttime.hxx"
+
+namespace miscpu
+{
+    TIoBus::TIoBus()
+        :   m_last(0) {
+    }
+
+    TIoBus::~TIoBus() {
+        flush();
+        for (unsigned i = 0; i < m_windows.size(); i++) {
+            delete m_windows[i].dev;
+        }
+    }
+
+    void TIoBus::map(TUint32 addr, TUint32 words, TIoDevice *dev) {
+        ASSERT_TRUE((0 != dev) && (0 != words) &&
+                    ((TUint64)addr + words <= ((TUint64)1 << 32)));
+        std::vector<TWindow>::iterator it = m_windows.begin();
+        while ((m_windows.end() != it) && (it->addr < addr)) {
+            ++it;
+        }
+        //no overlap
+        ASSERT_TRUE((m_windows.begin() == it) ||
+                    ((TUint64)(it - 1)->addr + (it - 1)->words <= addr));
+        ASSERT_TRUE((m_windows.end() == it) || ((TUint64)addr + words <= it->addr));
+        TWindow w = {addr, words, dev};
+        m_windows.insert(it, w);
+        m_last = 0;
+    }
+
+    const TIoBus::TWindow& TIoBus::lookup(TUint32 addr) {
+        unsigned lo = 0, hi = m_windows.size();
+        while (lo + 1 < hi) {
+            const unsigned mid = (lo + hi) / 2;
+            if (m_windows[mid].addr <= addr) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        const TWindow &w = m_windows[lo];
+        //not mapped: neither memory nor device
+        ASSERT_TRUE(addr - w.addr < w.words);
+        m_last = lo;
+        return w;
+    }
+
+    void TIoBus::flush() {
+        for (unsigned i = 0; i < m_windows.size(); i++) {
+            m_windows[i].dev->flush();
+        }
+    }
+
+    TConsoleDev::TConsoleDev(std::istream &in, std::ostream &out)
+        :   m_in(in), m_out(out) {
+    }
+
+    TConsoleDev::~TConsoleDev() {
+        flush();
+    }
+
+    TInt32 TConsoleDev::read(TUint32 offset) {
+        //let a prompt out before waiting for input
+        flush();
+        if (0 == offset) {
+            const int c = m_in.get();
+            return m_in.eof() ? -1 : (TInt32)(unsigned char)c;
+        }
+        return ((EOF != m_in.peek()) ? 1 : 0) | 2;
+    }
+
+    void TConsoleDev::write(TUint32 offset, TInt32 val) {
+        if (0 == offset) {
+            m_pending += (char)val;
+            if (cBatch <= m_pending.size()) {
+                flush();
+            }
+        }
+    }
+
+    void TConsoleDev::flush() {
+        if (!m_pending.empty()) {
+            m_out.write(m_pending.data(), m_pending.size());
+            m_pending.clear();
+        }
+        m_out.flush();
+    }
+
+    TTimerDev::TTimerDev()
+        :   m_start(nowSecs()), m_high(0) {
+    }
+
+    TInt32 TTimerDev::read(TUint32 offset) {
+        if (0 == offset) {
+            const TUint64 us = (TUint64)(1e6 * (nowSecs() - m_start));
+            m_high = (TUint32)(us >> 32);
+            return (TInt32)us;
+        }
+        return m_high;
+    }
+
+    void TTimerDev::write(TUint32 offset, TInt32) {
+        if (0 == offset) {
+            m_start = nowSecs();
+            m_high = 0;
+        }
+    }
+
+    TBlockDev::TBlockDev(const string &fname)
+        :   m_file(fname.c_str(), std::ios::in | std::ios::out | std::ios::binary),
+            m_block(0), m_loaded(false), m_dirty(false) {
+        ASSERT_TRUE(false == m_file.fail());
+        m_file.seekg(0, std::ios::end);
+        const TUint64 bytes = m_file.tellg();
+        m_blocks = (bytes + 4 * cBlockWords - 1) / (4 * cBlockWords);
+    }
+
+    TBlockDev::~TBlockDev() {
+        flush();
+    }
+
+    TInt32 TBlockDev::read(TUint32 offset) {
+        if (cData <= offset) {
+            if (!m_loaded) {
+                fill();
+            }
+            return m_buf[offset - cData];
+        }
+        return (0 == offset) ? m_block : ((1 == offset) ? m_blocks : 0);
+    }
+
+    void TBlockDev::write(TUint32 offset, TInt32 val) {
+        if (cData <= offset) {
+            if (!m_loaded) {
+                fill();
+            }
+            m_buf[offset - cData] = val;
+            m_dirty = true;
+        } else if (0 == offset) {
+            select(val);
+        } else if (2 == offset) {
+            flush();
+        }
+    }
+
+    void TBlockDev::select(TUint32 block) {
+        if (block != m_block) {
+            flush();
+            m_block = block;
+            m_loaded = false;
+        }
+    }
+
+    //Read m_block (0 past end of file).
+    void TBlockDev::fill() {
+        unsigned char bytes[4 * cBlockWords] = {0};
+        m_file.clear();
+        m_file.seekg((TUint64)m_block * sizeof(bytes));
+        m_file.read((char*)bytes, sizeof(bytes));
+        m_file.clear();
+        for (TUint32 i = 0; i < cBlockWords; i++) {
+            const unsigned char *p = &bytes[4 * i];
+            m_buf[i] = p[0] | (p[1] << 8) | (p[2] << 16) | ((TUint32)p[3] << 24);
+        }
+        m_loaded = true;
+    }
+
+    void TBlockDev::flush() {
+        if (!m_dirty) {
+            return;
+        }
+        unsigned char bytes[4 * cBlockWords];
+        for (TUint32 i = 0; i < cBlockWords; i++) {
+            const TUint32 w = m_buf[i];
+            unsigned char *p = &bytes[4 * i];
+            p[0] = w; p[1] = w >> 8; p[2] = w >> 16; p[3] = w >> 24;
+        }
+        m_file.clear();
+        m_file.seekp((TUint64)m_block * sizeof(bytes));
+        m_file.write((const char*)bytes, sizeof(bytes));
+        m_file.flush();
+        ASSERT_TRUE(false == m_file.fail());
+        m_dirty = false;
+        m_blocks = (m_block >= m_blocks) ? (m_block + 1) : m_blocks;
+    }
+};
@@ -0,0 +1,204 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+
+#if !defined(_miscpu_iobus_hxx_)
+#    define  _miscpu_iobus_hxx_
+
+#include <vector>
+#include <string>
+#include <istream>
+#include <ostream>
+#include <fstream>
+#include "xyzzy/portable.hxx"
+
+using std::string;
+using xyzzy::TUint32;
+using xyzzy::TUint64;
+using xyzzy::TInt32;
+
+namespace miscpu
+{
+    /**
+     * Memory mapped device: eLoad/eStore/ePush/ePop (and eLoadil) to an
+     * address above the memory of a MiscCpu go to the TIoBus window
+     * containing it (see MiscCpu::mapDevice()).
+     *
+     * read()/write() are called in the middle of an instruction, so they
+     * should only touch host memory; anything slow (host i/o) is batched
+     * and done by flush(), which MiscCpu::run() calls when it returns.
+     */
+    class TIoDevice {
+    public:
+        virtual ~TIoDevice() {
+        }
+
+        //Word at offset from the window base.
+        virtual TInt32 read(TUint32 offset) = 0;
+
+        virtual void write(TUint32 offset, TInt32 val) = 0;
+
+        //Complete deferred work.
+        virtual void flush() {
+        }
+    };
+
+    //Address windows => devices (owned).
+    class TIoBus {
+    public:
+        explicit TIoBus();
+
+        //flush() then delete devices.
+        ~TIoBus();
+
+        //Route [addr, addr+words) to dev, which is deleted with the bus.
+        void map(TUint32 addr, TUint32 words, TIoDevice *dev);
+
+        TInt32 read(TUint32 addr) {
+            const TWindow &w = find(addr);
+            return w.dev->read(addr - w.addr);
+        }
+
+        void write(TUint32 addr, TInt32 val) {
+            const TWindow &w = find(addr);
+            w.dev->write(addr - w.addr, val);
+        }
+
+        void flush();
+
+    private:
+        //not copyable (owns devices)
+        TIoBus(const TIoBus&);
+        TIoBus& operator=(const TIoBus&);
+
+        struct TWindow {
+            TUint32     addr, words;
+            TIoDevice   *dev;
+        };
+
+        //Window containing addr (must be mapped).
+        const TWindow& find(TUint32 addr) {
+            const TWindow &w = m_windows[m_last];
+            return (addr - w.addr < w.words) ? w : lookup(addr);
+        }
+
+        const TWindow& lookup(TUint32 addr);
+
+        std::vector<TWindow>    m_windows;  //by addr
+        unsigned                m_last;     //last found
+    };
+
+    //Default windows for the devices below (see main.cxx -io/-blockdev).
+    static const TUint32 cConsoleAddr = 0xFFFF0000;
+    static const TUint32 cTimerAddr   = 0xFFFF0010;
+    static const TUint32 cBlockAddr   = 0xFFFF1000;
+
+    /**
+     * Console (uart):
+     *   +0 read: next input byte (-1 at end of input); write: output byte
+     *   +1 read: 1 if input available (blocks until known) | 2 (can output)
+     * Output is buffered: written by flush(), when cBatch bytes are
+     * pending, or before input is read.
+     */
+    class TConsoleDev : public TIoDevice {
+    public:
+        static const TUint32 cWords = 2;
+
+        explicit TConsoleDev(std::istream &in, std::ostream &out);
+
+        ~TConsoleDev();
+
+        TInt32 read(TUint32 offset);
+
+        void write(TUint32 offset, TInt32 val);
+
+        void flush();
+
+    private:
+        static const unsigned cBatch = 4096;
+
+        std::istream    &m_in;
+        std::ostream    &m_out;
+        string          m_pending;
+    };
+
+    /**
+     * Timer: microseconds (host monotonic clock) since creation or reset.
+     *   +0 read: low word (latches high word); write: reset
+     *   +1 read: high word of last +0 read
+     */
+    class TTimerDev : public TIoDevice {
+    public:
+        static const TUint32 cWords = 2;
+
+        explicit TTimerDev();
+
+        TInt32 read(TUint32 offset);
+
+        void write(TUint32 offset, TInt32 val);
+
+    private:
+        double  m_start;
+        TUint32 m_high;
+    };
+
+    /**
+     * Block device on a host file, cBlockWords (little endian) words per
+     * block:
+     *   +0 read/write: block number (selects the block at +cData)
+     *   +1 read: number of blocks in file
+     *   +2 write: write selected block back to file now
+     *   +cData..: words of selected block
+     * A block is read from the file on first access to +cData, and
+     * written back (if changed) when another is selected, on +2, and
+     * by flush().
+     */
+    class TBlockDev : public TIoDevice {
+    public:
+        static const TUint32 cBlockWords = 128;
+        static const TUint32 cData = cBlockWords;
+        static const TUint32 cWords = cData + cBlockWords;
+
+        explicit TBlockDev(const string &fname);
+
+        ~TBlockDev();
+
+        TInt32 read(TUint32 offset);
+
+        void write(TUint32 offset, TInt32 val);
+
+        void flush();
+
+    private:
+        void select(TUint32 block);
+        void fill();
+
+        std::fstream    m_file;
+        TUint32         m_blocks, m_block;
+        bool            m_loaded, m_dirty;
+        TInt32          m_buf[cBlockWords];
+    };
+};
+
+#endif  //_miscpu_iobus_hxx_
@@ -0,0 +1,760 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+#include <cstring>
+#include <cstddef>
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#define MISCPU_JIT
+#endif
+#include "xyzzy/assert.hxx"
+#include "jit.hxx"
+
+namespace miscpu
+{
+    void MiscCpu::runJit() {
+        if (0 == m_jit) {
+            m_jit = new Jit(*this);
+        }
+        evalFlags();    //translated code uses m_cy, m_zero
+        TUint64 n = m_jit->run();
+        if (false == m_perfMon.isNull()) {
+            m_perfMon->incrInstructionCnt(n);
+        }
+        flushIo();
+    }
+
+    void MiscCpu::invalidateJit(TUint32 addr) {
+        m_jit->invalidate(addr);
+    }
+
+#if defined(MISCPU_JIT)
+    //Minimal x86-64 encoder: only the forms the translator uses.
+    namespace {
+        enum EReg {
+            eAx = 0, eCx = 1, eDx = 2, eBx = 3, eSp = 4, eBp = 5, eSi = 6, eDi = 7,
+            eR12 = 12, eR13 = 13, eR14 = 14, eR15 = 15
+        };
+
+        enum ECc {
+            eCcB = 0x2, eCcAE = 0x3, eCcZ = 0x4, eCcNZ = 0x5, eCcA = 0x7
+        };
+
+        //Group 1 /digit for 0x81 (op r/m32, imm32)
+        enum EAluExt {
+            eExtAdd = 0, eExtOr = 1, eExtAnd = 4, eExtSub = 5, eExtXor = 6, eExtCmp = 7
+        };
+
+        class Emitter {
+        public:
+            explicit Emitter(TUint8 *p) : m_p(p) {}
+
+            TUint8* here() const {
+                return m_p;
+            }
+
+            void byte(TUint8 v) {
+                *m_p++ = v;
+            }
+
+            void dword(TUint32 v) {
+                memcpy(m_p, &v, 4);
+                m_p += 4;
+            }
+
+            void qword(TUint64 v) {
+                memcpy(m_p, &v, 8);
+                m_p += 8;
+            }
+
+            void rex(bool w, unsigned reg, unsigned index, unsigned base) {
+                TUint8 r = 0x40 | (w ? 8 : 0) | (((reg >> 3) & 1) << 2)
+                         | (((index >> 3) & 1) << 1) | ((base >> 3) & 1);
+                if (0x40 != r) {
+                    byte(r);
+                }
+            }
+
+            //modrm (and sib) for [base+disp32]
+            void mem(unsigned reg, unsigned base, TInt32 disp) {
+                byte(0x80 | ((reg & 7) << 3) | (base & 7));
+                if (eSp == (base & 7)) {
+                    byte(0x24);
+                }
+                dword(disp);
+            }
+
+            //modrm and sib for [base+index*(1<<scaleLog)+disp32]
+            void memSib(unsigned reg, unsigned base, unsigned index,
+                        unsigned scaleLog, TInt32 disp) {
+                byte(0x84 | ((reg & 7) << 3));
+                byte((scaleLog << 6) | ((index & 7) << 3) | (base & 7));
+                dword(disp);
+            }
+
+            //op r/m32(dst), r32(src)
+            void opRR(TUint8 op, unsigned dst, unsigned src, bool w = false) {
+                rex(w, src, 0, dst);
+                byte(op);
+                byte(0xC0 | ((src & 7) << 3) | (dst & 7));
+            }
+
+            void load(unsigned reg, unsigned base, TInt32 disp) {
+                rex(false, reg, 0, base);
+                byte(0x8B);
+                mem(reg, base, disp);
+            }
+
+            void store(unsigned base, TInt32 disp, unsigned reg) {
+                rex(false, reg, 0, base);
+                byte(0x89);
+                mem(reg, base, disp);
+            }
+
+            void loadSib(unsigned reg, unsigned base, unsigned index, unsigned scaleLog) {
+                rex(false, reg, index, base);
+                byte(0x8B);
+                memSib(reg, base, index, scaleLog, 0);
+            }
+
+            void storeSib(unsigned base, unsigned index, unsigned scaleLog, unsigned reg) {
+                rex(false, reg, index, base);
+                byte(0x89);
+                memSib(reg, base, index, scaleLog, 0);
+            }
+
+            void movImm(unsigned reg, TUint32 imm) {
+                rex(false, 0, 0, reg);
+                byte(0xB8 | (reg & 7));
+                dword(imm);
+            }
+
+            void movImm64(unsigned reg, TUint64 imm) {
+                rex(true, 0, 0, reg);
+                byte(0xB8 | (reg & 7));
+                qword(imm);
+            }
+
+            void storeImm(unsigned base, TInt32 disp, TUint32 imm) {
+                rex(false, 0, 0, base);
+                byte(0xC7);
+                mem(0, base, disp);
+                dword(imm);
+            }
+
+            void aluImm(EAluExt ext, unsigned reg, TUint32 imm) {
+                rex(false, 0, 0, reg);
+                byte(0x81);
+                byte(0xC0 | (ext << 3) | (reg & 7));
+                dword(imm);
+            }
+
+            void notReg(unsigned reg) {
+                rex(false, 0, 0, reg);
+                byte(0xF7);
+                byte(0xC0 | (2 << 3) | (reg & 7));
+            }
+
+            //Group 2 /digit: 4=shl, 5=shr, 7=sar
+            void shiftImm(unsigned ext, unsigned reg, TUint8 amt) {
+                rex(false, 0, 0, reg);
+                byte(0xC1);
+                byte(0xC0 | (ext << 3) | (reg & 7));
+                byte(amt);
+            }
+
+            void setcc(ECc cc, unsigned base, TInt32 disp) {
+                rex(false, 0, 0, base);
+                byte(0x0F);
+                byte(0x90 | cc);
+                mem(0, base, disp);
+            }
+
+            //mov byte [base+disp], r8 (reg must be al..bl)
+            void storeByte(unsigned base, TInt32 disp, unsigned reg) {
+                rex(false, reg, 0, base);
+                byte(0x88);
+                mem(reg, base, disp);
+            }
+
+            void cmpByteImm(unsigned base, TInt32 disp, TUint8 imm) {
+                rex(false, 0, 0, base);
+                byte(0x80);
+                mem(7, base, disp);
+                byte(imm);
+            }
+
+            void cmpByteSibImm(unsigned base, unsigned index, unsigned scaleLog,
+                               TInt32 disp, TUint8 imm) {
+                rex(false, 0, index, base);
+                byte(0x80);
+                memSib(7, base, index, scaleLog, disp);
+                byte(imm);
+            }
+
+            void storeByteSibImm(unsigned base, unsigned index, unsigned scaleLog,
+                                 TInt32 disp, TUint8 imm) {
+                rex(false, 0, index, base);
+                byte(0xC6);
+                memSib(0, base, index, scaleLog, disp);
+                byte(imm);
+            }
+
+            void addQwordImm(unsigned base, TInt32 disp, TUint32 imm) {
+                rex(true, 0, 0, base);
+                byte(0x81);
+                mem(0, base, disp);
+                dword(imm);
+            }
+
+            void push(unsigned reg) {
+                rex(false, 0, 0, reg);
+                byte(0x50 | (reg & 7));
+            }
+
+            void pop(unsigned reg) {
+                rex(false, 0, 0, reg);
+                byte(0x58 | (reg & 7));
+            }
+
+            void callRax() {
+                byte(0xFF);
+                byte(0xD0);
+            }
+
+            //Return address of rel32 (to patch).
+            TUint8* jcc(ECc cc) {
+                byte(0x0F);
+                byte(0x80 | cc);
+                TUint8 *rel = m_p;
+                dword(0);
+                return rel;
+            }
+
+            void jmp(const TUint8 *to) {
+                byte(0xE9);
+                TUint8 *rel = m_p;
+                dword(0);
+                patch(rel, to);
+            }
+
+            static void patch(TUint8 *rel, const TUint8 *to) {
+                TInt32 off = to - (rel + 4);
+                memcpy(rel, &off, 4);
+            }
+
+        private:
+            TUint8  *m_p;
+        };
+    };
+
+    bool Jit::isSupported() {
+        return true;
+    }
+
+    Jit::Jit(MiscCpu &cpu)
+        :   m_cpu(cpu),
+            m_memMask(cpu.m_memMask),
+            m_codeMapArr(new PTMappedArray<TUint8>(cpu.m_mem.length())),
+            m_blockAtArr(new PTMappedArray<TBlock*>(cpu.m_mem.length())),
+            m_blockLo(cpu.m_mem.length()),
+            m_blockHi(0),
+            m_icount(0),
+            m_flushCnt(0) {
+        ASSERT_TRUE(8 == sizeof(MiscCpu::TDecoded));
+        void *p = mmap(0, cCodeBytes, PROT_READ | PROT_WRITE | PROT_EXEC,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        ASSERT_TRUE(MAP_FAILED != p);
+        m_code = (TUint8*)p;
+        m_codeMap = &(*m_codeMapArr)[0];
+        m_blockAt = &(*m_blockAtArr)[0];
+        const char *base = (const char*)&cpu;
+        m_pcOff = (const char*)&cpu.m_pc - base;
+        m_cyOff = (const char*)&cpu.m_cy - base;
+        m_zeroOff = (const char*)&cpu.m_zero - base;
+        m_aluzOff = (const char*)&cpu.m_aluz - base;
+        emitTrampoline();
+        m_cpu.m_jitCodeMap = m_codeMap;
+    }
+
+    Jit::~Jit() {
+        flush();
+        m_cpu.m_jitCodeMap = 0;
+        munmap(m_code, cCodeBytes);
+        delete m_codeMapArr;
+        delete m_blockAtArr;
+    }
+
+    /*
+     * enter(cpu, code, icount):
+     *   rbx=cpu, rbp=icount, r12=m_regs, r13=m_mem, r14=m_decoded,
+     *   r15=m_codeMap; then jump to code.  Blocks leave via m_epilogue
+     *   with the exit value in rax.
+     */
+    void Jit::emitTrampoline() {
+        Emitter e(m_code);
+        e.push(eBx); e.push(eBp);
+        e.push(eR12); e.push(eR13); e.push(eR14); e.push(eR15);
+        e.byte(0x48); e.byte(0x83); e.byte(0xEC); e.byte(0x08);    //sub rsp,8
+        e.opRR(0x89, eBx, eDi, true);
+        e.opRR(0x89, eBp, eDx, true);
+        e.movImm64(eR12, (TUint64)&m_cpu.m_regs[0]);
+        e.movImm64(eR13, (TUint64)&m_cpu.m_mem[0]);
+        e.movImm64(eR14, (TUint64)&m_cpu.m_decoded[0]);
+        e.movImm64(eR15, (TUint64)m_codeMap);
+        e.byte(0xFF); e.byte(0xE6);                                 //jmp rsi
+        m_epilogue = e.here();
+        e.byte(0x48); e.byte(0x83); e.byte(0xC4); e.byte(0x08);    //add rsp,8
+        e.pop(eR15); e.pop(eR14); e.pop(eR13); e.pop(eR12);
+        e.pop(eBp); e.pop(eBx);
+        e.byte(0xC3);
+        m_enter = (TEnterFn)m_code;
+        m_codeNext = e.here();
+    }
+
+    void Jit::flush() {
+        for (TUint64 i = m_blockLo; i < m_blockHi; i++) {
+            if (0 != m_blockAt[i]) {
+                delete m_blockAt[i];
+                m_blockAt[i] = 0;
+            }
+            if (0 != m_codeMap[i]) {
+                m_codeMap[i] = 0;
+            }
+        }
+        m_blockLo = m_cpu.m_mem.length();
+        m_blockHi = 0;
+        m_codeNext = m_epilogue;
+        emitTrampoline();
+        m_flushCnt++;
+    }
+
+    Jit::TBlock* Jit::lookup(TUint32 pc) {
+        return (pc <= m_memMask) ? m_blockAt[pc] : 0;
+    }
+
+    bool Jit::isTranslatable(TUint32 addr) const {
+        if (addr > m_memMask) {
+            return false;
+        }
+        TUint32 word = m_cpu.m_mem[addr];
+        unsigned op = word >> (32 - OpCode::cOpCodeN);
+        if ((OpCode::eNotUsed <= op) || (OpCode::eSwap == op)) {
+            return false;   //eSwap: rare, left to the interpreter
+        }
+        if (OpCode::isBranchOrCall((OpCode::EOp)op) &&
+            (MiscCpu::eNotUsed <= ((word >> 24) & 7))) {
+            return false;
+        }
+        if ((OpCode::eLoadil == op) && (addr >= m_memMask)) {
+            return false;
+        }
+        if ((OpCode::eCall == op) &&
+            m_cpu.isHooked(addr + 1 + ((TInt32)(word << 8) >> 8))) {
+            return false;   //the interpreter runs the hook (see hle.hxx)
+        }
+        return true;
+    }
+
+    void Jit::kill(TBlock *blk) {
+        for (unsigned i = 0; i < blk->incoming.size(); i++) {
+            Emitter::patch(blk->incoming[i] + 1, blk->incoming[i] + 5);
+        }
+        m_blockAt[blk->pc] = 0;
+        for (TUint32 i = blk->pc; i < blk->end; i++) {
+            if (0xFF != m_codeMap[i]) {
+                m_codeMap[i]--;
+            }
+        }
+        delete blk;
+    }
+
+    void Jit::invalidate(TUint32 addr) {
+        TUint32 lo = (addr > cMaxBlockSpan) ? (addr - cMaxBlockSpan) : 0;
+        for (TUint32 pc = lo; pc <= addr; pc++) {
+            TBlock *blk = m_blockAt[pc];
+            if ((0 != blk) && (addr < blk->end)) {
+                kill(blk);
+            }
+        }
+    }
+
+    void Jit::smcHelper(Jit *jit, TUint32 addr) {
+        jit->invalidate(addr);
+    }
+
+    void Jit::stepHelper(MiscCpu *cpu, TUint32 pc) {
+        cpu->m_pc = pc;
+        cpu->step();
+    }
+
+    namespace {
+        //Set pc, retire cnt, return rv from enter().
+        void emitExit(Emitter &e, int pcOff, TUint32 pc, TUint32 cnt,
+                      TUint32 rv, const TUint8 *epilogue) {
+            e.storeImm(eBx, pcOff, pc);
+            if (0 != cnt) {
+                e.addQwordImm(eBp, 0, cnt);
+            }
+            e.movImm(eAx, rv);
+            e.jmp(epilogue);
+        }
+
+        //As emitExit(), but through a patchable jmp (initially to the
+        //next instruction) and return the address of that jmp.
+        void emitChainExit(Emitter &e, int pcOff, TUint32 pc, TUint32 cnt,
+                           const TUint8 *epilogue) {
+            e.storeImm(eBx, pcOff, pc);
+            if (0 != cnt) {
+                e.addQwordImm(eBp, 0, cnt);
+            }
+            TUint8 *site = e.here();
+            e.jmp(site + 5);
+            e.movImm64(eAx, (TUint64)site);
+            e.jmp(epilogue);
+        }
+
+        //cpu->m_aluz = edx; {cy,zero} as MiscCpu::setFlags(opb=ecx),
+        //where eax is r[j] and the flags register is from edx=eax op ecx.
+        void emitArithFlags(Emitter &e, int aluzOff, int cyOff, int zeroOff) {
+            e.setcc(eCcZ, eBx, zeroOff);
+            e.store(eBx, aluzOff, eDx);
+            //cy = ~(a ^ b) & (z ^ a) : sign(a)==sign(b) && sign(z)!=sign(a)
+            e.opRR(0x31, eCx, eAx);
+            e.notReg(eCx);
+            e.opRR(0x89, eSi, eDx);
+            e.opRR(0x31, eSi, eAx);
+            e.opRR(0x21, eCx, eSi);
+            e.shiftImm(5, eCx, 31);
+            e.storeByte(eBx, cyOff, eCx);
+        }
+
+        //{zero} and m_aluz from eax, then r[j] = eax.
+        void emitLogicFlags(Emitter &e, int aluzOff, int zeroOff, unsigned j) {
+            e.store(eBx, aluzOff, eAx);
+            e.opRR(0x85, eAx, eAx);
+            e.setcc(eCcZ, eBx, zeroOff);
+            e.store(eR12, 4 * j, eAx);
+        }
+    };
+
+    Jit::TBlock* Jit::translate(TUint32 pc) {
+        if (false == isTranslatable(pc)) {
+            return 0;
+        }
+        if ((TUint32)((m_code + cCodeBytes) - m_codeNext) < cMinFreeBytes) {
+            flush();
+        }
+        const unsigned cSp = m_cpu.cSpRegIx;
+        const int cOpcodeOff = offsetof(MiscCpu::TDecoded, op1);
+        TBlock *blk = new TBlock;
+        blk->pc = pc;
+        blk->code = m_codeNext;
+        std::vector<TStub> stubs;
+        Emitter e(m_codeNext);
+        TUint32 addr = pc, n = 0;
+        bool done = false;
+        while (!done) {
+            if ((cMaxBlockInsns == n) || ((addr - pc) >= (cMaxBlockSpan - 1)) ||
+                (false == isTranslatable(addr))) {
+                emitChainExit(e, m_pcOff, addr, n, m_epilogue);
+                break;
+            }
+            if (MiscCpu::cNotDecoded == m_cpu.m_decoded[addr].op1) {
+                m_cpu.predecode(addr);
+            }
+            const MiscCpu::TDecoded dec = m_cpu.m_decoded[addr];
+            const unsigned j = dec.ixJ, k = dec.ixK;
+            TUint32 next = addr + 1;
+            switch (dec.getOpcode()) {
+                case OpCode::eNop:
+                    break;
+                case OpCode::eAdd: case OpCode::eSub: case OpCode::eCmp:
+                case OpCode::eAddi: case OpCode::eSubi: case OpCode::eCmpi:
+                    {   bool isImm = OpCode::hasImmed((OpCode::EOp)dec.getOpcode());
+                        bool isAdd = (OpCode::eAdd == dec.getOpcode()) ||
+                                     (OpCode::eAddi == dec.getOpcode());
+                        e.load(eAx, eR12, 4 * j);
+                        if (isImm) {
+                            e.movImm(eCx, dec.immed);
+                        } else {
+                            e.load(eCx, eR12, 4 * k);
+                        }
+                        e.opRR(0x89, eDx, eAx);
+                        e.opRR(isAdd ? 0x01 : 0x29, eDx, eCx);
+                        emitArithFlags(e, m_aluzOff, m_cyOff, m_zeroOff);
+                        if ((OpCode::eCmp != dec.getOpcode()) && (OpCode::eCmpi != dec.getOpcode())) {
+                            e.store(eR12, 4 * j, eDx);
+                        }
+                    }
+                    break;
+                case OpCode::eAnd: case OpCode::eOr: case OpCode::eXor:
+                    e.load(eAx, eR12, 4 * j);
+                    e.load(eCx, eR12, 4 * k);
+                    e.opRR((OpCode::eAnd == dec.getOpcode()) ? 0x21 :
+                           ((OpCode::eOr == dec.getOpcode()) ? 0x09 : 0x31), eAx, eCx);
+                    emitLogicFlags(e, m_aluzOff, m_zeroOff, j);
+                    break;
+                case OpCode::eAndi: case OpCode::eOri: case OpCode::eXori:
+                    e.load(eAx, eR12, 4 * j);
+                    e.aluImm((OpCode::eAndi == dec.getOpcode()) ? eExtAnd :
+                             ((OpCode::eOri == dec.getOpcode()) ? eExtOr : eExtXor),
+                             eAx, dec.immed);
+                    emitLogicFlags(e, m_aluzOff, m_zeroOff, j);
+                    break;
+                case OpCode::eNot:
+                    e.load(eAx, eR12, 4 * j);
+                    e.notReg(eAx);
+                    emitLogicFlags(e, m_aluzOff, m_zeroOff, j);
+                    break;
+                case OpCode::eLsli: case OpCode::eLsri: case OpCode::eAsri:
+                    //NOTE: execute() does eLsri as lsl(); and asr() is an
+                    //arithmetic shift, so host shl/sar match for 1..31
+                    //(CF is the last bit shifted out, as setCy()).
+                    if ((0 < dec.immed) && (32 > dec.immed)) {
+                        e.load(eAx, eR12, 4 * j);
+                        e.shiftImm((OpCode::eAsri == dec.getOpcode()) ? 7 : 4, eAx, dec.immed);
+                        e.setcc(eCcB, eBx, m_cyOff);
+                        emitLogicFlags(e, m_aluzOff, m_zeroOff, j);
+                        break;
+                    }
+                    //fall through
+                case OpCode::eLsl: case OpCode::eLsr: case OpCode::eAsr:
+                    //Rare enough to leave to the interpreter.
+                    e.opRR(0x89, eDi, eBx, true);
+                    e.movImm(eSi, addr);
+                    e.movImm64(eAx, (TUint64)&stepHelper);
+                    e.callRax();
+                    break;
+                case OpCode::eLoad:
+                    e.load(eAx, eR12, 4 * k);
+                    e.aluImm(eExtAdd, eAx, dec.immed);
+                    e.aluImm(eExtCmp, eAx, m_memMask);
+                    {   TStub st = {e.jcc(eCcA), addr, n, false};
+                        stubs.push_back(st);
+                    }
+                    e.loadSib(eCx, eR13, eAx, 2);
+                    e.store(eR12, 4 * j, eCx);
+                    break;
+                case OpCode::eLoadr:
+                    e.load(eAx, eR12, 4 * k);
+                    e.store(eR12, 4 * j, eAx);
+                    break;
+                case OpCode::eLoadi:
+                    e.storeImm(eR12, 4 * j, dec.immed);
+                    break;
+                case OpCode::eLoadil:
+                    e.storeImm(eR12, 4 * j, m_cpu.m_mem[addr + 1]);
+                    next = addr + 2;
+                    break;
+                case OpCode::eStore: case OpCode::ePush:
+                case OpCode::eCall:
+                    {   TUint32 smcPc = next;
+                        TUint8 *notTaken = 0;
+                        if (OpCode::eStore == dec.getOpcode()) {
+                            e.load(eAx, eR12, 4 * k);
+                            e.aluImm(eExtAdd, eAx, dec.immed);
+                            e.load(eCx, eR12, 4 * j);
+                        } else {
+                            if (OpCode::eCall == dec.getOpcode()) {
+                                smcPc = next + dec.immed;
+                                if (MiscCpu::eUncond != dec.cond) {
+                                    bool isCy = (MiscCpu::eCy == dec.cond) ||
+                                                (MiscCpu::eNotCy == dec.cond);
+                                    bool isNot = (MiscCpu::eNotCy == dec.cond) ||
+                                                 (MiscCpu::eNotZero == dec.cond);
+                                    e.cmpByteImm(eBx, isCy ? m_cyOff : m_zeroOff, 0);
+                                    notTaken = e.jcc(isNot ? eCcNZ : eCcZ);
+                                }
+                                e.movImm(eCx, next);
+                            } else {
+                                e.load(eCx, eR12, 4 * j);
+                            }
+                            e.load(eAx, eR12, 4 * cSp);
+                            e.aluImm(eExtSub, eAx, 1);
+                        }
+                        e.aluImm(eExtCmp, eAx, m_memMask);
+                        {   TStub st = {e.jcc(eCcA), addr, n, false};
+                            stubs.push_back(st);
+                        }
+                        e.storeSib(eR13, eAx, 2, eCx);
+                        e.storeByteSibImm(eR14, eAx, 3, cOpcodeOff, MiscCpu::cNotDecoded);
+                        if (OpCode::eStore != dec.getOpcode()) {
+                            e.store(eR12, 4 * cSp, eAx);
+                        }
+                        e.cmpByteSibImm(eR15, eAx, 0, 0, 0);
+                        {   TStub st = {e.jcc(eCcNZ), smcPc, n + 1, true};
+                            stubs.push_back(st);
+                        }
+                        if (OpCode::eCall == dec.getOpcode()) {
+                            emitChainExit(e, m_pcOff, smcPc, n + 1, m_epilogue);
+                            if (0 != notTaken) {
+                                Emitter::patch(notTaken, e.here());
+                                emitChainExit(e, m_pcOff, next, n + 1, m_epilogue);
+                            }
+                            done = true;
+                        }
+                    }
+                    break;
+                case OpCode::ePop:
+                case OpCode::eRetn:
+                    e.load(eAx, eR12, 4 * cSp);
+                    e.aluImm(eExtCmp, eAx, m_memMask);
+                    {   TStub st = {e.jcc(eCcA), addr, n, false};
+                        stubs.push_back(st);
+                    }
+                    e.loadSib(eCx, eR13, eAx, 2);
+                    e.aluImm(eExtAdd, eAx, 1);
+                    e.store(eR12, 4 * cSp, eAx);
+                    if (OpCode::ePop == dec.getOpcode()) {
+                        e.store(eR12, 4 * j, eCx);
+                    } else {
+                        e.store(eBx, m_pcOff, eCx);
+                        e.addQwordImm(eBp, 0, n + 1);
+                        e.movImm(eAx, cExitLookup);
+                        e.jmp(m_epilogue);
+                        done = true;
+                    }
+                    break;
+                case OpCode::eBr:
+                    {   TUint8 *notTaken = 0;
+                        if (MiscCpu::eUncond != dec.cond) {
+                            bool isCy = (MiscCpu::eCy == dec.cond) ||
+                                        (MiscCpu::eNotCy == dec.cond);
+                            bool isNot = (MiscCpu::eNotCy == dec.cond) ||
+                                         (MiscCpu::eNotZero == dec.cond);
+                            e.cmpByteImm(eBx, isCy ? m_cyOff : m_zeroOff, 0);
+                            notTaken = e.jcc(isNot ? eCcNZ : eCcZ);
+                        }
+                        emitChainExit(e, m_pcOff, next + dec.immed, n + 1, m_epilogue);
+                        if (0 != notTaken) {
+                            Emitter::patch(notTaken, e.here());
+                            emitChainExit(e, m_pcOff, next, n + 1, m_epilogue);
+                        }
+                        done = true;
+                    }
+                    break;
+                case OpCode::eHalt:
+                    emitExit(e, m_pcOff, next, n + 1, cExitHalt, m_epilogue);
+                    done = true;
+                    break;
+                default:
+                    ASSERT_NEVER;
+            }
+            n++;
+            addr = next;
+        }
+        blk->end = addr;
+        for (unsigned i = 0; i < stubs.size(); i++) {
+            const TStub &st = stubs[i];
+            Emitter::patch(st.rel, e.here());
+            if (st.isSmc) {
+                e.opRR(0x89, eSi, eAx);
+                e.movImm64(eDi, (TUint64)this);
+                e.movImm64(eAx, (TUint64)&smcHelper);
+                e.callRax();
+            }
+            emitExit(e, m_pcOff, st.pc, st.cnt,
+                     st.isSmc ? cExitLookup : cExitInterp, m_epilogue);
+        }
+        m_codeNext = e.here();
+        m_blockAt[pc] = blk;
+        if (blk->pc < m_blockLo) {
+            m_blockLo = blk->pc;
+        }
+        if (blk->end > m_blockHi) {
+            m_blockHi = blk->end;
+        }
+        for (TUint32 i = blk->pc; i < blk->end; i++) {
+            if (0xFF != m_codeMap[i]) {
+                m_codeMap[i]++;
+            }
+        }
+        return blk;
+    }
+
+    TUint64 Jit::run() {
+        m_icount = 0;
+        while (true) {
+            TBlock *blk = lookup(m_cpu.m_pc);
+            if (0 == blk) {
+                blk = translate(m_cpu.m_pc);
+            }
+            if (0 == blk) {
+                //not translatable: let the interpreter deal with it
+                m_icount++;
+                if (m_cpu.step()) {
+                    break;
+                }
+                continue;
+            }
+            TUint64 rv = m_enter(&m_cpu, blk->code, &m_icount);
+            if (cExitHalt == rv) {
+                break;
+            } else if (cExitInterp == rv) {
+                m_icount++;
+                if (m_cpu.step()) {
+                    break;
+                }
+            } else if (cExitLookup != rv) {
+                //chain the exit at rv to the block at m_pc
+                TUint8 *site = (TUint8*)rv;
+                unsigned flushCnt = m_flushCnt;
+                TBlock *to = lookup(m_cpu.m_pc);
+                if (0 == to) {
+                    to = translate(m_cpu.m_pc);
+                }
+                if ((0 != to) && (flushCnt == m_flushCnt)) {
+                    Emitter::patch(site + 1, to->code);
+                    to->incoming.push_back(site);
+                }
+            }
+        }
+        return m_icount;
+    }
+
+#else   //!MISCPU_JIT
+
+    bool Jit::isSupported() {
+        return false;
+    }
+
+    Jit::Jit(MiscCpu &cpu)
+        :   m_cpu(cpu),
+            m_memMask(0) {
+        ASSERT_NEVER;
+    }
+
+    Jit::~Jit() {
+    }
+
+    TUint64 Jit::run() {
+        return 0;
+    }
+
+    void Jit::invalidate(TUint32 addr) {
+    }
+
+#endif  //MISCPU_JIT
+};
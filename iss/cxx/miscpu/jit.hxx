@@ -0,0 +1,130 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+#if !defined(_miscpu_jit_hxx_)
+#    define  _miscpu_jit_hxx_
+
+#include <vector>
+#include "xyzzy/portable.hxx"
+#include "miscpu.hxx"
+
+using xyzzy::TUint8;
+using xyzzy::TUint32;
+using xyzzy::TUint64;
+
+namespace miscpu
+{
+    /**
+     * Basic block translator (x86-64 Linux hosts only).
+     *
+     * Straight-line guest code, up to and including eBr, eCall, eRetn
+     * or eHalt, is translated into host code and cached by start pc.
+     * Exits to a known pc (branch/call targets, fall through) are
+     * patched to jump directly to the target block once it exists.
+     *
+     * Translated code works directly on the MiscCpu state (m_regs,
+     * m_mem, m_cy, m_zero, m_aluz).  Anything it cannot do exactly
+     * (out of range address, invalid instruction word, eHalt) exits
+     * back to the interpreter at that instruction, so asserts are the
+     * same as under the interpreter.
+     *
+     * Every m_mem write checks m_jitCodeMap: a store into a translated
+     * word invalidates (and unchains) each block covering that word.
+     */
+    class Jit {
+    public:
+        explicit Jit(MiscCpu &cpu);
+
+        ~Jit();
+
+        static bool isSupported();
+
+        //Run until eHalt; return number of instructions retired.
+        TUint64 run();
+
+        //m_mem[addr] was written.
+        void invalidate(TUint32 addr);
+
+    private:
+        struct TBlock {
+            TUint32                 pc, end;    //m_mem[pc..end) translated
+            TUint8                  *code;
+            std::vector<TUint8*>    incoming;   //patched jumps to code
+        };
+
+        struct TStub {
+            TUint8      *rel;       //jcc rel32 to patch to stub
+            TUint32     pc;         //m_pc at exit
+            TUint32     cnt;        //retired (in block) at exit
+            bool        isSmc;      //else: exit to interpreter
+        };
+
+        typedef TUint64 (*TEnterFn)(MiscCpu *cpu, const TUint8 *code,
+                                    TUint64 *icount);
+
+        //Return values of translated code (any other value is the
+        //address of a patchable jump, with m_pc already set).
+        static const TUint64 cExitLookup = 0;
+        static const TUint64 cExitHalt = 1;
+        static const TUint64 cExitInterp = 2;
+
+        static const unsigned cMaxBlockInsns = 128;
+        static const unsigned cMaxBlockSpan = 2 * cMaxBlockInsns;
+        static const unsigned cCodeBytes = 16 << 20;
+        static const unsigned cMinFreeBytes = 64 << 10;
+
+        MiscCpu         &m_cpu;
+        const TUint32   m_memMask;      //m_mem.length() - 1
+        TUint8          *m_code, *m_codeNext;
+        TUint8          *m_epilogue;
+        TEnterFn        m_enter;
+        //Both parallel to m_mem: reserved, committed as touched.
+        PTMappedArray<TUint8>   *m_codeMapArr;  //#blocks covering each word
+        PTMappedArray<TBlock*>  *m_blockAtArr;  //block by start pc
+        TUint8          *m_codeMap;     //m_codeMapArr base
+        TBlock          **m_blockAt;    //m_blockAtArr base
+        TUint64         m_blockLo, m_blockHi;   //span of m_mem translated
+        TUint64         m_icount;
+        unsigned        m_flushCnt;
+
+        //byte offsets of MiscCpu members used by translated code
+        int             m_pcOff, m_cyOff, m_zeroOff, m_aluzOff;
+
+        void emitTrampoline();
+        void flush();
+        TBlock* lookup(TUint32 pc);
+        TBlock* translate(TUint32 pc);
+        bool isTranslatable(TUint32 addr) const;
+        void kill(TBlock *blk);
+
+        static void smcHelper(Jit *jit, TUint32 addr);
+        static void stepHelper(MiscCpu *cpu, TUint32 pc);
+
+        //not copyable
+        Jit(const Jit&);
+        Jit& operator=(const Jit&);
+    };
+};
+
+#endif  //_miscpu_jit_hxx_
@@ -24,65 +24,956 @@
 
 #include <stdlib.h>
 #include <iostream>
+#include <fstream>
 #include "xyzzy/assert.hxx"
 #include "xyzzy/array.hxx"
 #include "miscpu.hxx"
+#include "miscpucore.hxx"
+#include "profiler.hxx"
+#include "symbols.hxx"
+#include "image.hxx"
+#include "batch.hxx"
+#include "checkpoint.hxx"
+#include "trace.hxx"
+#include "cosim.hxx"
+#include "assembler.hxx"
+#include "iobus.hxx"
+#include "timing.hxx"
+#include "reverse.hxx"
+#include "gdbstub.hxx"
+#include "faultinj.hxx"
+#include "bench.hxx"
+#include "multihart.hxx"
+#include "hle.hxx"
+#include "telemetry.hxx"
+#include "hosttime.hxx"
 
 using xyzzy::PTArray;
 using namespace miscpu;
 using std::cout;
 using std::endl;
+using std::string;
 
-static void status(const MiscCpu &cpu) {
+//fused: also report instructions run fused (with -stats).
+static void status(const MiscCpu &cpu, bool fused = false) {
     cout << "Info: cpu ran " << cpu.getPerfMon()->getInstructionCnt()
          << " instructions" << endl;
+    if (fused && (0 != cpu.getFusedCnt())) {
+        cout << "Info: fused " << cpu.getFusedCnt() << " instruction(s) ("
+             << (100.0 * cpu.getFusedCnt() / cpu.getPerfMon()->getInstructionCnt())
+             << "% of instructions)" << endl;
+    }
 }
 
-int main(int argc, char** argv) {
-    if (1 < argc) {
-        MiscCpu cpu(argv[1]);   //mem.hex
+//Return number of words loaded.
+static unsigned loadBuiltin(MiscCpu &cpu) {
+    const int cMemSz = cpu.getMemDepth();
+    const unsigned cSpIx = cpu.getNumRegs() - 1;
+    unsigned n = 2; //loop count
+
+    TInt32 instructs[] = {
+        /*00*/cpu.instruction(OpCode::eLoadil, cSpIx),        //load sp w/ m[pc+1]
+        /*01*/cMemSz,                                         // sp-value
+        /*02*/cpu.instructioni(OpCode::eLoadi, 3u, n),        //r[3] = n
+        /*03*/cpu.instructioni(OpCode::eLoadi, 0u, 0),        //l1: r[0] = 0;
+        /*04*/cpu.instructioni(OpCode::eLoadi, 1u, 2),        //r[1] = 1;
+        /*05*/cpu.instructioni(OpCode::eLoadi, 2u, n),        //r[2] = n;
+        /*06*/cpu.instructioni(OpCode::eAddi,  1u, 1),        //lo: r[1] += 1;
+        /*07*/cpu.instructioni(OpCode::eSubi,  2u, 1),        //r[2] -= 1;
+        /*08*/cpu.instructionb(OpCode::eBr,  MiscCpu::eNotZero, -3), //->lo ? !=0
+        /*09*/cpu.instructioni(OpCode::eSubi,  3u, 1),        //r[3] -= 1;
+        /*10*/cpu.instructionb(OpCode::eBr,  MiscCpu::eNotZero, -8), //->l1 ? !=0
+        //write result to this next location, which we jump over
+        /*11*/cpu.instructionb(OpCode::eBr,  MiscCpu::eUncond, 1),    //->l2
+        /*12*/0, //@12: we will write here
+        /*13*/cpu.instructioni(OpCode::eLoadi, 4, 20),        //l2: r[4] = 20
+        /*14*/cpu.instruction(OpCode::eStore, 1, 4, -8),      //mem[r[4]-8] = r[1]
+        /*15*/cpu.instruction(OpCode::ePush, 1),    //push r[1]
+        /*16*/cpu.instructioni(OpCode::eLoadi, 1, 666),   //r[1]=666
+        /*17*/cpu.instruction(OpCode::ePop, 1),   //pop r[1]
+        /*18*/cpu.instruction(OpCode::eHalt),
+        /*19*/-1
+    };
+    PTArray<TInt32> instrAr(&instructs[0], -1);
+    cpu.loadMemory(instrAr);
+    return instrAr.length();
+}
+
+/*
+ * ALU microbenchmark: n times MULT16u (see asm/test/mult.s) inlined,
+ * operands from the loop count, products summed into r[7].
+ * Most instructions set {cy,zero} and only branches read them.
+ * Return number of words loaded.
+ */
+static unsigned loadAluBench(MiscCpu &cpu, TUint32 n) {
+    const int cMemSz = cpu.getMemDepth();
+    const unsigned cSpIx = cpu.getNumRegs() - 1;
+    ASSERT_TRUE(0 != n);
+
+    TInt32 instructs[] = {
+        /*00*/cpu.instruction(OpCode::eLoadil, cSpIx),        //load sp w/ m[pc+1]
+        /*01*/cMemSz,                                         // sp-value
+        /*02*/cpu.instruction(OpCode::eLoadil, 6u),           //r[6] = n
+        /*03*/(TInt32)n,
+        /*04*/cpu.instructioni(OpCode::eLoadi, 7u, 0),        //r[7] = 0
+        /*05*/cpu.instruction(OpCode::eLoadr, 1u, 6u),        //l0: r[1] = r[6] & 0xffff
+        /*06*/cpu.instructioni(OpCode::eAndi, 1u, 0xffff),
+        /*07*/cpu.instruction(OpCode::eLoadr, 2u, 6u),        //r[2] = (r[6] ^ 0x5a5a) & 0xffff
+        /*08*/cpu.instructioni(OpCode::eXori, 2u, 0x5a5a),
+        /*09*/cpu.instructioni(OpCode::eAndi, 2u, 0xffff),
+        /*10*/cpu.instructioni(OpCode::eLoadi, 4u, 0),        //r[4] = r[1] * r[2]
+        /*11*/cpu.instructioni(OpCode::eLoadi, 3u, 1),        //r[3] = 1 (and mask)
+        /*12*/cpu.instruction(OpCode::eLoadr, 5u, 2u),        //l1: r[5] = r[2] & r[3]
+        /*13*/cpu.instruction(OpCode::eAnd, 5u, 3u),
+        /*14*/cpu.instructionb(OpCode::eBr, MiscCpu::eZero, 1),   //->l2 ? ==0
+        /*15*/cpu.instruction(OpCode::eAdd, 4u, 1u),          //r[4] += r[1]
+        /*16*/cpu.instructioni(OpCode::eLsli, 1u, 1),         //l2: r[1] <<= 1
+        /*17*/cpu.instructioni(OpCode::eLsli, 3u, 1),         //r[3] <<= 1
+        /*18*/cpu.instructioni(OpCode::eCmpi, 3u, 0x10000),
+        /*19*/cpu.instructionb(OpCode::eBr, MiscCpu::eNotZero, -8),  //->l1 ? !=0
+        /*20*/cpu.instruction(OpCode::eAdd, 7u, 4u),          //r[7] += r[4]
+        /*21*/cpu.instructioni(OpCode::eSubi, 6u, 1),         //r[6] -= 1
+        /*22*/cpu.instructionb(OpCode::eBr, MiscCpu::eNotZero, -18), //->l0 ? !=0
+        /*23*/cpu.instruction(OpCode::eHalt),
+        /*24*/-1
+    };
+    PTArray<TInt32> instrAr(&instructs[0], -1);
+    cpu.loadMemory(instrAr);
+    return instrAr.length();
+}
+
+//Time loadAluBench(n) on each engine; check they agree on r[7].
+static int runAluBench(TUint32 n, unsigned memBits) {
+    static const MiscCpu::EEngine cEngines[] = {
+        MiscCpu::eSwitchEngine, MiscCpu::eThreadedEngine, MiscCpu::eJitEngine
+    };
+    static const char* const cNames[] = {"switch", "threaded", "jit"};
+    TInt32 sum = 0;
+    for (unsigned i = 0; i < sizeof(cEngines)/sizeof(cEngines[0]); i++) {
+        MiscCpu cpu(0, 5, memBits, true, cEngines[i]);
+        loadAluBench(cpu, n);
+        const double t0 = nowSecs();
         cpu.run();
-		cpu.dumpRegs(0,7); cpu.dumpRegs(31);
-        status(cpu);
+        const double secs = nowSecs() - t0;
+        const TUint64 cnt = cpu.getPerfMon()->getInstructionCnt();
+        cout << "Info: bench-alu: " << cNames[i] << ": " << cnt
+             << " instruction(s) in " << secs << " s ("
+             << (cnt / secs / 1e6) << " MIPS)" << endl;
+        if (0 == i) {
+            sum = cpu.getReg(7);
+        } else if (sum != cpu.getReg(7)) {
+            cout << "Error: " << cNames[i] << " engine: r[7]=" << cpu.getReg(7)
+                 << " (expected " << sum << ")" << endl;
+            return (EXIT_FAILURE);
+        }
+    }
+    return (EXIT_SUCCESS);
+}
+
+struct TRunOpts {
+    TRunOpts()
+        :   memFname(0), statsFname(0), profFname(0), symsFname(0),
+            profInterval(10007), batchFname(0), batchOutFname(0),
+            threads(0), batchBench(false), maxInstrs(0),
+            ckptPrefix(0), ckptEvery(0), restoreFname(0), traceFname(0),
+            traceDeflate(false),
+            simdLanes(0), simdCheck(false), io(false), blockFname(0),
+            timing(false), timingCfgFname(0),
+            rdebug(false), rdebugInterval(4096), rdebugMiB(16), gdbAddr(0),
+            fiCnt(0), fiSeed(1), fiInterval(4096), fiOutFname(0),
+            benchWarmup(1), benchReps(5), benchOutFname(0),
+            harts(0), quantum(10000), hartsRr(false), hartsBench(false),
+            noFuse(false), hle(false), hleVerify(false), telemetryName(0) {
+    }
+    const char  *memFname;
+    const char  *statsFname;    //-stats
+    const char  *profFname;     //-prof
+    const char  *symsFname;     //-syms
+    TUint32     profInterval;   //-prof-interval
+    const char  *batchFname;    //-batch
+    const char  *batchOutFname; //-batch-out
+    unsigned    threads;        //-threads (0: all host cpus)
+    bool        batchBench;     //-batch-bench
+    TUint64     maxInstrs;      //-max-instrs (0: until eHalt)
+    const char  *ckptPrefix;    //-ckpt
+    TUint64     ckptEvery;      //-ckpt-every
+    const char  *restoreFname;  //-restore
+    const char  *traceFname;    //-trace
+    bool        traceDeflate;   //-trace-deflate
+    unsigned    simdLanes;      //-simd (0: scalar)
+    bool        simdCheck;      //-simd-check
+    bool        io;             //-io
+    const char  *blockFname;    //-blockdev
+    bool        timing;         //-timing
+    const char  *timingCfgFname;//-timing-cfg
+    bool        rdebug;         //-rdebug
+    TUint32     rdebugInterval; //-rdebug-interval
+    TUint64     rdebugMiB;      //-rdebug-mem
+    const char  *gdbAddr;       //-gdb
+    unsigned    fiCnt;          //-fi
+    TUint32     fiSeed;         //-fi-seed
+    TUint32     fiInterval;     //-fi-interval
+    const char  *fiOutFname;    //-fi-out
+    unsigned    benchWarmup;    //-bench-warmup
+    unsigned    benchReps;      //-bench-reps
+    const char  *benchOutFname; //-bench-out
+    unsigned    harts;          //-harts (0: one MiscCpu)
+    TUint64     quantum;        //-quantum
+    bool        hartsRr;        //-harts-rr
+    bool        hartsBench;     //-harts-bench
+    bool        noFuse;         //-no-fuse
+    bool        hle;            //-hle
+    bool        hleVerify;      //-hle-verify
+    const char  *telemetryName; //-telemetry
+};
+
+static void writeStats(const TStatsMon &stats, const char *statsFname) {
+    string fname = statsFname;
+    std::ofstream ofs(statsFname);
+    ASSERT_TRUE(false == ofs.fail());
+    if ((5 < fname.length()) && (".json" == fname.substr(fname.length() - 5))) {
+        stats.writeJson(ofs);
     } else {
-        MiscCpu cpu;
-
-        const int cMemSz = cpu.getMemDepth();
-        const unsigned cSpIx = cpu.getNumRegs() - 1;
-        unsigned n = 2; //loop count
-
-        {
-            TInt32 instructs[] = {
-                /*00*/cpu.instruction(OpCode::eLoadil, cSpIx),        //load sp w/ m[pc+1]
-                /*01*/cMemSz,                                         // sp-value
-                /*02*/cpu.instructioni(OpCode::eLoadi, 3u, n),        //r[3] = n
-                /*03*/cpu.instructioni(OpCode::eLoadi, 0u, 0),        //l1: r[0] = 0;
-                /*04*/cpu.instructioni(OpCode::eLoadi, 1u, 2),        //r[1] = 1;
-                /*05*/cpu.instructioni(OpCode::eLoadi, 2u, n),        //r[2] = n;
-                /*06*/cpu.instructioni(OpCode::eAddi,  1u, 1),        //lo: r[1] += 1;
-                /*07*/cpu.instructioni(OpCode::eSubi,  2u, 1),        //r[2] -= 1;
-                /*08*/cpu.instructionb(OpCode::eBr,  MiscCpu::eNotZero, -3), //->lo ? !=0
-                /*09*/cpu.instructioni(OpCode::eSubi,  3u, 1),        //r[3] -= 1;
-                /*10*/cpu.instructionb(OpCode::eBr,  MiscCpu::eNotZero, -8), //->l1 ? !=0
-                //write result to this next location, which we jump over
-                /*11*/cpu.instructionb(OpCode::eBr,  MiscCpu::eUncond, 1),    //->l2
-                /*12*/0, //@12: we will write here
-                /*13*/cpu.instructioni(OpCode::eLoadi, 4, 20),        //l2: r[4] = 20
-                /*14*/cpu.instruction(OpCode::eStore, 1, 4, -8),      //mem[r[4]-8] = r[1]
-                /*15*/cpu.instruction(OpCode::ePush, 1),    //push r[1]
-                /*16*/cpu.instructioni(OpCode::eLoadi, 1, 666),   //r[1]=666
-                /*17*/cpu.instruction(OpCode::ePop, 1),   //pop r[1]
-                /*18*/cpu.instruction(OpCode::eHalt),
-                /*19*/-1
-            };
-            PTArray<TInt32> instrAr(&instructs[0], -1);
-            cpu.loadMemory(instrAr);
+        stats.writeCsv(ofs);
+    }
+    cout << "Info: " << fname << ": wrote statistics" << endl;
+}
+
+//Symbols of opts.memFname: -syms, else the image's or the source's.
+static void loadSymbols(const TRunOpts &opts, TSymbolMap &syms) {
+    if (0 != opts.symsFname) {
+        syms.load(opts.symsFname);
+    } else if ((0 != opts.memFname) && isImage(opts.memFname)) {
+        readImageSymbols(opts.memFname, syms);
+    } else if ((0 != opts.memFname) && isAsmSource(opts.memFname)) {
+        MiscCpu enc(0, 5, 1, false);
+        TAssembler as(enc);
+        if (as.assembleFile(opts.memFname, cout)) {
+            syms = as.getSymbols();
         }
-        cpu.run();
-        status(cpu);
     }
+}
+
+static void writeProfile(const TSampleProfiler &prof, const TRunOpts &opts) {
+    TSymbolMap syms;
+    loadSymbols(opts, syms);
+    std::ofstream ofs(opts.profFname);
+    ASSERT_TRUE(false == ofs.fail());
+    prof.writeFolded(ofs, syms);
+    prof.writeReport(cout);
+    cout << "Info: " << opts.profFname << ": wrote folded stacks" << endl;
+}
 
+//Run cpu with mon in blocks, publishing counters after each.
+template<class TMon>
+static void runPublished(MiscCpu &cpu, TMon &mon, const char *name) {
+    TTelemetry tm(name);
+    if (!tm.isOpen()) {
+        cout << "Error: " << tm.getPath() << ": cannot create; no telemetry"
+             << endl;
+        cpu.run(mon);
+        return;
+    }
+    cout << "Info: " << tm.getPath() << ": publishing telemetry" << endl;
+    bool done = false;
+    while (!done) {
+        cpu.run(mon, TTelemetry::cChunk);
+        done = (OpCode::eHalt == cpu.getOpcode());
+        tm.publish(cpu, done);
+    }
+}
 
+//Run cpu with mon, and the trace recorder if opts.traceFname.
+template<class TMon>
+static void runTraced(MiscCpu &cpu, TMon &mon, const TRunOpts &opts) {
+    if ((0 == opts.traceFname) && (0 != opts.telemetryName)) {
+        runPublished(cpu, mon, opts.telemetryName);
+        return;
+    } else if (0 == opts.traceFname) {
+        cpu.run(mon);
+        return;
+    }
+    const double t0 = nowSecs();
+    TTraceMon trace(cpu, opts.traceFname,
+                    opts.traceDeflate ? TTraceMon::eDeflate : TTraceMon::eStored);
+    PTMonPair<TMon, TTraceMon> both(mon, trace);
+    cpu.run(both);
+    trace.close();
+    cout << "Info: " << opts.traceFname << ": traced " << trace.getCount()
+         << " instruction(s) in " << (nowSecs() - t0) << " s, "
+         << trace.getBytes() << " byte(s), " << trace.getStalls()
+         << " stall(s)" << endl;
+}
+
+//As runTraced(), and the timing model if opts.timing.
+template<class TMon>
+static void runMon(MiscCpu &cpu, TMon &mon, const TRunOpts &opts) {
+    if (!opts.timing) {
+        runTraced(cpu, mon, opts);
+        return;
+    }
+    TTimingConfig cfg;
+    if (0 != opts.timingCfgFname) {
+        cfg.load(opts.timingCfgFname);
+    }
+    TTimingMon timing(cfg, cpu.getMemDepth());
+    PTMonPair<TMon, TTimingMon> both(mon, timing);
+    runTraced(cpu, both, opts);
+    timing.writeReport(cout);
+}
+
+//Devices selected by opts, at their default windows (see iobus.hxx).
+static void mapDevices(MiscCpu &cpu, const TRunOpts &opts) {
+    if (opts.io) {
+        cpu.mapDevice(cConsoleAddr, TConsoleDev::cWords, new TConsoleDev(std::cin, cout));
+        cpu.mapDevice(cTimerAddr, TTimerDev::cWords, new TTimerDev());
+    }
+    if (0 != opts.blockFname) {
+        cpu.mapDevice(cBlockAddr, TBlockDev::cWords, new TBlockDev(opts.blockFname));
+    }
+}
+
+//Run cpu with the monitors selected by opts.
+static void run(MiscCpu &cpu, const TRunOpts &opts) {
+    mapDevices(cpu, opts);
+    cpu.setFusion(!opts.noFuse);
+    THleLibrary hle;
+    if (opts.hle) {
+        TSymbolMap syms;
+        loadSymbols(opts, syms);
+        cout << "Info: hle: " << hle.install(cpu, syms) << " hook(s) installed"
+             << endl;
+        cpu.setHookVerify(opts.hleVerify);
+    }
+    if (opts.rdebug) {
+        TTimeTravel tt(cpu, opts.rdebugInterval, opts.rdebugMiB << 20);
+        runTimeTravelShell(tt, cpu, std::cin, cout);
+    } else if (0 != opts.gdbAddr) {
+        TGdbStub stub(cpu);
+        if (stub.serve(opts.gdbAddr, cout)) {
+            cpu.run();      //detached: run on as without the stub
+        }
+    } else if (0 != opts.ckptEvery) {
+        unsigned n = runCheckpointed(cpu, opts.ckptEvery, opts.ckptPrefix);
+        cout << "Info: " << opts.ckptPrefix << ": saved " << n
+             << " checkpoint(s)" << endl;
+    } else if ((0 == opts.statsFname) && (0 == opts.profFname)) {
+        if ((0 == opts.traceFname) && !opts.timing && (0 == opts.telemetryName)) {
+            cpu.run();
+        } else {
+            TNullMon none;
+            runMon(cpu, none, opts);
+        }
+    } else if (0 == opts.profFname) {
+        TStatsMon stats(cpu.getMemDepth());
+        runMon(cpu, stats, opts);
+        writeStats(stats, opts.statsFname);
+    } else if (0 == opts.statsFname) {
+        TSampleProfiler prof(opts.profInterval);
+        runMon(cpu, prof, opts);
+        writeProfile(prof, opts);
+    } else {
+        TStatsMon stats(cpu.getMemDepth());
+        TSampleProfiler prof(opts.profInterval);
+        PTMonPair<TStatsMon, TSampleProfiler> both(stats, prof);
+        runMon(cpu, both, opts);
+        writeStats(stats, opts.statsFname);
+        writeProfile(prof, opts);
+    }
+    if (opts.hle) {
+        hle.writeReport(cout);
+        hle.uninstall(cpu);
+    }
+}
+
+//Run jobs of opts.batchFname against image memFname.
+static int runBatch(const char *memFname, MiscCpu::EEngine engine,
+        const TRunOpts &opts) {
+    if ((0 == memFname) || !isImage(memFname)) {
+        cout << "Error: -batch needs an image mem file (see -mkimage)" << endl;
+        return (EXIT_FAILURE);
+    }
+    std::vector<TBatchJob> jobs;
+    readBatchJobs(opts.batchFname, jobs);
+    TBatchRunner runner(memFname, jobs, engine, opts.maxInstrs,
+                        opts.simdLanes, opts.simdCheck);
+    const unsigned maxThreads = (0 != opts.threads) ? opts.threads
+                                                    : TBatchRunner::getHostThreads();
+    if (opts.batchBench) {
+        //1, 2, 4, ... maxThreads
+        double base = 0;
+        for (unsigned n = 1; ; n = (2 * n < maxThreads) ? (2 * n) : maxThreads) {
+            const double rate = jobs.size() / runner.run(n);
+            if (1 == n) {
+                base = rate;
+            }
+            cout << "Info: batch: " << n << " thread(s): " << rate
+                 << " jobs/sec (x" << (rate / base) << ")" << endl;
+            if (maxThreads == n) {
+                break;
+            }
+        }
+    } else {
+        const double secs = runner.run(maxThreads);
+        cout << "Info: batch: " << jobs.size() << " job(s) on " << maxThreads
+             << " thread(s) in " << secs << " s ("
+             << (jobs.size() / secs) << " jobs/sec)" << endl;
+    }
+    if (0 != opts.simdLanes) {
+        runner.writeSimdStats(cout);
+        if (0 != runner.getSimdStats().mismatches) {
+            return (EXIT_FAILURE);
+        }
+    }
+    if (0 != opts.batchOutFname) {
+        std::ofstream ofs(opts.batchOutFname);
+        ASSERT_TRUE(false == ofs.fail());
+        runner.writeCsv(ofs);
+        cout << "Info: " << opts.batchOutFname << ": wrote results" << endl;
+    } else {
+        runner.writeCsv(cout);
+    }
     return (EXIT_SUCCESS);
 }
 
+//Fault-injection campaign of opts.fiCnt against image memFname.
+static int runFaultCampaign(const char *memFname, const TRunOpts &opts) {
+    if ((0 == memFname) || !isImage(memFname)) {
+        cout << "Error: -fi needs an image mem file (see -mkimage)" << endl;
+        return (EXIT_FAILURE);
+    }
+    TFaultCampaign campaign(memFname, opts.fiInterval);
+    if (!campaign.runGolden(opts.maxInstrs, cout)) {
+        return (EXIT_FAILURE);
+    }
+    campaign.generate(opts.fiCnt, opts.fiSeed);
+    const unsigned nthreads = (0 != opts.threads) ? opts.threads
+                                                  : TBatchRunner::getHostThreads();
+    const double secs = campaign.run(nthreads);
+    campaign.writeReport(cout, secs, nthreads);
+    if (0 != opts.fiOutFname) {
+        std::ofstream ofs(opts.fiOutFname);
+        ASSERT_TRUE(false == ofs.fail());
+        campaign.writeCsv(ofs);
+        cout << "Info: " << opts.fiOutFname << ": wrote results" << endl;
+    }
+    return (EXIT_SUCCESS);
+}
+
+//Run memFname on opts.harts harts sharing memory (see multihart.hxx).
+static int runHarts(const char *memFname, unsigned memBits, const TRunOpts &opts) {
+    if (0 == memFname) {
+        cout << "Error: -harts needs a mem file" << endl;
+        return (EXIT_FAILURE);
+    }
+    const unsigned maxThreads = (0 != opts.threads) ? opts.threads
+                                                    : TBatchRunner::getHostThreads();
+    if (opts.hartsBench) {
+        //1, 2, 4, ... maxThreads (at most one per hart): a fresh system each
+        const unsigned most = (maxThreads < opts.harts) ? maxThreads : opts.harts;
+        double base = 0;
+        for (unsigned n = 1; ; n = (2 * n < most) ? (2 * n) : most) {
+            TMultiHart sys(memFname, opts.harts, memBits);
+            const double secs = sys.run(n, opts.quantum, opts.maxInstrs);
+            const double mips = sys.getInstrs() / secs / 1e6;
+            if (1 == n) {
+                base = mips;
+            }
+            sys.writeReport(cout);
+            cout << "Info: harts: " << n << " thread(s): " << mips
+                 << " MIPS (x" << (mips / base) << ")" << endl;
+            if (most == n) {
+                break;
+            }
+        }
+        return (EXIT_SUCCESS);
+    }
+    TMultiHart sys(memFname, opts.harts, memBits);
+    sys.run(opts.hartsRr ? 0 : maxThreads, opts.quantum, opts.maxInstrs);
+    sys.writeReport(cout);
+    sys.getHart(0).dumpRegs(0, 7);
+    return (EXIT_SUCCESS);
+}
+
+//Benchmark kernels [0, n) on each engine (see bench.hxx).
+static int runBench(char **kernels, int n, unsigned memBits, const TRunOpts &opts) {
+    static const MiscCpu::EEngine cEngines[] = {
+        MiscCpu::eSwitchEngine, MiscCpu::eThreadedEngine, MiscCpu::eJitEngine
+    };
+    TBenchRunner runner(memBits, opts.benchWarmup, opts.benchReps);
+    bool ok = true;
+    for (int k = 0; k < n; k++) {
+        for (unsigned i = 0; i < sizeof(cEngines)/sizeof(cEngines[0]); i++) {
+            ok = runner.run(kernels[k], cEngines[i], cout) && ok;
+        }
+    }
+    if (0 != opts.benchOutFname) {
+        std::ofstream ofs(opts.benchOutFname);
+        ASSERT_TRUE(false == ofs.fail());
+        runner.writeJson(ofs);
+        cout << "Info: " << opts.benchOutFname << ": wrote results" << endl;
+    } else {
+        runner.writeJson(cout);
+    }
+    return ok ? (EXIT_SUCCESS) : (EXIT_FAILURE);
+}
+
+//Write records [from, from+count) (count 0: all) with pc in [pcLo, pcHi].
+static void dumpTrace(const char *fname, TUint64 from, TUint64 count,
+        TUint32 pcLo, TUint32 pcHi) {
+    TTraceReader reader(fname);
+    reader.setPcRange(pcLo, pcHi);
+    reader.seek(from);
+    TTraceRecord rec;
+    while (reader.next(rec) && ((0 == count) || (rec.index < from + count))) {
+        rec.write(cout);
+    }
+}
+
+static void usage(const char *argv0) {
+    cout << "Usage: " << argv0 << " [-switch|-jit|-cmp] [-stats file]" << endl
+         << "       [-prof file [-prof-interval n] [-syms file]]" << endl
+         << "       [-mkimage file [-syms file]] [-mktext file] [-mem-bits n]" << endl
+         << "       [-batch jobs [-batch-out file] [-threads n] [-batch-bench]" << endl
+         << "        [-max-instrs n] [-simd 8|16 [-simd-check]]]" << endl
+         << "       [-fi n [-fi-seed s] [-fi-interval n] [-fi-out file] [-threads n]" << endl
+         << "        [-max-instrs n]]" << endl
+         << "       [-harts n [-quantum n] [-threads n] [-harts-rr | -harts-bench]" << endl
+         << "        [-max-instrs n]]" << endl
+         << "       [-ckpt prefix -ckpt-every n]" << endl
+         << "       [-trace file [-trace-deflate]] [-io] [-blockdev file]" << endl
+         << "       [-timing [-timing-cfg file]]" << endl
+         << "       [-rdebug [-rdebug-interval n] [-rdebug-mem MiB]] [-gdb port|path]" << endl
+         << "       [-restore file | mem.hex|mem.img|mem.s]" << endl
+         << "   or: " << argv0 << " -trace-dump file [-trace-from n] [-trace-count n]" << endl
+         << "       [-trace-pc lo:hi]" << endl
+         << "   or: " << argv0 << " -trace-diff file file" << endl
+         << "   or: " << argv0 << " -cosim req rsp [-mem-bits n] [mem.hex|mem.img]" << endl
+         << "   or: " << argv0 << " -bench-alu n [-mem-bits n]" << endl
+         << "   or: " << argv0 << " [-mem-bits n] [-bench-warmup n] [-bench-reps n]" << endl
+         << "       [-bench-out file] -bench kernel..." << endl
+         << "  -switch  use switch dispatch (default is threaded)" << endl
+         << "  -jit     use x86-64 translation" << endl
+         << "  -no-fuse threaded: dispatch common pairs (cmp/br, ...) one" << endl
+         << "           at a time" << endl
+         << "  -hle     run built in native hooks (MULT16u) in place of the" << endl
+         << "           guest routines of those names (symbols as for -prof)" << endl
+         << "  -hle-verify  as -hle, but run the guest routines as well and" << endl
+         << "           report where a hook's result differs" << endl
+         << "  -cmp     run all engines and compare final state" << endl
+         << "  -stats   write opcode/branch/call/pc statistics to file" << endl
+         << "           (.json: json, else csv); report fused instructions" << endl
+         << "  -prof    write sampled call stacks (folded, for flame graphs)" << endl
+         << "  -prof-interval  instructions between samples" << endl
+         << "  -syms    symbol map (from asm -sym) for -prof/-mkimage" << endl
+         << "           (default for -prof: symbols of image or .s mem file)" << endl
+         << "  -mkimage write loaded memory as binary image; do not run" << endl
+         << "  -mktext  write assembled mem.s as text (as asm/lib/main.rb);" << endl
+         << "           do not run" << endl
+         << "  -mem-bits  log2 words of memory (1..32, default 20; below 32" << endl
+         << "           with -io/-blockdev); host pages are committed only as touched" << endl
+         << "  -batch   run each line of jobs (rN=val mA=val pc=val) on its own" << endl
+         << "           copy of image mem.img; write final state as csv" << endl
+         << "           (to -batch-out file, else stdout)" << endl
+         << "  -threads worker threads for -batch, -fi, -harts (default: host" << endl
+         << "           cpus)" << endl
+         << "  -batch-bench  report jobs/sec at 1, 2, 4, ... threads" << endl
+         << "  -max-instrs   instruction budget per job (default: to eHalt)" << endl
+         << "  -simd    run jobs in lockstep groups of 8 or 16 (registers of a" << endl
+         << "           group in host vectors); report lane utilization" << endl
+         << "  -simd-check  also run each job alone and compare final state" << endl
+         << "  -fi      inject n single bit flips (register, memory, fetched" << endl
+         << "           instruction, flag) into runs of image mem.img; report" << endl
+         << "           masked/sdc/hang/crash per target (see faultinj.hxx)" << endl
+         << "  -fi-seed  seed of injection times and targets (1)" << endl
+         << "  -fi-interval  golden state compared every n instructions (4096)" << endl
+         << "  -fi-out  write one csv row per injection to file" << endl
+         << "  -harts   run mem file on n harts sharing memory, each with its" << endl
+         << "           own registers, from r0 = hart, r1 = n (see multihart.hxx);" << endl
+         << "           report MIPS per hart and in all" << endl
+         << "  -quantum instructions per hart between barriers (10000)" << endl
+         << "  -harts-rr  run harts in turn on one thread (deterministic)" << endl
+         << "  -harts-bench  report MIPS at 1, 2, 4, ... threads" << endl
+         << "  -ckpt    save checkpoint prefix.N.ckp every -ckpt-every n" << endl
+         << "           instructions (interpreted; not with -stats/-prof)" << endl
+         << "  -restore start from checkpoint file instead of mem file" << endl
+         << "  -io      map console (stdin/stdout) at 0xffff0000 and" << endl
+         << "           microsecond timer at 0xffff0010" << endl
+         << "  -blockdev  map block device on file at 0xffff1000" << endl
+         << "  -timing  report cycles, CPI, stalls and cache hit rates of a" << endl
+         << "           pipelined model of the run (interpreted)" << endl
+         << "  -timing-cfg  latencies and cache sizes for -timing (see" << endl
+         << "           timing.hxx)" << endl
+         << "  -rdebug  debug on stdin with reverse step/continue (commands" << endl
+         << "           in reverse.hxx; interpreted; not with -io/-blockdev)" << endl
+         << "  -rdebug-interval  instructions between snapshots (4096)" << endl
+         << "  -rdebug-mem  bound on undo log and snapshots (16 MiB)" << endl
+         << "  -gdb     serve gdb remote protocol on localhost port or Unix" << endl
+         << "           socket path (see gdbstub.hxx; interpreted)" << endl
+         << "  -trace   record every instruction (pc, ir, register, memory and" << endl
+         << "           flag changes) to delta-encoded file (interpreted)" << endl
+         << "  -trace-deflate  also deflate the trace (about 25% smaller, but" << endl
+         << "           deflate is several times slower than the simulation)" << endl
+         << "  -trace-dump  write records of trace file, one per line, from" << endl
+         << "           instruction -trace-from, at most -trace-count of them," << endl
+         << "           only those with pc in -trace-pc" << endl
+         << "  -trace-diff  report first record which differs" << endl
+         << "  -telemetry  publish instructions, MIPS, pc, call depth, stores" << endl
+         << "           to /dev/shm/name while running (see telemetry.hxx;" << endl
+         << "           interpreted: not with -jit)" << endl
+         << "  -telemetry-watch  show telemetry name until its run is done:" << endl
+         << "           a top-like view, or rows appended to -telemetry-csv" << endl
+         << "           file, every -telemetry-period seconds (1)" << endl
+         << "  -cosim   serve memory to RTL (vlog/cosim.v) on pipes req/rsp and" << endl
+         << "           check its state after each instruction; stop at first" << endl
+         << "           difference" << endl
+         << "  -bench-alu  time n MULT16u (shift/and/add) loops on each engine" << endl
+         << "  -bench   time each kernel (mem file; suite: asm/bench, make bench)" << endl
+         << "           on each engine; write json (to -bench-out file, else" << endl
+         << "           stdout; see bench.hxx).  Last option" << endl
+         << "  -bench-warmup  untimed runs first (1)" << endl
+         << "  -bench-reps  timed runs, each freshly loaded (5)" << endl;
+}
+
+int main(int argc, char** argv) {
+    MiscCpu::EEngine engine = MiscCpu::eThreadedEngine;
+    bool doCmp = false;
+    unsigned memBits = 20;
+    const char *imageFname = 0, *textFname = 0;
+    TRunOpts opts;
+    const char *traceDump = 0, *traceDiff[2] = {0, 0};
+    const char *telemetryWatch = 0, *telemetryCsv = 0;
+    double telemetryPeriod = 1.0;
+    const char *cosim[2] = {0, 0};
+    TUint32 benchAlu = 0;
+    TUint64 traceFrom = 0, traceCount = 0;
+    TUint32 tracePcLo = 0, tracePcHi = ~0u;
+    int argi = 1;
+    for (; argi < argc && '-' == argv[argi][0]; argi++) {
+        string opt = argv[argi];
+        if ("-switch" == opt) {
+            engine = MiscCpu::eSwitchEngine;
+        } else if ("-jit" == opt) {
+            engine = MiscCpu::eJitEngine;
+        } else if ("-no-fuse" == opt) {
+            opts.noFuse = true;
+        } else if ("-hle" == opt) {
+            opts.hle = true;
+        } else if ("-hle-verify" == opt) {
+            opts.hle = opts.hleVerify = true;
+        } else if ("-cmp" == opt) {
+            doCmp = true;
+        } else if (("-stats" == opt) && (argi + 1 < argc)) {
+            opts.statsFname = argv[++argi];
+        } else if (("-prof" == opt) && (argi + 1 < argc)) {
+            opts.profFname = argv[++argi];
+        } else if (("-prof-interval" == opt) && (argi + 1 < argc)) {
+            opts.profInterval = strtoul(argv[++argi], 0, 0);
+        } else if (("-syms" == opt) && (argi + 1 < argc)) {
+            opts.symsFname = argv[++argi];
+        } else if (("-mem-bits" == opt) && (argi + 1 < argc)) {
+            memBits = strtoul(argv[++argi], 0, 0);
+            if ((memBits < 1) || (memBits > 32)) {
+                usage(argv[0]);
+                return (EXIT_FAILURE);
+            }
+        } else if (("-batch" == opt) && (argi + 1 < argc)) {
+            opts.batchFname = argv[++argi];
+        } else if (("-batch-out" == opt) && (argi + 1 < argc)) {
+            opts.batchOutFname = argv[++argi];
+        } else if (("-threads" == opt) && (argi + 1 < argc)) {
+            opts.threads = strtoul(argv[++argi], 0, 0);
+        } else if ("-batch-bench" == opt) {
+            opts.batchBench = true;
+        } else if (("-max-instrs" == opt) && (argi + 1 < argc)) {
+            opts.maxInstrs = strtoull(argv[++argi], 0, 0);
+        } else if (("-simd" == opt) && (argi + 1 < argc)) {
+            opts.simdLanes = strtoul(argv[++argi], 0, 0);
+            if ((8 != opts.simdLanes) && (16 != opts.simdLanes)) {
+                usage(argv[0]);
+                return (EXIT_FAILURE);
+            }
+        } else if ("-simd-check" == opt) {
+            opts.simdCheck = true;
+        } else if (("-ckpt" == opt) && (argi + 1 < argc)) {
+            opts.ckptPrefix = argv[++argi];
+        } else if (("-ckpt-every" == opt) && (argi + 1 < argc)) {
+            opts.ckptEvery = strtoull(argv[++argi], 0, 0);
+        } else if (("-restore" == opt) && (argi + 1 < argc)) {
+            opts.restoreFname = argv[++argi];
+        } else if ("-io" == opt) {
+            opts.io = true;
+        } else if (("-blockdev" == opt) && (argi + 1 < argc)) {
+            opts.blockFname = argv[++argi];
+        } else if ("-timing" == opt) {
+            opts.timing = true;
+        } else if (("-timing-cfg" == opt) && (argi + 1 < argc)) {
+            opts.timingCfgFname = argv[++argi];
+        } else if ("-rdebug" == opt) {
+            opts.rdebug = true;
+        } else if (("-rdebug-interval" == opt) && (argi + 1 < argc)) {
+            opts.rdebugInterval = strtoul(argv[++argi], 0, 0);
+        } else if (("-rdebug-mem" == opt) && (argi + 1 < argc)) {
+            opts.rdebugMiB = strtoull(argv[++argi], 0, 0);
+        } else if (("-gdb" == opt) && (argi + 1 < argc)) {
+            opts.gdbAddr = argv[++argi];
+        } else if (("-bench-warmup" == opt) && (argi + 1 < argc)) {
+            opts.benchWarmup = strtoul(argv[++argi], 0, 0);
+        } else if (("-bench-reps" == opt) && (argi + 1 < argc)) {
+            opts.benchReps = strtoul(argv[++argi], 0, 0);
+        } else if (("-bench-out" == opt) && (argi + 1 < argc)) {
+            opts.benchOutFname = argv[++argi];
+        } else if (("-bench" == opt) && (argi + 1 < argc) && (0 < opts.benchReps)) {
+            //the rest are kernels
+            return runBench(&argv[argi + 1], argc - argi - 1, memBits, opts);
+        } else if (("-fi" == opt) && (argi + 1 < argc)) {
+            opts.fiCnt = strtoul(argv[++argi], 0, 0);
+        } else if (("-fi-seed" == opt) && (argi + 1 < argc)) {
+            opts.fiSeed = strtoul(argv[++argi], 0, 0);
+        } else if (("-fi-interval" == opt) && (argi + 1 < argc)) {
+            opts.fiInterval = strtoul(argv[++argi], 0, 0);
+        } else if (("-fi-out" == opt) && (argi + 1 < argc)) {
+            opts.fiOutFname = argv[++argi];
+        } else if (("-harts" == opt) && (argi + 1 < argc)) {
+            opts.harts = strtoul(argv[++argi], 0, 0);
+        } else if (("-quantum" == opt) && (argi + 1 < argc)) {
+            opts.quantum = strtoull(argv[++argi], 0, 0);
+        } else if ("-harts-rr" == opt) {
+            opts.hartsRr = true;
+        } else if ("-harts-bench" == opt) {
+            opts.hartsBench = true;
+        } else if (("-trace" == opt) && (argi + 1 < argc)) {
+            opts.traceFname = argv[++argi];
+        } else if ("-trace-deflate" == opt) {
+            opts.traceDeflate = true;
+        } else if (("-telemetry" == opt) && (argi + 1 < argc)) {
+            opts.telemetryName = argv[++argi];
+        } else if (("-telemetry-watch" == opt) && (argi + 1 < argc)) {
+            telemetryWatch = argv[++argi];
+        } else if (("-telemetry-csv" == opt) && (argi + 1 < argc)) {
+            telemetryCsv = argv[++argi];
+        } else if (("-telemetry-period" == opt) && (argi + 1 < argc)) {
+            telemetryPeriod = strtod(argv[++argi], 0);
+            if (!(0 < telemetryPeriod)) {
+                usage(argv[0]);
+                return (EXIT_FAILURE);
+            }
+        } else if (("-trace-dump" == opt) && (argi + 1 < argc)) {
+            traceDump = argv[++argi];
+        } else if (("-trace-from" == opt) && (argi + 1 < argc)) {
+            traceFrom = strtoull(argv[++argi], 0, 0);
+        } else if (("-trace-count" == opt) && (argi + 1 < argc)) {
+            traceCount = strtoull(argv[++argi], 0, 0);
+        } else if (("-trace-pc" == opt) && (argi + 1 < argc)) {
+            char *end = 0;
+            tracePcLo = strtoul(argv[++argi], &end, 0);
+            if (':' != *end) {
+                usage(argv[0]);
+                return (EXIT_FAILURE);
+            }
+            tracePcHi = strtoul(end + 1, 0, 0);
+        } else if (("-trace-diff" == opt) && (argi + 2 < argc)) {
+            traceDiff[0] = argv[++argi];
+            traceDiff[1] = argv[++argi];
+        } else if (("-cosim" == opt) && (argi + 2 < argc)) {
+            cosim[0] = argv[++argi];
+            cosim[1] = argv[++argi];
+        } else if (("-bench-alu" == opt) && (argi + 1 < argc)) {
+            benchAlu = strtoul(argv[++argi], 0, 0);
+            if (0 == benchAlu) {
+                usage(argv[0]);
+                return (EXIT_FAILURE);
+            }
+        } else if (("-mkimage" == opt) && (argi + 1 < argc)) {
+            imageFname = argv[++argi];
+        } else if (("-mktext" == opt) && (argi + 1 < argc)) {
+            textFname = argv[++argi];
+        } else {
+            usage(argv[0]);
+            return (EXIT_FAILURE);
+        }
+    }
+    const char *memFname = (argi < argc) ? argv[argi] : 0;
+    opts.memFname = memFname;
+    if (((0 != opts.ckptEvery) != (0 != opts.ckptPrefix)) ||
+        ((0 != opts.ckptEvery) && ((0 != opts.statsFname) || (0 != opts.profFname) ||
+                                   (0 != opts.traceFname) || opts.timing)) ||
+        ((0 != opts.timingCfgFname) && !opts.timing) ||
+        (opts.rdebug && ((0 != opts.ckptEvery) || (0 != opts.statsFname) ||
+                         (0 != opts.profFname) || (0 != opts.traceFname) ||
+                         opts.timing || opts.io || (0 != opts.blockFname) ||
+                         (0 == opts.rdebugInterval))) ||
+        ((0 != opts.gdbAddr) && ((0 != opts.ckptEvery) || (0 != opts.statsFname) ||
+                                 (0 != opts.profFname) || (0 != opts.traceFname) ||
+                                 opts.timing || opts.rdebug)) ||
+        ((0 != opts.fiCnt) && ((0 != opts.batchFname) || (0 == opts.fiInterval))) ||
+        ((opts.hartsRr || opts.hartsBench) && (0 == opts.harts)) ||
+        (opts.hle && ((0 != opts.traceFname) || opts.rdebug ||
+                      (0 != opts.batchFname) || (0 != opts.fiCnt) ||
+                      (0 != opts.harts))) ||
+        ((0 != telemetryCsv) && (0 == telemetryWatch)) ||
+        (opts.traceDeflate && (0 == opts.traceFname)) ||
+        //devices sit above memory: none is left at 2^32 words
+        ((opts.io || (0 != opts.blockFname)) && (32 == memBits)) ||
+        ((0 != opts.telemetryName) && ((0 != opts.traceFname) || opts.rdebug ||
+                                       (0 != opts.gdbAddr) || (0 != opts.ckptEvery) ||
+                                       (0 != opts.batchFname) || (0 != opts.fiCnt) ||
+                                       (0 != opts.harts) ||
+                                       (MiscCpu::eJitEngine == engine))) ||
+        ((0 != opts.harts) && ((0 != opts.batchFname) || (0 != opts.fiCnt) ||
+                               (0 != opts.ckptEvery) || (0 != opts.statsFname) ||
+                               (0 != opts.profFname) || (0 != opts.traceFname) ||
+                               opts.timing || opts.rdebug || (0 != opts.gdbAddr) ||
+                               opts.io || (0 != opts.blockFname) ||
+                               (0 != opts.restoreFname) || (0 == opts.quantum) ||
+                               (opts.hartsRr && opts.hartsBench)))) {
+        usage(argv[0]);
+        return (EXIT_FAILURE);
+    }
+    if (0 != benchAlu) {
+        return runAluBench(benchAlu, memBits);
+    } else if (0 != telemetryWatch) {
+        if (!watchTelemetry(telemetryWatch, telemetryCsv, telemetryPeriod, cout)) {
+            return (EXIT_FAILURE);
+        }
+    } else if (0 != traceDump) {
+        dumpTrace(traceDump, traceFrom, traceCount, tracePcLo, tracePcHi);
+    } else if (0 != traceDiff[0]) {
+        if (~(TUint64)0 != diffTraces(traceDiff[0], traceDiff[1], cout)) {
+            return (EXIT_FAILURE);
+        }
+        cout << "Info: traces match" << endl;
+    } else if (0 != cosim[0]) {
+        MiscCpu ref(memFname, 5, memBits, true, MiscCpu::eSwitchEngine);
+        MiscCpu bus(memFname, 5, memBits, false, MiscCpu::eSwitchEngine);
+        if (0 == memFname) {
+            loadBuiltin(ref);
+            loadBuiltin(bus);
+        }
+        TCosim sim(ref, bus);
+        const double t0 = nowSecs();
+        const bool ok = sim.run(cosim[0], cosim[1], cout);
+        const double secs = nowSecs() - t0;
+        cout << "Info: cosim: " << sim.getRetired() << " instruction(s) compared in "
+             << secs << " sec(s)" << endl;
+        if (!ok) {
+            return (EXIT_FAILURE);
+        }
+        cout << "Info: RTL matches reference" << endl;
+    } else if (0 != opts.batchFname) {
+        return runBatch(memFname, engine, opts);
+    } else if (0 != opts.fiCnt) {
+        return runFaultCampaign(memFname, opts);
+    } else if (0 != opts.harts) {
+        return runHarts(memFname, memBits, opts);
+    } else if (0 != textFname) {
+        MiscCpu cpu(0, 5, memBits, false, engine);
+        TAssembler as(cpu);
+        if ((0 == memFname) || !isAsmSource(memFname)) {
+            cout << "Error: -mktext needs a source mem file (.s)" << endl;
+            return (EXIT_FAILURE);
+        }
+        if (!as.assembleFile(memFname, cout)) {
+            return (EXIT_FAILURE);
+        }
+        std::ofstream ofs(textFname);
+        ASSERT_TRUE(false == ofs.fail());
+        as.writeText(ofs);
+        cout << "Info: " << textFname << ": wrote " << as.getWords().size()
+             << " word(s)" << endl;
+    } else if (0 != imageFname) {
+        MiscCpu cpu(0, 5, memBits, false, engine);
+        TSymbolMap syms;
+        TUint32 addr = 0, entry = 0;
+        unsigned n;
+        if ((0 != memFname) && isAsmSource(memFname)) {
+            //words at their .ORG, labels as symbols
+            TAssembler as(cpu);
+            if (!as.assembleFile(memFname, cout)) {
+                return (EXIT_FAILURE);
+            }
+            as.load(cpu);
+            n = as.getExtent(addr);
+            entry = as.getEntry();
+            syms = as.getSymbols();
+        } else {
+            n = (0 != memFname) ? cpu.loadMemory(memFname) : loadBuiltin(cpu);
+        }
+        if (0 != opts.symsFname) {
+            syms.load(opts.symsFname);
+        }
+        cpu.saveImage(imageFname, addr, n, entry, &syms);
+        cout << "Info: " << imageFname << ": wrote " << n << " word(s), "
+             << syms.size() << " symbol(s)" << endl;
+    } else if (doCmp) {
+        static const MiscCpu::EEngine cDuts[] = {
+            MiscCpu::eThreadedEngine, MiscCpu::eJitEngine
+        };
+        static const char* const cDutNames[] = {"threaded", "jit"};
+        MiscCpu ref(memFname, 5, memBits, true, MiscCpu::eSwitchEngine);
+        if (0 == memFname) {
+            loadBuiltin(ref);
+        }
+        ref.run();
+        status(ref);
+        unsigned nfails = 0;
+        for (unsigned i = 0; i < sizeof(cDuts)/sizeof(cDuts[0]); i++) {
+            MiscCpu dut(memFname, 5, memBits, true, cDuts[i]);
+            if (0 == memFname) {
+                loadBuiltin(dut);
+            }
+            dut.run();
+            unsigned ndiffs = dut.compareState(ref, cout);
+            if (ref.getPerfMon()->getInstructionCnt() !=
+                dut.getPerfMon()->getInstructionCnt()) {
+                cout << "instruction count: " << dut.getPerfMon()->getInstructionCnt()
+                     << " (expected " << ref.getPerfMon()->getInstructionCnt()
+                     << ")" << endl;
+                ndiffs++;
+            }
+            if (0 != ndiffs) {
+                cout << "Error: " << cDutNames[i] << " engine differs from switch engine ("
+                     << ndiffs << " difference(s))" << endl;
+                nfails++;
+            } else {
+                cout << "Info: " << cDutNames[i] << " and switch engines match" << endl;
+            }
+        }
+        if (0 != nfails) {
+            return (EXIT_FAILURE);
+        }
+    } else if (0 != opts.restoreFname) {
+        TCheckpointHeader hdr;
+        if (!readCheckpointHeader(opts.restoreFname, hdr)) {
+            cout << "Error: " << opts.restoreFname << ": not a checkpoint" << endl;
+            return (EXIT_FAILURE);
+        }
+        if ((opts.io || (0 != opts.blockFname)) && (32 == hdr.memBits)) {
+            cout << "Error: " << opts.restoreFname
+                 << ": 2^32 words of memory leave no room for -io/-blockdev" << endl;
+            return (EXIT_FAILURE);
+        }
+        MiscCpu cpu(0, hdr.regBits, hdr.memBits, true, engine);
+        const double t0 = nowSecs();
+        unsigned n = cpu.restoreCheckpoint(opts.restoreFname);
+        cout << "Info: " << opts.restoreFname << ": restored " << n
+             << " page(s) in " << (1e3 * (nowSecs() - t0)) << " ms" << endl;
+        run(cpu, opts);
+		cpu.dumpRegs(0,7); cpu.dumpRegs(31);
+        status(cpu, 0 != opts.statsFname);
+    } else if (0 != memFname) {
+        MiscCpu cpu(memFname, 5, memBits, true, engine);   //mem.hex
+        run(cpu, opts);
+		cpu.dumpRegs(0,7); cpu.dumpRegs(31);
+        status(cpu, 0 != opts.statsFname);
+        cpu.dumpMemUsage(cout);
+    } else {
+        MiscCpu cpu(0, 5, memBits, true, engine);
+        loadBuiltin(cpu);
+        run(cpu, opts);
+        status(cpu, 0 != opts.statsFname);
+    }
+
+
+    return (EXIT_SUCCESS);
+}
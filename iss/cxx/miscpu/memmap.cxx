@@ -0,0 +1,108 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "memmap.hxx"
+
+namespace miscpu
+{
+    TMappedRegion::TMappedRegion(TUint64 bytes) {
+        const TUint64 cPage = getPageBytes();
+        m_bytes = (bytes + cPage - 1) & ~(cPage - 1);
+        if (0 == m_bytes) {
+            m_bytes = cPage;
+        }
+        void *p = mmap(0, m_bytes, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        ASSERT_TRUE(MAP_FAILED != p);
+        m_base = p;
+    }
+
+    TMappedRegion::~TMappedRegion() {
+        munmap(m_base, m_bytes);
+    }
+
+    unsigned TMappedRegion::getPageBytes() {
+        static const unsigned cPage = sysconf(_SC_PAGESIZE);
+        return cPage;
+    }
+
+    TUint64 TMappedRegion::getResidentPages() const {
+        std::vector<TUint64> pages;
+        getResidentPages(pages);
+        return pages.size();
+    }
+
+    void TMappedRegion::getResidentPages(std::vector<TUint64> &pages) const {
+        const TUint64 cPage = getPageBytes();
+        const TUint64 cChunkPages = 1 << 20;
+        std::vector<unsigned char> vec(cChunkPages);
+        for (TUint64 off = 0; off < m_bytes; off += cChunkPages * cPage) {
+            TUint64 n = (m_bytes - off) / cPage;
+            if (n > cChunkPages) {
+                n = cChunkPages;
+            }
+            ASSERT_TRUE(0 == mincore((char*)m_base + off, n * cPage, &vec[0]));
+            for (TUint64 i = 0; i < n; i++) {
+                if (vec[i] & 1) {
+                    pages.push_back((off / cPage) + i);
+                }
+            }
+        }
+    }
+
+    void TMappedRegion::discard() {
+        //replace in place: m_base is unchanged
+        void *p = mmap(m_base, m_bytes, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+                       -1, 0);
+        ASSERT_TRUE(m_base == p);
+    }
+
+    bool TMappedRegion::mapFile(int fd, TUint64 fileOffset, TUint64 offset,
+            TUint64 n, TUint64 *lo, TUint64 *hi) {
+        ASSERT_TRUE((offset <= m_bytes) && (n <= (m_bytes - offset)));
+        const TUint64 cPage = getPageBytes();
+        *lo = *hi = offset;
+        if ((fileOffset % cPage) != (offset % cPage)) {
+            return false;
+        }
+        const TUint64 skip = (cPage - (offset % cPage)) % cPage;
+        if (n <= skip) {
+            return true;    //no whole page
+        }
+        const TUint64 len = (n - skip) & ~(cPage - 1);
+        if (0 != len) {
+            void *p = mmap((char*)m_base + offset + skip, len,
+                           PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+                           fd, fileOffset + skip);
+            ASSERT_TRUE(MAP_FAILED != p);
+        }
+        *lo = offset + skip;
+        *hi = *lo + len;
+        return true;
+    }
+};
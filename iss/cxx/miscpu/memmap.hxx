@@ -0,0 +1,120 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+#if !defined(_miscpu_memmap_hxx_)
+#    define  _miscpu_memmap_hxx_
+
+#include <vector>
+#include "xyzzy/portable.hxx"
+#include "xyzzy/assert.hxx"
+
+using xyzzy::TUint32;
+using xyzzy::TUint64;
+
+namespace miscpu
+{
+    /**
+     * Reserved (not committed) private anonymous address range: host
+     * pages are allocated, zero filled, on first write.  So a 2^32 word
+     * guest memory costs only the pages the guest (or a loader) touches;
+     * the host MMU serves as page table and TLB.
+     *
+     * Whole pages can be replaced by copy-on-write mappings of a file
+     * (see mapFile()).
+     */
+    class TMappedRegion {
+    public:
+        explicit TMappedRegion(TUint64 bytes);
+
+        ~TMappedRegion();
+
+        TUint64 getBytes() const {
+            return m_bytes;
+        }
+
+        static unsigned getPageBytes();
+
+        //Host pages of the range which are resident (mincore(2)).
+        //NOTE: includes pages only read (mapped to the zero page).
+        TUint64 getResidentPages() const;
+
+        //Append (ascending) index of each resident host page.
+        void getResidentPages(std::vector<TUint64> &pages) const;
+
+        //Drop every page (and file mapping): all demand zero again.
+        void discard();
+
+        /**
+         * Map file fd at fileOffset over bytes [offset, offset+n): only
+         * whole host pages are mapped (returned as [*lo, *hi)); the
+         * caller copies the bytes outside that range.
+         * Returns false (nothing mapped) if fileOffset and offset are
+         * not congruent modulo the page size.
+         */
+        bool mapFile(int fd, TUint64 fileOffset, TUint64 offset, TUint64 n,
+                TUint64 *lo, TUint64 *hi);
+
+    protected:
+        void    *m_base;
+
+    private:
+        //not copyable
+        TMappedRegion(const TMappedRegion&);
+        TMappedRegion& operator=(const TMappedRegion&);
+
+        TUint64 m_bytes;    //mapped (page multiple)
+    };
+
+    /**
+     * Array of T in a TMappedRegion: elements not yet written are 0.
+     * Same element access as PTArray (bounds checked operator[]).
+     */
+    template<typename T>
+    class PTMappedArray : public TMappedRegion {
+    public:
+        explicit PTMappedArray(TUint64 len)
+            :   TMappedRegion(len * sizeof(T)),
+                m_len(len) {
+        }
+
+        TUint64 length() const {
+            return m_len;
+        }
+
+        T& operator[](TUint64 i) {
+            ASSERT_TRUE(i < m_len);
+            return ((T*)m_base)[i];
+        }
+
+        const T& operator[](TUint64 i) const {
+            ASSERT_TRUE(i < m_len);
+            return ((const T*)m_base)[i];
+        }
+
+    private:
+        TUint64 m_len;
+    };
+};
+
+#endif  //_miscpu_memmap_hxx_
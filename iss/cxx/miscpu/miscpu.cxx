@@ -23,10 +23,20 @@
 **/
 
 #include <fstream>
+#include <sstream>
+#include <algorithm>
 #include <cstdio>
 #include "xyzzy/assert.hxx"
 #include "miscpu.hxx"
+#include "miscpucore.hxx"
 #include "opcode.hxx"
+#include "jit.hxx"
+#include "image.hxx"
+#include "assembler.hxx"
+#include "iobus.hxx"
+#include "hosttime.hxx"
+#include "reverse.hxx"
+#include "hle.hxx"
 
 using xyzzy::TBitVec;
 
@@ -35,12 +45,35 @@ namespace miscpu
     MiscCpu::MiscCpu(const char *memFname,
         unsigned numRegsN,
         unsigned memDepthN,
-        bool useDfltPerfMon)
+        bool useDfltPerfMon,
+        EEngine engine)
         :   cRegsN(numRegsN),
             m_regs(1 << numRegsN),
-            m_mem(1 << memDepthN),
-            cSpRegIx((1 << numRegsN) - 1) {
-        ASSERT_TRUE((1 << OpCode::cOpCodeN) > OpCode::eNotUsed);
+            m_mem((TUint64)1 << memDepthN),
+            m_decoded((TUint64)1 << memDepthN),
+            cSpRegIx((1 << numRegsN) - 1),
+            m_engine(engine),
+            m_fusion(true),
+            m_fusedCnt(0),
+            m_storeCnt(0),
+            m_callDepth(0),
+            m_hleCall(0),
+            m_hleVerify(false),
+            m_hleGuest(false),
+            m_jit(0),
+            m_jitCodeMap(0),
+            m_bus(0),
+            m_undo(0),
+            m_hookStores(false),
+            m_stop(eNoStop),
+            m_faultStops(false),
+            m_stopAddr(0) {
+        m_regBase = &m_regs[0];
+        m_memBase = &m_mem[0];
+        m_decodedBase = &m_decoded[0];
+        m_memMask = m_mem.length() - 1;
+        ASSERT_TRUE(32 >= memDepthN);
+        ASSERT_TRUE((1 << OpCode::cOpCodeN) >= OpCode::eNotUsed);
         initialize();
         if (useDfltPerfMon) {
             setPerfMon(DefaultPerfMon::create());
@@ -50,25 +83,49 @@ namespace miscpu
         }
     }
 
+    MiscCpu::~MiscCpu() {
+        delete m_bus;
+        delete m_jit;
+    }
+
     void MiscCpu::initialize() {
         unsigned totalBits = (3 * cRegsN) + OpCode::cOpCodeN;
         ASSERT_TRUE(cInstRegNbits >= totalBits);   //enough for all opcode bits.
         for (int i = 0; i < m_regs.length(); i++) {
             m_regs[i] = 0xDEADBEEF;
         }
-        for (int i = 0; i < m_mem.length(); i++) {
-            m_mem[i] = OpCode::eNotUsed;
-        }
+        //m_mem, m_decoded: demand zero (word 0 is eNop)
         reset();
     }
 
     void MiscCpu::reset() {
         m_pc = 0;
-        m_ir = ~0;
-        m_cy = m_zero = false;
+        setZeroCy(false, false);
+        m_aluz = 0;     //lsl()/lsr() by 0 keep last alu output
+        m_flagA = m_flagB = m_flagZ = 0;
     }
 
-    void MiscCpu::loadMemory(string fname) {
+    unsigned MiscCpu::loadMemory(string fname) {
+        const double t0 = nowSecs();
+        const bool isImg = isImage(fname), isAsm = !isImg && isAsmSource(fname);
+        unsigned n;
+        if (isImg) {
+            n = loadImage(fname);
+        } else if (isAsm) {
+            TAssembler as(*this);
+            const bool ok = as.assembleFile(fname, std::cout);
+            ASSERT_TRUE(ok);
+            n = as.load(*this);
+        } else {
+            n = loadText(fname);
+        }
+        std::cout << "Info: " << fname << ": initialized " << n << " location(s) from "
+                  << (isImg ? "image" : (isAsm ? "source" : "text"))
+                  << " in " << (1e3 * (nowSecs() - t0)) << " ms" << std::endl;
+        return n;
+    }
+
+    unsigned MiscCpu::loadText(string fname) {
         std::ifstream ifs(fname.c_str());
         ASSERT_TRUE(false == ifs.fail());
         TUint32 val;
@@ -83,16 +140,45 @@ namespace miscpu
             if (ifs.fail()) break;
 #endif
 
-            m_mem[i++] = val;
+            writeMem(i++, val);
         }
         ifs.close();
-        std::cout << "Info: " << fname << ": initialized " << i
-                  << " location(s)" << std::endl;
+        return i;
     }
 
     void MiscCpu::loadMemory(const PTArray<TInt32> &instructs) {
         for (unsigned i = 0; i < instructs.length(); i++) {
-            m_mem[i] = instructs[i];
+            writeMem(i, instructs[i]);
+        }
+    }
+
+    void MiscCpu::mapDevice(TUint32 addr, TUint32 words, TIoDevice *dev) {
+        ASSERT_TRUE(addr > m_memMask);
+        if (0 == m_bus) {
+            m_bus = new TIoBus();
+        }
+        m_bus->map(addr, words, dev);
+    }
+
+    TInt32 MiscCpu::ioRead(TUint32 addr) {
+        if (0 == m_bus) {
+            fault(addr);    //neither memory nor device
+            return 0;
+        }
+        return m_bus->read(addr);
+    }
+
+    void MiscCpu::ioWrite(TUint32 addr, TInt32 val) {
+        if (0 == m_bus) {
+            fault(addr);
+            return;
+        }
+        m_bus->write(addr, val);
+    }
+
+    void MiscCpu::flushIo() {
+        if (0 != m_bus) {
+            m_bus->flush();
         }
     }
 
@@ -100,55 +186,268 @@ namespace miscpu
         m_perfMon = pmon;
     }
 
-    void MiscCpu::fetch() {
-        static const unsigned cImmedLsb = cInstRegNbits - 1 -
-                                          (OpCode::cOpCodeN + (2 * cRegsN));
-        /**
-         * instruction fields
-         * |--opcode--|--ixJ--|--ixK--|--immed--|
-         * |31......27|26...22|21...17|16......0|
-         * NOTE: immed only used (as offset) for eLoad/eStore
-         *
-         * conditional
-         * |--opcode--|--cond--|--immed--|
-         * |31......27|26....24|23......0|
-         *
-         * xxxi (arith, load) immediate:  i.e., "m_opcode.hasImmed()==true"
-         * |--opcode--|--ixJ--|--immed--|
-         * |31......27|26...22|21......0|
-         */
-        m_ir = m_mem[m_pc++];
-        //slice up instruction
-        unsigned lb = cInstRegNbits - 1,
-                 rb = cInstRegNbits - 1 - OpCode::cOpCodeN + 1;
-        OpCode::tAsBits opc(m_ir(lb,rb));
-        m_opCode = opc;
-        lb = rb - 1;
-        if (m_opCode.hasImmed()) {
-            rb = lb - cRegsN + 1;
-            m_ixJ = m_ir(lb,rb);
-            lb = rb - 1;
-            m_immed = m_ir(lb,0);
-        } else if (m_opCode.isBranchOrCall()) {
-            rb = lb - 2;
-            m_cond = (ECond)((int)m_ir(lb,rb));
-            ASSERT_TRUE(eNotUsed > m_cond);
-            lb = rb - 1;
-            m_immed = m_ir(lb,0);
+    void MiscCpu::predecode(TUint32 addr) {
+        predecodeT<TDynCfg>(addr);
+    }
+
+    bool MiscCpu::fuses(OpCode::EOp first, OpCode::EOp second) {
+        switch (first) {
+            case OpCode::eCmp: case OpCode::eCmpi:
+            case OpCode::eAnd: case OpCode::eAndi:
+            case OpCode::eAddi:
+                return (OpCode::eBr == second);
+            case OpCode::eSubi:
+                return (OpCode::eBr == second) || (OpCode::eCall == second);
+            case OpCode::eLoadr:
+                return (OpCode::eAnd == second) || (OpCode::eAndi == second);
+            case OpCode::ePush: case OpCode::ePop:
+                return (first == second);
+            default:
+                return false;
+        }
+    }
+
+    void MiscCpu::shareMemory(MiscCpu &owner) {
+        ASSERT_TRUE(owner.m_memMask == m_memMask);
+        ASSERT_TRUE((0 == m_bus) && (0 == m_jit));
+        m_memBase = owner.m_memBase;
+        m_decodedBase = owner.m_decodedBase;
+    }
+
+    void MiscCpu::setHook(TUint32 entry, THleHook *hook) {
+        if (0 == hook) {
+            m_hooks.erase(entry);
         } else {
-            m_cond = eNotUsed;
-            rb = lb - cRegsN + 1;
-            m_ixJ = m_ir(lb,rb);
-            lb = rb - 1; rb = lb - cRegsN + 1;
-            m_ixK = m_ir(lb,rb);
-            m_immed = m_ir(lb=cImmedLsb,0);
+            ASSERT_TRUE(0 == m_jit);    //translated calls would not check
+            m_hooks[entry] = hook;
+        }
+    }
+
+    void MiscCpu::callHook(bool taken) {
+        m_hleCall = 0;
+        if (!taken || m_hleGuest) {
+            return;
+        }
+        std::map<TUint32, THleHook*>::iterator it = m_hooks.find(m_pc);
+        if (m_hooks.end() == it) {
+            return;
+        }
+        THleHook &hook = *it->second;
+        m_callDepth--;  //returns before the next instruction
+        if (m_hleVerify) {
+            verifyHook(hook);
+        } else {
+            hook.call(*this);
+        }
+        hook.m_calls++;
+        if (!m_perfMon.isNull()) {
+            m_perfMon->incrInstructionCnt(hook.getInstrs());
         }
-        if (0 != m_ir(lb)) { //sign extend
-            TInt32 cSext = (~0) << lb;
-            m_immed |= cSext;
+        m_hleCall = &hook;
+    }
+
+    void MiscCpu::verifyHook(THleHook &hook) {
+        static const TUint64 cGuestMax = 1 << 24;   //else "did not return"
+        static const TUint64 cReportMax = 10;       //mismatches written
+        ASSERT_TRUE(0 == m_undo);   //not under TTimeTravel
+        const TUint32 sp = m_regBase[cSpRegIx];
+        if (sp > m_memMask) {
+            hook.call(*this);       //stack on a device: cannot be undone
+            return;
+        }
+        const unsigned nregs = m_regs.length();
+        const TUint32 pc = m_pc, retPc = m_memBase[sp];
+        const std::vector<TInt32> regs(m_regBase, m_regBase + nregs);
+        evalFlags();
+        const bool zero = m_zero, cy = m_cy;
+        //the eCall's, for monitors retiring it
+        const OpCode opCode = m_opCode;
+        const unsigned ixJ = m_ixJ, ixK = m_ixK;
+        const ECond cond = m_cond;
+        const TInt32 immed = m_immed, rj = m_rj, rk = m_rk;
+        //telemetry counts: the guest's stores, depth as returned
+        const TUint64 storeCnt = m_storeCnt;
+        const long long callDepth = m_callDepth;
+
+        //hook: note its result, then undo it
+        TUndoLog log;
+        setUndoLog(&log);
+        hook.call(*this);
+        setUndoLog(0);
+        const std::vector<TInt32> hookRegs(m_regBase, m_regBase + nregs);
+        const TUint32 hookPc = m_pc;
+        evalFlags();
+        const bool hookZero = m_zero, hookCy = m_cy;
+        std::map<TUint32, TInt32> hookMem;
+        for (TUint64 i = log.getBegin(); i < log.getEnd(); i++) {
+            const TUint32 addr = log.getEntry(i).addr;
+            hookMem[addr] = m_memBase[addr];
+        }
+        log.undo(*this, log.getBegin());
+        std::copy(regs.begin(), regs.end(), m_regBase);
+        m_pc = pc;
+        setZeroCy(zero, cy);
+        m_storeCnt = storeCnt;
+
+        //guest
+        const TUint64 mark = log.getEnd();
+        TNullMon mon;
+        TUint64 n = 0;
+        bool returned = false;
+        setUndoLog(&log);
+        m_hleGuest = true;
+        while (!returned && (n < cGuestMax)) {
+            runSwitchT<TDynCfg>(mon, 1);
+            n++;
+            if ((OpCode::eHalt == m_opCode.getOpcode()) || (eNoStop != m_stop)) {
+                break;
+            }
+            returned = (retPc == m_pc) && ((TUint32)m_regBase[cSpRegIx] > sp);
+        }
+        m_hleGuest = false;
+        setUndoLog(0);
+        const TUint64 guestStores = m_storeCnt - storeCnt;
+
+        std::ostringstream diffs;
+        if (!returned) {
+            diffs << " guest did not return (" << n << " instruction(s))";
+            //go on with the hook's result
+            log.undo(*this, mark);
+            for (std::map<TUint32, TInt32>::const_iterator it = hookMem.begin();
+                    it != hookMem.end(); ++it) {
+                setMem(it->first, it->second);
+            }
+            std::copy(hookRegs.begin(), hookRegs.end(), m_regBase);
+            m_pc = hookPc;
+            setZeroCy(hookZero, hookCy);
+        } else {
+            if (m_pc != hookPc) {
+                diffs << " pc=0x" << std::hex << hookPc << " (guest 0x" << m_pc
+                      << ")" << std::dec;
+            }
+            for (unsigned i = 0; i < nregs; i++) {
+                const bool clobbered = (i < 32) && (i != cSpRegIx) &&
+                                       (0 != ((hook.getClobbers() >> i) & 1));
+                if (!clobbered && (m_regBase[i] != hookRegs[i])) {
+                    diffs << " r" << i << "=" << hookRegs[i] << " (guest "
+                          << m_regBase[i] << ")";
+                }
+            }
+            //words either wrote: the guest's first old value is as before
+            std::set<TUint32> seen;
+            for (std::map<TUint32, TInt32>::const_iterator it = hookMem.begin();
+                    it != hookMem.end(); ++it) {
+                seen.insert(it->first);
+                if (m_memBase[it->first] != it->second) {
+                    diffs << " mem[0x" << std::hex << it->first << std::dec << "]="
+                          << it->second << " (guest " << m_memBase[it->first] << ")";
+                }
+            }
+            for (TUint64 i = mark; i < log.getEnd(); i++) {
+                const TUndoLog::TEntry &entry = log.getEntry(i);
+                if (seen.insert(entry.addr).second &&
+                    (m_memBase[entry.addr] != entry.old)) {
+                    diffs << " mem[0x" << std::hex << entry.addr << std::dec << "]="
+                          << entry.old << " (guest " << m_memBase[entry.addr] << ")";
+                }
+            }
+        }
+        m_opCode = opCode;
+        m_ixJ = ixJ;
+        m_ixK = ixK;
+        m_cond = cond;
+        m_immed = immed;
+        m_rj = rj;
+        m_rk = rk;
+        m_storeCnt = storeCnt + guestStores;
+        m_callDepth = callDepth;
+        hook.m_verified++;
+        hook.m_guestInstrs += n;
+        if (!diffs.str().empty()) {
+            if (hook.m_mismatches < cReportMax) {
+                std::cout << "Error: hle: " << hook.getName() << " called from 0x"
+                          << std::hex << (retPc - 1) << std::dec << ":"
+                          << diffs.str() << std::endl;
+            }
+            hook.m_mismatches++;
+        }
+    }
+
+    void MiscCpu::setMem(TUint32 addr, TInt32 val) {
+        ASSERT_TRUE(addr <= m_memMask);
+        writeMem(addr, val);
+    }
+
+    void MiscCpu::writeMem(TUint32 addr, TInt32 val) {
+        writeMemT<TDynCfg>(addr, val);
+    }
+
+    void MiscCpu::storeHook(TUint32 addr) {
+        if (0 != m_undo) {
+            m_undo->record(addr, m_memBase[addr]);
+        }
+        if (!m_watches.empty() && (0 != m_watches.count(addr))) {
+            m_stop = eWatchStop;
+            m_stopAddr = addr;
+            //The switch engine stops after this instruction retires.
+            m_opCode = OpCode(OpCode::eHalt);
+        }
+    }
+
+    void MiscCpu::trap(TUint32 pc) {
+        if (0 == m_traps.count(pc)) {
+            fault(pc);      //undefined instruction (see predecodeT())
+            return;
+        }
+        m_stop = eTrapStop;
+        m_stopAddr = pc;
+        m_opCode = OpCode(OpCode::eHalt);
+        m_ixJ = m_ixK = 0;
+    }
+
+    void MiscCpu::fault(TUint32 addr) {
+        ASSERT_TRUE(m_faultStops);
+        m_stop = eFaultStop;
+        m_stopAddr = addr;
+        m_opCode = OpCode(OpCode::eHalt);
+        m_ixJ = m_ixK = 0;
+    }
+
+    void MiscCpu::setTrap(TUint32 addr) {
+        ASSERT_TRUE(addr <= m_memMask);
+        m_traps.insert(addr);
+        m_decodedBase[addr].op1 = cTrapOp1;
+    }
+
+    void MiscCpu::clearTrap(TUint32 addr) {
+        ASSERT_TRUE(addr <= m_memMask);
+        m_traps.erase(addr);
+        if (cTrapOp1 == m_decodedBase[addr].op1) {
+            m_decodedBase[addr].op1 = cNotDecoded;
         }
     }
 
+    void MiscCpu::setWatch(TUint32 addr) {
+        ASSERT_TRUE(addr <= m_memMask);
+        m_watches.insert(addr);
+        m_hookStores = true;
+    }
+
+    void MiscCpu::clearWatch(TUint32 addr) {
+        m_watches.erase(addr);
+        m_hookStores = (0 != m_undo) || !m_watches.empty();
+    }
+
+    void MiscCpu::dumpMemUsage(std::ostream &os) const {
+        const TUint64 cPageKb = TMappedRegion::getPageBytes() / 1024;
+        const TUint64 memPages = m_mem.getResidentPages(),
+                      decPages = m_decoded.getResidentPages();
+        os << "Info: memory: " << m_mem.length() << " word(s) reserved, "
+           << memPages << " page(s) resident (" << (memPages * cPageKb)
+           << " KiB); predecode: " << decPages << " page(s) ("
+           << (decPages * cPageKb) << " KiB)" << std::endl;
+    }
+
 	void MiscCpu::dumpRegs(unsigned lo, unsigned hi) const {
 		std::ostream &os = std::cout;
 		TInt32 val;
@@ -159,178 +458,16 @@ namespace miscpu
 	}
 
     void MiscCpu::decode() {
-        OpCode::EOp opcode = m_opCode.getOpcode();
-        switch (opcode) {
-            case OpCode::eAdd:
-            case OpCode::eSub:
-            case OpCode::eCmp:
-            case OpCode::eLoad: 
-			case OpCode::eLoadr:
-            case OpCode::eStore:
-            case OpCode::eLsl:
-            case OpCode::eLsr:
-            case OpCode::eAsr:
-            case OpCode::eAnd:
-            case OpCode::eOr:
-            case OpCode::eXor:
-                m_rj = m_regs[m_ixJ];
-                m_rk = m_regs[m_ixK];
-                break;
-            case OpCode::eAndi:
-            case OpCode::eOri:
-            case OpCode::eXori:
-            case OpCode::eAddi:
-            case OpCode::eSubi:
-            case OpCode::eCmpi:
-            case OpCode::eLoadi:
-            case OpCode::eLsli:
-            case OpCode::eLsri:
-            case OpCode::eAsri:
-            case OpCode::eNot:
-            case OpCode::ePush:
-                m_rj = m_regs[m_ixJ];
-                break;
-            case OpCode::eLoadil:
-                //see execute();
-				break;
-            case OpCode::eNotUsed:
-                ASSERT_NEVER;
-                break;
-            default:
-                ;//do nothing
-        }
+        //Fields not used by an opcode are predecoded as 0 (see predecode()),
+        //so just read both: cheaper than switching on the opcode again.
+        m_rj = m_regBase[m_ixJ];
+        m_rk = m_regBase[m_ixK];
     }
     
-    void MiscCpu::execute() {
-        OpCode::EOp opcode = m_opCode.getOpcode();
-		switch(opcode) {
-            case OpCode::eNop:  //fall through
-            case OpCode::eHalt:
-				break;
-            //
-            //Arithmetic
-            case OpCode::eAdd:   // r[j] = r[j] + r[k]
-                m_aluz = m_rj + m_rk;
-                setFlagsUpdateRj(m_rk);
-				break;
-            case OpCode::eAddi:  // r[j] = r[j] + immed
-                m_aluz = m_rj + m_immed;
-                setFlagsUpdateRj(m_immed);
-				break;
-            case OpCode::eSub:   // r[j] = r[j] - r[k]
-                m_aluz = m_rj - m_rk;
-                setFlagsUpdateRj(m_rk);
-				break;
-            case OpCode::eCmp:   // r[j] - r[k]
-                m_aluz = m_rj - m_rk;
-                setFlags(m_rk);
-				break;
-            case OpCode::eSubi:  // r[j] = r[j] - immed
-                m_aluz = m_rj - m_immed;
-                setFlagsUpdateRj(m_immed);
-				break;
-            case OpCode::eCmpi:  // r[j] - immed
-                m_aluz = m_rj - m_immed;
-                setFlags(m_immed);
-				break;
-            //
-            //Logical
-            case OpCode::eLsl:   // r[j] = r[j] << r[k]  (0 fill LSBs)
-                lsl(m_rk);
-				break;
-            case OpCode::eLsli:  // r[j] = r[j] << immed (0 fill LSBs)
-                lsl(m_immed);
-                break;
-            case OpCode::eLsr:   // r[j] = r[j] >> r[k]  (0 fill MSBs)
-                lsr(m_rk);
-                break;
-            case OpCode::eLsri:  // r[j] = r[j] >> immed (0 fill LSBs)
-                lsl(m_immed);
-                break;
-            case OpCode::eAsr:   // r[j] = r[j] >> r[k]  (MSB fill MSBs)
-                asr(m_rk);
-                break;
-            case OpCode::eAsri:  // r[j] = r[j] >> immed (MSB fill MSBs)
-                asr(m_immed);
-                break;
-            case OpCode::eAnd:   // r[j] = r[j] & r[k]
-                m_aluz = m_rj & m_rk;
-                setFlagsUpdateRj();
-				break;
-            case OpCode::eOr:    // r[j] = r[j] | r[k]
-                m_aluz = m_rj | m_rk;
-                setFlagsUpdateRj();
-				break;
-            case OpCode::eXor:   // r[j] = r[j] ^ r[k]
-                m_aluz = m_rj ^ m_rk;
-                setFlagsUpdateRj();
-				break;
-            case OpCode::eAndi:   // r[j] = r[j] & immed
-                m_aluz = m_rj & m_immed;
-                setFlagsUpdateRj();
-				break;
-            case OpCode::eOri:    // r[j] = r[j] | immed
-                m_aluz = m_rj | m_immed;
-                setFlagsUpdateRj();
-				break;
-            case OpCode::eXori:   // r[j] = r[j] ^ immed
-                m_aluz = m_rj ^ m_immed;
-                setFlagsUpdateRj();
-				break;
-            case OpCode::eNot:   // r[j] = ~r[j]
-                m_aluz = ~m_rj;
-                setFlagsUpdateRj();
-				break;
-            //
-            //Load/store (do not affect flags)
-            case OpCode::eLoad:  // r[j] = mem[r[k]+immed]
-                {   TInt32 addr = m_rk + m_immed;
-                    m_regs[m_ixJ] = m_mem[addr];
-                }
-				break;
-            case OpCode::eLoadr: // r[j] = r[k]
-                m_regs[m_ixJ] = m_regs[m_ixK];
-                break;
-            case OpCode::eLoadi: // r[j] = immed
-                m_regs[m_ixJ] = m_immed;
-                break;
-            case OpCode::eLoadil:// r[j] = [pc+1]   ([pc+1] is next full word)
-                m_regs[m_ixJ] = m_mem[m_pc++];
-                break;
-            case OpCode::eStore: // mem[r[k]+immed] = r[j]
-                {   TInt32 addr = m_rk + m_immed;
-                    m_mem[addr] = m_rj;
-                }
-				break;
-            case OpCode::ePush:
-                push(m_rj);
-                break;
-            case OpCode::ePop:
-                m_regs[m_ixJ] = pop();
-                break;
-            //
-            //Branch
-            case OpCode::eBr:    // pc = pc + immed  (immed is signed offset)
-                if (checkCond()) {
-                    m_pc += m_immed;
-                }
-				break;
-            //
-            //Call (push next pc onto stack)
-            case OpCode::eCall:  // push pc+1 onto stack; pc = pc + immed
-                call(checkCond());
-                break;
-            case OpCode::eRetn:
-                m_pc = pop();
-                break;
-			default:
-				ASSERT_NEVER;
-		}
-    }
-
     bool MiscCpu::checkCond() const {
         bool cond;
         ASSERT_TRUE(m_opCode.isBranchOrCall());
+        evalFlags();
         switch(m_cond) {
             case eCy:
                 cond = m_cy;
@@ -353,53 +490,15 @@ namespace miscpu
         return cond;
     }
 
-    static bool sgn(TInt32 v) {
-        return (0 > v);
-    }
-
-    void MiscCpu::push(TInt32 val) {
-        TUint32 sp = m_regs[cSpRegIx] - 1;
-        m_mem[sp] = val;
-        m_regs[cSpRegIx] = sp;
-    }
-
-    TInt32 MiscCpu::pop() {
-        TUint32 sp = m_regs[cSpRegIx];
-        TInt32 rval = m_mem[sp++];
-        m_regs[cSpRegIx] = sp;
-        return rval;
-    }
-
-    void MiscCpu::call(bool cond) {
-        if (cond) {
-            push(m_pc);
-            m_pc += m_immed;
-        }
+    const char* MiscCpu::condName(ECond cond) {
+        static const char* const cNames[] = {
+            "eUncond", "eCy", "eNotCy", "eZero", "eNotZero", "eNotUsed"
+        };
+        return cNames[cond];
     }
 
-    void MiscCpu::setFlags(TInt32 opb) {
-        bool sgnA = sgn(m_rj), sgnB = sgn(opb), sgnZ = sgn(m_aluz);
-        m_cy = (sgnA != sgnB) ? false : (sgnZ != sgnA);
-        setFlags();
-    }
-
-    void MiscCpu::setFlags() {
-        m_zero = (0 == m_aluz);
-    }
-
-    void MiscCpu::setFlagsUpdateRj(TInt32 opb) {
-        setFlags(opb);
-        m_regs[m_ixJ] = m_aluz;
-    }
-
-    void MiscCpu::setFlagsUpdateRj() {
-        setFlags();
-        m_regs[m_ixJ] = m_aluz;
-    }
-
-    void MiscCpu::setCy(unsigned pos) {
-        TBitVec<32> bits(m_rj);
-        m_cy = (0 != bits(pos));
+    static bool sgn(TInt32 v) {
+        return (0 > v);
     }
 
     /*
@@ -412,7 +511,7 @@ namespace miscpu
                 m_aluz = m_rj << amt; 
             } else {
                 m_aluz = 0;
-                m_cy = false;
+                clearCy();
             }
         }
         setFlagsUpdateRj();
@@ -425,7 +524,7 @@ namespace miscpu
                 m_aluz = m_rj >> amt;
             } else {
                 m_aluz = 0;
-                m_cy = false;
+                clearCy();
             }
         }
         if (doUpdate) {
@@ -444,21 +543,68 @@ namespace miscpu
     }
 
     const MiscCpu& MiscCpu::run(TUint64 cnt) {
-        bool loop = true, doCnt = (0 != cnt);
-        while (loop) {
-            fetch();
-            decode();
-            execute();
-            if (false == m_perfMon.isNull()) {
-                m_perfMon->process(*this);
+        //Translated code retires whole blocks: use an interpreter for
+        //an exact budget, or if the PerfMon must see every instruction.
+        bool canJit = (0 == cnt) && Jit::isSupported() &&
+                      (m_perfMon.isNull() || m_perfMon->isCountOnly());
+        if ((eJitEngine == m_engine) && canJit) {
+            runJit();
+        } else {
+            runInterp(cnt);
+        }
+        return *this;
+    }
+
+    void MiscCpu::runInterp(TUint64 cnt) {
+        if ((TDfltCfg::cRegBits == cRegsN) &&
+            (TDfltCfg::cMemMask == m_memMask)) {
+            runInterpT<TDfltCfg>(cnt);
+        } else {
+            runInterpT<TDynCfg>(cnt);
+        }
+    }
+
+    bool MiscCpu::step() {
+        fetchT<TDynCfg>();
+        decode();
+        executeT<TDynCfg>();
+        evalFlags();    //for translated code (see runJit())
+        return (OpCode::eHalt == m_opCode.getOpcode());
+    }
+
+    unsigned MiscCpu::compareState(const MiscCpu &ref, std::ostream &os) const {
+        unsigned ndiffs = 0;
+        evalFlags();
+        ref.evalFlags();
+        if (m_pc != ref.m_pc) {
+            os << "m_pc=" << m_pc << " (expected " << ref.m_pc << ")" << std::endl;
+            ndiffs++;
+        }
+        if (m_cy != ref.m_cy) {
+            os << "m_cy=" << m_cy << " (expected " << ref.m_cy << ")" << std::endl;
+            ndiffs++;
+        }
+        if (m_zero != ref.m_zero) {
+            os << "m_zero=" << m_zero << " (expected " << ref.m_zero << ")" << std::endl;
+            ndiffs++;
+        }
+        ASSERT_TRUE(m_regs.length() == ref.m_regs.length());
+        for (unsigned i = 0; i < m_regs.length(); i++) {
+            if (m_regs[i] != ref.m_regs[i]) {
+                os << "m_regs[" << i << "]=" << m_regs[i]
+                   << " (expected " << ref.m_regs[i] << ")" << std::endl;
+                ndiffs++;
             }
-            if (OpCode::eHalt == m_opCode.getOpcode()) {
-                loop = false;
-            } else if (doCnt) {
-                loop = (0 != --cnt);
+        }
+        ASSERT_TRUE(m_mem.length() == ref.m_mem.length());
+        for (TUint64 i = 0; i < m_mem.length(); i++) {
+            if (m_mem[i] != ref.m_mem[i]) {
+                os << "m_mem[" << i << "]=" << m_mem[i]
+                   << " (expected " << ref.m_mem[i] << ")" << std::endl;
+                ndiffs++;
             }
         }
-        return *this;
+        return ndiffs;
     }
 
     TInt32 MiscCpu::instruction(OpCode::EOp opcode, unsigned j, unsigned k, int immed) {
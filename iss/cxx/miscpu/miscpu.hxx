@@ -26,14 +26,19 @@
 #    define  _miscpu_miscpu_hxx_
 
 #include <string>
+#include <set>
+#include <map>
+#include <ostream>
 #include "xyzzy/portable.hxx"
 #include "xyzzy/array.hxx"
 #include "xyzzy/refcnt.hxx"
 #include "xyzzy/bitvec.hxx"
 #include "opcode.hxx"
-#include "miscpu.hxx"
+#include "memmap.hxx"
+#include "symbols.hxx"
 
 using std::string;
+using xyzzy::TUint8;
 using xyzzy::TUint32;
 using xyzzy::TUint64;
 using xyzzy::TInt32;
@@ -46,12 +51,18 @@ using xyzzy::TBitVec;
 namespace miscpu
 {
     class MiscCpu;	//forward reference
+    class Jit;      //see jit.hxx
+    class TImage;   //see image.hxx
+    class TIoBus;   //see iobus.hxx
+    class TIoDevice;
+    class TUndoLog; //see reverse.hxx
+    class THleHook; //see hle.hxx
 
     class PerfMon : public TRcObj {
     public:
         virtual ~PerfMon() = 0;
 
-        void incrInstructionCnt(unsigned incr = 1) {
+        void incrInstructionCnt(TUint64 incr = 1) {
             m_instructionCnt += incr;
         }
 
@@ -59,9 +70,21 @@ namespace miscpu
             return m_instructionCnt;
         }
 
+        //Restore count (see MiscCpu::restoreCheckpoint()).
+        void setInstructionCnt(TUint64 cnt) {
+            m_instructionCnt = cnt;
+        }
+
         //Called during each instruction eval.
         virtual void process(const MiscCpu &cpu) = 0;
 
+        //True if process() only counts instructions: engines which
+        //retire whole blocks at once may then skip process() and call
+        //incrInstructionCnt(n) instead.
+        virtual bool isCountOnly() const {
+            return false;
+        }
+
     protected:
         explicit PerfMon()
             :   m_instructionCnt(0) {
@@ -78,13 +101,17 @@ namespace miscpu
         explicit DefaultPerfMon();
 
         void process(const MiscCpu &cpu);
+
+        bool isCountOnly() const {
+            return true;
+        }
         
         static TRcPerfMon create();
         
         ~DefaultPerfMon();
 
     private:
-        //TODO: add cycle count, etc
+        //more statistics: see monitors.hxx (MiscCpu::run(TMon&))
     };
 
     class MiscCpu {
@@ -96,14 +123,46 @@ namespace miscpu
             eNotUsed
         };
 
+        //Instruction dispatch used by run().
+        enum EEngine {
+            eSwitchEngine,      //fetch/decode/execute() per instruction
+            eThreadedEngine,    //direct threaded (see runThreaded())
+            eJitEngine          //x86-64 translation (see jit.hxx)
+        };
+
         explicit MiscCpu(const char *memFname = 0,
                 unsigned numRegsN = 5,
                 unsigned memDepthN = 20,
-                bool useDfltPerfMon = true);
+                bool useDfltPerfMon = true,
+                EEngine engine = eSwitchEngine);
+
+        virtual ~MiscCpu();
+
+        //Binary image (see image.hxx), assembler source (.s: see
+        //assembler.hxx) or text (decimal word per line).
+        //Return number of words loaded.
+        unsigned loadMemory(string fname);
 
-        void loadMemory(string fname);
+        //Load binary image: whole pages are mapped copy-on-write.
+        //Sets pc to the image entry; adds its symbols to syms (if !0).
+        unsigned loadImage(string fname, TSymbolMap *syms = 0);
+
+        //Load already opened image (may be shared by many MiscCpu).
+        unsigned loadImage(const TImage &img);
+
+        //Write m_mem[addr, addr+n) as binary image.
+        void saveImage(string fname, TUint32 addr, TUint32 n,
+                TUint32 entryPc = 0, const TSymbolMap *syms = 0) const;
         void loadMemory(const PTArray<TInt32> &instructs);
 
+        //Write pc, flags, regs, PerfMon count and memory pages which
+        //differ from the last image loaded (see checkpoint.hxx).
+        void saveCheckpoint(string fname) const;
+
+        //Replace all of the above (and memory) by checkpoint fname.
+        //Return number of memory pages copied.
+        unsigned restoreCheckpoint(string fname);
+
         //Generate 32-bit opcode
         TInt32 instruction(OpCode::EOp opcode, unsigned j, unsigned k=0, int immed=0);
         TInt32 instructionb(OpCode::EOp opcode, ECond cond, int immed);
@@ -112,6 +171,86 @@ namespace miscpu
             return instruction(opcode, 0u, 0u);
         }
 
+        //Route loads/stores to [addr, addr+words) to dev (deleted with
+        //this MiscCpu).  The window must be above memory.
+        void mapDevice(TUint32 addr, TUint32 words, TIoDevice *dev);
+
+        //Record the old value of each memory word written by the
+        //interpreter in undo (0: off).  Translated code does not record.
+        void setUndoLog(TUndoLog *undo) {
+            m_undo = undo;
+            m_hookStores = (0 != m_undo) || !m_watches.empty();
+        }
+
+        /**
+         * Debug stops (see gdbstub.hxx), for interpreted run() only.
+         * A trap is a predecoded marker: fetching it ends run() before
+         * the instruction (pc stays at it; monitors see an eHalt).  A
+         * store to a watched word ends run() after the instruction, with
+         * the switch engine.  Neither costs anything while none is set.
+         */
+        enum EStop {
+            eNoStop, eTrapStop, eWatchStop, eFaultStop
+        };
+
+        void setTrap(TUint32 addr);
+        void clearTrap(TUint32 addr);
+        void setWatch(TUint32 addr);
+        void clearWatch(TUint32 addr);
+
+        /**
+         * If on, a guest error ends run() (eFaultStop, at the address)
+         * instead of asserting: an undefined instruction or condition,
+         * a fetch outside memory, a load or store outside memory with
+         * no device there (which stops the switch engine only, after the
+         * instruction).  See faultinj.hxx.
+         */
+        void setFaultStops(bool on) {
+            m_faultStops = on;
+        }
+
+        //Why the last run() stopped early (and at what address); clears it.
+        EStop takeStop(TUint32 &addr) {
+            const EStop stop = m_stop;
+            addr = m_stopAddr;
+            m_stop = eNoStop;
+            return stop;
+        }
+
+        /**
+         * Load/store/fetch owner's memory (and predecode cache) instead
+         * of this one's: a hart of TMultiHart (see multihart.hxx).  Same
+         * depth; for interpreted run() only, with no devices, undo log or
+         * debug stops (which stay per MiscCpu).  owner must outlive this.
+         */
+        void shareMemory(MiscCpu &owner);
+
+        /**
+         * High-level emulation (see hle.hxx): a taken eCall to entry runs
+         * hook (not owned; 0 removes it) in place of the guest routine.
+         * The eCall retires as one instruction (budgets count just it);
+         * the hook's declared cost is added to getPerfMon() and seen by
+         * monitors through getHleCall().  For interpreted run() and
+         * runJit() (calls to entry are left to the interpreter): add
+         * hooks before the first runJit().
+         */
+        void setHook(TUint32 entry, THleHook *hook);
+
+        bool isHooked(TUint32 entry) const {
+            return !m_hooks.empty() && (0 != m_hooks.count(entry));
+        }
+
+        //If on, run the guest routine as well as each hook; keep the
+        //guest's result and count any difference (see verifyHook()).
+        void setHookVerify(bool on) {
+            m_hleVerify = on;
+        }
+
+        //Hook run by the eCall which just retired; else 0.
+        const THleHook* getHleCall() const {
+            return m_hleCall;
+        }
+
         void setPerfMon(TRcPerfMon pmon);
 
         TRcPerfMon getPerfMon() const {
@@ -120,10 +259,117 @@ namespace miscpu
 
         virtual const MiscCpu& run(TUint64 cnt = 0);
 
-        unsigned getMemDepth() const {
+        //Run with statically dispatched monitor (see monitors.hxx),
+        //as well as getPerfMon().  Always interpreted.
+        template<class TMon>
+        const MiscCpu& run(TMon &mon, TUint64 cnt = 0);
+
+        EEngine getEngine() const {
+            return m_engine;
+        }
+
+        void setEngine(EEngine engine) {
+            m_engine = engine;
+        }
+
+        //Mark pairs to fuse (see fuses()) as words are predecoded (on).
+        void setFusion(bool on) {
+            m_fusion = on;
+        }
+
+        //Instructions the threaded engine ran fused to the one before.
+        TUint64 getFusedCnt() const {
+            return m_fusedCnt;
+        }
+
+        //Words written (eStore, ePush, taken eCall, eSwap; devices too)
+        //and taken eCalls - eRetns, as interpreted: translated code does
+        //not count them.  For telemetry (see telemetry.hxx).
+        TUint64 getStoreCnt() const {
+            return m_storeCnt;
+        }
+
+        long long getCallDepth() const {
+            return m_callDepth;
+        }
+
+        TUint32 getPc() const {
+            return m_pc;
+        }
+
+        void setPc(TUint32 pc) {
+            m_pc = pc;
+        }
+
+        TInt32 getReg(unsigned ix) const {
+            return m_regs[ix];
+        }
+
+        void setReg(unsigned ix, TInt32 val) {
+            m_regs[ix] = val;
+        }
+
+        TInt32 getMem(TUint32 addr) const {
+            ASSERT_TRUE(addr <= m_memMask);
+            return m_memBase[addr];     //m_mem, or shareMemory()'s
+        }
+
+        //As a store instruction would (predecode/translation updated).
+        void setMem(TUint32 addr, TInt32 val);
+
+        //Fields of last fetched instruction.
+        OpCode::EOp getOpcode() const {
+            return m_opCode.getOpcode();
+        }
+
+        ECond getCond() const {
+            return m_cond;
+        }
+
+        unsigned getIxJ() const {
+            return m_ixJ;
+        }
+
+        unsigned getIxK() const {
+            return m_ixK;
+        }
+
+        TInt32 getImmed() const {
+            return m_immed;
+        }
+
+        //r[k] as read at decode (eLoad/eStore base address).
+        TInt32 getRk() const {
+            return m_rk;
+        }
+
+        bool getCy() const {
+            evalFlags();
+            return m_cy;
+        }
+
+        bool getZero() const {
+            evalFlags();
+            return m_zero;
+        }
+
+        //m_cond vs. flags: only for eBr/eCall.
+        bool checkCond() const;
+
+        static const char* condName(ECond cond);
+
+        //Compare architectural state (pc, flags, regs, mem) against ref.
+        //Each difference is written to os; returns number of differences.
+        unsigned compareState(const MiscCpu &ref, std::ostream &os) const;
+
+        //Words of memory (up to 2^32).
+        TUint64 getMemDepth() const {
             return m_mem.length();
         }
 
+        //Resident host pages of memory and predecode cache.
+        void dumpMemUsage(std::ostream &os) const;
+
         unsigned getNumRegs() const {
             return m_regs.length();
         }
@@ -138,14 +384,98 @@ namespace miscpu
         const unsigned cSpRegIx;    //m_regs[cSpRegIx] is stack pointer
         
     protected:
+        /**
+         * Predecoded form of a memory word: fields sliced out once (on
+         * first fetch) and reused until the word is written again.
+         * All 0 (cNotDecoded) until then, so m_decoded is demand zero.
+         */
+        struct TDecoded {
+            TInt32          immed;      //sign extended
+            unsigned char   op1;        //OpCode::EOp + 1, or cNotDecoded
+            unsigned char   ixJ, ixK;   //0 if not used by opcode
+            unsigned char   cond;       //ECond of branch/call; else eNotUsed
+                                        //or cFuseNext (see fuses())
+
+            OpCode::EOp getOpcode() const {
+                return (OpCode::EOp)(op1 - 1);
+            }
+        };
+
+        static const unsigned char cNotDecoded = 0;
+        static const unsigned char cTrapOp1 = 0xff;  //see setTrap()
+
+        //cond of a word which the next word is fused with.
+        static const unsigned char cFuseNext = eNotUsed + 1;
+
+        /**
+         * Superinstructions: pairs (first at pc, second at pc+1) which
+         * the threaded engine runs with no dispatch between them (see
+         * runThreadedT()).  Chosen from TPairMon profiles of asm/test
+         * and asm/bench: compare/test/count then branch, "rk = rj" then
+         * and, runs of push or pop.  Predecode marks the first word.
+         */
+        static bool fuses(OpCode::EOp first, OpCode::EOp second);
+
+        //Not an opcode: cNotDecoded or cTrapOp1 (one compare for both).
+        static bool isSlowFetch(const TDecoded &dec) {
+            return (unsigned char)(dec.op1 - 1) >= OpCode::eNotUsed;
+        }
+
         TUint32     m_pc;
-        bool        m_zero, m_cy;
-        TBitVec<32> m_ir;
+
+        /**
+         * {zero,cy} are evaluated lazily: ALU ops only record what they
+         * follow from, evalFlags() computes them when read (checkCond(),
+         * getCy(), ...).  Translated code (see jit.hxx) uses m_zero and
+         * m_cy directly, so they are evaluated before it runs.
+         *
+         *   m_lazy & cLazyZero:    m_zero is (0 == m_aluz)
+         *   m_lazy & eCyArith:     m_cy as setFlags(opb): r[j] = m_flagA,
+         *                          opb = m_flagB, alu output = m_flagZ
+         *   m_lazy & eCyBit:       m_cy is bit m_flagB of r[j] = m_flagA
+         */
+        enum ELazyCy {
+            eCyValid = 0, eCyArith = 2, eCyBit = 4
+        };
+
+        static const unsigned cLazyZero = 1;
+
+        mutable bool        m_zero, m_cy;
+        mutable unsigned    m_lazy;
+        TInt32      m_flagA, m_flagB, m_flagZ;
+
+        void evalFlags() const {
+            if (0 != m_lazy) {
+                evalLazyFlags();
+            }
+        }
+
+        void evalLazyFlags() const {
+            if (0 != (m_lazy & cLazyZero)) {
+                m_zero = (0 == m_aluz);
+            }
+            if (0 != (m_lazy & eCyArith)) {
+                //operands of one sign, result of the other
+                m_cy = (0 > (~(m_flagA ^ m_flagB) & (m_flagA ^ m_flagZ)));
+            } else if (0 != (m_lazy & eCyBit)) {
+                m_cy = (0 != (((TUint32)m_flagA >> m_flagB) & 1));
+            }
+            m_lazy = eCyValid;
+        }
+
+        //Set both (e.g., restored state).
+        void setZeroCy(bool zero, bool cy) {
+            m_zero = zero;
+            m_cy = cy;
+            m_lazy = eCyValid;
+        }
 
         PTArray<TInt32> m_regs;
-        PTArray<TInt32> m_mem;
+        //Reserved, not allocated: host pages are committed as touched.
+        PTMappedArray<TInt32>   m_mem;
+        PTMappedArray<TDecoded> m_decoded;  //parallel to m_mem
 
-        //The following initialized by decode()
+        //The following initialized by fetch()/decode()
         TInt32      m_rj, m_rk;         //r[j], r[k]
         TInt32      m_aluz;             //alu output
         OpCode      m_opCode;
@@ -155,32 +485,155 @@ namespace miscpu
         ECond       m_cond; //from conditional field for branch/call
 
         TRcPerfMon  m_perfMon;
+        EEngine     m_engine;
+        bool        m_fusion;
+        TUint64     m_fusedCnt;
+        TUint64     m_storeCnt;     //see getStoreCnt()
+        long long   m_callDepth;
+
+        std::map<TUint32, THleHook*>    m_hooks;    //see setHook()
+        THleHook    *m_hleCall;     //see getHleCall()
+        bool        m_hleVerify;
+        bool        m_hleGuest;     //verifyHook() running the guest
+
+        string      m_imageFname;   //last loadImage(), for checkpoints
+
+        Jit         *m_jit;         //created on first runJit()
+        TUint8      *m_jitCodeMap;  //!=0 at m_mem[i] covered by translation
+
+        TIoBus      *m_bus;         //created on first mapDevice()
+        TUndoLog    *m_undo;        //see setUndoLog()
+        std::set<TUint32>   m_traps, m_watches;
+        bool        m_hookStores;   //m_undo or m_watches: see storeHook()
+        EStop       m_stop;
+        bool        m_faultStops;
+        TUint32     m_stopAddr;
+
+        //Unchecked views of m_regs, m_mem, m_decoded (for the core).
+        TInt32      *m_regBase;
+        TInt32      *m_memBase;
+        TDecoded    *m_decodedBase;
+        TUint32     m_memMask;      //m_mem.length() - 1
+
+        //Interpreter run(): default 5/20 configuration is run by
+        //runInterpT<TDfltCfg>; any other by runInterpT<TDynCfg>.
+        virtual void runInterp(TUint64 cnt);
+
+        template<class TCfg> void runInterpT(TUint64 cnt);
+        template<class TCfg, class TMon> void runMonT(TMon &mon, TUint64 cnt);
 
     private:
+        friend class Jit;
+        template<unsigned Lanes> friend class PTSimdGroup;
+        friend class TTimeTravel;
+        friend class TGdbStub;
+        friend class TFaultCampaign;
+
+        //not copyable (owns m_jit)
+        MiscCpu(const MiscCpu&);
+        MiscCpu& operator=(const MiscCpu&);
+
         void initialize();
         void reset();
 
-        void fetch();
+        unsigned loadText(string fname);
+
         void decode();
-        void execute();
 
-        void setFlags(TInt32 opb);  //{cy,zero}
-        void setFlags();            //{zero}
+        //Interpreter core: templated on TCfg (see miscpucore.hxx).
+        template<class TCfg> void fetchT();
+        void setFetched(TUint32 pc, const TDecoded &dec);
+        template<class TCfg> void predecodeT(TUint32 addr);
+        template<class TCfg> void executeT();
+        template<class TCfg, class TMon> void runSwitchT(TMon &mon, TUint64 cnt);
+        template<class TCfg, class TMon> void runThreadedT(TMon &mon, TUint64 cnt);
+        template<class TCfg> TInt32 readMemT(TUint32 addr);
+        template<class TCfg> void writeMemT(TUint32 addr, TInt32 val);
+        template<class TCfg> void swapT();
+        template<class TCfg> void callT(bool cond);
+        template<class TCfg> void pushT(TInt32 val);
+        template<class TCfg> TInt32 popT();
+
+        void predecode(TUint32 addr);
+
+        void runJit();
+
+        //Execute one instruction; return true if it was eHalt.
+        bool step();
+
+        void invalidateJit(TUint32 addr);
+
+        //All writes to m_mem go through here (to invalidate m_decoded).
+        void writeMem(TUint32 addr, TInt32 val);
+
+        //Loads/stores above memory (readMemT(), writeMemT()).
+        TInt32 ioRead(TUint32 addr);
+        void ioWrite(TUint32 addr, TInt32 val);
+
+        //Deferred device work: when run() returns.
+        void flushIo();
+
+        //m_mem[addr] is about to be written: to m_undo, check m_watches.
+        void storeHook(TUint32 addr);
+
+        //eCall executed (taken if taken): run its hook, if any.
+        void callHook(bool taken);
+
+        /**
+         * Run hook, note its registers, pc and memory writes; undo it
+         * and run the guest routine (switch engine, hooks off) until it
+         * returns: pc at the return address, sp above where it was.
+         * Compare pc, sp, registers hook does not clobber and the words
+         * either wrote.  Flags are not compared.
+         */
+        void verifyHook(THleHook &hook);
+
+        //Fetch from a trap: end run() as eHalt would.
+        void trap(TUint32 pc);
+
+        //Guest error at addr: eFaultStop if m_faultStops, else assert.
+        void fault(TUint32 addr);
+
+        //{cy,zero}
+        void setFlags(TInt32 opb) {
+            m_flagA = m_rj;
+            m_flagB = opb;
+            m_flagZ = m_aluz;
+            m_lazy = cLazyZero | eCyArith;
+        }
 
-        void setFlagsUpdateRj(TInt32 opb);    //{cy,zero} then update r[j]
-        void setFlagsUpdateRj();              //{zero} ...
+        //{zero}
+        void setFlags() {
+            m_lazy |= cLazyZero;
+        }
+
+        //{cy,zero} then update r[j]
+        void setFlagsUpdateRj(TInt32 opb) {
+            setFlags(opb);
+            m_regBase[m_ixJ] = m_aluz;
+        }
+
+        //{zero} ...
+        void setFlagsUpdateRj() {
+            setFlags();
+            m_regBase[m_ixJ] = m_aluz;
+        }
 
         void lsl(TUint32 amt);
         void lsr(TUint32 amt, bool doUpdate = true);
         void asr(TUint32 amt);
 
-        void setCy(unsigned pos);
-
-        bool checkCond() const;
+        //cy is bit pos of r[j]
+        void setCy(unsigned pos) {
+            m_flagA = m_rj;
+            m_flagB = pos;
+            m_lazy = (m_lazy & cLazyZero) | eCyBit;
+        }
 
-        void call(bool cond = true);    //save pc+1 on stack, ...
-        void push(TInt32 val);
-        TInt32 pop();
+        void clearCy() {
+            m_cy = false;
+            m_lazy &= cLazyZero;
+        }
 
         static const unsigned cInstRegNbits = 32;
     };
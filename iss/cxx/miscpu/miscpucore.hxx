@@ -0,0 +1,700 @@
+/**
+ * The MIT License
+ *
+ * Copyright (c) 2010  Karl W. Pfalzer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+#if !defined(_miscpu_miscpucore_hxx_)
+#    define  _miscpu_miscpucore_hxx_
+
+/*
+ * Interpreter core (fetch/decode/execute, engine loops), templated on a
+ * configuration TCfg which supplies the register field width and the
+ * memory address check:
+ *
+ *   TDynCfg                    numRegsN/memDepthN from the constructor.
+ *   PTFixedCfg<R,M,MaskAddr>   compile time constants: field positions,
+ *                              masks and memory bound fold into the
+ *                              instruction stream.
+ *
+ * MiscCpu runs the default 5/20 configuration as PTFixedCfg<5,20>;
+ * MiscCpuT<R,M> does the same for any other configuration.
+ *
+ * The loops are also templated on a monitor TMon (see monitors.hxx),
+ * so m_perfMon is only called (virtually) if it needs more than the
+ * instruction count.
+ */
+
+#include "xyzzy/assert.hxx"
+#include "miscpu.hxx"
+#include "opcode.hxx"
+#include "monitors.hxx"
+
+namespace miscpu
+{
+    /**
+     * Register field width and memory depth known only at run time.
+     * Addresses are checked against the allocated depth.
+     */
+    struct TDynCfg {
+        static unsigned regsN(const MiscCpu &cpu) {
+            return cpu.cRegsN;
+        }
+
+        static TUint32 memIx(TUint32 addr, TUint32 memMask) {
+            ASSERT_TRUE(addr <= memMask);
+            return addr;
+        }
+
+        //Else a device (see iobus.hxx).
+        static bool isMem(TUint32 addr, TUint32 memMask) {
+            return (addr <= memMask);
+        }
+    };
+
+    /**
+     * 2^RegBits registers, 2^MemBits words of memory.
+     * If MaskAddr, addresses wrap (are masked to MemBits) instead
+     * of being checked.
+     */
+    template<unsigned RegBits, unsigned MemBits, bool MaskAddr = false>
+    struct PTFixedCfg {
+        static const unsigned cRegBits = RegBits;
+        static const unsigned cMemBits = MemBits;
+        static const TUint64  cMemWords = (TUint64)1 << MemBits;
+        static const TUint32  cMemMask = (TUint32)(cMemWords - 1);
+
+        static unsigned regsN(const MiscCpu&) {
+            return RegBits;
+        }
+
+        static TUint32 memIx(TUint32 addr, TUint32) {
+            if (MaskAddr) {
+                return addr & cMemMask;
+            }
+            ASSERT_TRUE(addr <= cMemMask);  //folds away for 32
+            return addr;
+        }
+
+        //Wrapped addresses never reach a device.
+        static bool isMem(TUint32 addr, TUint32) {
+            return MaskAddr || (addr <= cMemMask);
+        }
+    };
+
+    typedef PTFixedCfg<5, 20> TDfltCfg;
+
+    /**
+     * MiscCpu with register file width and memory depth fixed at
+     * compile time.
+     */
+    template<unsigned RegBits, unsigned MemBits, bool MaskAddr = false>
+    class MiscCpuT : public MiscCpu {
+    public:
+        typedef PTFixedCfg<RegBits, MemBits, MaskAddr> TCfg;
+
+        explicit MiscCpuT(const char *memFname = 0,
+                bool useDfltPerfMon = true,
+                EEngine engine = eSwitchEngine)
+            :   MiscCpu(memFname, RegBits, MemBits, useDfltPerfMon, engine) {
+        }
+
+        using MiscCpu::run;
+
+        template<class TMon>
+        const MiscCpu& run(TMon &mon, TUint64 cnt = 0) {
+            runMonT<TCfg>(mon, cnt);
+            return *this;
+        }
+
+    protected:
+        virtual void runInterp(TUint64 cnt) {
+            runInterpT<TCfg>(cnt);
+        }
+    };
+
+    template<class TMon>
+    const MiscCpu& MiscCpu::run(TMon &mon, TUint64 cnt) {
+        if ((TDfltCfg::cRegBits == cRegsN) &&
+            (TDfltCfg::cMemMask == m_memMask)) {
+            runMonT<TDfltCfg>(mon, cnt);
+        } else {
+            runMonT<TDynCfg>(mon, cnt);
+        }
+        return *this;
+    }
+
+    template<class TCfg>
+    void MiscCpu::predecodeT(TUint32 addr) {
+        /**
+         * instruction fields
+         * |--opcode--|--ixJ--|--ixK--|--immed--|
+         * |31......27|26...22|21...17|16......0|
+         * NOTE: immed only used (as offset) for eLoad/eStore
+         *
+         * conditional
+         * |--opcode--|--cond--|--immed--|
+         * |31......27|26....24|23......0|
+         *
+         * xxxi (arith, load) immediate:  i.e., "m_opcode.hasImmed()==true"
+         * |--opcode--|--ixJ--|--immed--|
+         * |31......27|26...22|21......0|
+         */
+        const unsigned cOpLsb = cInstRegNbits - OpCode::cOpCodeN;
+        const unsigned cRegN = TCfg::regsN(*this);
+        const TUint32 cRegMask = (1u << cRegN) - 1;
+        const TUint32 ir = m_memBase[addr];
+        const OpCode::EOp opcode = (OpCode::EOp)(ir >> cOpLsb);
+        if (OpCode::eNotUsed <= opcode) {
+            //undefined: fetchT() stops at the marker (see trap())
+            ASSERT_TRUE(m_faultStops);
+            m_decodedBase[addr].op1 = cTrapOp1;
+            return;
+        }
+        TDecoded dec;
+        unsigned immedN;    //immed is ir(immedN-1,0)
+        dec.ixJ = dec.ixK = 0;
+        dec.cond = eNotUsed;
+        if (OpCode::hasImmed(opcode)) {
+            immedN = cOpLsb - cRegN;
+            dec.ixJ = (ir >> immedN) & cRegMask;
+        } else if (OpCode::isBranchOrCall(opcode)) {
+            immedN = cOpLsb - 3;
+            dec.cond = (ir >> immedN) & 0x7;
+            if (eNotUsed <= dec.cond) {
+                ASSERT_TRUE(m_faultStops);
+                m_decodedBase[addr].op1 = cTrapOp1;
+                return;
+            }
+        } else {
+            immedN = cOpLsb - (2 * cRegN);
+            dec.ixJ = (ir >> (immedN + cRegN)) & cRegMask;
+            dec.ixK = (ir >> immedN) & cRegMask;
+        }
+        //sign extend
+        dec.immed = (TInt32)(ir << (32 - immedN)) >> (32 - immedN);
+        dec.op1 = opcode + 1;
+        if (m_fusion && (addr < m_memMask) &&
+            fuses(opcode, (OpCode::EOp)((TUint32)m_memBase[addr + 1] >> cOpLsb))) {
+            dec.cond = cFuseNext;   //checked again when run: see FUSE
+        }
+        if (!m_traps.empty() && (0 != m_traps.count(addr))) {
+            dec.op1 = cTrapOp1;     //decoded again once the trap is cleared
+        }
+        //op1 last: a hart sharing m_decodedBase (see shareMemory()) which
+        //sees op1 sees the other fields (host stores are not reordered).
+        TDecoded &to = m_decodedBase[addr];
+        to.immed = dec.immed;
+        to.ixJ = dec.ixJ;
+        to.ixK = dec.ixK;
+        to.cond = dec.cond;
+#if defined(__GNUC__)
+        __asm__ __volatile__("" ::: "memory");
+#endif
+        to.op1 = dec.op1;
+    }
+
+    template<class TCfg>
+    void MiscCpu::fetchT() {
+        if (!TCfg::isMem(m_pc, m_memMask)) {
+            fault(m_pc);    //the compare memIx() checks anyway
+            return;
+        }
+        const TUint32 pc = TCfg::memIx(m_pc, m_memMask);
+        const TDecoded &dec = m_decodedBase[pc];
+        if (isSlowFetch(dec)) {
+            if (cNotDecoded == dec.op1) {
+                predecodeT<TCfg>(pc);
+            }
+            if (cTrapOp1 == dec.op1) {
+                trap(pc);
+                return;
+            }
+        }
+        setFetched(pc, dec);
+    }
+
+    inline void MiscCpu::setFetched(TUint32 pc, const TDecoded &dec) {
+        m_opCode = OpCode(dec.getOpcode());
+        m_ixJ = dec.ixJ;
+        m_ixK = dec.ixK;
+        m_cond = (ECond)dec.cond;
+        m_immed = dec.immed;
+        m_pc = pc + 1;
+    }
+
+    template<class TCfg>
+    TInt32 MiscCpu::readMemT(TUint32 addr) {
+        //memory: the one compare memIx() did anyway
+        if (TCfg::isMem(addr, m_memMask)) {
+            return m_memBase[TCfg::memIx(addr, m_memMask)];
+        }
+        return ioRead(addr);
+    }
+
+    template<class TCfg>
+    void MiscCpu::writeMemT(TUint32 addr, TInt32 val) {
+        m_storeCnt++;
+        if (!TCfg::isMem(addr, m_memMask)) {
+            ioWrite(addr, val);
+            return;
+        }
+        addr = TCfg::memIx(addr, m_memMask);
+        if (m_hookStores) {
+            storeHook(addr);
+        }
+        m_memBase[addr] = val;
+        m_decodedBase[addr].op1 = cNotDecoded;
+        if ((0 != m_jitCodeMap) && (0 != m_jitCodeMap[addr])) {
+            invalidateJit(addr);
+        }
+    }
+
+    template<class TCfg>
+    void MiscCpu::swapT() {
+        const TUint32 addr = m_rk + m_immed;
+        m_storeCnt++;
+        if (!TCfg::isMem(addr, m_memMask)) {
+            //device: read then write (no other hart shares m_bus)
+            const TInt32 val = ioRead(addr);
+            ioWrite(addr, m_rj);
+            m_regBase[m_ixJ] = val;
+            return;
+        }
+        const TUint32 ix = TCfg::memIx(addr, m_memMask);
+        if (m_hookStores) {
+            storeHook(ix);
+        }
+#if defined(__GNUC__)
+        //one host xchg: indivisible vs. harts sharing m_memBase
+        m_regBase[m_ixJ] = __sync_lock_test_and_set(&m_memBase[ix], m_rj);
+#else
+        const TInt32 val = m_memBase[ix];
+        m_memBase[ix] = m_rj;
+        m_regBase[m_ixJ] = val;
+#endif
+        m_decodedBase[ix].op1 = cNotDecoded;
+        if ((0 != m_jitCodeMap) && (0 != m_jitCodeMap[ix])) {
+            invalidateJit(ix);
+        }
+    }
+
+    template<class TCfg>
+    void MiscCpu::pushT(TInt32 val) {
+        TUint32 sp = m_regBase[cSpRegIx] - 1;
+        writeMemT<TCfg>(sp, val);
+        m_regBase[cSpRegIx] = sp;
+    }
+
+    template<class TCfg>
+    TInt32 MiscCpu::popT() {
+        TUint32 sp = m_regBase[cSpRegIx];
+        TInt32 rval = readMemT<TCfg>(sp++);
+        m_regBase[cSpRegIx] = sp;
+        return rval;
+    }
+
+    template<class TCfg>
+    void MiscCpu::callT(bool cond) {
+        if (cond) {
+            pushT<TCfg>(m_pc);
+            m_pc += m_immed;
+            m_callDepth++;
+        }
+        if (!m_hooks.empty()) {
+            callHook(cond);
+        }
+    }
+
+    template<class TCfg>
+    void MiscCpu::executeT() {
+        OpCode::EOp opcode = m_opCode.getOpcode();
+		switch(opcode) {
+            case OpCode::eNop:  //fall through
+            case OpCode::eHalt:
+				break;
+            //
+            //Arithmetic
+            case OpCode::eAdd:   // r[j] = r[j] + r[k]
+                m_aluz = m_rj + m_rk;
+                setFlagsUpdateRj(m_rk);
+				break;
+            case OpCode::eAddi:  // r[j] = r[j] + immed
+                m_aluz = m_rj + m_immed;
+                setFlagsUpdateRj(m_immed);
+				break;
+            case OpCode::eSub:   // r[j] = r[j] - r[k]
+                m_aluz = m_rj - m_rk;
+                setFlagsUpdateRj(m_rk);
+				break;
+            case OpCode::eCmp:   // r[j] - r[k]
+                m_aluz = m_rj - m_rk;
+                setFlags(m_rk);
+				break;
+            case OpCode::eSubi:  // r[j] = r[j] - immed
+                m_aluz = m_rj - m_immed;
+                setFlagsUpdateRj(m_immed);
+				break;
+            case OpCode::eCmpi:  // r[j] - immed
+                m_aluz = m_rj - m_immed;
+                setFlags(m_immed);
+				break;
+            //
+            //Logical
+            case OpCode::eLsl:   // r[j] = r[j] << r[k]  (0 fill LSBs)
+                lsl(m_rk);
+				break;
+            case OpCode::eLsli:  // r[j] = r[j] << immed (0 fill LSBs)
+                lsl(m_immed);
+                break;
+            case OpCode::eLsr:   // r[j] = r[j] >> r[k]  (0 fill MSBs)
+                lsr(m_rk);
+                break;
+            case OpCode::eLsri:  // r[j] = r[j] >> immed (0 fill LSBs)
+                lsl(m_immed);
+                break;
+            case OpCode::eAsr:   // r[j] = r[j] >> r[k]  (MSB fill MSBs)
+                asr(m_rk);
+                break;
+            case OpCode::eAsri:  // r[j] = r[j] >> immed (MSB fill MSBs)
+                asr(m_immed);
+                break;
+            case OpCode::eAnd:   // r[j] = r[j] & r[k]
+                m_aluz = m_rj & m_rk;
+                setFlagsUpdateRj();
+				break;
+            case OpCode::eOr:    // r[j] = r[j] | r[k]
+                m_aluz = m_rj | m_rk;
+                setFlagsUpdateRj();
+				break;
+            case OpCode::eXor:   // r[j] = r[j] ^ r[k]
+                m_aluz = m_rj ^ m_rk;
+                setFlagsUpdateRj();
+				break;
+            case OpCode::eAndi:   // r[j] = r[j] & immed
+                m_aluz = m_rj & m_immed;
+                setFlagsUpdateRj();
+				break;
+            case OpCode::eOri:    // r[j] = r[j] | immed
+                m_aluz = m_rj | m_immed;
+                setFlagsUpdateRj();
+				break;
+            case OpCode::eXori:   // r[j] = r[j] ^ immed
+                m_aluz = m_rj ^ m_immed;
+                setFlagsUpdateRj();
+				break;
+            case OpCode::eNot:   // r[j] = ~r[j]
+                m_aluz = ~m_rj;
+                setFlagsUpdateRj();
+				break;
+            //
+            //Load/store (do not affect flags)
+            case OpCode::eLoad:  // r[j] = mem[r[k]+immed]
+                m_regBase[m_ixJ] = readMemT<TCfg>(m_rk + m_immed);
+				break;
+            case OpCode::eLoadr: // r[j] = r[k]
+                m_regBase[m_ixJ] = m_rk;
+                break;
+            case OpCode::eLoadi: // r[j] = immed
+                m_regBase[m_ixJ] = m_immed;
+                break;
+            case OpCode::eLoadil:// r[j] = [pc+1]   ([pc+1] is next full word)
+                m_regBase[m_ixJ] = readMemT<TCfg>(m_pc++);
+                break;
+            case OpCode::eStore: // mem[r[k]+immed] = r[j]
+                writeMemT<TCfg>(m_rk + m_immed, m_rj);
+				break;
+            case OpCode::ePush:
+                pushT<TCfg>(m_rj);
+                break;
+            case OpCode::ePop:
+                m_regBase[m_ixJ] = popT<TCfg>();
+                break;
+            //
+            //Branch
+            case OpCode::eBr:    // pc = pc + immed  (immed is signed offset)
+                if (checkCond()) {
+                    m_pc += m_immed;
+                }
+				break;
+            //
+            //Call (push next pc onto stack)
+            case OpCode::eCall:  // push pc+1 onto stack; pc = pc + immed
+                callT<TCfg>(checkCond());
+                break;
+            case OpCode::eRetn:
+                m_pc = popT<TCfg>();
+                m_callDepth--;
+                break;
+            //
+            //Atomic
+            case OpCode::eSwap:  // r[j] <-> mem[r[k]+immed]
+                swapT<TCfg>();
+                break;
+			default:
+				ASSERT_NEVER;
+		}
+    }
+
+    template<class TCfg>
+    void MiscCpu::runInterpT(TUint64 cnt) {
+        TNullMon mon;
+        runMonT<TCfg>(mon, cnt);
+    }
+
+    //Add m_perfMon (if any) to mon.
+    template<class TCfg, class TMon>
+    void MiscCpu::runMonT(TMon &mon, TUint64 cnt) {
+        if (m_perfMon.isNull()) {
+            if (eSwitchEngine == m_engine) {
+                runSwitchT<TCfg>(mon, cnt);
+            } else {
+                runThreadedT<TCfg>(mon, cnt);
+            }
+        } else if (m_perfMon->isCountOnly()) {
+            TCountMon counter;
+            PTMonPair<TMon, TCountMon> both(mon, counter);
+            if (eSwitchEngine == m_engine) {
+                runSwitchT<TCfg>(both, cnt);
+            } else {
+                runThreadedT<TCfg>(both, cnt);
+            }
+            m_perfMon->incrInstructionCnt(counter.getCnt());
+        } else {
+            TPerfMonMon perfMon(m_perfMon);
+            PTMonPair<TMon, TPerfMonMon> both(mon, perfMon);
+            if (eSwitchEngine == m_engine) {
+                runSwitchT<TCfg>(both, cnt);
+            } else {
+                runThreadedT<TCfg>(both, cnt);
+            }
+        }
+        flushIo();
+    }
+
+    template<class TCfg, class TMon>
+    void MiscCpu::runSwitchT(TMon &mon, TUint64 cnt) {
+        bool loop = true, doCnt = (0 != cnt);
+        while (loop) {
+            const TUint32 pc = m_pc;
+            fetchT<TCfg>();
+            decode();
+            executeT<TCfg>();
+            mon.retire(*this, pc);
+            if (OpCode::eHalt == m_opCode.getOpcode()) {
+                loop = false;
+            } else if (doCnt) {
+                loop = (0 != --cnt);
+            }
+        }
+    }
+
+    /*
+     * Direct threaded dispatch: every handler ends with its own copy of
+     * NEXT (i.e., its own indirect jump), so the host branch predictor
+     * keeps separate history per opcode.  Handlers must match executeT().
+     */
+    template<class TCfg, class TMon>
+    void MiscCpu::runThreadedT(TMon &mon, TUint64 cnt) {
+#if defined(__GNUC__)
+        static void* const cHandlers[] = {
+            &&l_eNop,
+            &&l_eAdd, &&l_eAddi, &&l_eSub, &&l_eSubi,
+            &&l_eLoad, &&l_eLoadr, &&l_eLoadi, &&l_eLoadil,
+            &&l_eStore, &&l_ePush, &&l_ePop,
+            &&l_eLsl, &&l_eLsli, &&l_eLsr, &&l_eLsri, &&l_eAsr, &&l_eAsri,
+            &&l_eAnd, &&l_eOr, &&l_eXor, &&l_eAndi, &&l_eOri, &&l_eXori,
+            &&l_eNot, &&l_eCmp, &&l_eCmpi,
+            &&l_eBr, &&l_eCall, &&l_eRetn,
+            &&l_eHalt,
+            &&l_eSwap
+        };
+        ASSERT_TRUE(OpCode::eNotUsed == sizeof(cHandlers)/sizeof(cHandlers[0]));
+        const bool doCnt = (0 != cnt);
+        TUint32 pc;
+
+#define NEXT                                                    \
+        mon.retire(*this, pc);                                  \
+        if (doCnt && (0 == --cnt)) {                            \
+            return;                                             \
+        }                                                       \
+        pc = m_pc;                                              \
+        fetchT<TCfg>();                                         \
+        decode();                                               \
+        goto *cHandlers[m_opCode.getOpcode()]
+
+    /*
+     * Superinstruction: predecodeT() marked this instruction (cFuseNext)
+     * as the first of a pair fuses() accepts.  If the next one is still
+     * decoded as B, jump straight to its handler: no fetchT() checks and
+     * no indirect jump.  Each half still retires on its own, so counts,
+     * budgets and monitors are the same as unfused.
+     */
+#define FUSE(B)                                                 \
+        if ((cFuseNext == m_cond) &&                            \
+            ((OpCode::B + 1) == m_decodedBase[m_pc].op1)) {     \
+            mon.retire(*this, pc);                              \
+            if (doCnt && (0 == --cnt)) {                        \
+                return;                                         \
+            }                                                   \
+            m_fusedCnt++;                                       \
+            pc = m_pc;                                          \
+            setFetched(pc, m_decodedBase[pc]);                  \
+            decode();                                           \
+            goto l_##B;                                         \
+        }
+
+        pc = m_pc;
+        fetchT<TCfg>();
+        decode();
+        goto *cHandlers[m_opCode.getOpcode()];
+
+        l_eNop:
+            NEXT;
+        l_eHalt:
+            mon.retire(*this, pc);
+            return;
+        l_eAdd:
+            m_aluz = m_rj + m_rk;
+            setFlagsUpdateRj(m_rk);
+            NEXT;
+        l_eAddi:
+            m_aluz = m_rj + m_immed;
+            setFlagsUpdateRj(m_immed);
+            FUSE(eBr);
+            NEXT;
+        l_eSub:
+            m_aluz = m_rj - m_rk;
+            setFlagsUpdateRj(m_rk);
+            NEXT;
+        l_eCmp:
+            m_aluz = m_rj - m_rk;
+            setFlags(m_rk);
+            FUSE(eBr);
+            NEXT;
+        l_eSubi:
+            m_aluz = m_rj - m_immed;
+            setFlagsUpdateRj(m_immed);
+            FUSE(eBr);
+            FUSE(eCall);
+            NEXT;
+        l_eCmpi:
+            m_aluz = m_rj - m_immed;
+            setFlags(m_immed);
+            FUSE(eBr);
+            NEXT;
+        l_eLsl:
+            lsl(m_rk);
+            NEXT;
+        l_eLsli:
+            lsl(m_immed);
+            NEXT;
+        l_eLsr:
+            lsr(m_rk);
+            NEXT;
+        l_eLsri:
+            lsl(m_immed);   //same as executeT()
+            NEXT;
+        l_eAsr:
+            asr(m_rk);
+            NEXT;
+        l_eAsri:
+            asr(m_immed);
+            NEXT;
+        l_eAnd:
+            m_aluz = m_rj & m_rk;
+            setFlagsUpdateRj();
+            FUSE(eBr);
+            NEXT;
+        l_eOr:
+            m_aluz = m_rj | m_rk;
+            setFlagsUpdateRj();
+            NEXT;
+        l_eXor:
+            m_aluz = m_rj ^ m_rk;
+            setFlagsUpdateRj();
+            NEXT;
+        l_eAndi:
+            m_aluz = m_rj & m_immed;
+            setFlagsUpdateRj();
+            FUSE(eBr);
+            NEXT;
+        l_eOri:
+            m_aluz = m_rj | m_immed;
+            setFlagsUpdateRj();
+            NEXT;
+        l_eXori:
+            m_aluz = m_rj ^ m_immed;
+            setFlagsUpdateRj();
+            NEXT;
+        l_eNot:
+            m_aluz = ~m_rj;
+            setFlagsUpdateRj();
+            NEXT;
+        l_eLoad:
+            m_regBase[m_ixJ] = readMemT<TCfg>(m_rk + m_immed);
+            NEXT;
+        l_eLoadr:
+            m_regBase[m_ixJ] = m_rk;
+            FUSE(eAnd);
+            FUSE(eAndi);
+            NEXT;
+        l_eLoadi:
+            m_regBase[m_ixJ] = m_immed;
+            NEXT;
+        l_eLoadil:
+            m_regBase[m_ixJ] = readMemT<TCfg>(m_pc++);
+            NEXT;
+        l_eStore:
+            writeMemT<TCfg>(m_rk + m_immed, m_rj);
+            NEXT;
+        l_ePush:
+            pushT<TCfg>(m_rj);
+            FUSE(ePush);
+            NEXT;
+        l_ePop:
+            m_regBase[m_ixJ] = popT<TCfg>();
+            FUSE(ePop);
+            NEXT;
+        l_eBr:
+            if (checkCond()) {
+                m_pc += m_immed;
+            }
+            NEXT;
+        l_eCall:
+            callT<TCfg>(checkCond());
+            NEXT;
+        l_eRetn:
+            m_pc = popT<TCfg>();
+            m_callDepth--;
+            NEXT;
+        l_eSwap:
+            swapT<TCfg>();
+            NEXT;
+#undef FUSE
+#undef NEXT
+#else
+        runSwitchT<TCfg>(mon, cnt);
+#endif
+    }
+};
+
+#endif  //_miscpu_miscpucore_hxx_
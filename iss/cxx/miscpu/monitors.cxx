@@ -0,0 +1,179 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+#include "monitors.hxx"
+
+namespace miscpu
+{
+    TOpcodeMon::TOpcodeMon() {
+        for (unsigned i = 0; i < OpCode::eNotUsed; i++) {
+            m_cnt[i] = 0;
+        }
+    }
+
+    void TOpcodeMon::writeCsv(std::ostream &os) const {
+        for (unsigned i = 0; i < OpCode::eNotUsed; i++) {
+            os << "opcode," << OpCode::name((OpCode::EOp)i) << ","
+               << m_cnt[i] << std::endl;
+        }
+    }
+
+    void TOpcodeMon::writeJson(std::ostream &os) const {
+        os << "{";
+        for (unsigned i = 0; i < OpCode::eNotUsed; i++) {
+            os << ((0 == i) ? "" : ", ") << "\"" << OpCode::name((OpCode::EOp)i)
+               << "\": " << m_cnt[i];
+        }
+        os << "}";
+    }
+
+    TBranchMon::TBranchMon() {
+        for (unsigned i = 0; i < MiscCpu::eNotUsed; i++) {
+            m_taken[i] = m_notTaken[i] = 0;
+        }
+    }
+
+    void TBranchMon::writeCsv(std::ostream &os) const {
+        for (unsigned i = 0; i < MiscCpu::eNotUsed; i++) {
+            const char *cond = MiscCpu::condName((MiscCpu::ECond)i);
+            os << "branch.taken," << cond << "," << m_taken[i] << std::endl
+               << "branch.notTaken," << cond << "," << m_notTaken[i] << std::endl;
+        }
+    }
+
+    void TBranchMon::writeJson(std::ostream &os) const {
+        os << "{";
+        for (unsigned i = 0; i < MiscCpu::eNotUsed; i++) {
+            os << ((0 == i) ? "" : ", ") << "\""
+               << MiscCpu::condName((MiscCpu::ECond)i) << "\": {\"taken\": "
+               << m_taken[i] << ", \"notTaken\": " << m_notTaken[i] << "}";
+        }
+        os << "}";
+    }
+
+    TCallMon::TCallMon()
+        :   m_calls(0), m_retns(0), m_depth(0), m_maxDepth(0) {
+    }
+
+    void TCallMon::writeCsv(std::ostream &os) const {
+        os << "call,calls," << m_calls << std::endl
+           << "call,returns," << m_retns << std::endl
+           << "call,depth," << m_depth << std::endl
+           << "call,maxDepth," << m_maxDepth << std::endl;
+    }
+
+    void TCallMon::writeJson(std::ostream &os) const {
+        os << "{\"calls\": " << m_calls << ", \"returns\": " << m_retns
+           << ", \"depth\": " << m_depth << ", \"maxDepth\": " << m_maxDepth
+           << "}";
+    }
+
+    TPcMon::TPcMon(TUint64 memDepth)
+        :   m_cnt(memDepth), m_end(0) {
+    }
+
+    void TPcMon::writeCsv(std::ostream &os) const {
+        for (TUint64 i = 0; i < m_end; i++) {
+            if (0 != m_cnt[i]) {
+                os << "pc," << i << "," << m_cnt[i] << std::endl;
+            }
+        }
+    }
+
+    void TPcMon::writeJson(std::ostream &os) const {
+        const char *sep = "";
+        os << "{";
+        for (TUint64 i = 0; i < m_end; i++) {
+            if (0 != m_cnt[i]) {
+                os << sep << "\"" << i << "\": " << m_cnt[i];
+                sep = ", ";
+            }
+        }
+        os << "}";
+    }
+
+    TPairMon::TPairMon()
+        :   m_prev(OpCode::eNop), m_nextPc(~(TUint32)0) {    //no first yet
+        for (unsigned i = 0; i < OpCode::eNotUsed; i++) {
+            for (unsigned j = 0; j < OpCode::eNotUsed; j++) {
+                m_cnt[i][j] = 0;
+            }
+        }
+    }
+
+    void TPairMon::writeCsv(std::ostream &os) const {
+        for (unsigned i = 0; i < OpCode::eNotUsed; i++) {
+            for (unsigned j = 0; j < OpCode::eNotUsed; j++) {
+                if (0 != m_cnt[i][j]) {
+                    os << "pair," << OpCode::name((OpCode::EOp)i) << "."
+                       << OpCode::name((OpCode::EOp)j) << "," << m_cnt[i][j] << std::endl;
+                }
+            }
+        }
+    }
+
+    void TPairMon::writeJson(std::ostream &os) const {
+        const char *sep = "";
+        os << "{";
+        for (unsigned i = 0; i < OpCode::eNotUsed; i++) {
+            for (unsigned j = 0; j < OpCode::eNotUsed; j++) {
+                if (0 != m_cnt[i][j]) {
+                    os << sep << "\"" << OpCode::name((OpCode::EOp)i) << "."
+                       << OpCode::name((OpCode::EOp)j) << "\": " << m_cnt[i][j];
+                    sep = ", ";
+                }
+            }
+        }
+        os << "}";
+    }
+
+    TStatsMon::TStatsMon(TUint64 memDepth)
+        :   m_pcs(memDepth) {
+    }
+
+    void TStatsMon::writeCsv(std::ostream &os) const {
+        os << "stat,key,value" << std::endl
+           << "count,instructions," << m_count.getCnt() << std::endl;
+        m_opcodes.writeCsv(os);
+        m_branches.writeCsv(os);
+        m_calls.writeCsv(os);
+        m_pcs.writeCsv(os);
+        m_pairs.writeCsv(os);
+    }
+
+    void TStatsMon::writeJson(std::ostream &os) const {
+        os << "{\"instructions\": " << m_count.getCnt() << "," << std::endl
+           << " \"opcodes\": ";
+        m_opcodes.writeJson(os);
+        os << "," << std::endl << " \"branches\": ";
+        m_branches.writeJson(os);
+        os << "," << std::endl << " \"calls\": ";
+        m_calls.writeJson(os);
+        os << "," << std::endl << " \"pcs\": ";
+        m_pcs.writeJson(os);
+        os << "," << std::endl << " \"pairs\": ";
+        m_pairs.writeJson(os);
+        os << "}" << std::endl;
+    }
+};
@@ -0,0 +1,305 @@
+/**
+ * The MIT License
+ *
+ * Copyright (c) 2010  Karl W. Pfalzer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+#if !defined(_miscpu_monitors_hxx_)
+#    define  _miscpu_monitors_hxx_
+
+/*
+ * Statically dispatched monitors: the interpreter loops are templated
+ * on the monitor type and call
+ *
+ *      void retire(const MiscCpu &cpu, TUint32 pc);
+ *
+ * (inline, non-virtual) after each instruction executes; pc is the
+ * address of the instruction, cpu holds its fetched fields and the
+ * state after it.  TNullMon compiles away.
+ *
+ * Use: MiscCpu::run(mon [,cnt]).  Monitors combine with PTMonPair.
+ */
+
+#include <vector>
+#include <ostream>
+#include "xyzzy/portable.hxx"
+#include "miscpu.hxx"
+#include "opcode.hxx"
+
+using xyzzy::TUint32;
+using xyzzy::TUint64;
+
+namespace miscpu
+{
+    struct TNullMon {
+        void retire(const MiscCpu&, TUint32) {
+        }
+    };
+
+    //Call both A and B.
+    template<class A, class B>
+    class PTMonPair {
+    public:
+        explicit PTMonPair(A &a, B &b)
+            :   m_a(a), m_b(b) {
+        }
+
+        void retire(const MiscCpu &cpu, TUint32 pc) {
+            m_a.retire(cpu, pc);
+            m_b.retire(cpu, pc);
+        }
+
+    private:
+        A   &m_a;
+        B   &m_b;
+    };
+
+    //Instruction count only (what DefaultPerfMon records).
+    class TCountMon {
+    public:
+        explicit TCountMon()
+            :   m_cnt(0) {
+        }
+
+        void retire(const MiscCpu&, TUint32) {
+            m_cnt++;
+        }
+
+        TUint64 getCnt() const {
+            return m_cnt;
+        }
+
+    private:
+        TUint64 m_cnt;
+    };
+
+    //Call a (dynamic) PerfMon::process().
+    class TPerfMonMon {
+    public:
+        explicit TPerfMonMon(const TRcPerfMon &perfMon)
+            :   m_perfMon(perfMon) {
+        }
+
+        void retire(const MiscCpu &cpu, TUint32) {
+            m_perfMon->process(cpu);
+        }
+
+    private:
+        TRcPerfMon  m_perfMon;
+    };
+
+    //Executions per opcode.
+    class TOpcodeMon {
+    public:
+        explicit TOpcodeMon();
+
+        void retire(const MiscCpu &cpu, TUint32) {
+            m_cnt[cpu.getOpcode()]++;
+        }
+
+        TUint64 getCnt(OpCode::EOp op) const {
+            return m_cnt[op];
+        }
+
+        void writeCsv(std::ostream &os) const;
+        void writeJson(std::ostream &os) const;
+
+    private:
+        TUint64 m_cnt[OpCode::eNotUsed];
+    };
+
+    //eBr taken/not taken per condition.
+    class TBranchMon {
+    public:
+        explicit TBranchMon();
+
+        void retire(const MiscCpu &cpu, TUint32) {
+            if (OpCode::eBr == cpu.getOpcode()) {
+                //flags are not changed by eBr: condition still valid
+                TUint64 *cnt = cpu.checkCond() ? m_taken : m_notTaken;
+                cnt[cpu.getCond()]++;
+            }
+        }
+
+        TUint64 getTaken(MiscCpu::ECond cond) const {
+            return m_taken[cond];
+        }
+
+        TUint64 getNotTaken(MiscCpu::ECond cond) const {
+            return m_notTaken[cond];
+        }
+
+        void writeCsv(std::ostream &os) const;
+        void writeJson(std::ostream &os) const;
+
+    private:
+        TUint64 m_taken[MiscCpu::eNotUsed];
+        TUint64 m_notTaken[MiscCpu::eNotUsed];
+    };
+
+    //Taken eCall/eRetn and call depth.
+    class TCallMon {
+    public:
+        explicit TCallMon();
+
+        void retire(const MiscCpu &cpu, TUint32) {
+            OpCode::EOp op = cpu.getOpcode();
+            //a hooked call returned already (see MiscCpu::setHook())
+            if ((OpCode::eCall == op) && (0 == cpu.getHleCall()) &&
+                cpu.checkCond()) {
+                m_calls++;
+                if (++m_depth > m_maxDepth) {
+                    m_maxDepth = m_depth;
+                }
+            } else if (OpCode::eRetn == op) {
+                m_retns++;
+                m_depth--;
+            }
+        }
+
+        //calls - returns: < 0 if returned past the starting frame
+        long long getDepth() const {
+            return m_depth;
+        }
+
+        long long getMaxDepth() const {
+            return m_maxDepth;
+        }
+
+        void writeCsv(std::ostream &os) const;
+        void writeJson(std::ostream &os) const;
+
+    private:
+        TUint64     m_calls, m_retns;
+        long long   m_depth, m_maxDepth;
+    };
+
+    //Executions per pc.
+    class TPcMon {
+    public:
+        explicit TPcMon(TUint64 memDepth);
+
+        void retire(const MiscCpu&, TUint32 pc) {
+            m_cnt[pc]++;    //pc was checked by fetch
+            if (pc >= m_end) {
+                m_end = (TUint64)pc + 1;
+            }
+        }
+
+        TUint64 getCnt(TUint32 pc) const {
+            return m_cnt[pc];
+        }
+
+        //Only executed pcs are written.
+        void writeCsv(std::ostream &os) const;
+        void writeJson(std::ostream &os) const;
+
+    private:
+        //Reserved like MiscCpu::m_mem: only pages of executed pcs commit.
+        PTMappedArray<TUint64>  m_cnt;
+        TUint64                 m_end;  //1 + highest executed pc
+    };
+
+    /**
+     * Executions per pair of opcodes at consecutive addresses, the
+     * second falling through from the first: the profile the fused
+     * pairs of runThreadedT() were chosen from (see miscpucore.hxx).
+     */
+    class TPairMon {
+    public:
+        explicit TPairMon();
+
+        void retire(const MiscCpu &cpu, TUint32 pc) {
+            const OpCode::EOp op = cpu.getOpcode();
+            if (pc == m_nextPc) {
+                m_cnt[m_prev][op]++;
+            }
+            m_prev = op;
+            m_nextPc = pc + 1;
+        }
+
+        TUint64 getCnt(OpCode::EOp first, OpCode::EOp second) const {
+            return m_cnt[first][second];
+        }
+
+        //Only pairs executed are written.
+        void writeCsv(std::ostream &os) const;
+        void writeJson(std::ostream &os) const;
+
+    private:
+        TUint64     m_cnt[OpCode::eNotUsed][OpCode::eNotUsed];
+        OpCode::EOp m_prev;
+        TUint32     m_nextPc;   //pc after m_prev, if it fell through
+    };
+
+    //All of the above.
+    class TStatsMon {
+    public:
+        explicit TStatsMon(TUint64 memDepth);
+
+        void retire(const MiscCpu &cpu, TUint32 pc) {
+            m_count.retire(cpu, pc);
+            m_opcodes.retire(cpu, pc);
+            m_branches.retire(cpu, pc);
+            m_calls.retire(cpu, pc);
+            m_pcs.retire(cpu, pc);
+            m_pairs.retire(cpu, pc);
+        }
+
+        const TCountMon& getCount() const {
+            return m_count;
+        }
+
+        const TOpcodeMon& getOpcodes() const {
+            return m_opcodes;
+        }
+
+        const TBranchMon& getBranches() const {
+            return m_branches;
+        }
+
+        const TCallMon& getCalls() const {
+            return m_calls;
+        }
+
+        const TPcMon& getPcs() const {
+            return m_pcs;
+        }
+
+        const TPairMon& getPairs() const {
+            return m_pairs;
+        }
+
+        //Rows of: stat,key,value
+        void writeCsv(std::ostream &os) const;
+        void writeJson(std::ostream &os) const;
+
+    private:
+        TCountMon   m_count;
+        TOpcodeMon  m_opcodes;
+        TBranchMon  m_branches;
+        TCallMon    m_calls;
+        TPcMon      m_pcs;
+        TPairMon    m_pairs;
+    };
+};
+
+#endif  //_miscpu_monitors_hxx_
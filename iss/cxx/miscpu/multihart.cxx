@@ -0,0 +1,186 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+
+#include "xyzzy/assert.hxx"
+#include "multihart.hxx"
+#include "monitors.hxx"
+#include "miscpucore.hxx"
+#include "hosttime.hxx"
+
+namespace miscpu
+{
+    TMultiHart::TMultiHart(const char *memFname, unsigned nharts,
+            unsigned memBits, TUint32 stackWords)
+        :   m_nthreads(0),
+            m_quantum(0),
+            m_maxInstrs(0),
+            m_rounds(0),
+            m_stop(false),
+            m_secs(0) {
+        ASSERT_TRUE(0 < nharts);
+        ASSERT_TRUE((TUint64)nharts * stackWords <= ((TUint64)1 << memBits));
+        //0 if 32 bits: the first push wraps to the top word
+        const TUint32 top = (TUint32)((TUint64)1 << memBits);
+        for (unsigned i = 0; i < nharts; i++) {
+            THart hart;
+            hart.cpu = new MiscCpu((0 == i) ? memFname : 0, 5, memBits, false,
+                                   MiscCpu::eThreadedEngine);
+            hart.instrs = 0;
+            hart.done = false;
+            if (0 < i) {
+                hart.cpu->shareMemory(*m_harts[0].cpu);
+                hart.cpu->setPc(m_harts[0].cpu->getPc());
+            }
+            hart.cpu->setReg(0, i);
+            hart.cpu->setReg(1, nharts);
+            hart.cpu->setReg(hart.cpu->cSpRegIx, top - (i * stackWords));
+            m_harts.push_back(hart);
+        }
+    }
+
+    TMultiHart::~TMultiHart() {
+        //hart 0 (the memory) last
+        for (unsigned i = m_harts.size(); 0 < i; i--) {
+            delete m_harts[i - 1].cpu;
+        }
+    }
+
+    double TMultiHart::run(unsigned nthreads, TUint64 quantum, TUint64 maxInstrs) {
+        ASSERT_TRUE(0 < quantum);
+        m_quantum = quantum;
+        m_maxInstrs = maxInstrs;
+        m_rounds = 0;
+        m_stop = false;
+        for (unsigned i = 0; i < m_harts.size(); i++) {
+            m_harts[i].instrs = 0;
+            m_harts[i].done = (OpCode::eHalt == m_harts[i].cpu->getOpcode());
+        }
+        //no thread without a hart
+        m_nthreads = (nthreads < m_harts.size()) ? nthreads : m_harts.size();
+        const double t0 = nowSecs();
+        if (0 == m_nthreads) {
+            while (!allDone()) {
+                for (unsigned i = 0; i < m_harts.size(); i++) {
+                    runQuantum(i);
+                }
+                m_rounds++;
+            }
+        } else {
+            ASSERT_TRUE(0 == pthread_barrier_init(&m_barrier, 0, m_nthreads));
+            std::vector<TWorker> workers(m_nthreads);
+            std::vector<pthread_t> tids(m_nthreads);
+            for (unsigned i = 0; i < m_nthreads; i++) {
+                workers[i].sys = this;
+                workers[i].ix = i;
+                //worker 0 is this thread
+                if (0 < i) {
+                    ASSERT_TRUE(0 == pthread_create(&tids[i], 0, worker, &workers[i]));
+                }
+            }
+            worker(&workers[0]);
+            for (unsigned i = 1; i < m_nthreads; i++) {
+                pthread_join(tids[i], 0);
+            }
+            pthread_barrier_destroy(&m_barrier);
+        }
+        m_secs = nowSecs() - t0;
+        return m_secs;
+    }
+
+    void* TMultiHart::worker(void *arg) {
+        TWorker *w = (TWorker*)arg;
+        TMultiHart &sys = *w->sys;
+        while (true) {
+            for (unsigned i = w->ix; i < sys.m_harts.size(); i += sys.m_nthreads) {
+                sys.runQuantum(i);
+            }
+            //One thread decides for all: the second barrier publishes it.
+            if (PTHREAD_BARRIER_SERIAL_THREAD == pthread_barrier_wait(&sys.m_barrier)) {
+                sys.m_rounds++;
+                sys.m_stop = sys.allDone();
+            }
+            pthread_barrier_wait(&sys.m_barrier);
+            if (sys.m_stop) {
+                break;
+            }
+        }
+        return 0;
+    }
+
+    void TMultiHart::runQuantum(unsigned ix) {
+        THart &hart = m_harts[ix];
+        if (hart.done) {
+            return;
+        }
+        TUint64 n = m_quantum;
+        if ((0 != m_maxInstrs) && (m_maxInstrs - hart.instrs < n)) {
+            n = m_maxInstrs - hart.instrs;
+        }
+        TCountMon cnt;
+        hart.cpu->run(cnt, n);
+        hart.instrs += cnt.getCnt();
+        hart.done = (OpCode::eHalt == hart.cpu->getOpcode()) ||
+                    ((0 != m_maxInstrs) && (m_maxInstrs == hart.instrs));
+    }
+
+    bool TMultiHart::allDone() const {
+        for (unsigned i = 0; i < m_harts.size(); i++) {
+            if (!m_harts[i].done) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    TUint64 TMultiHart::getInstrs() const {
+        TUint64 n = 0;
+        for (unsigned i = 0; i < m_harts.size(); i++) {
+            n += m_harts[i].instrs;
+        }
+        return n;
+    }
+
+    void TMultiHart::writeReport(std::ostream &os) const {
+        const double secs = (0 < m_secs) ? m_secs : 1e-9;
+        const TUint64 n = getInstrs();
+        os << "Info: harts: " << m_harts.size() << " hart(s) on ";
+        if (0 == m_nthreads) {
+            os << "1 thread (round-robin)";
+        } else {
+            os << m_nthreads << " thread(s)";
+        }
+        os << ", " << m_rounds << " round(s), quantum " << m_quantum << ": " << n
+           << " instruction(s) in " << m_secs << " s (" << (n / secs / 1e6)
+           << " MIPS)" << std::endl;
+        for (unsigned i = 0; i < m_harts.size(); i++) {
+            const THart &hart = m_harts[i];
+            const bool halted = (OpCode::eHalt == hart.cpu->getOpcode());
+            os << "Info: hart " << i << ": " << hart.instrs << " instruction(s) ("
+               << (hart.instrs / secs / 1e6) << " MIPS), "
+               << (halted ? "halted" : "stopped") << " at pc " << hart.cpu->getPc()
+               << std::endl;
+        }
+    }
+};
@@ -0,0 +1,129 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+
+#if !defined(_miscpu_multihart_hxx_)
+#    define  _miscpu_multihart_hxx_
+
+/*
+ * Multi-hart system: n harts (MiscCpu) on one memory.  Each hart has
+ * its own pc, flags and registers, so its own stack (r[cSpRegIx]); all
+ * load, store and fetch hart 0's memory and predecode cache (see
+ * MiscCpu::shareMemory()).  Hart i starts at the image entry with
+ *
+ *      r0 = i, r1 = n, sp = top of memory - i * stackWords
+ *
+ * (so a program for it does not set sp itself).
+ *
+ * Harts are interpreted in quanta of instructions:
+ *
+ *      parallel        nthreads host threads, hart i on thread
+ *                      i % nthreads; after each quantum every thread
+ *                      waits at a barrier, until all harts halted
+ *      round-robin     (nthreads 0) one quantum of each hart in turn on
+ *                      the calling thread: the run is deterministic
+ *
+ * eSwap is the one atomic access (a host xchg); other loads and stores
+ * are plain host accesses, ordered as the host orders them, so guest
+ * locks are built on eSwap.  Writing code another hart is running is a
+ * guest race.
+ */
+
+#include <vector>
+#include <ostream>
+#include <pthread.h>
+#include "xyzzy/portable.hxx"
+#include "miscpu.hxx"
+
+using xyzzy::TUint32;
+using xyzzy::TUint64;
+
+namespace miscpu
+{
+    class TMultiHart {
+    public:
+        //Load memFname (as MiscCpu(memFname)) into n harts' memory.
+        explicit TMultiHart(const char *memFname,
+                unsigned nharts,
+                unsigned memBits = 20,
+                TUint32 stackWords = 0x1000);
+
+        ~TMultiHart();
+
+        unsigned getNumHarts() const {
+            return m_harts.size();
+        }
+
+        MiscCpu& getHart(unsigned ix) {
+            return *m_harts[ix].cpu;
+        }
+
+        /**
+         * Run until every hart halted, or ran maxInstrs (0: no limit),
+         * quantum instructions at a time, on nthreads host threads (0:
+         * round-robin).  Harts start again from their state of the last
+         * run(), if any.  Return elapsed seconds.
+         */
+        double run(unsigned nthreads, TUint64 quantum, TUint64 maxInstrs = 0);
+
+        //Instructions and MIPS of each hart and in all, of last run().
+        void writeReport(std::ostream &os) const;
+
+        //Sum over harts, of last run().
+        TUint64 getInstrs() const;
+
+    private:
+        struct THart {
+            MiscCpu     *cpu;
+            TUint64     instrs;     //of last run()
+            bool        done;       //halted, or at maxInstrs
+        };
+
+        struct TWorker {
+            TMultiHart  *sys;
+            unsigned    ix;
+        };
+
+        //not copyable (owns m_harts[].cpu)
+        TMultiHart(const TMultiHart&);
+        TMultiHart& operator=(const TMultiHart&);
+
+        static void* worker(void *arg);
+
+        //Run hart ix for up to one quantum.
+        void runQuantum(unsigned ix);
+
+        bool allDone() const;
+
+        std::vector<THart>  m_harts;
+        pthread_barrier_t   m_barrier;
+        unsigned            m_nthreads;
+        TUint64             m_quantum, m_maxInstrs;
+        TUint64             m_rounds;   //quanta per hart, of last run()
+        bool                m_stop;     //set at a barrier: all done
+        double              m_secs;
+    };
+};
+
+#endif  //_miscpu_multihart_hxx_
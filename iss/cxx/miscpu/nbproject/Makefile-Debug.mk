@@ -35,6 +35,27 @@ OBJECTDIR=build/${CND_CONF}/${CND_PLATFORM}
 OBJECTFILES= \
 	${OBJECTDIR}/miscpu.o \
 	${OBJECTDIR}/perfmon.o \
+	${OBJECTDIR}/jit.o \
+	${OBJECTDIR}/monitors.o \
+	${OBJECTDIR}/profiler.o \
+	${OBJECTDIR}/symbols.o \
+	${OBJECTDIR}/memmap.o \
+	${OBJECTDIR}/image.o \
+	${OBJECTDIR}/batch.o \
+	${OBJECTDIR}/checkpoint.o \
+	${OBJECTDIR}/trace.o \
+	${OBJECTDIR}/cosim.o \
+	${OBJECTDIR}/simd.o \
+	${OBJECTDIR}/assembler.o \
+	${OBJECTDIR}/iobus.o \
+	${OBJECTDIR}/timing.o \
+	${OBJECTDIR}/reverse.o \
+	${OBJECTDIR}/gdbstub.o \
+	${OBJECTDIR}/faultinj.o \
+	${OBJECTDIR}/bench.o \
+	${OBJECTDIR}/multihart.o \
+	${OBJECTDIR}/hle.o \
+	${OBJECTDIR}/telemetry.o \
 	${OBJECTDIR}/main.o
 
 
@@ -52,7 +73,7 @@ FFLAGS=
 ASFLAGS=
 
 # Link Libraries and Options
-LDLIBSOPTIONS=
+LDLIBSOPTIONS=-lpthread -lz
 
 # Build Targets
 .build-conf: ${BUILD_SUBPROJECTS}
@@ -72,6 +93,111 @@ ${OBJECTDIR}/perfmon.o: perfmon.cxx
 	${RM} $@.d
 	$(COMPILE.cc) -I../../../../xyzzy/src -MMD -MP -MF $@.d -o ${OBJECTDIR}/perfmon.o perfmon.cxx
 
+${OBJECTDIR}/jit.o: jit.cxx 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.cc) -I../../../../xyzzy/src -MMD -MP -MF $@.d -o ${OBJECTDIR}/jit.o jit.cxx
+
+${OBJECTDIR}/monitors.o: monitors.cxx 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.cc) -I../../../../xyzzy/src -MMD -MP -MF $@.d -o ${OBJECTDIR}/monitors.o monitors.cxx
+
+${OBJECTDIR}/profiler.o: profiler.cxx 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.cc) -I../../../../xyzzy/src -MMD -MP -MF $@.d -o ${OBJECTDIR}/profiler.o profiler.cxx
+
+${OBJECTDIR}/symbols.o: symbols.cxx 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.cc) -I../../../../xyzzy/src -MMD -MP -MF $@.d -o ${OBJECTDIR}/symbols.o symbols.cxx
+
+${OBJECTDIR}/memmap.o: memmap.cxx 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.cc) -I../../../../xyzzy/src -MMD -MP -MF $@.d -o ${OBJECTDIR}/memmap.o memmap.cxx
+
+${OBJECTDIR}/image.o: image.cxx 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.cc) -I../../../../xyzzy/src -MMD -MP -MF $@.d -o ${OBJECTDIR}/image.o image.cxx
+
+${OBJECTDIR}/batch.o: batch.cxx 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.cc) -I../../../../xyzzy/src -MMD -MP -MF $@.d -o ${OBJECTDIR}/batch.o batch.cxx
+
+${OBJECTDIR}/checkpoint.o: checkpoint.cxx 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.cc) -I../../../../xyzzy/src -MMD -MP -MF $@.d -o ${OBJECTDIR}/checkpoint.o checkpoint.cxx
+
+${OBJECTDIR}/trace.o: trace.cxx 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.cc) -I../../../../xyzzy/src -MMD -MP -MF $@.d -o ${OBJECTDIR}/trace.o trace.cxx
+
+${OBJECTDIR}/cosim.o: cosim.cxx 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.cc) -I../../../../xyzzy/src -MMD -MP -MF $@.d -o ${OBJECTDIR}/cosim.o cosim.cxx
+
+${OBJECTDIR}/simd.o: simd.cxx 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.cc) -I../../../../xyzzy/src -MMD -MP -MF $@.d -o ${OBJECTDIR}/simd.o simd.cxx
+
+${OBJECTDIR}/assembler.o: assembler.cxx 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.cc) -I../../../../xyzzy/src -MMD -MP -MF $@.d -o ${OBJECTDIR}/assembler.o assembler.cxx
+
+${OBJECTDIR}/iobus.o: iobus.cxx 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.cc) -I../../../../xyzzy/src -MMD -MP -MF $@.d -o ${OBJECTDIR}/iobus.o iobus.cxx
+
+${OBJECTDIR}/timing.o: timing.cxx 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.cc) -I../../../../xyzzy/src -MMD -MP -MF $@.d -o ${OBJECTDIR}/timing.o timing.cxx
+
+${OBJECTDIR}/reverse.o: reverse.cxx 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.cc) -I../../../../xyzzy/src -MMD -MP -MF $@.d -o ${OBJECTDIR}/reverse.o reverse.cxx
+
+${OBJECTDIR}/gdbstub.o: gdbstub.cxx 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.cc) -I../../../../xyzzy/src -MMD -MP -MF $@.d -o ${OBJECTDIR}/gdbstub.o gdbstub.cxx
+
+${OBJECTDIR}/faultinj.o: faultinj.cxx 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.cc) -I../../../../xyzzy/src -MMD -MP -MF $@.d -o ${OBJECTDIR}/faultinj.o faultinj.cxx
+
+${OBJECTDIR}/bench.o: bench.cxx 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.cc) -I../../../../xyzzy/src -MMD -MP -MF $@.d -o ${OBJECTDIR}/bench.o bench.cxx
+
+${OBJECTDIR}/multihart.o: multihart.cxx 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.cc) -I../../../../xyzzy/src -MMD -MP -MF $@.d -o ${OBJECTDIR}/multihart.o multihart.cxx
+
+${OBJECTDIR}/hle.o: hle.cxx 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.cc) -I../../../../xyzzy/src -MMD -MP -MF $@.d -o ${OBJECTDIR}/hle.o hle.cxx
+
+${OBJECTDIR}/telemetry.o: telemetry.cxx 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.cc) -I../../../../xyzzy/src -MMD -MP -MF $@.d -o ${OBJECTDIR}/telemetry.o telemetry.cxx
+
 ${OBJECTDIR}/main.o: main.cxx 
 	${MKDIR} -p ${OBJECTDIR}
 	${RM} $@.d
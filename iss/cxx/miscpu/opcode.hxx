@@ -92,6 +92,9 @@ namespace miscpu
             //Control
             eHalt,
             //
+            //Atomic (one indivisible access: see multihart.hxx)
+            eSwap,  // r[j] <-> mem[r[k]+immed]
+            //
             //UNUSED
             eNotUsed
         };
@@ -105,6 +108,10 @@ namespace miscpu
             ASSERT_TRUE(eNotUsed > m_opCode);
         }
 
+        explicit OpCode(EOp opcode) {
+            m_opCode = opcode;
+        }
+
         static bool isBranchOrCall(EOp opcode) {
             return (eBr==opcode || eCall==opcode);
         }
@@ -132,6 +139,23 @@ namespace miscpu
             return m_opCode;
         }
 
+        static const char* name(EOp opcode) {
+            static const char* const cNames[] = {
+                "eNop",
+                "eAdd", "eAddi", "eSub", "eSubi",
+                "eLoad", "eLoadr", "eLoadi", "eLoadil",
+                "eStore", "ePush", "ePop",
+                "eLsl", "eLsli", "eLsr", "eLsri", "eAsr", "eAsri",
+                "eAnd", "eOr", "eXor", "eAndi", "eOri", "eXori",
+                "eNot", "eCmp", "eCmpi",
+                "eBr", "eCall", "eRetn",
+                "eHalt",
+                "eSwap",
+                "eNotUsed"
+            };
+            return cNames[opcode];
+        }
+
     private:
         EOp m_opCode;
     };
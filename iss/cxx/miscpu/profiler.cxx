@@ -0,0 +1,126 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+#include "xyzzy/assert.hxx"
+#include "profiler.hxx"
+#include "hosttime.hxx"
+
+namespace miscpu
+{
+    TSampleProfiler::TSampleProfiler(TUint32 interval, double maxOverhead)
+        :   m_depth(0),
+            m_interval(interval),
+            m_countdown(interval),
+            m_maxOverhead(maxOverhead),
+            m_samples(0), m_truncated(0), m_underflows(0),
+            m_doublings(0),
+            m_first(0), m_last(0), m_sampleSecs(0),
+            m_windowStart(0), m_windowSecs(0),
+            m_windowSamples(0) {
+        ASSERT_TRUE(0 < interval);
+    }
+
+    void TSampleProfiler::sample(TUint32 pc) {
+        const double t0 = nowSecs();
+        if (0 == m_samples) {
+            m_first = m_windowStart = t0;
+        }
+        unsigned depth = m_depth;
+        if (cMaxDepth < depth) {
+            depth = cMaxDepth;
+            m_truncated++;
+        }
+        std::vector<TUint32> key(&m_stack[0], &m_stack[depth]);
+        key.push_back(pc);
+        m_stacks[key] += m_interval;
+        m_samples++;
+        m_countdown = m_interval;
+        const double t1 = nowSecs();
+        m_sampleSecs += t1 - t0;
+        m_windowSecs += t1 - t0;
+        m_last = t1;
+        if (cWindowSamples == ++m_windowSamples) {
+            const double elapsed = t1 - m_windowStart;
+            if ((0 < elapsed) && ((m_windowSecs / elapsed) > m_maxOverhead)
+                && (0 == (m_interval >> 31))) {
+                m_interval <<= 1;
+                m_countdown = m_interval;
+                m_doublings++;
+            }
+            m_windowStart = t1;
+            m_windowSecs = 0;
+            m_windowSamples = 0;
+        }
+    }
+
+    double TSampleProfiler::getOverhead() const {
+        const double elapsed = m_last - m_first;
+        return (0 < elapsed) ? (m_sampleSecs / elapsed) : 0;
+    }
+
+    void TSampleProfiler::writeFolded(std::ostream &os,
+            const TSymbolMap &syms) const {
+        std::map<string, TUint64> folded;
+        for (t_stacks::const_iterator it = m_stacks.begin();
+             it != m_stacks.end(); ++it) {
+            const std::vector<TUint32> &key = it->first;
+            string stack, frame;
+            for (unsigned i = 0; i + 1 < key.size(); i++) {
+                frame = syms.symbolize(key[i]);
+                stack += (0 == i) ? frame : (";" + frame);
+            }
+            string leaf = syms.symbolize(key.back());
+            if (stack.empty()) {
+                stack = leaf;
+            } else if (leaf != frame) {
+                stack += ";" + leaf;
+            }
+            folded[stack] += it->second;
+        }
+        for (std::map<string, TUint64>::const_iterator it = folded.begin();
+             it != folded.end(); ++it) {
+            os << it->first << " " << it->second << std::endl;
+        }
+    }
+
+    void TSampleProfiler::writeReport(std::ostream &os) const {
+        os << "Info: profile: " << m_samples << " sample(s), "
+           << m_stacks.size() << " distinct stack(s)" << std::endl
+           << "Info: profile: interval " << m_interval
+           << " instruction(s) (doubled " << m_doublings << " time(s))"
+           << std::endl
+           << "Info: profile: sampling took " << (1e3 * m_sampleSecs)
+           << " ms (" << (100.0 * getOverhead()) << "% of run, limit "
+           << (100.0 * m_maxOverhead) << "%)" << std::endl;
+        if (0 != m_truncated) {
+            os << "Warning: profile: " << m_truncated
+               << " sample(s) truncated to " << cMaxDepth << " frames"
+               << std::endl;
+        }
+        if (0 != m_underflows) {
+            os << "Warning: profile: " << m_underflows
+               << " eRetn(s) without eCall" << std::endl;
+        }
+    }
+};
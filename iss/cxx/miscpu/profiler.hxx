@@ -0,0 +1,129 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+#if !defined(_miscpu_profiler_hxx_)
+#    define  _miscpu_profiler_hxx_
+
+#include <map>
+#include <vector>
+#include <ostream>
+#include "xyzzy/portable.hxx"
+#include "miscpu.hxx"
+#include "opcode.hxx"
+#include "symbols.hxx"
+
+using xyzzy::TUint32;
+using xyzzy::TUint64;
+
+namespace miscpu
+{
+    /**
+     * Sampling profiler: a monitor (see monitors.hxx) which records the
+     * guest pc and call stack every getInterval() instructions.
+     *
+     * The call stack is shadowed from taken eCall (push callee entry)
+     * and eRetn (pop), so it does not depend on what else the guest
+     * keeps on its stack.
+     *
+     * Overhead: between samples the cost is a count down and an opcode
+     * compare.  Time spent in sample() is measured; if over a window it
+     * exceeds maxOverhead of elapsed time, the interval is doubled.
+     * Each sample is weighted by the instructions it stands for.
+     */
+    class TSampleProfiler {
+    public:
+        explicit TSampleProfiler(TUint32 interval = 10007,
+                double maxOverhead = 0.01);
+
+        void retire(const MiscCpu &cpu, TUint32 pc) {
+            if (0 == --m_countdown) {
+                sample(pc);
+            }
+            OpCode::EOp op = cpu.getOpcode();
+            if (OpCode::eCall == op) {
+                //a hooked call returned already (see MiscCpu::setHook())
+                if ((0 == cpu.getHleCall()) && cpu.checkCond()) {
+                    enter(cpu.getPc());
+                }
+            } else if (OpCode::eRetn == op) {
+                leave();
+            }
+        }
+
+        TUint32 getInterval() const {
+            return m_interval;
+        }
+
+        TUint64 getSamples() const {
+            return m_samples;
+        }
+
+        //Time in sample() / time since first sample.
+        double getOverhead() const;
+
+        //Flame graph input: "frame;frame;...;leaf weight" per line.
+        //Frames are callee entries, leaf the label at/before pc.
+        void writeFolded(std::ostream &os, const TSymbolMap &syms) const;
+
+        void writeReport(std::ostream &os) const;
+
+    private:
+        //frames (callee entries) then sampled pc => weight
+        typedef std::map<std::vector<TUint32>, TUint64> t_stacks;
+
+        void enter(TUint32 entry) {
+            if (cMaxDepth > m_depth) {
+                m_stack[m_depth] = entry;
+            }
+            m_depth++;
+        }
+
+        void leave() {
+            if (0 < m_depth) {
+                m_depth--;
+            } else {
+                m_underflows++;
+            }
+        }
+
+        void sample(TUint32 pc);
+
+        static const unsigned cMaxDepth = 256;
+        static const unsigned cWindowSamples = 64;
+
+        t_stacks    m_stacks;
+        TUint32     m_stack[cMaxDepth];
+        unsigned    m_depth;
+        TUint32     m_interval, m_countdown;
+        double      m_maxOverhead;
+        TUint64     m_samples, m_truncated, m_underflows;
+        unsigned    m_doublings;
+        //seconds (monotonic clock)
+        double      m_first, m_last, m_sampleSecs;
+        double      m_windowStart, m_windowSecs;
+        unsigned    m_windowSamples;
+    };
+};
+
+#endif  //_miscpu_profiler_hxx_
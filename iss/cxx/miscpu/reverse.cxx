@@ -0,0 +1,345 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+#include "xyzzy/assert.hxx"
+#include "reverse.hxx"
+#include "miscpucore.hxx"
+
+namespace miscpu
+{
+    void TUndoLog::undo(MiscCpu &cpu, TUint64 pos) {
+        ASSERT_TRUE((m_begin <= pos) && (pos <= getEnd()));
+        while (getEnd() > pos) {
+            const TEntry &entry = m_entries[--m_end];
+            cpu.setMem(entry.addr, entry.old);
+        }
+    }
+
+    void TUndoLog::discard(TUint64 pos) {
+        ASSERT_TRUE((m_begin <= pos) && (pos <= getEnd()));
+        m_first += pos - m_begin;
+        m_begin = pos;
+    }
+
+    void TUndoLog::grow() {
+        if ((0 != m_first) && ((m_end - m_first) <= (m_entries.size() / 2))) {
+            //at most half live: move them down (so allocation stays
+            //within twice the live entries)
+            std::copy(m_entries.begin() + m_first, m_entries.begin() + m_end,
+                      m_entries.begin());
+            m_end -= m_first;
+            m_first = 0;
+        } else {
+            m_entries.resize((0 != m_end) ? (2 * m_end) : 4096);
+        }
+    }
+
+    //Times at which the next pc is a breakpoint (first and last).
+    class TBreakScan {
+    public:
+        static const TUint64 cNone = ~(TUint64)0;
+
+        explicit TBreakScan(const TTimeTravel &tt)
+            :   m_tt(tt), m_first(cNone), m_last(cNone) {
+        }
+
+        //after TTimeTravel::retire() (see PTMonPair)
+        void retire(const MiscCpu &cpu, TUint32) {
+            if (m_tt.isBreak(cpu.getPc())) {
+                m_last = m_tt.getNow();
+                if (cNone == m_first) {
+                    m_first = m_last;
+                }
+            }
+        }
+
+        TUint64 getFirst() const {
+            return m_first;
+        }
+
+        TUint64 getLast() const {
+            return m_last;
+        }
+
+    private:
+        const TTimeTravel   &m_tt;
+        TUint64             m_first, m_last;
+    };
+
+    TTimeTravel::TTimeTravel(MiscCpu &cpu, TUint32 interval, TUint64 maxBytes)
+        :   m_cpu(cpu),
+            m_interval(interval),
+            m_maxBytes(maxBytes),
+            m_snapBytes(sizeof(TSnapshot) + cpu.getNumRegs() * sizeof(TInt32)),
+            m_now(0),
+            m_countdown(interval),
+            m_haltTime(~(TUint64)0),
+            m_perfBase(cpu.getPerfMon().isNull() ? 0
+                                                 : cpu.getPerfMon()->getInstructionCnt()) {
+        ASSERT_TRUE(0 < interval);
+        for (unsigned i = 0; i < cBloomWords; i++) {
+            m_breakBloom[i] = 0;
+        }
+        snapshot();
+        m_cpu.setUndoLog(&m_log);
+    }
+
+    TTimeTravel::~TTimeTravel() {
+        m_cpu.setUndoLog(0);
+    }
+
+    TUint64 TTimeTravel::getBytes() const {
+        return ((m_log.getEnd() - m_log.getBegin()) * TUndoLog::cEntryBytes) +
+               (m_snaps.size() * m_snapBytes);
+    }
+
+    void TTimeTravel::snapshot() {
+        m_snaps.push_back(TSnapshot());
+        TSnapshot &snap = m_snaps.back();
+        snap.time = m_now;
+        snap.logPos = m_log.getEnd();
+        snap.pc = m_cpu.getPc();
+        snap.zero = m_cpu.getZero();
+        snap.cy = m_cpu.getCy();
+        snap.regs.resize(m_cpu.getNumRegs());
+        for (unsigned i = 0; i < snap.regs.size(); i++) {
+            snap.regs[i] = m_cpu.getReg(i);
+        }
+        snap.fusedCnt = m_cpu.getFusedCnt();
+        snap.storeCnt = m_cpu.getStoreCnt();
+        snap.callDepth = m_cpu.getCallDepth();
+        m_countdown = m_interval;
+        while ((1 < m_snaps.size()) && (getBytes() > m_maxBytes)) {
+            m_snaps.pop_front();
+            m_log.discard(m_snaps.front().logPos);
+        }
+    }
+
+    void TTimeTravel::restore(unsigned ix) {
+        const TSnapshot &snap = m_snaps[ix];
+        m_cpu.setUndoLog(0);
+        m_log.undo(m_cpu, snap.logPos);
+        m_cpu.setUndoLog(&m_log);
+        m_cpu.setPc(snap.pc);
+        m_cpu.setZeroCy(snap.zero, snap.cy);
+        for (unsigned i = 0; i < snap.regs.size(); i++) {
+            m_cpu.setReg(i, snap.regs[i]);
+        }
+        m_now = snap.time;
+        if (false == m_cpu.getPerfMon().isNull()) {
+            m_cpu.getPerfMon()->setInstructionCnt(m_perfBase + m_now);
+        }
+        m_cpu.m_fusedCnt = snap.fusedCnt;
+        m_cpu.m_storeCnt = snap.storeCnt;
+        m_cpu.m_callDepth = snap.callDepth;
+        m_countdown = m_interval;
+        m_snaps.erase(m_snaps.begin() + ix + 1, m_snaps.end());
+    }
+
+    template<class TMon>
+    void TTimeTravel::runWith(TMon &mon, TUint64 n) {
+        ASSERT_TRUE(0 < n);     //run(mon, 0) is until eHalt
+        PTMonPair<TTimeTravel, TMon> both(*this, mon);
+        m_cpu.run(both, n);
+        if (OpCode::eHalt == m_cpu.getOpcode()) {
+            m_haltTime = m_now;
+        }
+    }
+
+    TUint64 TTimeTravel::step(TUint64 n) {
+        if (isHalted() || (0 == n)) {
+            return 0;
+        }
+        const TUint64 t0 = m_now;
+        TNullMon none;
+        runWith(none, n);
+        return m_now - t0;
+    }
+
+    bool TTimeTravel::cont() {
+        if (m_breaks.empty()) {
+            TNullMon none;
+            while (!isHalted()) {
+                runWith(none, ~(TUint64)0);
+            }
+            return false;
+        }
+        //a snapshot interval at a time; back to the first hit
+        while (!isHalted()) {
+            TBreakScan scan(*this);
+            runWith(scan, m_interval);
+            if (TBreakScan::cNone != scan.getFirst()) {
+                seek(scan.getFirst());
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool TTimeTravel::seek(TUint64 t) {
+        if (t >= m_now) {
+            step(t - m_now);
+            return (t == m_now);
+        }
+        const bool reached = (t >= getOldest());
+        if (!reached) {
+            t = getOldest();
+        }
+        unsigned ix = m_snaps.size() - 1;
+        while (m_snaps[ix].time > t) {
+            ix--;
+        }
+        restore(ix);
+        if (t > m_now) {
+            TNullMon none;
+            runWith(none, t - m_now);
+        }
+        return reached;
+    }
+
+    bool TTimeTravel::reverseStep(TUint64 n) {
+        const bool inRange = (n <= m_now);
+        return seek(inRange ? (m_now - n) : 0) && inRange;
+    }
+
+    bool TTimeTravel::reverseCont() {
+        //scan back a snapshot interval at a time; to the last hit
+        TUint64 end = m_now;
+        while (end > getOldest()) {
+            unsigned ix = m_snaps.size() - 1;
+            while (m_snaps[ix].time >= end) {
+                ix--;
+            }
+            restore(ix);
+            const TUint64 start = m_now;
+            TUint64 hit = isBreak(m_cpu.getPc()) ? start : TBreakScan::cNone;
+            if (start + 1 < end) {
+                TBreakScan scan(*this);
+                runWith(scan, end - 1 - start);
+                if (TBreakScan::cNone != scan.getLast()) {
+                    hit = scan.getLast();
+                }
+            }
+            if (TBreakScan::cNone != hit) {
+                seek(hit);
+                return true;
+            }
+            end = start;
+        }
+        seek(getOldest());
+        return false;
+    }
+
+    void TTimeTravel::addBreak(TUint32 pc) {
+        m_breaks.insert(pc);
+        m_breakBloom[(pc >> 5) % cBloomWords] |= (1u << (pc & 31));
+    }
+
+    void TTimeTravel::removeBreak(TUint32 pc) {
+        m_breaks.erase(pc);
+        //rebuild: other breakpoints may share the bit
+        for (unsigned i = 0; i < cBloomWords; i++) {
+            m_breakBloom[i] = 0;
+        }
+        for (std::set<TUint32>::const_iterator it = m_breaks.begin();
+                it != m_breaks.end(); ++it) {
+            m_breakBloom[(*it >> 5) % cBloomWords] |= (1u << (*it & 31));
+        }
+    }
+
+    static void writeWhere(const TTimeTravel &tt, const MiscCpu &cpu,
+            std::ostream &os) {
+        os << "Info: t=" << tt.getNow() << " pc=0x" << std::hex << cpu.getPc()
+           << std::dec;
+        if (tt.isHalted()) {
+            os << " (halted)";
+        } else if (tt.isBreak(cpu.getPc())) {
+            os << " (breakpoint)";
+        }
+        os << std::endl;
+    }
+
+    void runTimeTravelShell(TTimeTravel &tt, MiscCpu &cpu, std::istream &is,
+            std::ostream &os) {
+        string line;
+        writeWhere(tt, cpu, os);
+        while (std::getline(is, line)) {
+            std::istringstream iss(line);
+            string cmd, arg1, arg2;
+            iss >> cmd >> arg1 >> arg2;
+            const TUint64 n1 = arg1.empty() ? 1 : strtoull(arg1.c_str(), 0, 0);
+            const TUint64 n2 = arg2.empty() ? 1 : strtoull(arg2.c_str(), 0, 0);
+            bool ok = true;
+            if (cmd.empty()) {
+                continue;
+            } else if ("q" == cmd) {
+                break;
+            } else if ("s" == cmd) {
+                ok = (tt.step(n1) == n1);
+            } else if ("rs" == cmd) {
+                ok = tt.reverseStep(n1);
+            } else if ("c" == cmd) {
+                ok = tt.cont();
+            } else if ("rc" == cmd) {
+                ok = tt.reverseCont();
+            } else if (("g" == cmd) && !arg1.empty()) {
+                ok = tt.seek(n1);
+            } else if (("b" == cmd) && !arg1.empty()) {
+                tt.addBreak(n1);
+                continue;
+            } else if (("d" == cmd) && !arg1.empty()) {
+                tt.removeBreak(n1);
+                continue;
+            } else if ("r" == cmd) {
+                os << "pc=0x" << std::hex << cpu.getPc() << std::dec
+                   << " zero=" << cpu.getZero() << " cy=" << cpu.getCy() << std::endl;
+                for (unsigned i = 0; i < cpu.getNumRegs(); i++) {
+                    os << "r" << i << "=" << cpu.getReg(i) << std::endl;
+                }
+                continue;
+            } else if (("m" == cmd) && !arg1.empty()) {
+                for (TUint64 a = n1; (a < n1 + n2) && (a < cpu.getMemDepth()); a++) {
+                    os << "mem[0x" << std::hex << a << std::dec << "]="
+                       << cpu.getMem(a) << std::endl;
+                }
+                continue;
+            } else if ("i" == cmd) {
+                os << "Info: t=" << tt.getNow() << ", history from t="
+                   << tt.getOldest() << ", " << tt.getBytes() << " byte(s), "
+                   << tt.getBreaks().size() << " breakpoint(s)" << std::endl;
+                continue;
+            } else {
+                os << "Error: " << line << ": unknown command" << std::endl;
+                continue;
+            }
+            if (!ok && !tt.isHalted()) {
+                os << "Info: start of history" << std::endl;
+            }
+            writeWhere(tt, cpu, os);
+        }
+    }
+};
@@ -0,0 +1,241 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+#if !defined(_miscpu_reverse_hxx_)
+#    define  _miscpu_reverse_hxx_
+
+/*
+ * Reverse execution.
+ *
+ * History is kept as periodic snapshots of pc, flags and registers
+ * plus an undo log of (address, old value) for every memory word the
+ * interpreter writes (eStore, ePush, taken eCall).  To go back to
+ * instruction t: undo the log down to the last snapshot at or before
+ * t, restore that snapshot and re-execute forward to t.  So seeking
+ * back N instructions costs about N + snapshot interval instructions,
+ * not the whole run.
+ *
+ * Re-execution must repeat the original: device windows (iobus.hxx)
+ * are neither undone nor replayed.
+ */
+
+#include <deque>
+#include <vector>
+#include <set>
+#include <istream>
+#include <ostream>
+#include "xyzzy/portable.hxx"
+#include "miscpu.hxx"
+
+using xyzzy::TUint32;
+using xyzzy::TUint64;
+using xyzzy::TInt32;
+
+namespace miscpu
+{
+    //Old values of written memory words (see MiscCpu::setUndoLog()).
+    class TUndoLog {
+    public:
+        struct TEntry {
+            TUint32 addr;
+            TInt32  old;
+        };
+
+        static const unsigned cEntryBytes = sizeof(TEntry);
+
+        explicit TUndoLog()
+            :   m_first(0), m_end(0), m_begin(0) {
+        }
+
+        void record(TUint32 addr, TInt32 old) {
+            if (m_end == m_entries.size()) {
+                grow();
+            }
+            TEntry &entry = m_entries[m_end++];
+            entry.addr = addr;
+            entry.old = old;
+        }
+
+        //Positions count every record() since construction.
+        TUint64 getBegin() const {
+            return m_begin;
+        }
+
+        TUint64 getEnd() const {
+            return m_begin + (m_end - m_first);
+        }
+
+        //pos in [getBegin(), getEnd()).
+        const TEntry& getEntry(TUint64 pos) const {
+            return m_entries[m_first + (pos - m_begin)];
+        }
+
+        //Write back old values of [pos, getEnd()), newest first, and drop
+        //them.  cpu must not be recording into this log.
+        void undo(MiscCpu &cpu, TUint64 pos);
+
+        //Drop [getBegin(), pos).
+        void discard(TUint64 pos);
+
+    private:
+        //Live entries are m_entries[m_first, m_end): discard() only
+        //moves m_first, grow() compacts or resizes, so record() is a
+        //plain store.
+        std::vector<TEntry> m_entries;
+        size_t              m_first, m_end;
+        TUint64             m_begin;    //position of m_entries[m_first]
+
+        void grow();
+    };
+
+    /**
+     * Time-travel over one MiscCpu: a monitor (see monitors.hxx) which
+     * runs the cpu with its undo log attached.  Time is instructions
+     * retired since construction; state "at t" is that after t of them.
+     *
+     * Memory is bounded by maxBytes (live undo log and snapshots; the
+     * log allocation is at most twice its live part): the oldest
+     * snapshots and their log are dropped to stay under it, so
+     * getOldest() moves forward.  At least one snapshot is kept.
+     *
+     * Breakpoints are pcs: a (reverse) continue stops where the next
+     * instruction to execute is at one of them.
+     */
+    class TTimeTravel {
+    public:
+        explicit TTimeTravel(MiscCpu &cpu, TUint32 interval = 4096,
+                TUint64 maxBytes = 16 << 20);
+
+        ~TTimeTravel();
+
+        void retire(const MiscCpu&, TUint32) {
+            m_now++;
+            if (0 == --m_countdown) {
+                snapshot();
+            }
+        }
+
+        TUint64 getNow() const {
+            return m_now;
+        }
+
+        //Earliest t seek() can reach.
+        TUint64 getOldest() const {
+            return m_snaps.front().time;
+        }
+
+        //True if the instruction retired at getNow() was eHalt.
+        bool isHalted() const {
+            return m_now == m_haltTime;
+        }
+
+        //Bytes held by undo log and snapshots.
+        TUint64 getBytes() const;
+
+        //Execute up to n instructions (stop at eHalt).
+        //Return number executed.
+        TUint64 step(TUint64 n = 1);
+
+        //Execute until a breakpoint or eHalt.  Return true at breakpoint.
+        bool cont();
+
+        //Move to t: back if t < getNow() (not before getOldest()), else
+        //forward (not past eHalt).  Return false if t was not reached.
+        bool seek(TUint64 t);
+
+        //seek(getNow() - n).
+        bool reverseStep(TUint64 n = 1);
+
+        //Back to the latest t < getNow() at a breakpoint.  If none,
+        //stop at getOldest() and return false.
+        bool reverseCont();
+
+        void addBreak(TUint32 pc);
+        void removeBreak(TUint32 pc);
+
+        const std::set<TUint32>& getBreaks() const {
+            return m_breaks;
+        }
+
+        bool isBreak(TUint32 pc) const {
+            return (0 != (m_breakBloom[(pc >> 5) % cBloomWords] & (1u << (pc & 31)))) &&
+                   (0 != m_breaks.count(pc));
+        }
+
+    private:
+        struct TSnapshot {
+            TUint64             time;
+            TUint64             logPos;     //m_log.getEnd() at time
+            TUint32             pc;
+            bool                zero, cy;
+            std::vector<TInt32> regs;
+            TUint64             fusedCnt;   //MiscCpu::getFusedCnt()
+            TUint64             storeCnt;   //MiscCpu::getStoreCnt()
+            long long           callDepth;  //MiscCpu::getCallDepth()
+        };
+
+        static const unsigned cBloomWords = 128;
+
+        void snapshot();
+
+        //Restore m_snaps[ix], drop later ones.
+        void restore(unsigned ix);
+
+        //Run cpu n (> 0) instructions with mon and *this.
+        template<class TMon>
+        void runWith(TMon &mon, TUint64 n);
+
+        MiscCpu             &m_cpu;
+        const TUint32       m_interval;
+        const TUint64       m_maxBytes;
+        const TUint64       m_snapBytes;    //of one TSnapshot
+        TUndoLog            m_log;
+        std::deque<TSnapshot>   m_snaps;    //ascending time; not empty
+        TUint64             m_now;
+        TUint32             m_countdown;    //to next snapshot
+        TUint64             m_haltTime;     //~0 if not (yet) halted
+        const TUint64       m_perfBase;     //PerfMon count at time 0
+        std::set<TUint32>   m_breaks;
+        TUint32             m_breakBloom[cBloomWords];
+
+        //not copyable (attached to m_cpu)
+        TTimeTravel(const TTimeTravel&);
+        TTimeTravel& operator=(const TTimeTravel&);
+    };
+
+    /**
+     * Line commands on is, replies on os (until "q" or end of input):
+     *
+     *      s [n]       step n (1)          rs [n]      reverse step n
+     *      c           continue            rc          reverse continue
+     *      g t         go to time t        b pc / d pc set/delete breakpoint
+     *      r           pc, flags, regs     m addr [n]  memory words
+     *      i           time, history, bytes
+     *      q           quit
+     */
+    void runTimeTravelShell(TTimeTravel &tt, MiscCpu &cpu, std::istream &is,
+            std::ostream &os);
+};
+
+#endif  //_miscpu_reverse_hxx_
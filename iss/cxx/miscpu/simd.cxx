@@ -0,0 +1,504 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+
+#include "xyzzy/assert.hxx"
+#include "simd.hxx"
+#include "miscpucore.hxx"
+
+namespace miscpu
+{
+    //Steps per lane utilization check.
+    static const TUint64 cWindowSteps = 4096;
+
+    //The build targets baseline x86-64 (SSE2): step() is also compiled
+    //for AVX2 and AVX-512, and the loader picks the widest the host has.
+#if defined(__x86_64__) && defined(__linux__)
+#    define SIMD_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#    define SIMD_CLONES
+#endif
+
+    static MiscCpu& first(const std::vector<MiscCpu*> &cpus) {
+        ASSERT_TRUE(false == cpus.empty());
+        return *cpus[0];
+    }
+
+    //Index of lowest set bit; clear it.
+    static unsigned nextLane(TUint32 &bits) {
+        const unsigned l = __builtin_ctz(bits);
+        bits &= bits - 1;
+        return l;
+    }
+
+    template<unsigned Lanes>
+    PTSimdGroup<Lanes>::PTSimdGroup(const std::vector<MiscCpu*> &cpus, double minUtil)
+        :   m_cpus(cpus),
+            m_lead(first(cpus)),
+            m_n(cpus.size()),
+            m_nregs(m_lead.getNumRegs()),
+            m_all((TUint32)(((TUint64)1 << cpus.size()) - 1)),
+            m_minUtil(minUtil),
+            m_live(m_all),
+            m_converged(true),
+            m_pc(m_lead.m_pc),
+            m_runSteps(0),
+            m_maxInstrs(0),
+            m_stopAt(0),
+            m_isCode(m_lead.getMemDepth()),
+            m_fallback(0),
+            m_steps(0),
+            m_laneInstrs(0),
+            m_scalarInstrs(0),
+            m_splits(0),
+            m_windowSteps(0),
+            m_windowLanes(0) {
+        ASSERT_TRUE(Lanes >= m_n);
+        ASSERT_TRUE(cMaxRegs >= m_nregs);
+        m_zero = m_cy = m_aluz = (TVec){};
+        for (unsigned i = 0; i < cMaxRegs; i++) {
+            m_regs[i] = (TVec){};
+        }
+        for (unsigned l = 0; l < Lanes; l++) {
+            m_laneIx[l] = l;
+            m_pcs[l] = 0;
+            m_lastOp[l] = OpCode::eNop;
+            m_instrs[l] = 0;
+        }
+        for (unsigned l = 0; l < m_n; l++) {
+            const MiscCpu &cpu = *m_cpus[l];
+            cpu.evalFlags();
+            ASSERT_TRUE(m_nregs == cpu.getNumRegs());
+            ASSERT_TRUE(m_lead.getMemDepth() == cpu.getMemDepth());
+            for (unsigned i = 0; i < m_nregs; i++) {
+                m_regs[i][l] = cpu.m_regBase[i];
+            }
+            m_zero[l] = cpu.m_zero ? -1 : 0;
+            m_cy[l] = cpu.m_cy ? -1 : 0;
+            m_aluz[l] = cpu.m_aluz;
+            m_pcs[l] = cpu.m_pc;
+            if (cpu.m_pc != m_pc) {
+                m_converged = false;
+            }
+        }
+    }
+
+    template<unsigned Lanes>
+    void PTSimdGroup<Lanes>::run(TUint64 maxInstrs) {
+        m_maxInstrs = maxInstrs;
+        flush();
+        while ((0 != m_live) && (0 == m_fallback)) {
+            TUint32 pc = m_pc, mask = m_live;
+            if (!m_converged) {
+                //lanes at lowest pc: behind (or in a callee of) the rest
+                pc = ~0u;
+                for (TUint32 b = m_live; 0 != b; ) {
+                    const unsigned l = nextLane(b);
+                    pc = (m_pcs[l] < pc) ? m_pcs[l] : pc;
+                }
+                mask = 0;
+                for (TUint32 b = m_live; 0 != b; ) {
+                    const unsigned l = nextLane(b);
+                    mask |= (TUint32)(pc == m_pcs[l]) << l;
+                }
+                if (mask == m_live) {
+                    m_converged = true;
+                    m_pc = pc;
+                    flush();
+                }
+            }
+            pc = TDynCfg::memIx(pc, m_lead.m_memMask);
+            if ((0 == m_isCode[pc]) && !checkCode(pc)) {
+                m_fallback = "code differs";
+                break;
+            }
+            if (MiscCpu::cNotDecoded == m_lead.m_decodedBase[pc].op1) {
+                m_lead.predecode(pc);
+            }
+            const MiscCpu::TDecoded dec = m_lead.m_decodedBase[pc];
+            if ((OpCode::eLoadil == dec.getOpcode()) &&
+                (0 == m_isCode[TDynCfg::memIx(pc + 1, m_lead.m_memMask)]) &&
+                !checkCode(pc + 1)) {
+                m_fallback = "code differs";
+                break;
+            }
+            step(pc, mask, dec);
+            stopAtBudget(dec.getOpcode());
+            if (cWindowSteps == m_windowSteps) {
+                if ((double)m_windowLanes < (m_minUtil * cWindowSteps * m_n)) {
+                    m_fallback = "divergence";
+                }
+                m_windowSteps = m_windowLanes = 0;
+            }
+        }
+        writeBack();
+    }
+
+    template<unsigned Lanes>
+    bool PTSimdGroup<Lanes>::checkCode(TUint32 addr) {
+        const TInt32 word = m_lead.m_memBase[addr];
+        for (TUint32 b = m_live; 0 != b; ) {
+            if (word != m_cpus[nextLane(b)]->m_memBase[addr]) {
+                return false;
+            }
+        }
+        m_isCode[addr] = 1;
+        return true;
+    }
+
+    template<unsigned Lanes>
+    SIMD_CLONES
+    void PTSimdGroup<Lanes>::step(TUint32 pc, TUint32 mask, const MiscCpu::TDecoded &dec) {
+        const bool full = (mask == m_all);
+        //-1 in lanes of mask, else 0
+        const TVec mv = -((((TVec){} + (TInt32)mask) >> m_laneIx) & 1);
+        const OpCode::EOp op = dec.getOpcode();
+        const unsigned sp = m_lead.cSpRegIx;
+        const unsigned nlanes = __builtin_popcount(mask);
+        if (m_converged) {
+            m_runSteps++;
+        } else {
+            for (TUint32 b = mask; 0 != b; ) {
+                m_instrs[nextLane(b)]++;
+            }
+        }
+        m_steps++;
+        m_laneInstrs += nlanes;
+        m_windowSteps++;
+        m_windowLanes += nlanes;
+        //as MiscCpu::decode(): operands before any update
+        TVec &rj = m_regs[dec.ixJ];
+        const TVec a = rj;
+        const TVec b = OpCode::hasImmed(op) ? ((TVec){} + dec.immed) : m_regs[dec.ixK];
+        TUint32 next = pc + 1;
+        TUint32 alt = 0, nexts[Lanes];  //lanes of alt go to nexts[l]
+        TVec z;
+        switch (op) {
+            case OpCode::eNop:
+                break;
+            case OpCode::eHalt:
+                flush();
+                m_live &= ~mask;
+                for (TUint32 bits = mask; 0 != bits; ) {
+                    const unsigned l = nextLane(bits);
+                    m_pcs[l] = next;
+                    m_lastOp[l] = op;
+                }
+                return;
+            //
+            //Arithmetic: {cy,zero} as MiscCpu::setFlags(opb)
+            case OpCode::eAdd: case OpCode::eAddi:
+            case OpCode::eSub: case OpCode::eSubi:
+            case OpCode::eCmp: case OpCode::eCmpi:
+                z = ((OpCode::eAdd == op) || (OpCode::eAddi == op)) ? (a + b) : (a - b);
+                assign(m_cy, (~(a ^ b) & (z ^ a)) >> 31, full, mv);
+                assign(m_zero, (z == 0), full, mv);
+                assign(m_aluz, z, full, mv);
+                if ((OpCode::eCmp != op) && (OpCode::eCmpi != op)) {
+                    assign(rj, z, full, mv);
+                }
+                break;
+            //
+            //Logical: {zero}
+            case OpCode::eAnd: case OpCode::eAndi:
+            case OpCode::eOr: case OpCode::eOri:
+            case OpCode::eXor: case OpCode::eXori:
+            case OpCode::eNot:
+                if ((OpCode::eAnd == op) || (OpCode::eAndi == op)) {
+                    z = a & b;
+                } else if ((OpCode::eOr == op) || (OpCode::eOri == op)) {
+                    z = a | b;
+                } else if (OpCode::eNot == op) {
+                    z = ~a;
+                } else {
+                    z = a ^ b;
+                }
+                assign(m_zero, (z == 0), full, mv);
+                assign(m_aluz, z, full, mv);
+                assign(rj, z, full, mv);
+                break;
+            //
+            //Shifts: as MiscCpu::lsl()/lsr()/asr() for 1..31 (where
+            //lsr() is arithmetic, and eLsri runs lsl()); else per lane.
+            case OpCode::eLsl: case OpCode::eLsli: case OpCode::eLsri:
+            case OpCode::eLsr: case OpCode::eAsr: case OpCode::eAsri:
+                if (mask != (mask & toBits((b > 0) & (b < 32)))) {
+                    for (TUint32 bits = mask; 0 != bits; ) {
+                        stepLane(nextLane(bits), pc);
+                    }
+                } else {
+                    TVec cy;
+                    if ((OpCode::eLsl == op) || (OpCode::eLsli == op) || (OpCode::eLsri == op)) {
+                        z = a << b;
+                        cy = (a >> (32 - b)) & 1;
+                    } else {
+                        z = a >> b;
+                        cy = (a >> (b - 1)) & 1;
+                    }
+                    assign(m_cy, -cy, full, mv);
+                    assign(m_zero, (z == 0), full, mv);
+                    assign(m_aluz, z, full, mv);
+                    assign(rj, z, full, mv);
+                }
+                break;
+            //
+            //Load/store: memory is per lane
+            case OpCode::eLoad:
+                for (TUint32 bits = mask; 0 != bits; ) {
+                    const unsigned l = nextLane(bits);
+                    rj[l] = m_cpus[l]->template readMemT<TDynCfg>(b[l] + dec.immed);
+                }
+                break;
+            case OpCode::eLoadr:
+            case OpCode::eLoadi:
+                assign(rj, b, full, mv);
+                break;
+            case OpCode::eLoadil:
+                //pc+1 checked as code
+                assign(rj, ((TVec){} + m_lead.m_memBase[pc + 1]), full, mv);
+                next = pc + 2;
+                break;
+            case OpCode::eStore:
+                for (TUint32 bits = mask; 0 != bits; ) {
+                    const unsigned l = nextLane(bits);
+                    store(l, b[l] + dec.immed, a[l]);
+                }
+                break;
+            case OpCode::ePush:
+                for (TUint32 bits = mask; 0 != bits; ) {
+                    const unsigned l = nextLane(bits);
+                    const TUint32 addr = m_regs[sp][l] - 1;
+                    store(l, addr, a[l]);
+                    m_regs[sp][l] = addr;
+                }
+                break;
+            case OpCode::ePop:
+                for (TUint32 bits = mask; 0 != bits; ) {
+                    const unsigned l = nextLane(bits);
+                    const TUint32 addr = m_regs[sp][l];
+                    const TInt32 val = m_cpus[l]->template readMemT<TDynCfg>(addr);
+                    m_regs[sp][l] = addr + 1;
+                    rj[l] = val;
+                }
+                break;
+            case OpCode::eSwap:
+                for (TUint32 bits = mask; 0 != bits; ) {
+                    const unsigned l = nextLane(bits);
+                    const TUint32 addr = b[l] + dec.immed;
+                    const TInt32 val = m_cpus[l]->template readMemT<TDynCfg>(addr);
+                    store(l, addr, a[l]);
+                    rj[l] = val;
+                }
+                break;
+            //
+            //Branch/call: lanes which differ are split
+            case OpCode::eBr:
+            case OpCode::eCall:
+                {   TVec cond;
+                    switch (dec.cond) {
+                        case MiscCpu::eUncond:
+                            cond = (TVec){} - 1;
+                            break;
+                        case MiscCpu::eCy:
+                            cond = m_cy;
+                            break;
+                        case MiscCpu::eNotCy:
+                            cond = ~m_cy;
+                            break;
+                        case MiscCpu::eZero:
+                            cond = m_zero;
+                            break;
+                        case MiscCpu::eNotZero:
+                            cond = ~m_zero;
+                            break;
+                        default:
+                            ASSERT_NEVER;
+                    }
+                    const TUint32 taken = mask & toBits(cond);
+                    const TUint32 target = next + dec.immed;
+                    if (OpCode::eCall == op) {
+                        for (TUint32 bits = taken; 0 != bits; ) {
+                            const unsigned l = nextLane(bits);
+                            const TUint32 addr = m_regs[sp][l] - 1;
+                            store(l, addr, next);
+                            m_regs[sp][l] = addr;
+                        }
+                    }
+                    if (taken == mask) {
+                        next = target;
+                    } else if (0 != taken) {
+                        alt = taken;
+                        for (TUint32 bits = taken; 0 != bits; ) {
+                            nexts[nextLane(bits)] = target;
+                        }
+                    }
+                }
+                break;
+            case OpCode::eRetn:
+                {   bool same = true;
+                    for (TUint32 bits = mask; 0 != bits; ) {
+                        const unsigned l = nextLane(bits);
+                        const TUint32 addr = m_regs[sp][l];
+                        nexts[l] = m_cpus[l]->template readMemT<TDynCfg>(addr);
+                        m_regs[sp][l] = addr + 1;
+                        next = same ? nexts[l] : next;
+                        same = same && (nexts[l] == next);
+                    }
+                    alt = same ? 0 : mask;
+                }
+                break;
+            default:
+                ASSERT_NEVER;
+        }
+        setNext(mask, alt, next, nexts);
+    }
+
+    template<unsigned Lanes>
+    void PTSimdGroup<Lanes>::setNext(TUint32 mask, TUint32 alt, TUint32 pc, const TUint32 *next) {
+        if (0 == alt) {
+            if (m_converged) {
+                m_pc = pc;
+            } else {
+                for (TUint32 bits = mask; 0 != bits; ) {
+                    m_pcs[nextLane(bits)] = pc;
+                }
+            }
+            return;
+        }
+        if (m_converged) {
+            flush();
+            for (TUint32 bits = m_live; 0 != bits; ) {
+                m_pcs[nextLane(bits)] = m_pc;
+            }
+            m_converged = false;
+        }
+        for (TUint32 bits = mask; 0 != bits; ) {
+            const unsigned l = nextLane(bits);
+            m_pcs[l] = (0 != (alt & (1u << l))) ? next[l] : pc;
+        }
+        m_splits++;
+    }
+
+    template<unsigned Lanes>
+    TUint32 PTSimdGroup<Lanes>::stepLane(unsigned l, TUint32 pc) {
+        MiscCpu &cpu = *m_cpus[l];
+        for (unsigned i = 0; i < m_nregs; i++) {
+            cpu.m_regBase[i] = m_regs[i][l];
+        }
+        cpu.m_pc = pc;
+        cpu.setZeroCy(0 != m_zero[l], 0 != m_cy[l]);
+        cpu.m_aluz = m_aluz[l];
+        cpu.step();
+        for (unsigned i = 0; i < m_nregs; i++) {
+            m_regs[i][l] = cpu.m_regBase[i];
+        }
+        m_zero[l] = cpu.m_zero ? -1 : 0;
+        m_cy[l] = cpu.m_cy ? -1 : 0;
+        m_aluz[l] = cpu.m_aluz;
+        return cpu.m_pc;
+    }
+
+    template<unsigned Lanes>
+    void PTSimdGroup<Lanes>::store(unsigned l, TUint32 addr, TInt32 val) {
+        m_cpus[l]->template writeMemT<TDynCfg>(addr, val);
+        if (0 != m_isCode[addr]) {
+            m_fallback = "code written";
+        }
+    }
+
+    template<unsigned Lanes>
+    void PTSimdGroup<Lanes>::flush() {
+        if (!m_converged) {
+            return;
+        }
+        m_stopAt = ~(TUint64)0;
+        for (TUint32 bits = m_live; 0 != bits; ) {
+            const unsigned l = nextLane(bits);
+            m_instrs[l] += m_runSteps;
+            if ((0 != m_maxInstrs) && ((m_maxInstrs - m_instrs[l]) < m_stopAt)) {
+                m_stopAt = m_maxInstrs - m_instrs[l];
+            }
+        }
+        m_runSteps = 0;
+    }
+
+    template<unsigned Lanes>
+    void PTSimdGroup<Lanes>::stopAtBudget(OpCode::EOp op) {
+        if (0 == m_maxInstrs) {
+            return;
+        }
+        if (m_converged) {
+            if (m_runSteps < m_stopAt) {
+                return;
+            }
+            flush();
+        }
+        for (TUint32 bits = m_live; 0 != bits; ) {
+            const unsigned l = nextLane(bits);
+            if (m_instrs[l] >= m_maxInstrs) {
+                m_live &= ~(1u << l);
+                m_pcs[l] = m_converged ? m_pc : m_pcs[l];
+                m_lastOp[l] = op;
+            }
+        }
+        flush();
+    }
+
+    template<unsigned Lanes>
+    void PTSimdGroup<Lanes>::writeBack() {
+        flush();
+        for (unsigned l = 0; l < m_n; l++) {
+            MiscCpu &cpu = *m_cpus[l];
+            const bool live = (0 != (m_live & (1u << l)));
+            for (unsigned i = 0; i < m_nregs; i++) {
+                cpu.m_regBase[i] = m_regs[i][l];
+            }
+            cpu.setZeroCy(0 != m_zero[l], 0 != m_cy[l]);
+            cpu.m_aluz = m_aluz[l];
+            cpu.m_pc = (live && m_converged) ? m_pc : m_pcs[l];
+            if (!live) {
+                cpu.m_opCode = OpCode(m_lastOp[l]);
+            }
+            if (!cpu.m_perfMon.isNull()) {
+                cpu.m_perfMon->incrInstructionCnt(m_instrs[l]);
+            }
+        }
+        if (0 == m_fallback) {
+            return;
+        }
+        for (TUint32 bits = m_live; 0 != bits; ) {
+            const unsigned l = nextLane(bits);
+            MiscCpu &cpu = *m_cpus[l];
+            const TUint64 before = cpu.m_perfMon.isNull() ? 0 : cpu.m_perfMon->getInstructionCnt();
+            cpu.run((0 != m_maxInstrs) ? (m_maxInstrs - m_instrs[l]) : 0);
+            if (!cpu.m_perfMon.isNull()) {
+                m_scalarInstrs += cpu.m_perfMon->getInstructionCnt() - before;
+            }
+        }
+        m_live = 0;
+    }
+
+    template class PTSimdGroup<8>;
+    template class PTSimdGroup<16>;
+};
@@ -0,0 +1,206 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+
+#if !defined(_miscpu_simd_hxx_)
+#    define  _miscpu_simd_hxx_
+
+#include <vector>
+#include <ostream>
+#include "xyzzy/portable.hxx"
+#include "miscpu.hxx"
+#include "memmap.hxx"
+#include "opcode.hxx"
+
+using xyzzy::TUint8;
+using xyzzy::TUint32;
+using xyzzy::TUint64;
+using xyzzy::TInt32;
+
+namespace miscpu
+{
+    /**
+     * Host vector of Lanes TInt32 (GCC vector extension: one AVX2
+     * register for 8 lanes, one AVX-512 register for 16, where the host
+     * has them (see step()); else pairs of SSE2 registers).
+     * Only 4 byte aligned, so a group can be allocated anywhere.
+     */
+    template<unsigned Lanes> struct PTLaneVec;
+
+    template<> struct PTLaneVec<8> {
+        typedef TInt32 TVec __attribute__((vector_size(32), aligned(4)));
+    };
+
+    template<> struct PTLaneVec<16> {
+        typedef TInt32 TVec __attribute__((vector_size(64), aligned(4)));
+    };
+
+    /**
+     * Up to Lanes MiscCpu instances (lanes) run together: the register
+     * file is held as structure of arrays (r[j] of all lanes in one host
+     * vector), so each ALU instruction is fetched and decoded once and
+     * executed as vector operations, with {zero,cy} per lane.  Memory
+     * stays with each lane's MiscCpu (loads and stores are per lane).
+     *
+     * Lanes whose branch, call or return go different ways are split:
+     * each step runs the lanes at the lowest pc (masked; the others keep
+     * their state) until they meet again at a common pc.
+     *
+     * Code is fetched and predecoded from lane 0, so the lanes must run
+     * the same code: each word is checked equal in all live lanes the
+     * first time it is fetched.  The group falls back to scalar (each
+     * live lane continues on its own MiscCpu::run()) if
+     *
+     *   - lane utilization (lanes stepped / lanes) over a window of
+     *     steps is below minUtil (divergence, or lanes halted early),
+     *   - code differs between lanes, or a lane writes to code.
+     *
+     * Shifts by other than 1..31 (cy and result edge cases) are stepped
+     * per lane on the lane's MiscCpu, so all results are as MiscCpu's.
+     */
+    template<unsigned Lanes>
+    class PTSimdGroup {
+    public:
+        typedef typename PTLaneVec<Lanes>::TVec TVec;
+
+        static const unsigned cLanes = Lanes;
+        static const unsigned cMaxRegs = 32;
+
+        //1..Lanes cpus, all with the same register count and memory
+        //depth; state is loaded from them here and stored back by run().
+        explicit PTSimdGroup(const std::vector<MiscCpu*> &cpus, double minUtil = 0.5);
+
+        //Run every lane to eHalt, or maxInstrs each (0: no limit).
+        //Each lane's PerfMon is credited with its instructions.
+        void run(TUint64 maxInstrs = 0);
+
+        unsigned getLanes() const {
+            return m_n;
+        }
+
+        //Instructions issued to the group (vector steps).
+        TUint64 getSteps() const {
+            return m_steps;
+        }
+
+        //Instructions retired by lanes in steps.
+        TUint64 getLaneInstrs() const {
+            return m_laneInstrs;
+        }
+
+        //Instructions retired by lanes after fallback to scalar.
+        TUint64 getScalarInstrs() const {
+            return m_scalarInstrs;
+        }
+
+        //Times lanes were split.
+        TUint64 getSplits() const {
+            return m_splits;
+        }
+
+        //Lane instructions / (steps * lanes).
+        double getUtilization() const {
+            return (0 == m_steps) ? 1.0 : ((double)m_laneInstrs / ((double)m_steps * m_n));
+        }
+
+        //Why the group fell back to scalar; 0 if it did not.
+        const char* getFallback() const {
+            return m_fallback;
+        }
+
+    private:
+        //not copyable (owns m_isCode)
+        PTSimdGroup(const PTSimdGroup&);
+        PTSimdGroup& operator=(const PTSimdGroup&);
+
+        //Bit l set if lane l of v is not 0.
+        static TUint32 toBits(const TVec &v) {
+            TUint32 bits = 0;
+            for (unsigned l = 0; l < Lanes; l++) {
+                bits |= (TUint32)(0 != v[l]) << l;
+            }
+            return bits;
+        }
+
+        //dst = v in lanes of mv (all, if full).
+        static void assign(TVec &dst, const TVec &v, bool full, const TVec &mv) {
+            dst = full ? v : ((v & mv) | (dst & ~mv));
+        }
+
+        //Word at addr the same in live lanes (then marked as code)?
+        bool checkCode(TUint32 addr);
+
+        //Lanes of mask at pc: add instruction to their counts, run it.
+        void step(TUint32 pc, TUint32 mask, const MiscCpu::TDecoded &dec);
+
+        //Next pc of lanes in mask: next[l] if bit l of alt, else pc.
+        void setNext(TUint32 mask, TUint32 alt, TUint32 pc, const TUint32 *next);
+
+        //Run instruction at pc on lane l's MiscCpu; return next pc.
+        TUint32 stepLane(unsigned l, TUint32 pc);
+
+        void store(unsigned l, TUint32 addr, TInt32 val);
+
+        //Credit steps run while converged to live lanes.
+        void flush();
+
+        //Remove live lanes at budget (op: instruction just run).
+        void stopAtBudget(OpCode::EOp op);
+
+        //Lanes to MiscCpu; then continue live lanes there if fallback.
+        void writeBack();
+
+        std::vector<MiscCpu*>   m_cpus;
+        MiscCpu                 &m_lead;    //code is fetched from here
+        const unsigned          m_n;
+        const unsigned          m_nregs;
+        const TUint32           m_all;      //lanes in group
+        const double            m_minUtil;
+
+        TVec        m_regs[cMaxRegs];
+        TVec        m_zero, m_cy;           //-1 (set) or 0
+        TVec        m_aluz;
+        TVec        m_laneIx;               //0, 1, ... Lanes-1
+
+        TUint32     m_live;                 //lanes not halted/stopped
+        bool        m_converged;            //all live lanes at m_pc
+        TUint32     m_pc;
+        TUint32     m_pcs[Lanes];           //if !m_converged, or not live
+        OpCode::EOp m_lastOp[Lanes];        //if not live
+        TUint64     m_instrs[Lanes];        //+ m_runSteps if converged
+        TUint64     m_runSteps;
+        TUint64     m_maxInstrs, m_stopAt;  //m_runSteps at next budget stop
+
+        PTMappedArray<TUint8>   m_isCode;   //fetched (and checked) words
+        const char  *m_fallback;
+
+        TUint64     m_steps, m_laneInstrs, m_scalarInstrs, m_splits;
+        TUint64     m_windowSteps, m_windowLanes;
+    };
+
+    typedef PTSimdGroup<8>  TSimdGroup8;
+    typedef PTSimdGroup<16> TSimdGroup16;
+};
+
+#endif  //_miscpu_simd_hxx_
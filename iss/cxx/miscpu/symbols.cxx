@@ -0,0 +1,91 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include "xyzzy/assert.hxx"
+#include "symbols.hxx"
+
+namespace miscpu
+{
+    TSymbolMap::TSymbolMap() {
+    }
+
+    unsigned TSymbolMap::load(string fname) {
+        std::ifstream ifs(fname.c_str());
+        ASSERT_TRUE(false == ifs.fail());
+        unsigned n = 0;
+        TUint32 addr;
+        string name;
+        while (ifs >> addr >> name) {
+            add(addr, name);
+            n++;
+        }
+        ifs.close();
+        std::cout << "Info: " << fname << ": read " << n
+                  << " symbol(s)" << std::endl;
+        return n;
+    }
+
+    void TSymbolMap::add(TUint32 addr, const string &name) {
+        //first label at an address wins (assembler writes sorted)
+        m_byAddr.insert(t_byAddr::value_type(addr, name));
+    }
+
+    const string* TSymbolMap::find(TUint32 addr) const {
+        t_byAddr::const_iterator it = m_byAddr.find(addr);
+        return (m_byAddr.end() != it) ? &it->second : 0;
+    }
+
+    const string* TSymbolMap::findNearest(TUint32 addr) const {
+        t_byAddr::const_iterator it = m_byAddr.upper_bound(addr);
+        if (m_byAddr.begin() == it) {
+            return 0;
+        }
+        --it;
+        return &it->second;
+    }
+
+    bool TSymbolMap::findAddr(const string &name, TUint32 &addr) const {
+        for (t_byAddr::const_iterator it = m_byAddr.begin();
+             it != m_byAddr.end(); ++it) {
+            if (name == it->second) {
+                addr = it->first;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    string TSymbolMap::symbolize(TUint32 addr) const {
+        const string *name = findNearest(addr);
+        if (0 != name) {
+            return *name;
+        }
+        std::ostringstream os;
+        os << "0x" << std::hex << addr;
+        return os.str();
+    }
+};
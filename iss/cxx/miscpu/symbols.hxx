@@ -0,0 +1,87 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+#if !defined(_miscpu_symbols_hxx_)
+#    define  _miscpu_symbols_hxx_
+
+#include <map>
+#include <string>
+#include "xyzzy/portable.hxx"
+
+using std::string;
+using xyzzy::TUint32;
+
+namespace miscpu
+{
+    /**
+     * Guest address => label, as written by the assembler
+     * (asm/lib/main.rb -sym): one "address label" per line.
+     */
+    class TSymbolMap {
+    public:
+        typedef std::map<TUint32, string> t_byAddr;
+        typedef t_byAddr::const_iterator const_iterator;
+
+        explicit TSymbolMap();
+
+        //Return number of symbols read.
+        unsigned load(string fname);
+
+        void add(TUint32 addr, const string &name);
+
+        bool isEmpty() const {
+            return m_byAddr.empty();
+        }
+
+        unsigned size() const {
+            return m_byAddr.size();
+        }
+
+        //In address order.
+        const_iterator begin() const {
+            return m_byAddr.begin();
+        }
+
+        const_iterator end() const {
+            return m_byAddr.end();
+        }
+
+        //Label at addr; or 0.
+        const string* find(TUint32 addr) const;
+
+        //Label at or before addr; or 0.
+        const string* findNearest(TUint32 addr) const;
+
+        //Address of name; false if not found.
+        bool findAddr(const string &name, TUint32 &addr) const;
+
+        //findNearest(addr), else "0x..." address.
+        string symbolize(TUint32 addr) const;
+
+    private:
+        t_byAddr    m_byAddr;
+    };
+};
+
+#endif  //_miscpu_symbols_hxx_
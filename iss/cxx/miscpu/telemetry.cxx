@@ -0,0 +1,279 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+
+#include <cstring>
+#include <cerrno>
+#include <fstream>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "xyzzy/assert.hxx"
+#include "telemetry.hxx"
+#include "hosttime.hxx"
+
+namespace miscpu
+{
+    namespace {
+        //C++98: the GNU builtins (as std::memory_order_relaxed).
+        template<class T>
+        inline void storeRelaxed(T &to, T val) {
+            __atomic_store_n(&to, val, __ATOMIC_RELAXED);
+        }
+
+        template<class T>
+        inline T loadRelaxed(const T &from) {
+            return __atomic_load_n(&from, __ATOMIC_RELAXED);
+        }
+
+        void sleepSecs(double secs) {
+            struct timespec ts;
+            ts.tv_sec = (time_t)secs;
+            ts.tv_nsec = (long)(1e9 * (secs - ts.tv_sec));
+            nanosleep(&ts, 0);
+        }
+
+        //Seqlock read (see telemetry.hxx); false if no stable copy yet.
+        bool readPage(const TTelemetryPage &page, TTelemetryPage &snap) {
+            for (unsigned tries = 0; tries < 1000; tries++) {
+                const TUint64 seq = __atomic_load_n(&page.seq, __ATOMIC_ACQUIRE);
+                if (0 != (seq & 1)) {
+                    continue;
+                }
+                snap.magic = loadRelaxed(page.magic);
+                snap.version = loadRelaxed(page.version);
+                snap.pid = loadRelaxed(page.pid);
+                snap.state = loadRelaxed(page.state);
+                snap.publishes = loadRelaxed(page.publishes);
+                snap.elapsedUs = loadRelaxed(page.elapsedUs);
+                snap.instrs = loadRelaxed(page.instrs);
+                snap.ips = loadRelaxed(page.ips);
+                snap.pc = loadRelaxed(page.pc);
+                snap.stores = loadRelaxed(page.stores);
+                snap.callDepth = loadRelaxed(page.callDepth);
+                snap.fused = loadRelaxed(page.fused);
+                __atomic_thread_fence(__ATOMIC_ACQUIRE);
+                if (seq == loadRelaxed(page.seq)) {
+                    snap.seq = seq;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void writeTop(const string &path, const TTelemetryPage &snap,
+                std::ostream &os) {
+            const bool done = (TTelemetryPage::eDone == snap.state);
+            os << "\033[H\033[2J"
+               << "miscpu telemetry: " << path << " (pid " << snap.pid << ", "
+               << (done ? "done" : "running") << ", " << (1e-6 * snap.elapsedUs)
+               << " s)" << std::endl
+               << "  instructions  " << snap.instrs << std::endl
+               << "  MIPS          " << (1e-6 * snap.ips) << std::endl
+               << "  pc            0x" << std::hex << snap.pc << std::dec << std::endl
+               << "  call depth    " << snap.callDepth << std::endl
+               << "  stores        " << snap.stores << std::endl
+               << "  fused         " << snap.fused << " ("
+               << ((0 != snap.instrs) ? (100.0 * snap.fused / snap.instrs) : 0.0)
+               << "%)" << std::endl
+               << "  publishes     " << snap.publishes << std::endl;
+        }
+    };
+
+    const double TTelemetry::cSlotSecs = 0.25;
+
+    string telemetryPath(const string &name) {
+        return (string::npos != name.find('/')) ? name : ("/dev/shm/" + name);
+    }
+
+    TTelemetry::TTelemetry(const string &name)
+        :   m_path(telemetryPath(name)),
+            m_page(0),
+            m_t0(nowSecs()),
+            m_newest(cSlots - 1),
+            m_used(0) {
+        //a new file: a reader may still have the last run's mapped
+        unlink(m_path.c_str());
+        const int fd = open(m_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (0 > fd) {
+            return;
+        }
+        if (0 == ftruncate(fd, sizeof(TTelemetryPage))) {
+            void *p = mmap(0, sizeof(TTelemetryPage), PROT_READ | PROT_WRITE,
+                           MAP_SHARED, fd, 0);
+            if (MAP_FAILED != p) {
+                m_page = (TTelemetryPage*)p;
+            }
+        }
+        close(fd);
+        if (0 == m_page) {
+            unlink(m_path.c_str());
+            return;
+        }
+        memset(m_page, 0, sizeof(TTelemetryPage));
+        m_page->version = TTelemetryPage::cVersion;
+        m_page->pid = getpid();
+        m_page->state = TTelemetryPage::eRunning;
+        //last: a reader waits for it
+        __atomic_store_n(&m_page->magic, TTelemetryPage::cMagic, __ATOMIC_RELEASE);
+    }
+
+    TTelemetry::~TTelemetry() {
+        if (0 == m_page) {
+            return;
+        }
+        if (TTelemetryPage::eDone != m_page->state) {
+            const TUint64 seq = m_page->seq;
+            storeRelaxed(m_page->seq, seq + 1);
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+            storeRelaxed(m_page->state, (TUint32)TTelemetryPage::eDone);
+            __atomic_store_n(&m_page->seq, seq + 2, __ATOMIC_RELEASE);
+        }
+        munmap(m_page, sizeof(TTelemetryPage));
+        unlink(m_path.c_str());
+    }
+
+    void TTelemetry::publish(const MiscCpu &cpu, bool done) {
+        if (0 == m_page) {
+            return;
+        }
+        const double now = nowSecs();
+        const TUint64 instrs = cpu.getPerfMon().isNull() ? 0
+                             : cpu.getPerfMon()->getInstructionCnt();
+        if ((0 == m_used) || ((now - m_samples[m_newest].secs) >= cSlotSecs)) {
+            m_newest = (m_newest + 1) % cSlots;
+            m_samples[m_newest].secs = now;
+            m_samples[m_newest].instrs = instrs;
+            if (m_used < cSlots) {
+                m_used++;
+            }
+        }
+        const TSample &oldest = m_samples[(m_newest + cSlots + 1 - m_used) % cSlots];
+        const double span = now - oldest.secs;
+        const TUint64 ips = (0 < span) ? (TUint64)((instrs - oldest.instrs) / span) : 0;
+
+        //only this thread writes: plain reads of the page are current
+        TTelemetryPage &page = *m_page;
+        const TUint64 seq = page.seq;
+        storeRelaxed(page.seq, seq + 1);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        storeRelaxed(page.publishes, page.publishes + 1);
+        storeRelaxed(page.elapsedUs, (TUint64)(1e6 * (now - m_t0)));
+        storeRelaxed(page.instrs, instrs);
+        storeRelaxed(page.ips, ips);
+        storeRelaxed(page.pc, (TUint64)cpu.getPc());
+        storeRelaxed(page.stores, cpu.getStoreCnt());
+        storeRelaxed(page.callDepth, cpu.getCallDepth());
+        storeRelaxed(page.fused, cpu.getFusedCnt());
+        storeRelaxed(page.state, (TUint32)(done ? TTelemetryPage::eDone
+                                                : TTelemetryPage::eRunning));
+        __atomic_store_n(&page.seq, seq + 2, __ATOMIC_RELEASE);
+    }
+
+    bool watchTelemetry(const string &name, const char *csvFname,
+            double periodSecs, std::ostream &os) {
+        const string path = telemetryPath(name);
+        bool waiting = false;
+        const TTelemetryPage *page = 0;
+        while (0 == page) {
+            //the writer may not have created, sized or set it up yet
+            const int fd = open(path.c_str(), O_RDONLY);
+            struct stat st;
+            if ((0 > fd) && (ENOENT != errno)) {
+                os << "Error: " << path << ": cannot open" << std::endl;
+                return false;
+            }
+            if ((0 <= fd) && (0 == fstat(fd, &st)) &&
+                (sizeof(TTelemetryPage) <= (size_t)st.st_size)) {
+                void *p = mmap(0, sizeof(TTelemetryPage), PROT_READ, MAP_SHARED, fd, 0);
+                if (MAP_FAILED != p) {
+                    page = (const TTelemetryPage*)p;
+                }
+            }
+            if (0 <= fd) {
+                close(fd);
+            }
+            if (0 != page) {
+                const TUint32 magic = __atomic_load_n(&page->magic, __ATOMIC_ACQUIRE);
+                if ((0 != magic) && ((TTelemetryPage::cMagic != magic) ||
+                                     (TTelemetryPage::cVersion != page->version))) {
+                    os << "Error: " << path << ": not a miscpu telemetry page"
+                       << std::endl;
+                    munmap((void*)page, sizeof(TTelemetryPage));
+                    return false;
+                } else if (0 == magic) {
+                    munmap((void*)page, sizeof(TTelemetryPage));
+                    page = 0;
+                }
+            }
+            if (0 == page) {
+                if (!waiting) {
+                    os << "Info: " << path << ": waiting for the run" << std::endl;
+                    waiting = true;
+                }
+                sleepSecs(periodSecs);
+            }
+        }
+        std::ofstream csv;
+        if (0 != csvFname) {
+            std::ifstream probe(csvFname);
+            const bool isNew = !probe.good() || (EOF == probe.peek());
+            csv.open(csvFname, std::ios::app);
+            ASSERT_TRUE(false == csv.fail());
+            if (isNew) {
+                csv << "secs,instrs,mips,pc,call_depth,stores,fused" << std::endl;
+            }
+        }
+        TTelemetryPage snap;
+        while (true) {
+            if (readPage(*page, snap)) {
+                if (0 != csvFname) {
+                    csv << (1e-6 * snap.elapsedUs) << "," << snap.instrs << ","
+                        << (1e-6 * snap.ips) << "," << snap.pc << ","
+                        << snap.callDepth << "," << snap.stores << ","
+                        << snap.fused << std::endl;
+                } else {
+                    writeTop(path, snap, os);
+                }
+                if (TTelemetryPage::eDone == snap.state) {
+                    break;
+                }
+                if ((0 != kill(snap.pid, 0)) && (ESRCH == errno)) {
+                    os << "Error: " << path << ": writer (pid " << snap.pid
+                       << ") is gone" << std::endl;
+                    break;
+                }
+            }
+            sleepSecs(periodSecs);
+        }
+        munmap((void*)page, sizeof(TTelemetryPage));
+        if (0 != csvFname) {
+            os << "Info: " << csvFname << ": appended telemetry of " << path
+               << std::endl;
+        }
+        return true;
+    }
+};
@@ -0,0 +1,133 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+
+#if !defined(_miscpu_telemetry_hxx_)
+#    define  _miscpu_telemetry_hxx_
+
+/*
+ * Live telemetry of a long run: the simulation thread publishes its
+ * counters to a page in /dev/shm, which another process reads while it
+ * runs (watchTelemetry(), miscpu -telemetry-watch).
+ *
+ * The run is cut into blocks of TTelemetry::cChunk instructions (as
+ * MiscCpu::run(mon, cnt)); the page is written between blocks with
+ * relaxed atomic stores: no locks, no system calls (the clock is read
+ * through the vDSO).  Readers do not block the writer either: seq is a
+ * sequence lock, odd while an update is under way, so a reader copies
+ * the page and retries if seq was odd or moved meanwhile.
+ */
+
+#include <string>
+#include <ostream>
+#include "xyzzy/portable.hxx"
+#include "miscpu.hxx"
+
+using std::string;
+using xyzzy::TUint32;
+using xyzzy::TUint64;
+
+namespace miscpu
+{
+    //Layout of the page (host order; writer and reader on one host).
+    struct TTelemetryPage {
+        enum EState {
+            eRunning = 1, eDone = 2
+        };
+
+        static const TUint32 cMagic = 0x4c45544d;  //"MTEL"
+        static const TUint32 cVersion = 1;
+
+        TUint32     magic;
+        TUint32     version;
+        TUint32     pid;        //of the writer
+        TUint32     state;      //EState
+        TUint64     seq;        //see above
+        TUint64     publishes;
+        TUint64     elapsedUs;  //since the writer started
+        TUint64     instrs;     //PerfMon count (HLE declared cost too)
+        TUint64     ips;        //instructions/sec over the last window
+        TUint64     pc;
+        TUint64     stores;     //MiscCpu::getStoreCnt()
+        long long   callDepth;  //MiscCpu::getCallDepth()
+        TUint64     fused;      //MiscCpu::getFusedCnt()
+    };
+
+    class TTelemetry {
+    public:
+        //Instructions between publish()es.
+        static const TUint64 cChunk = 1 << 20;
+
+        //Create /dev/shm/name (or the path name, if it has a '/').
+        explicit TTelemetry(const string &name);
+
+        //Marks the page done (if not yet) and removes it; readers which
+        //have it open still see the last counts.
+        ~TTelemetry();
+
+        bool isOpen() const {
+            return (0 != m_page);
+        }
+
+        const string& getPath() const {
+            return m_path;
+        }
+
+        //After each block; done when the run is over.
+        void publish(const MiscCpu &cpu, bool done = false);
+
+    private:
+        //not copyable (owns the mapping)
+        TTelemetry(const TTelemetry&);
+        TTelemetry& operator=(const TTelemetry&);
+
+        //Sliding window for ips: cSlots samples at least cSlotSecs apart.
+        static const unsigned cSlots = 16;
+        static const double cSlotSecs;
+
+        struct TSample {
+            double  secs;
+            TUint64 instrs;
+        };
+
+        string          m_path;
+        TTelemetryPage  *m_page;
+        double          m_t0;
+        TSample         m_samples[cSlots];
+        unsigned        m_newest, m_used;
+    };
+
+    //Path of name as TTelemetry creates it.
+    string telemetryPath(const string &name);
+
+    /**
+     * Poll name's page every periodSecs until its run is done (or its
+     * writer is gone): append a row to csvFname if not 0, else redraw a
+     * top-like view on os.  Return false if name is not a telemetry page.
+     */
+    bool watchTelemetry(const string &name, const char *csvFname,
+            double periodSecs, std::ostream &os);
+};
+
+#endif  //_miscpu_telemetry_hxx_
@@ -0,0 +1,208 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include "xyzzy/assert.hxx"
+#include "timing.hxx"
+
+namespace miscpu
+{
+    static bool isPow2(unsigned n) {
+        return (0 != n) && (0 == (n & (n - 1)));
+    }
+
+    static unsigned log2Of(unsigned n) {
+        unsigned r = 0;
+        while (1u < (n >> r)) {
+            r++;
+        }
+        return r;
+    }
+
+    TTimingConfig::TTimingConfig()
+        :   branchPenalty(2), loadUsePenalty(1), fetchLat(8), memLat(8),
+            icacheLines(64), icacheLineWords(4),
+            dcacheLines(64), dcacheLineWords(4) {
+        for (unsigned i = 0; i < OpCode::eNotUsed; i++) {
+            execLat[i] = 1;
+        }
+    }
+
+    void TTimingConfig::load(const string &fname) {
+        std::ifstream ifs(fname.c_str());
+        ASSERT_TRUE(false == ifs.fail());
+        unsigned lineNum = 0;
+        string line;
+        while (std::getline(ifs, line)) {
+            lineNum++;
+            string::size_type hash = line.find('#');
+            if (string::npos != hash) {
+                line.erase(hash);
+            }
+            std::istringstream iss(line);
+            string key;
+            if (!(iss >> key)) {
+                continue;   //blank
+            }
+            unsigned val = 0, words = 0;
+            bool ok = (iss >> val);
+            if (ok && (("icache" == key) || ("dcache" == key))) {
+                ok = (iss >> words) &&
+                     (((0 == val) && (0 == words)) || (isPow2(val) && isPow2(words)));
+                unsigned &lines = ("icache" == key) ? icacheLines : dcacheLines;
+                unsigned &lineWords = ("icache" == key) ? icacheLineWords
+                                                         : dcacheLineWords;
+                lines = val;
+                lineWords = words;
+            } else if (ok && ("branch" == key)) {
+                branchPenalty = val;
+            } else if (ok && ("loaduse" == key)) {
+                loadUsePenalty = val;
+            } else if (ok && ("fetch" == key)) {
+                fetchLat = val;
+            } else if (ok && ("mem" == key)) {
+                memLat = val;
+            } else if (ok) {
+                unsigned i = 0;
+                while ((i < OpCode::eNotUsed) && (key != OpCode::name((OpCode::EOp)i))) {
+                    i++;
+                }
+                ok = (i < OpCode::eNotUsed) && (1 <= val);
+                if (ok) {
+                    execLat[i] = val;
+                }
+            }
+            string extra;
+            if (!ok || (iss >> extra)) {
+                std::cerr << "Error: " << fname << ":" << lineNum
+                          << ": bad line \"" << line << "\"" << std::endl;
+                ASSERT_NEVER;
+            }
+        }
+        ifs.close();
+    }
+
+    TCacheModel::TCacheModel(unsigned lines, unsigned lineWords)
+        :   m_tags((0 != lines) ? lines : 1, ~(TUint64)0),
+            m_lines(lines),
+            m_lineShift((0 != lines) ? log2Of(lineWords) : 0),
+            m_lineMask((0 != lines) ? (lines - 1) : 0),
+            m_hits(0), m_misses(0) {
+        ASSERT_TRUE((0 == lines) || (isPow2(lines) && isPow2(lineWords)));
+    }
+
+    void TCacheModel::writeReport(std::ostream &os, const char *name) const {
+        if (0 == m_lines) {
+            os << "Info: timing: " << name << ": none (" << m_misses
+               << " access(es))" << std::endl;
+            return;
+        }
+        const TUint64 n = m_hits + m_misses;
+        os << "Info: timing: " << name << ": " << m_lines << " x "
+           << (1u << m_lineShift) << " word(s), " << m_hits << " hit(s), "
+           << m_misses << " miss(es)";
+        if (0 != n) {
+            os << ", hit rate " << (100.0 * m_hits / n) << "%";
+        }
+        os << std::endl;
+    }
+
+    const TUint32 TTimingMon::cMemOrFlowOps =
+        (1u << OpCode::eLoad) | (1u << OpCode::eStore) |
+        (1u << OpCode::ePush) | (1u << OpCode::ePop) |
+        (1u << OpCode::eBr) | (1u << OpCode::eCall) | (1u << OpCode::eRetn) |
+        (1u << OpCode::eSwap);
+
+    const TUint32 TTimingMon::cReadsRj =
+        (1u << OpCode::eAdd) | (1u << OpCode::eAddi) |
+        (1u << OpCode::eSub) | (1u << OpCode::eSubi) |
+        (1u << OpCode::eStore) | (1u << OpCode::ePush) |
+        (1u << OpCode::eLsl) | (1u << OpCode::eLsli) |
+        (1u << OpCode::eLsr) | (1u << OpCode::eLsri) |
+        (1u << OpCode::eAsr) | (1u << OpCode::eAsri) |
+        (1u << OpCode::eAnd) | (1u << OpCode::eOr) | (1u << OpCode::eXor) |
+        (1u << OpCode::eAndi) | (1u << OpCode::eOri) | (1u << OpCode::eXori) |
+        (1u << OpCode::eNot) | (1u << OpCode::eCmp) | (1u << OpCode::eCmpi) |
+        (1u << OpCode::eSwap);
+
+    const TUint32 TTimingMon::cReadsRk =
+        (1u << OpCode::eAdd) | (1u << OpCode::eSub) |
+        (1u << OpCode::eLoad) | (1u << OpCode::eLoadr) | (1u << OpCode::eStore) |
+        (1u << OpCode::eLsl) | (1u << OpCode::eLsr) | (1u << OpCode::eAsr) |
+        (1u << OpCode::eAnd) | (1u << OpCode::eOr) | (1u << OpCode::eXor) |
+        (1u << OpCode::eCmp) | (1u << OpCode::eSwap);
+
+    const TUint32 TTimingMon::cReadsSp =
+        (1u << OpCode::ePush) | (1u << OpCode::ePop) |
+        (1u << OpCode::eCall) | (1u << OpCode::eRetn);
+
+    TTimingMon::TTimingMon(const TTimingConfig &cfg, TUint64 memDepth)
+        :   m_cfg(cfg),
+            m_memMask(memDepth - 1),
+            m_icache(cfg.icacheLines, cfg.icacheLineWords),
+            m_dcache(cfg.dcacheLines, cfg.dcacheLineWords),
+            m_instrs(0),
+            m_loadDst(cNoReg),
+            m_fetchLine(~(TUint64)0) {
+        for (unsigned i = 0; i < OpCode::eNotUsed; i++) {
+            ASSERT_TRUE(1 <= cfg.execLat[i]);
+            m_execStall[i] = cfg.execLat[i] - 1;
+        }
+        for (unsigned i = 0; i < eNumStalls; i++) {
+            m_stalls[i] = 0;
+        }
+    }
+
+    TUint64 TTimingMon::getCycles() const {
+        TUint64 cycles = m_instrs + cPipeDepth - 1;
+        for (unsigned i = 0; i < eNumStalls; i++) {
+            cycles += m_stalls[i];
+        }
+        return cycles;
+    }
+
+    const char* TTimingMon::stallName(EStall stall) {
+        static const char* const cNames[] = {
+            "exec", "fetch", "mem", "branch", "loaduse", "hle"
+        };
+        return cNames[stall];
+    }
+
+    void TTimingMon::writeReport(std::ostream &os) const {
+        const TUint64 cycles = getCycles();
+        os << "Info: timing: " << m_instrs << " instruction(s), " << cycles
+           << " cycle(s), CPI " << ((0 != m_instrs) ? ((double)cycles / m_instrs) : 0.0)
+           << std::endl;
+        for (unsigned i = 0; i < eNumStalls; i++) {
+            os << "Info: timing: " << stallName((EStall)i) << " stalls: "
+               << m_stalls[i] << " cycle(s) ("
+               << ((0 != cycles) ? (100.0 * m_stalls[i] / cycles) : 0.0)
+               << "%)" << std::endl;
+        }
+        m_icache.writeReport(os, "icache");
+        m_dcache.writeReport(os, "dcache");
+    }
+};
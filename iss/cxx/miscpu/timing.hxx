@@ -0,0 +1,294 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+#if !defined(_miscpu_timing_hxx_)
+#    define  _miscpu_timing_hxx_
+
+#include <vector>
+#include <ostream>
+#include "xyzzy/portable.hxx"
+#include "xyzzy/assert.hxx"
+#include "miscpu.hxx"
+#include "hle.hxx"
+#include "opcode.hxx"
+
+using xyzzy::TUint32;
+using xyzzy::TUint64;
+
+namespace miscpu
+{
+    /**
+     * Latencies of the timing model (see TTimingMon).  All but execLat
+     * are extra (stall) cycles.
+     *
+     * A config file has lines of:
+     *
+     *      eAdd 1              //execLat[eAdd] (any OpCode::name())
+     *      branch 2            //branchPenalty
+     *      loaduse 1           //loadUsePenalty
+     *      fetch 8             //fetchLat
+     *      mem 8               //memLat
+     *      icache 64 4         //icacheLines icacheLineWords (0 0: none)
+     *      dcache 64 4         //dcacheLines dcacheLineWords (0 0: none)
+     *
+     * '#' starts a comment; keys not given keep their default.
+     */
+    struct TTimingConfig {
+        explicit TTimingConfig();
+
+        //Update from file fname (as above).
+        void load(const string &fname);
+
+        unsigned    execLat[OpCode::eNotUsed];  //cycles in execute (>= 1)
+        unsigned    branchPenalty;  //taken eBr/eCall, every eRetn
+        unsigned    loadUsePenalty; //next instruction reads eLoad/ePop result
+        unsigned    fetchLat;       //instruction word not in icache
+        unsigned    memLat;         //data word not in dcache (or above memory)
+        unsigned    icacheLines, icacheLineWords;   //powers of 2
+        unsigned    dcacheLines, dcacheLineWords;
+    };
+
+    //Direct mapped cache: tags only.
+    class TCacheModel {
+    public:
+        //lines == 0: disabled (every access misses).
+        explicit TCacheModel(unsigned lines, unsigned lineWords);
+
+        //Return true on hit; allocate on miss.
+        bool access(TUint32 addr) {
+            const TUint64 line = addr >> m_lineShift;
+            TUint64 &tag = m_tags[line & m_lineMask];
+            if (line == tag) {
+                m_hits++;
+                return true;
+            }
+            m_misses++;
+            if (0 != m_lines) {
+                tag = line;
+            }
+            return false;
+        }
+
+        //As access() of an address known to be cached.
+        void hit() {
+            m_hits++;
+        }
+
+        unsigned getLines() const {
+            return m_lines;
+        }
+
+        unsigned getLineShift() const {
+            return m_lineShift;
+        }
+
+        TUint64 getHits() const {
+            return m_hits;
+        }
+
+        TUint64 getMisses() const {
+            return m_misses;
+        }
+
+        void writeReport(std::ostream &os, const char *name) const;
+
+    private:
+        std::vector<TUint64>    m_tags; //line numbers (~0: invalid)
+        unsigned                m_lines;
+        unsigned                m_lineShift;
+        TUint64                 m_lineMask;
+        TUint64                 m_hits, m_misses;
+    };
+
+    /**
+     * Cycle-approximate timing: a monitor (see monitors.hxx) which
+     * models an in-order fetch/decode/execute pipeline over the retired
+     * instruction stream.
+     *
+     * Each instruction issues one cycle after the previous one, plus
+     * stalls for:
+     *      exec:    execLat[opcode] - 1
+     *      fetch:   fetchLat per instruction word (eLoadil has 2) which
+     *               misses the icache
+     *      mem:     memLat per eLoad/eStore/eSwap/ePush/ePop/taken eCall/eRetn
+     *               data word which misses the dcache (device windows
+     *               above memory are never cached)
+     *      branch:  branchPenalty per taken eBr/eCall and eRetn
+     *               (fetch is not predicted: the pipeline refills)
+     *      loaduse: loadUsePenalty if an instruction reads the register
+     *               loaded by the eLoad/eSwap/ePop before it
+     *      hle:     an eCall run by a hook (see hle.hxx) counts the
+     *               hook's declared instructions too, and its declared
+     *               cycles beyond them as stalls
+     *
+     * getCycles() adds the pipeline fill (cPipeDepth - 1).
+     *
+     * The cost per instruction is a few table lookups and, when
+     * enabled, a tag compare per cache: cheap enough to time whole
+     * runs.
+     */
+    class TTimingMon {
+    public:
+        enum EStall {
+            eExecStall, eFetchStall, eMemStall, eBranchStall, eLoadUseStall,
+            eHleStall, eNumStalls
+        };
+
+        static const unsigned cPipeDepth = 3;
+
+        explicit TTimingMon(const TTimingConfig &cfg, TUint64 memDepth);
+
+        void retire(const MiscCpu &cpu, TUint32 pc) {
+            const OpCode::EOp op = cpu.getOpcode();
+            const TUint32 opBit = 1u << op;
+            m_instrs++;
+            fetch(pc);
+            if (OpCode::eLoadil == op) {
+                fetch(pc + 1);
+            }
+            if ((cNoReg != m_loadDst) && readsReg(cpu, opBit, m_loadDst)) {
+                m_stalls[eLoadUseStall] += m_cfg.loadUsePenalty;
+            }
+            m_loadDst = cNoReg;
+            m_stalls[eExecStall] += m_execStall[op];
+            if (0 == (cMemOrFlowOps & opBit)) {
+                return;
+            }
+            const TUint32 sp = cpu.getReg(cpu.cSpRegIx);
+            switch (op) {
+                case OpCode::eLoad:
+                    m_loadDst = cpu.getIxJ();
+                    //fall through
+                case OpCode::eStore:
+                    data(cpu.getRk() + cpu.getImmed());
+                    break;
+                case OpCode::eSwap:
+                    m_loadDst = cpu.getIxJ();
+                    data(cpu.getRk() + cpu.getImmed());
+                    break;
+                case OpCode::ePush:
+                    data(sp);
+                    break;
+                case OpCode::ePop:
+                    m_loadDst = cpu.getIxJ();
+                    data(sp - 1);
+                    break;
+                case OpCode::eBr:
+                    //cheaper than checkCond(); eBr +1 taken is a nop anyway
+                    if (cpu.getPc() != pc + 1) {
+                        m_stalls[eBranchStall] += m_cfg.branchPenalty;
+                    }
+                    break;
+                case OpCode::eCall:
+                    if (0 != cpu.getHleCall()) {
+                        const THleHook &hook = *cpu.getHleCall();
+                        m_instrs += hook.getInstrs();
+                        if (hook.getCycles() > hook.getInstrs()) {
+                            m_stalls[eHleStall] += hook.getCycles() - hook.getInstrs();
+                        }
+                        m_stalls[eBranchStall] += m_cfg.branchPenalty;
+                    } else if (cpu.checkCond()) {
+                        data(sp);
+                        m_stalls[eBranchStall] += m_cfg.branchPenalty;
+                    }
+                    break;
+                case OpCode::eRetn:
+                    data(sp - 1);
+                    m_stalls[eBranchStall] += m_cfg.branchPenalty;
+                    break;
+                default:
+                    ASSERT_NEVER;
+            }
+        }
+
+        TUint64 getInstrs() const {
+            return m_instrs;
+        }
+
+        TUint64 getStalls(EStall stall) const {
+            return m_stalls[stall];
+        }
+
+        TUint64 getCycles() const;
+
+        const TCacheModel& getIcache() const {
+            return m_icache;
+        }
+
+        const TCacheModel& getDcache() const {
+            return m_dcache;
+        }
+
+        //Cycles, CPI, stall breakdown and cache statistics.
+        void writeReport(std::ostream &os) const;
+
+        static const char* stallName(EStall stall);
+
+    private:
+        static const unsigned cNoReg = ~0u;
+
+        //Opcodes which access data memory or change flow (see retire()).
+        static const TUint32 cMemOrFlowOps;
+        //Opcodes which read r[j], r[k], sp.
+        static const TUint32 cReadsRj;
+        static const TUint32 cReadsRk;
+        static const TUint32 cReadsSp;
+
+        void fetch(TUint32 addr) {
+            //sequential fetch within the last line hits without a lookup
+            const TUint64 line = addr >> m_icache.getLineShift();
+            if (line == m_fetchLine) {
+                m_icache.hit();
+            } else if (m_icache.access(addr)) {
+                m_fetchLine = line;
+            } else {
+                m_fetchLine = (0 != m_icache.getLines()) ? line : m_fetchLine;
+                m_stalls[eFetchStall] += m_cfg.fetchLat;
+            }
+        }
+
+        void data(TUint32 addr) {
+            if ((addr > m_memMask) || !m_dcache.access(addr)) {
+                m_stalls[eMemStall] += m_cfg.memLat;
+            }
+        }
+
+        bool readsReg(const MiscCpu &cpu, TUint32 opBit, unsigned ix) const {
+            return ((0 != (cReadsRj & opBit)) && (cpu.getIxJ() == ix)) ||
+                   ((0 != (cReadsRk & opBit)) && (cpu.getIxK() == ix)) ||
+                   ((0 != (cReadsSp & opBit)) && (cpu.cSpRegIx == ix));
+        }
+
+        const TTimingConfig m_cfg;
+        const TUint64       m_memMask;
+        unsigned            m_execStall[OpCode::eNotUsed];
+        TCacheModel         m_icache, m_dcache;
+        TUint64             m_instrs;
+        TUint64             m_stalls[eNumStalls];
+        unsigned            m_loadDst;  //of previous eLoad/ePop, else cNoReg
+        TUint64             m_fetchLine;    //icache line of last fetch
+    };
+};
+
+#endif  //_miscpu_timing_hxx_
@@ -0,0 +1,576 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+
+#include <cstring>
+#include <zlib.h>
+#include <unistd.h>
+#include "xyzzy/assert.hxx"
+#include "trace.hxx"
+#include "image.hxx"
+
+namespace miscpu
+{
+    static const char cMagic[4] = {'M', 'T', 'R', 'C'};
+    static const TUint32 cVersion = 2;
+
+    //Varint (7 bits per byte, low first) at p, before end.
+    static TUint32 getU(const TUint8 *&p, const TUint8 *end) {
+        TUint32 v = 0;
+        for (unsigned sh = 0; ; sh += 7) {
+            ASSERT_TRUE((p < end) && (35 > sh));
+            const TUint8 b = *p++;
+            v |= (TUint32)(b & 0x7F) << sh;
+            if (0 == (b & 0x80)) {
+                return v;
+            }
+        }
+    }
+
+    //Zigzag varint.
+    static TUint32 getS(const TUint8 *&p, const TUint8 *end) {
+        const TUint32 v = getU(p, end);
+        return (v >> 1) ^ (0 - (v & 1));
+    }
+
+    static TUint8* putU(TUint8 *p, TUint32 v) {
+        while (0x80 <= v) {
+            *p++ = (TUint8)(v | 0x80);
+            v >>= 7;
+        }
+        *p++ = (TUint8)v;
+        return p;
+    }
+
+    static TUint8* putS(TUint8 *p, TUint32 v) {
+        return putU(p, (v << 1) ^ (TUint32)((TInt32)v >> 31));
+    }
+
+    static TUint8* putRaw(TUint8 *p, TUint32 v) {
+        p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+        return p + 4;
+    }
+
+    //Record r[ix] = val at p if it changes.
+    static bool putReg(std::vector<TInt32> &regs, unsigned ix, TInt32 val, TUint8 *&p) {
+        const TInt32 old = regs[ix];
+        if (val == old) {
+            return false;
+        }
+        regs[ix] = val;
+        *p++ = ix;
+        p = putS(p, val - old);
+        return true;
+    }
+
+    const TUint32 TTraceMon::cWritesRj =
+        (1u << OpCode::eAdd) | (1u << OpCode::eAddi) |
+        (1u << OpCode::eSub) | (1u << OpCode::eSubi) |
+        (1u << OpCode::eLoad) | (1u << OpCode::eLoadr) |
+        (1u << OpCode::eLoadi) | (1u << OpCode::eLoadil) | (1u << OpCode::ePop) |
+        (1u << OpCode::eLsl) | (1u << OpCode::eLsli) |
+        (1u << OpCode::eLsr) | (1u << OpCode::eLsri) |
+        (1u << OpCode::eAsr) | (1u << OpCode::eAsri) |
+        (1u << OpCode::eAnd) | (1u << OpCode::eOr) | (1u << OpCode::eXor) |
+        (1u << OpCode::eAndi) | (1u << OpCode::eOri) | (1u << OpCode::eXori) |
+        (1u << OpCode::eNot) | (1u << OpCode::eSwap);
+
+    const TUint32 TTraceMon::cWritesFlags =
+        (1u << OpCode::eAdd) | (1u << OpCode::eAddi) |
+        (1u << OpCode::eSub) | (1u << OpCode::eSubi) |
+        (1u << OpCode::eCmp) | (1u << OpCode::eCmpi) |
+        (1u << OpCode::eLsl) | (1u << OpCode::eLsli) |
+        (1u << OpCode::eLsr) | (1u << OpCode::eLsri) |
+        (1u << OpCode::eAsr) | (1u << OpCode::eAsri) |
+        (1u << OpCode::eAnd) | (1u << OpCode::eOr) | (1u << OpCode::eXor) |
+        (1u << OpCode::eAndi) | (1u << OpCode::eOri) | (1u << OpCode::eXori) |
+        (1u << OpCode::eNot);
+
+    const TUint32 TTraceMon::cWritesSp =
+        (1u << OpCode::ePush) | (1u << OpCode::ePop) |
+        (1u << OpCode::eCall) | (1u << OpCode::eRetn);
+
+    const TUint32 TTraceMon::cMemOps =
+        cWritesSp | (1u << OpCode::eStore) | (1u << OpCode::eSwap);
+
+    TTraceMon::TTraceMon(const MiscCpu &cpu, const string &fname,
+            ECodec codec, unsigned encoders, unsigned chunkInstrs,
+            unsigned ringChunks)
+        :   m_ofs(fname.c_str(), std::ios::out | std::ios::binary),
+            m_codec(codec),
+            m_regBits(cpu.cRegsN),
+            m_spIx(cpu.cSpRegIx),
+            m_memMask(cpu.getMemDepth() - 1),
+            m_closed(false),
+            m_written(0),
+            m_cur(0),
+            m_index(0),
+            m_stalls(0),
+            m_zBytes(0) {
+        ASSERT_TRUE(false == m_ofs.fail());
+        ASSERT_TRUE(0 < chunkInstrs);
+        if (0 == encoders) {
+            const long n = sysconf(_SC_NPROCESSORS_ONLN);
+            encoders = (1 < n) ? (n - 1) : 1;
+        }
+        //a buffer for each encoder, and at least one to fill
+        m_ring.resize((encoders + 2 > ringChunks) ? (encoders + 2) : ringChunks);
+        m_ofs.write(cMagic, 4);
+        putLe32(m_ofs, cVersion);
+        putLe32(m_ofs, m_regBits);
+        putLe32(m_ofs, m_codec);
+        for (unsigned i = 0; i < m_ring.size(); i++) {
+            TBuffer &buf = m_ring[i];
+            buf.raw.resize(cEntryWords * chunkInstrs);
+            buf.regs.resize(cpu.getNumRegs());
+            buf.data.resize(5 + (4 * buf.regs.size()) + (cMaxRecordBytes * chunkInstrs));
+            if (0 < i) {
+                m_free.push_back(&buf);
+            }
+        }
+        m_cur = &m_ring[0];
+        startChunk(cpu);
+        pthread_mutex_init(&m_lock, 0);
+        pthread_cond_init(&m_cond, 0);
+        pthread_mutex_init(&m_writeLock, 0);
+        pthread_cond_init(&m_writeCond, 0);
+        m_threads.resize(encoders);
+        for (unsigned i = 0; i < encoders; i++) {
+            ASSERT_TRUE(0 == pthread_create(&m_threads[i], 0, drain, this));
+        }
+    }
+
+    TTraceMon::~TTraceMon() {
+        close();
+        pthread_cond_destroy(&m_writeCond);
+        pthread_mutex_destroy(&m_writeLock);
+        pthread_cond_destroy(&m_cond);
+        pthread_mutex_destroy(&m_lock);
+    }
+
+    void TTraceMon::startChunk(const MiscCpu &cpu) {
+        m_cur->firstIndex = m_index;
+        m_cur->nextPc = cpu.getPc();
+        m_cur->flags = (cpu.getCy() ? 1 : 0) | (cpu.getZero() ? 2 : 0);
+        for (unsigned i = 0; i < m_cur->regs.size(); i++) {
+            m_cur->regs[i] = cpu.getReg(i);
+        }
+        m_base = m_pos = &m_cur->raw[0];
+        m_end = m_base + m_cur->raw.size();
+    }
+
+    void TTraceMon::endChunk() {
+        m_cur->count = (m_pos - m_base) / cEntryWords;
+        m_index += m_cur->count;
+        m_pos = m_base;
+    }
+
+    void TTraceMon::nextChunk(const MiscCpu &cpu) {
+        endChunk();
+        pthread_mutex_lock(&m_lock);
+        m_full.push_back(m_cur);
+        pthread_cond_broadcast(&m_cond);
+        if (m_free.empty()) {
+            m_stalls++;
+            do {
+                pthread_cond_wait(&m_cond, &m_lock);
+            } while (m_free.empty());
+        }
+        m_cur = m_free.back();
+        m_free.pop_back();
+        pthread_mutex_unlock(&m_lock);
+        startChunk(cpu);
+    }
+
+    void TTraceMon::close() {
+        if (0 == m_cur) {
+            return;
+        }
+        endChunk();
+        pthread_mutex_lock(&m_lock);
+        if (0 < m_cur->count) {
+            m_full.push_back(m_cur);
+        }
+        m_closed = true;
+        pthread_cond_broadcast(&m_cond);
+        pthread_mutex_unlock(&m_lock);
+        for (unsigned i = 0; i < m_threads.size(); i++) {
+            pthread_join(m_threads[i], 0);
+        }
+        m_cur = 0;
+        m_ofs.close();
+    }
+
+    void* TTraceMon::drain(void *arg) {
+        TTraceMon *self = (TTraceMon*)arg;
+        while (true) {
+            pthread_mutex_lock(&self->m_lock);
+            while (self->m_full.empty() && !self->m_closed) {
+                pthread_cond_wait(&self->m_cond, &self->m_lock);
+            }
+            if (self->m_full.empty()) {
+                pthread_mutex_unlock(&self->m_lock);
+                return 0;
+            }
+            TBuffer *buf = self->m_full.front();
+            self->m_full.erase(self->m_full.begin());
+            pthread_mutex_unlock(&self->m_lock);
+            self->encode(*buf);
+            //chunks are taken in order: the one before is being encoded
+            pthread_mutex_lock(&self->m_writeLock);
+            while (self->m_written != buf->firstIndex) {
+                pthread_cond_wait(&self->m_writeCond, &self->m_writeLock);
+            }
+            self->write(*buf);
+            self->m_written += buf->count;
+            pthread_cond_broadcast(&self->m_writeCond);
+            pthread_mutex_unlock(&self->m_writeLock);
+            pthread_mutex_lock(&self->m_lock);
+            self->m_free.push_back(buf);
+            pthread_cond_broadcast(&self->m_cond);
+            pthread_mutex_unlock(&self->m_lock);
+        }
+    }
+
+    void TTraceMon::encode(TBuffer &buf) const {
+        //ir seen in the chunk, by pc + 1 (0: none); a collision only
+        //records ir again
+        static const unsigned cIrSlots = 1 << 12;
+        std::vector<TUint64> irPcs(cIrSlots, 0);
+        std::vector<TUint32> irs(cIrSlots);
+        std::vector<TInt32> regs(buf.regs);
+        TUint32 nextPc = buf.nextPc, lastAddr = 0;
+        TUint8 flags = buf.flags;
+        buf.pcLo = ~0u;
+        buf.pcHi = 0;
+        TUint8 *p = &buf.data[0];
+        p = putRaw(p, nextPc);
+        *p++ = flags;
+        for (unsigned i = 0; i < regs.size(); i++) {
+            p = putRaw(p, regs[i]);
+        }
+        const TUint32 *e = &buf.raw[0];
+        for (const TUint32 *end = e + (cEntryWords * buf.count); e < end; e += cEntryWords) {
+            const TUint32 pc = e[0], ir = e[1], op = e[2] & 0xFF, j = e[2] >> 8;
+            const TUint32 a = e[3], b = e[4], bit = 1u << op;
+            TUint8 *const tag = p++;
+            unsigned t = 0;
+            if (pc != nextPc) {
+                t |= cPcJump;
+                p = putS(p, pc - nextPc);
+            }
+            const unsigned slot = pc & (cIrSlots - 1);
+            if ((irPcs[slot] != pc + 1ull) || (irs[slot] != ir)) {
+                irPcs[slot] = pc + 1ull;
+                irs[slot] = ir;
+                t |= cIr;
+                p = putRaw(p, ir);
+            }
+            const TInt32 oldRj = regs[j];
+            if ((cWritesRj & bit) && putReg(regs, j, a, p)) {
+                t |= cReg;
+            }
+            //a taken eCall moves sp
+            bool moved = false;
+            if ((cWritesSp & bit) && putReg(regs, m_spIx, b, p)) {
+                t |= (t & cReg) ? cReg2 : cReg;
+                moved = true;
+            }
+            bool isMem = true;
+            TUint32 addr = b, val = a;
+            if (OpCode::eStore == op) {
+                addr = a;
+                val = b;
+            } else if (OpCode::eSwap == op) {
+                val = oldRj;
+            } else if (OpCode::eCall == op) {
+                isMem = moved;
+            } else {
+                isMem = (OpCode::ePush == op);
+            }
+            if (isMem && (addr <= m_memMask)) {
+                t |= cMem;
+                p = putS(p, addr - lastAddr);
+                p = putS(p, val);
+                lastAddr = addr;
+            }
+            if ((cWritesFlags & bit) && (b != flags)) {
+                flags = b;
+                t |= cFlags;
+                *p++ = flags;
+            }
+            *tag = t;
+            nextPc = pc + 1;
+            buf.pcLo = (pc < buf.pcLo) ? pc : buf.pcLo;
+            buf.pcHi = (pc > buf.pcHi) ? pc : buf.pcHi;
+        }
+        buf.rawBytes = p - &buf.data[0];
+        buf.zBytes = buf.rawBytes;
+        if (eDeflate == m_codec) {
+            buf.z.resize(compressBound(buf.rawBytes));
+            uLongf zlen = buf.z.size();
+            ASSERT_TRUE(Z_OK == compress2(&buf.z[0], &zlen, &buf.data[0], buf.rawBytes,
+                                          Z_BEST_SPEED));
+            buf.zBytes = zlen;
+        }
+    }
+
+    void TTraceMon::write(const TBuffer &buf) {
+        putLe32(m_ofs, (TUint32)buf.firstIndex);
+        putLe32(m_ofs, (TUint32)(buf.firstIndex >> 32));
+        putLe32(m_ofs, buf.count);
+        putLe32(m_ofs, buf.pcLo);
+        putLe32(m_ofs, buf.pcHi);
+        putLe32(m_ofs, buf.rawBytes);
+        putLe32(m_ofs, buf.zBytes);
+        const TUint8 *payload = (eDeflate == m_codec) ? &buf.z[0] : &buf.data[0];
+        m_ofs.write((const char*)payload, buf.zBytes);
+        ASSERT_TRUE(false == m_ofs.fail());
+        m_zBytes += TTraceChunk::cBytes + buf.zBytes;
+    }
+
+    bool TTraceRecord::operator==(const TTraceRecord &r) const {
+        if ((pc != r.pc) || (ir != r.ir) || (nregs != r.nregs) ||
+            (isMemWrite != r.isMemWrite) || (cy != r.cy) || (zero != r.zero)) {
+            return false;
+        }
+        for (unsigned i = 0; i < nregs; i++) {
+            if ((regIx[i] != r.regIx[i]) || (regVal[i] != r.regVal[i])) {
+                return false;
+            }
+        }
+        return !isMemWrite || ((memAddr == r.memAddr) && (memVal == r.memVal));
+    }
+
+    void TTraceRecord::write(std::ostream &os) const {
+        const unsigned op = (TUint32)ir >> (32 - OpCode::cOpCodeN);
+        os << index << " " << pc << " " << ir << " "
+           << ((OpCode::eNotUsed > op) ? OpCode::name((OpCode::EOp)op) : "?");
+        for (unsigned i = 0; i < nregs; i++) {
+            os << " r" << regIx[i] << "=" << regVal[i];
+        }
+        if (isMemWrite) {
+            os << " m" << memAddr << "=" << memVal;
+        }
+        os << (cy ? " cy" : "") << (zero ? " zero" : "") << std::endl;
+    }
+
+    TTraceReader::TTraceReader(const string &fname)
+        :   m_ifs(fname.c_str(), std::ios::in | std::ios::binary),
+            m_count(0),
+            m_pcLo(0),
+            m_pcHi(~0u),
+            m_chunk(0),
+            m_pos(0),
+            m_index(0),
+            m_end(0),
+            m_nextPc(0),
+            m_lastAddr(0),
+            m_flags(0) {
+        unsigned char b[TTraceChunk::cBytes];
+        m_ifs.read((char*)b, 12);
+        ASSERT_TRUE(!m_ifs.fail() && (0 == memcmp(b, cMagic, 4)));
+        const TUint32 version = getLe32(b + 4);
+        ASSERT_TRUE((1 == version) || (cVersion == version));
+        m_regBits = getLe32(b + 8);
+        ASSERT_TRUE(16 >= m_regBits);
+        m_codec = TTraceMon::eDeflate;
+        if (1 < version) {
+            m_ifs.read((char*)b, 4);
+            ASSERT_TRUE(!m_ifs.fail());
+            m_codec = (TTraceMon::ECodec)getLe32(b);
+            ASSERT_TRUE((TTraceMon::eStored == m_codec) || (TTraceMon::eDeflate == m_codec));
+        }
+        m_regs.resize(1u << m_regBits);
+        while (m_ifs.read((char*)b, sizeof(b))) {
+            TTraceChunk c;
+            c.firstIndex = getLe32(b) | ((TUint64)getLe32(b + 4) << 32);
+            c.count = getLe32(b + 8);
+            c.pcLo = getLe32(b + 12);
+            c.pcHi = getLe32(b + 16);
+            c.rawBytes = getLe32(b + 20);
+            c.zBytes = getLe32(b + 24);
+            c.offset = m_ifs.tellg();
+            m_chunks.push_back(c);
+            m_count += c.count;
+            m_ifs.seekg(c.zBytes, std::ios::cur);
+        }
+        m_ifs.clear();
+        m_chunk = m_chunks.size();
+        seek(0);
+    }
+
+    bool TTraceReader::loadChunk(unsigned ix) {
+        if (ix >= m_chunks.size()) {
+            m_chunk = m_chunks.size();
+            return false;
+        }
+        const TTraceChunk &c = m_chunks[ix];
+        m_data.resize(c.rawBytes);
+        uLongf len = c.rawBytes;
+        m_ifs.seekg(c.offset);
+        if (TTraceMon::eStored == m_codec) {
+            ASSERT_TRUE(c.zBytes == c.rawBytes);
+            m_ifs.read((char*)&m_data[0], len);
+            ASSERT_TRUE(false == m_ifs.fail());
+        } else {
+            std::vector<TUint8> z(c.zBytes);
+            m_ifs.read((char*)&z[0], z.size());
+            ASSERT_TRUE(false == m_ifs.fail());
+            ASSERT_TRUE(Z_OK == uncompress(&m_data[0], &len, &z[0], z.size()));
+        }
+        ASSERT_TRUE((len == c.rawBytes) && ((5 + (4 * m_regs.size())) <= len));
+        const TUint8 *p = &m_data[0];
+        m_nextPc = getLe32(p);
+        m_flags = p[4];
+        p += 5;
+        for (unsigned i = 0; i < m_regs.size(); i++, p += 4) {
+            m_regs[i] = getLe32(p);
+        }
+        m_pos = p - &m_data[0];
+        m_irs.clear();
+        m_lastAddr = 0;
+        m_chunk = ix;
+        m_index = c.firstIndex;
+        m_end = c.firstIndex + c.count;
+        return true;
+    }
+
+    void TTraceReader::seek(TUint64 index) {
+        //last chunk starting at or before index
+        unsigned lo = 0, hi = m_chunks.size();
+        while (lo < hi) {
+            const unsigned mid = (lo + hi) / 2;
+            if (m_chunks[mid].firstIndex <= index) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if ((0 == lo) || !loadChunk(lo - 1)) {
+            m_chunk = m_chunks.size();
+            return;
+        }
+        TTraceRecord rec;
+        while ((m_index < index) && (m_index < m_end)) {
+            decode(rec);
+        }
+    }
+
+    void TTraceReader::setPcRange(TUint32 lo, TUint32 hi) {
+        m_pcLo = lo;
+        m_pcHi = hi;
+    }
+
+    bool TTraceReader::next(TTraceRecord &rec) {
+        while (m_chunk < m_chunks.size()) {
+            if (m_index >= m_end) {
+                unsigned ix = m_chunk + 1;
+                while ((ix < m_chunks.size()) &&
+                       ((m_chunks[ix].pcHi < m_pcLo) || (m_chunks[ix].pcLo > m_pcHi))) {
+                    ix++;
+                }
+                if (!loadChunk(ix)) {
+                    return false;
+                }
+                continue;
+            }
+            decode(rec);
+            if ((m_pcLo <= rec.pc) && (rec.pc <= m_pcHi)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void TTraceReader::decode(TTraceRecord &rec) {
+        const TUint8 *const end = &m_data[0] + m_data.size();
+        const TUint8 *p = &m_data[0] + m_pos;
+        ASSERT_TRUE(p < end);
+        const unsigned tag = *p++;
+        rec.index = m_index++;
+        rec.pc = m_nextPc;
+        if (tag & TTraceMon::cPcJump) {
+            rec.pc += getS(p, end);
+        }
+        m_nextPc = rec.pc + 1;
+        if (tag & TTraceMon::cIr) {
+            ASSERT_TRUE(4 <= (end - p));
+            rec.ir = getLe32(p);
+            p += 4;
+            m_irs[rec.pc] = rec.ir;
+        } else {
+            std::map<TUint32, TInt32>::const_iterator it = m_irs.find(rec.pc);
+            ASSERT_TRUE(m_irs.end() != it);
+            rec.ir = it->second;
+        }
+        rec.nregs = 0;
+        const unsigned nregs = ((tag & TTraceMon::cReg) ? 1 : 0) +
+                               ((tag & TTraceMon::cReg2) ? 1 : 0);
+        for (; rec.nregs < nregs; rec.nregs++) {
+            ASSERT_TRUE(p < end);
+            const unsigned ix = *p++;
+            ASSERT_TRUE(ix < m_regs.size());
+            m_regs[ix] += getS(p, end);
+            rec.regIx[rec.nregs] = ix;
+            rec.regVal[rec.nregs] = m_regs[ix];
+        }
+        rec.isMemWrite = (0 != (tag & TTraceMon::cMem));
+        if (rec.isMemWrite) {
+            m_lastAddr += getS(p, end);
+            rec.memAddr = m_lastAddr;
+            rec.memVal = getS(p, end);
+        }
+        if (tag & TTraceMon::cFlags) {
+            ASSERT_TRUE(p < end);
+            m_flags = *p++;
+        }
+        rec.cy = (0 != (m_flags & 1));
+        rec.zero = (0 != (m_flags & 2));
+        m_pos = p - &m_data[0];
+    }
+
+    TUint64 diffTraces(const string &a, const string &b, std::ostream &os) {
+        TTraceReader ra(a), rb(b);
+        TTraceRecord x, y;
+        while (true) {
+            const bool hasA = ra.next(x), hasB = rb.next(y);
+            if (!hasA || !hasB) {
+                if (hasA == hasB) {
+                    return ~(TUint64)0;
+                }
+                const TUint64 n = hasA ? rb.getCount() : ra.getCount();
+                os << (hasA ? b : a) << " ends at " << n << std::endl;
+                return n;
+            }
+            if (!(x == y)) {
+                os << a << ": ";
+                x.write(os);
+                os << b << ": ";
+                y.write(os);
+                return x.index;
+            }
+        }
+    }
+};
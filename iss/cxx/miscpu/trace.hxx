@@ -0,0 +1,315 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+
+
+#if !defined(_miscpu_trace_hxx_)
+#    define  _miscpu_trace_hxx_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <ostream>
+#include <fstream>
+#include <pthread.h>
+#include "xyzzy/portable.hxx"
+#include "miscpu.hxx"
+#include "opcode.hxx"
+
+using std::string;
+using xyzzy::TUint8;
+using xyzzy::TUint32;
+using xyzzy::TUint64;
+using xyzzy::TInt32;
+
+namespace miscpu
+{
+    /**
+     * Instruction trace file, fields little-endian 32-bit:
+     *
+     *   header      magic "MTRC", version, regBits, codec
+     *   chunks      {firstIndex (lo, hi), count, pcLo, pcHi, rawBytes,
+     *               zBytes, payload[zBytes]} ...
+     *
+     * codec is TTraceMon::eStored (zBytes == rawBytes) or eDeflate (zlib).
+     * Version 1 files have no codec word: their payloads are deflated.
+     *
+     * Each payload decodes on its own (so a reader can seek to any
+     * chunk): it starts with the state before its first instruction
+     *
+     *   nextPc, flags (1: cy, 2: zero), regs[2^regBits]  (raw 32-bit)
+     *
+     * then one record per retired instruction:
+     *
+     *   tag         cPcJump|cIr|cReg|cReg2|cMem|cFlags
+     *   [pc]        zigzag varint: pc - (previous pc + 1)
+     *   [ir]        raw 32-bit (first time at pc in the chunk, or changed)
+     *   [reg]       ix, zigzag varint: new - old value  (x2 for cReg2)
+     *   [mem]       zigzag varint: addr - previous mem addr; zigzag value
+     *   [flags]     new flags
+     *
+     * Registers and flags are only recorded if the value changes.
+     */
+    struct TTraceChunk {
+        static const unsigned cBytes = 28;
+
+        TUint64     firstIndex;
+        TUint32     count;
+        TUint32     pcLo, pcHi;
+        TUint32     rawBytes, zBytes;
+        TUint64     offset;     //of payload in file (reader only)
+    };
+
+    //One retired instruction.
+    struct TTraceRecord {
+        TUint64     index;
+        TUint32     pc;
+        TInt32      ir;
+        unsigned    nregs;          //registers changed (0..2)
+        unsigned    regIx[2];
+        TInt32      regVal[2];
+        bool        isMemWrite;
+        TUint32     memAddr;
+        TInt32      memVal;
+        bool        cy, zero;
+
+        //Compare all but index.
+        bool operator==(const TTraceRecord &r) const;
+
+        //One line: index pc ir opcode [rN=val]* [m[addr]=val] [cy zero]
+        void write(std::ostream &os) const;
+    };
+
+    /**
+     * Monitor (see monitors.hxx) which records every retired instruction.
+     *
+     * retire() only copies a fixed entry (pc, ir, the values written)
+     * into one of a ring of chunk buffers, with the state before the
+     * chunk's first instruction.  Full buffers are encoded (and written,
+     * in order) by background threads: one per spare host cpu, at least
+     * one.  retire() only waits if every buffer is queued (see
+     * getStalls()).  eDeflate costs those threads several times what
+     * the simulation costs, for a quarter of the bytes.
+     *
+     * The initial state is taken from cpu at construction: construct
+     * just before MiscCpu::run(mon).
+     */
+    class TTraceMon {
+    public:
+        //Chunk payload encoding.
+        enum ECodec {
+            eStored = 0,
+            eDeflate = 1
+        };
+
+        //encoders: 0 is one per host cpu but one (at least one).
+        explicit TTraceMon(const MiscCpu &cpu, const string &fname,
+                ECodec codec = eStored, unsigned encoders = 0,
+                unsigned chunkInstrs = 1 << 14, unsigned ringChunks = 4);
+
+        ~TTraceMon();
+
+        void retire(const MiscCpu &cpu, TUint32 pc) {
+            const OpCode::EOp op = cpu.getOpcode();
+            TUint32 *const e = m_pos;
+            e[0] = pc;
+            e[1] = cpu.getMem(pc);
+            e[2] = op | (cpu.getIxJ() << 8);
+            if (0 == (cMemOps & (1u << op))) {
+                //r[j] and flags: encode() keeps them if op writes them
+                e[3] = cpu.getReg(cpu.getIxJ());
+                e[4] = (cpu.getCy() ? 1 : 0) | (cpu.getZero() ? 2 : 0);
+            } else {
+                retireMem(cpu, op, e);
+            }
+            m_pos = e + cEntryWords;
+            if (m_pos == m_end) {
+                nextChunk(cpu);
+            }
+        }
+
+        //Write the last chunk, wait for the background threads.
+        void close();
+
+        TUint64 getCount() const {
+            return m_index + (m_pos - m_base) / cEntryWords;
+        }
+
+        //Times retire() waited for a free buffer.
+        TUint64 getStalls() const {
+            return m_stalls;
+        }
+
+        TUint64 getBytes() const {
+            return m_zBytes;
+        }
+
+        //Record tag bits.
+        static const unsigned cPcJump = 1;
+        static const unsigned cIr = 2;
+        static const unsigned cReg = 4;
+        static const unsigned cReg2 = 8;
+        static const unsigned cMem = 16;
+        static const unsigned cFlags = 32;
+
+    private:
+        /**
+         * Entry per retired instruction: pc, ir, op | (j << 8), a, b.
+         * a is the new r[j] (or the word at the new sp after ePush and
+         * eCall, or the address of eStore); b is the new flags, or the
+         * new sp after an sp op, or the word stored by eStore, or the
+         * address of eSwap (which stores the old r[j]).
+         */
+        static const unsigned cEntryWords = 5;
+
+        struct TBuffer : public TTraceChunk {
+            std::vector<TUint32>    raw;    //entries
+            std::vector<TInt32>     regs;   //state before the first entry
+            TUint32                 nextPc;
+            TUint8                  flags;
+            std::vector<TUint8>     data;   //payload (rawBytes)
+            std::vector<TUint8>     z;      //deflated payload
+        };
+
+        //opcodes (bit per EOp) which write r[j], the stack pointer, flags;
+        //which retireMem() records
+        static const TUint32 cWritesRj;
+        static const TUint32 cWritesSp;
+        static const TUint32 cWritesFlags;
+        static const TUint32 cMemOps;
+
+        //largest record
+        static const unsigned cMaxRecordBytes = 1 + 5 + 4 + 2 * 6 + 10 + 1;
+
+        void retireMem(const MiscCpu &cpu, OpCode::EOp op, TUint32 *e) const {
+            const TUint32 sp = cpu.getReg(m_spIx);
+            switch (op) {
+                case OpCode::eStore:
+                    e[3] = cpu.getRk() + cpu.getImmed();
+                    //above memory: a device (see iobus.hxx), not traced
+                    e[4] = (e[3] <= m_memMask) ? cpu.getMem(e[3]) : 0;
+                    break;
+                case OpCode::eSwap:
+                    //getRk() is the operand latched before r[j] was
+                    //written, so the address holds even if j == k
+                    e[3] = cpu.getReg(cpu.getIxJ());
+                    e[4] = cpu.getRk() + cpu.getImmed();
+                    break;
+                case OpCode::ePop:
+                    e[3] = cpu.getReg(cpu.getIxJ());
+                    e[4] = sp;
+                    break;
+                default:    //ePush, eCall, eRetn
+                    e[3] = (sp <= m_memMask) ? cpu.getMem(sp) : 0;
+                    e[4] = sp;
+                    break;
+            }
+        }
+
+        //not copyable (owns threads)
+        TTraceMon(const TTraceMon&);
+        TTraceMon& operator=(const TTraceMon&);
+
+        void nextChunk(const MiscCpu &cpu);
+        void startChunk(const MiscCpu &cpu);
+        void endChunk();
+        static void* drain(void *arg);
+        void encode(TBuffer &buf) const;
+        void write(const TBuffer &buf);
+
+        std::ofstream           m_ofs;
+        const ECodec            m_codec;
+        const unsigned          m_regBits;
+        const unsigned          m_spIx;
+        const TUint32           m_memMask;
+        std::vector<TBuffer>    m_ring;
+        //buffer queues (m_lock): to the drain threads, back from them
+        std::vector<TBuffer*>   m_full, m_free;
+        pthread_mutex_t         m_lock;
+        pthread_cond_t          m_cond;
+        std::vector<pthread_t>  m_threads;
+        bool                    m_closed;
+        //file order (m_writeLock): first index of the next chunk
+        pthread_mutex_t         m_writeLock;
+        pthread_cond_t          m_writeCond;
+        TUint64                 m_written;
+        //simulation thread
+        TBuffer                 *m_cur;
+        TUint32                 *m_base, *m_pos, *m_end;    //of m_cur->raw
+        TUint64                 m_index;    //of m_cur first entry
+        TUint64                 m_stalls;
+        TUint64                 m_zBytes;   //written (m_writeLock)
+    };
+
+    /**
+     * Read trace file: chunk headers are scanned at open, so seek()
+     * only decodes within one chunk.
+     */
+    class TTraceReader {
+    public:
+        explicit TTraceReader(const string &fname);
+
+        TUint64 getCount() const {
+            return m_count;
+        }
+
+        //Next call of next() returns record index (or later, see setPcRange).
+        void seek(TUint64 index);
+
+        //Only return records with pc in [lo, hi]; chunks outside are skipped.
+        void setPcRange(TUint32 lo, TUint32 hi);
+
+        //False at end of trace.
+        bool next(TTraceRecord &rec);
+
+    private:
+        bool loadChunk(unsigned ix);
+        void decode(TTraceRecord &rec);
+
+        std::ifstream               m_ifs;
+        unsigned                    m_regBits;
+        TTraceMon::ECodec           m_codec;
+        std::vector<TTraceChunk>    m_chunks;
+        TUint64                     m_count;
+        TUint32                     m_pcLo, m_pcHi;
+        //current chunk
+        unsigned                    m_chunk;    //m_chunks.size(): none
+        std::vector<TUint8>         m_data;
+        TUint32                     m_pos;
+        TUint64                     m_index;    //of next record
+        TUint64                     m_end;      //1 + last index in chunk
+        std::map<TUint32, TInt32>   m_irs;
+        std::vector<TInt32>         m_regs;
+        TUint32                     m_nextPc, m_lastAddr;
+        TUint8                      m_flags;
+    };
+
+    /**
+     * Compare traces a and b record by record: write first difference
+     * to os.  Return its index, or the shorter count (if one is a
+     * prefix of the other), or ~0 if the same.
+     */
+    TUint64 diffTraces(const string &a, const string &b, std::ostream &os);
+};
+
+#endif  //_miscpu_trace_hxx_
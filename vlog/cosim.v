@@ -0,0 +1,91 @@
+/**
+ * The MIT License
+ * 
+ * Copyright (c) 2010  Karl W. Pfalzer
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+**/
+//Lockstep co-simulation against the ISS (miscpu -cosim req rsp mem.hex):
+//memory is served by the ISS, state after each instruction is checked
+//by it (see iss/cxx/miscpu/cosim.hxx for the protocol).
+//
+//  iverilog -o cosim miscpu.v cosim.v -s tb_cosim
+//  vvp cosim +req=cosim.req +rsp=cosim.rsp
+//
+//Only reads wait for the ISS: state and writes are sent buffered.
+module tb_cosim;
+	parameter REGNB = 5, N=32;
+
+	wire ovld;
+	wire [N-1:0] addr;
+	wire we;
+	wire [N-1:0] dout;
+
+	reg ivld;
+	reg [N-1:0] din;
+
+	integer req, rsp, i, n;
+	reg [8*256-1:0] reqName, rspName;
+	reg [7:0] code;
+
+	miscpu #(REGNB,N) dut(ovld,addr,we,dout,ivld,din);
+
+	initial begin
+		#0 ivld = 0;
+		if (!$value$plusargs("req=%s", reqName))
+			reqName = "cosim.req";
+		if (!$value$plusargs("rsp=%s", rspName))
+			rspName = "cosim.rsp";
+		//Same open order as ISS, else both block.
+		req = $fopen(reqName, "w");
+		rsp = $fopen(rspName, "r");
+	end
+
+	always @(posedge ovld) begin
+		if (we) begin
+			$fdisplay(req, "W %0d %0d", addr, dout);
+		end else begin
+			$fdisplay(req, "R %0d", addr);
+			$fflush(req);
+			n = $fscanf(rsp, " %c %d", code, din);
+			if ((2 != n) || ("D" != code)) begin
+				$display("cosim: stopped by ISS (difference, see ISS output)");
+				$finish;
+			end
+		end
+		#1 ivld = ~ivld;
+		@ovld;
+		#1 ivld = ~ivld;
+	end
+
+	always @dut.ev_retire begin
+		$fwrite(req, "S %0d %0d %0d", dut.m_pc, dut.m_zero, dut.m_cy);
+		for (i = 0; i < (1<<REGNB); i = i + 1)
+			$fwrite(req, " %0d", dut.m_regs[i]);
+		$fwrite(req, "\n");
+	end
+
+	always @dut.ev_halt begin
+		$fdisplay(req, "H");
+		$fflush(req);
+		$fclose(req);
+		#1 $finish;
+	end
+
+endmodule
@@ -33,11 +33,14 @@ module miscpu
 		input [N-1:0] din
 	);
 
-	reg [N-1:0] m_regs[0:(1<<REGNB - 1)];
+	reg [N-1:0] m_regs[0:(1<<REGNB) - 1];
 	reg [N-1:0] m_ir, m_pc;
 	reg m_zero, m_cy;
 
 	event ev_reset, ev_fetch, ev_decode, ev_execute;
+	//Architectural state (m_pc, m_zero, m_cy, m_regs) is final for
+	//an instruction at ev_retire; ev_halt after eHalt (see cosim.v).
+	event ev_retire, ev_halt;
 
 	initial begin
 		#0 ->ev_reset;